@@ -31,6 +31,21 @@ HandleType_t		htJSON;
 JSONObjectKeysHandler	g_JSONObjectKeysHandler;
 HandleType_t			htJSONObjectKeys;
 
+JSONWriterHandler	g_JSONWriterHandler;
+HandleType_t		htJSONWriter;
+
+JSONKeyHandler		g_JSONKeyHandler;
+HandleType_t		htJSONKey;
+
+JSONColumnsHandler	g_JSONColumnsHandler;
+HandleType_t		htJSONColumns;
+
+JSONPersistentHandler	g_JSONPersistentHandler;
+HandleType_t			htJSONPersistent;
+
+JSONQueryHandler	g_JSONQueryHandler;
+HandleType_t		htJSONQuery;
+
 bool Jansson::SDK_OnLoad(char *error, size_t maxlength, bool late)
 {
 	sharesys->AddNatives(myself, json_natives);
@@ -44,6 +59,11 @@ bool Jansson::SDK_OnLoad(char *error, size_t maxlength, bool late)
 
 	htJSON = handlesys->CreateType("Json", &g_JSONHandler, 0, NULL, &haJSON, myself->GetIdentity(), NULL);
 	htJSONObjectKeys = handlesys->CreateType("JsonKeys", &g_JSONObjectKeysHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+	htJSONWriter = handlesys->CreateType("JsonWriter", &g_JSONWriterHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+	htJSONKey = handlesys->CreateType("JsonKey", &g_JSONKeyHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+	htJSONColumns = handlesys->CreateType("JsonColumns", &g_JSONColumnsHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+	htJSONPersistent = handlesys->CreateType("JsonPersistent", &g_JSONPersistentHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+	htJSONQuery = handlesys->CreateType("JsonQuery", &g_JSONQueryHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
 
 	return true;
 }
@@ -52,6 +72,11 @@ void Jansson::SDK_OnUnload()
 {
 	handlesys->RemoveType(htJSON, myself->GetIdentity());
 	handlesys->RemoveType(htJSONObjectKeys, myself->GetIdentity());
+	handlesys->RemoveType(htJSONWriter, myself->GetIdentity());
+	handlesys->RemoveType(htJSONKey, myself->GetIdentity());
+	handlesys->RemoveType(htJSONColumns, myself->GetIdentity());
+	handlesys->RemoveType(htJSONPersistent, myself->GetIdentity());
+	handlesys->RemoveType(htJSONQuery, myself->GetIdentity());
 }
 
 void JSONHandler::OnHandleDestroy(HandleType_t type, void *object)
@@ -63,3 +88,28 @@ void JSONObjectKeysHandler::OnHandleDestroy(HandleType_t type, void *object)
 {
 	delete (struct JSONObjectKeys *)object;
 }
+
+void JSONWriterHandler::OnHandleDestroy(HandleType_t type, void *object)
+{
+	delete (struct JSONWriter *)object;
+}
+
+void JSONKeyHandler::OnHandleDestroy(HandleType_t type, void *object)
+{
+	json_key_free((json_key_t *)object);
+}
+
+void JSONColumnsHandler::OnHandleDestroy(HandleType_t type, void *object)
+{
+	json_columnar_free((json_columnar_t *)object);
+}
+
+void JSONPersistentHandler::OnHandleDestroy(HandleType_t type, void *object)
+{
+	json_persistent_decref((json_persistent_t *)object);
+}
+
+void JSONQueryHandler::OnHandleDestroy(HandleType_t type, void *object)
+{
+	json_query_free((json_query_t *)object);
+}
\ No newline at end of file
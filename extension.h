@@ -30,7 +30,8 @@ enum JsonUpdateType
 	JSON_UPDATE = 0, 
     JSON_UPDATE_EXISTING,
     JSON_UPDATE_MISSING,
-    JSON_UPDATE_RECURSIVE
+    JSON_UPDATE_RECURSIVE,
+    JSON_UPDATE_MERGE_PATCH
 };
 
 struct JSONObjectKeys {
@@ -51,6 +52,20 @@ private:
 	void *iter;
 };
 
+struct JSONWriter {
+	JSONWriter(json_writer_t *writer, FILE *file = NULL) : writer(writer), file(file) {}
+
+	~JSONWriter()
+	{
+		json_writer_free(writer);
+		if (file != NULL)
+			fclose(file);
+	}
+
+	json_writer_t *writer;
+	FILE *file;
+};
+
 
 /**
  * @brief Implementation of the REST in Pawn Extension.
@@ -141,6 +156,36 @@ public:
 	void OnHandleDestroy(HandleType_t type, void *object);
 };
 
+class JSONWriterHandler : public IHandleTypeDispatch
+{
+public:
+	void OnHandleDestroy(HandleType_t type, void *object);
+};
+
+class JSONKeyHandler : public IHandleTypeDispatch
+{
+public:
+	void OnHandleDestroy(HandleType_t type, void *object);
+};
+
+class JSONColumnsHandler : public IHandleTypeDispatch
+{
+public:
+	void OnHandleDestroy(HandleType_t type, void *object);
+};
+
+class JSONPersistentHandler : public IHandleTypeDispatch
+{
+public:
+	void OnHandleDestroy(HandleType_t type, void *object);
+};
+
+class JSONQueryHandler : public IHandleTypeDispatch
+{
+public:
+	void OnHandleDestroy(HandleType_t type, void *object);
+};
+
 extern Jansson g_Jansson;
 
 extern JSONHandler	g_JSONHandler;
@@ -149,6 +194,21 @@ extern HandleType_t		htJSON;
 extern JSONObjectKeysHandler	g_JSONObjectKeysHandler;
 extern HandleType_t				htJSONObjectKeys;
 
+extern JSONWriterHandler	g_JSONWriterHandler;
+extern HandleType_t			htJSONWriter;
+
+extern JSONKeyHandler		g_JSONKeyHandler;
+extern HandleType_t			htJSONKey;
+
+extern JSONColumnsHandler	g_JSONColumnsHandler;
+extern HandleType_t			htJSONColumns;
+
+extern JSONPersistentHandler	g_JSONPersistentHandler;
+extern HandleType_t				htJSONPersistent;
+
+extern JSONQueryHandler		g_JSONQueryHandler;
+extern HandleType_t			htJSONQuery;
+
 extern const sp_nativeinfo_t json_natives[];
 
 #endif // _INCLUDE_SOURCEMOD_EXTENSION_PROPER_H_
@@ -4,6 +4,8 @@ include $(CLEAR_VARS)
 LOCAL_ARM_MODE := arm
 
 LOCAL_SRC_FILES := \
+    src/cbor.c \
+    src/columnar.c \
     src/dump.c \
     src/error.c \
     src/hashtable.c \
@@ -11,6 +13,10 @@ LOCAL_SRC_FILES := \
     src/load.c \
     src/memory.c \
     src/pack_unpack.c \
+    src/patch.c \
+    src/persistent.c \
+    src/pointer.c \
+    src/query.c \
     src/strbuffer.c \
     src/strconv.c \
     src/utf.c \
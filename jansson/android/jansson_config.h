@@ -36,6 +36,16 @@
    otherwise to 0. */
 #define JSON_HAVE_LOCALECONV 0
 
+/* If 1, the reference count of json_t is 32 bits wide, so that the
+   header of every value takes 8 bytes instead of 16 on 64-bit
+   platforms. This changes the ABI. */
+#define JSON_COMPACT_NODES 0
+
+/* If 1, reference counts are changed with plain increments and
+   decrements even if atomic builtins are available. Only for programs
+   that never share values between threads. */
+#define JSON_SINGLE_THREADED_REFCOUNT 0
+
 /* Maximum recursion depth for parsing JSON input.
    This limits the depth of e.g. array-within-array constructions. */
 #define JSON_PARSER_MAX_DEPTH 2048
@@ -1,5 +1,6 @@
 #cmakedefine HAVE_ENDIAN_H 1
 #cmakedefine HAVE_FCNTL_H 1
+#cmakedefine HAVE_PTHREAD_H 1
 #cmakedefine HAVE_SCHED_H 1
 #cmakedefine HAVE_UNISTD_H 1
 #cmakedefine HAVE_SYS_PARAM_H 1
@@ -0,0 +1,103 @@
+/*
+ * Measure the memory taken by each kind of JSON value.
+ *
+ * SYNOPSIS:
+ * $ examples/node_footprint
+ * compact nodes: no
+ * value            bytes/node  16-byte classes  allocations/node
+ * integer                32.0             32.0              1.00
+ * real                   32.0             32.0              1.00
+ * short string           48.9             62.4              1.00
+ * array of 1            184.0            192.0              3.00
+ * object of 1           256.0            272.0              3.00
+ *
+ * The bytes are the sizes passed to the allocator. "16-byte classes"
+ * rounds every allocation up to a multiple of 16 bytes, like most
+ * size-class allocators do. Build Jansson with and without
+ * JANSSON_COMPACT_NODES to compare the layouts.
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NODES 100000
+
+/* bytes and blocks currently allocated */
+static size_t requested, rounded, allocations;
+
+static void *counting_malloc(size_t size) {
+    size_t *block = malloc(sizeof(size_t) * 2 + size);
+    if (!block)
+        return NULL;
+
+    block[0] = size;
+    requested += size;
+    rounded += (size + 15) & ~(size_t)15;
+    allocations++;
+    return block + 2;
+}
+
+static void counting_free(void *ptr) {
+    size_t *block = ptr;
+    if (!block)
+        return;
+
+    block -= 2;
+    requested -= block[0];
+    rounded -= (block[0] + 15) & ~(size_t)15;
+    allocations--;
+    free(block);
+}
+
+static json_t *make_integer(int i) { return json_integer(i); }
+static json_t *make_real(int i) { return json_real(i + 0.5); }
+
+static json_t *make_short_string(int i) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "item_%d", i % 1000);
+    return json_string(buffer);
+}
+
+static json_t *make_array(int i) { return json_pack("[i]", i); }
+static json_t *make_object(int i) { return json_pack("{s:i}", "id", i); }
+
+static void measure(const char *name, json_t *(*make)(int)) {
+    json_t *array = json_array();
+    size_t base_requested, base_rounded, base_allocations;
+    int i;
+
+    /* reserve the array's table first so it isn't counted */
+    for (i = 0; i < NODES; i++)
+        json_array_append_new(array, json_null());
+    base_requested = requested;
+    base_rounded = rounded;
+    base_allocations = allocations;
+
+    for (i = 0; i < NODES; i++)
+        json_array_set_new(array, i, make(i));
+
+    printf("%-14s %12.1f %16.1f %17.2f\n", name,
+           (double)(requested - base_requested) / NODES,
+           (double)(rounded - base_rounded) / NODES,
+           (double)(allocations - base_allocations) / NODES);
+
+    json_decref(array);
+}
+
+int main(void) {
+    json_set_alloc_funcs(counting_malloc, counting_free);
+
+    printf("compact nodes: %s\n", JSON_COMPACT_NODES ? "yes" : "no");
+    printf("value            bytes/node  16-byte classes  allocations/node\n");
+    measure("integer", make_integer);
+    measure("real", make_real);
+    measure("short string", make_short_string);
+    measure("array of 1", make_array);
+    measure("object of 1", make_object);
+
+    return 0;
+}
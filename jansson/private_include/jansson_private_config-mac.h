@@ -40,6 +40,9 @@
 /* Define to 1 if you have the `open' function. */
 #define HAVE_OPEN 1
 
+/* Define to 1 if you have the <pthread.h> header file. */
+#define HAVE_PTHREAD_H 1
+
 /* Define to 1 if you have the `read' function. */
 #define HAVE_READ 1
 
@@ -0,0 +1,794 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "jansson_private.h"
+
+#include <errno.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jansson.h"
+#include "strbuffer.h"
+#include "utf.h"
+
+/* CBOR (RFC 8949) major types */
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES    2
+#define CBOR_TEXT     3
+#define CBOR_ARRAY    4
+#define CBOR_MAP      5
+#define CBOR_TAG      6
+#define CBOR_SIMPLE   7
+
+/* additional information values of major type 7 */
+#define CBOR_FALSE   20
+#define CBOR_TRUE    21
+#define CBOR_NULL    22
+#define CBOR_HALF    25
+#define CBOR_FLOAT   26
+#define CBOR_DOUBLE  27
+#define CBOR_LENGTH_INDEFINITE 31
+
+#define CBOR_BREAK 0xff
+
+/* Output is staged in a buffer of this size so that the callback sees
+   large chunks instead of one call per item */
+#define CBOR_OUTPUT_BUFFER_SIZE 4096
+
+/*** encoding ***/
+
+typedef struct {
+    json_dump_callback_t dump;
+    void *data;
+    size_t used;
+    hashtable_t parents;
+    char buffer[CBOR_OUTPUT_BUFFER_SIZE];
+} cbor_encoder_t;
+
+static int encoder_flush(cbor_encoder_t *enc) {
+    if (enc->used && enc->dump(enc->buffer, enc->used, enc->data))
+        return -1;
+
+    enc->used = 0;
+    return 0;
+}
+
+static int encoder_write(cbor_encoder_t *enc, const char *bytes, size_t size) {
+    if (enc->used + size > CBOR_OUTPUT_BUFFER_SIZE) {
+        if (encoder_flush(enc))
+            return -1;
+
+        if (size > CBOR_OUTPUT_BUFFER_SIZE)
+            return enc->dump(bytes, size, enc->data);
+    }
+
+    memcpy(enc->buffer + enc->used, bytes, size);
+    enc->used += size;
+    return 0;
+}
+
+/* Write an initial byte and its argument in the shortest form */
+static int encode_head(cbor_encoder_t *enc, int major, uint64_t value) {
+    char head[9];
+    size_t size, i;
+
+    if (value < 24) {
+        head[0] = (char)((major << 5) | (int)value);
+        return encoder_write(enc, head, 1);
+    }
+
+    if (value <= 0xff) {
+        head[0] = (char)((major << 5) | 24);
+        size = 1;
+    } else if (value <= 0xffff) {
+        head[0] = (char)((major << 5) | 25);
+        size = 2;
+    } else if (value <= 0xffffffffUL) {
+        head[0] = (char)((major << 5) | 26);
+        size = 4;
+    } else {
+        head[0] = (char)((major << 5) | 27);
+        size = 8;
+    }
+
+    for (i = size; i > 0; i--) {
+        head[i] = (char)(value & 0xff);
+        value >>= 8;
+    }
+
+    return encoder_write(enc, head, size + 1);
+}
+
+static int encode_real(cbor_encoder_t *enc, double value) {
+    char bytes[9];
+    uint64_t bits;
+    size_t size, i;
+
+    /* Use single precision when it represents the value exactly */
+    if (value >= -FLT_MAX && value <= FLT_MAX && (double)(float)value == value) {
+        float single = (float)value;
+        uint32_t single_bits;
+
+        memcpy(&single_bits, &single, sizeof(single_bits));
+        bits = single_bits;
+        bytes[0] = (char)((CBOR_SIMPLE << 5) | CBOR_FLOAT);
+        size = 4;
+    } else {
+        memcpy(&bits, &value, sizeof(bits));
+        bytes[0] = (char)((CBOR_SIMPLE << 5) | CBOR_DOUBLE);
+        size = 8;
+    }
+
+    for (i = size; i > 0; i--) {
+        bytes[i] = (char)(bits & 0xff);
+        bits >>= 8;
+    }
+
+    return encoder_write(enc, bytes, size + 1);
+}
+
+static int encode_string(cbor_encoder_t *enc, const char *str, size_t len) {
+    if (encode_head(enc, CBOR_TEXT, len))
+        return -1;
+
+    return encoder_write(enc, str, len);
+}
+
+static int encode_value(cbor_encoder_t *enc, const json_t *json) {
+    char loop_key[LOOP_KEY_LEN];
+    size_t loop_key_len;
+    char byte;
+
+    switch (json_typeof(json)) {
+        case JSON_NULL:
+            byte = (char)((CBOR_SIMPLE << 5) | CBOR_NULL);
+            return encoder_write(enc, &byte, 1);
+
+        case JSON_TRUE:
+            byte = (char)((CBOR_SIMPLE << 5) | CBOR_TRUE);
+            return encoder_write(enc, &byte, 1);
+
+        case JSON_FALSE:
+            byte = (char)((CBOR_SIMPLE << 5) | CBOR_FALSE);
+            return encoder_write(enc, &byte, 1);
+
+        case JSON_INTEGER: {
+            json_int_t value = json_integer_value(json);
+
+            if (value >= 0)
+                return encode_head(enc, CBOR_UNSIGNED, (uint64_t)value);
+
+            /* -1 - value without overflowing for the minimum value */
+            return encode_head(enc, CBOR_NEGATIVE, (uint64_t)(-(value + 1)));
+        }
+
+        case JSON_REAL:
+            return encode_real(enc, json_real_value(json));
+
+        case JSON_STRING:
+            return encode_string(enc, json_string_value(json), json_string_length(json));
+
+        case JSON_ARRAY: {
+            size_t i, n = json_array_size(json);
+
+            if (jsonp_loop_check(&enc->parents, json, loop_key, sizeof(loop_key),
+                                 &loop_key_len))
+                return -1;
+
+            if (encode_head(enc, CBOR_ARRAY, n))
+                goto array_error;
+
+            for (i = 0; i < n; i++) {
+                jsonp_array_scratch_t scratch;
+
+                if (encode_value(enc, jsonp_array_peek(json, i, &scratch)))
+                    goto array_error;
+            }
+
+            hashtable_del(&enc->parents, loop_key, loop_key_len);
+            return 0;
+
+        array_error:
+            hashtable_del(&enc->parents, loop_key, loop_key_len);
+            return -1;
+        }
+
+        case JSON_OBJECT: {
+            void *iter;
+
+            if (jsonp_loop_check(&enc->parents, json, loop_key, sizeof(loop_key),
+                                 &loop_key_len))
+                return -1;
+
+            if (encode_head(enc, CBOR_MAP, json_object_size(json)))
+                goto object_error;
+
+            iter = jsonp_object_iter(json);
+            while (iter) {
+                const char *key = json_object_iter_key(iter);
+
+                if (encode_string(enc, key, json_object_iter_key_len(iter)) ||
+                    encode_value(enc, json_object_iter_value(iter)))
+                    goto object_error;
+
+                iter = jsonp_object_iter_next(json, iter);
+            }
+
+            hashtable_del(&enc->parents, loop_key, loop_key_len);
+            return 0;
+
+        object_error:
+            hashtable_del(&enc->parents, loop_key, loop_key_len);
+            return -1;
+        }
+
+        default:
+            /* not reached */
+            return -1;
+    }
+}
+
+int json_dump_cbor_callback(const json_t *json, json_dump_callback_t callback, void *data,
+                            size_t flags) {
+    cbor_encoder_t *enc;
+    int res;
+
+    if (!json || !callback)
+        return -1;
+
+    if (!(flags & JSON_ENCODE_ANY)) {
+        if (!json_is_array(json) && !json_is_object(json))
+            return -1;
+    }
+
+    enc = jsonp_malloc(sizeof(cbor_encoder_t));
+    if (!enc)
+        return -1;
+
+    if (hashtable_init(&enc->parents)) {
+        jsonp_free(enc);
+        return -1;
+    }
+
+    enc->dump = callback;
+    enc->data = data;
+    enc->used = 0;
+
+    res = encode_value(enc, json);
+    if (!res)
+        res = encoder_flush(enc);
+
+    hashtable_close(&enc->parents);
+    jsonp_free(enc);
+    return res;
+}
+
+struct cbor_buffer {
+    const size_t size;
+    size_t used;
+    char *data;
+};
+
+static int dump_to_cbor_buffer(const char *buffer, size_t size, void *data) {
+    struct cbor_buffer *buf = (struct cbor_buffer *)data;
+
+    if (buf->used + size <= buf->size)
+        memcpy(&buf->data[buf->used], buffer, size);
+
+    buf->used += size;
+    return 0;
+}
+
+size_t json_dumpb_cbor(const json_t *json, char *buffer, size_t size, size_t flags) {
+    struct cbor_buffer buf = {size, 0, buffer};
+
+    if (json_dump_cbor_callback(json, dump_to_cbor_buffer, (void *)&buf, flags))
+        return 0;
+
+    return buf.used;
+}
+
+int json_dump_file_cbor(const json_t *json, const char *path, size_t flags) {
+    return jsonp_dump_file(json, path, "wb", flags, json_dump_cbor_callback);
+}
+
+/*** decoding ***/
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+    size_t flags;
+    int depth;
+    jsonp_shape_cache_t shapes;
+    json_error_t *error;
+} cbor_decoder_t;
+
+static void decoder_error(cbor_decoder_t *dec, enum json_error_code code,
+                          const char *msg) {
+    jsonp_error_set(dec->error, -1, -1, dec->pos, code, "%s", msg);
+}
+
+/* Read an initial byte. For definite lengths and values *arg receives
+   the argument, *info is CBOR_LENGTH_INDEFINITE otherwise. */
+static int decode_head(cbor_decoder_t *dec, int *major, int *info, uint64_t *arg) {
+    size_t size, i;
+    uint64_t value = 0;
+
+    if (dec->pos >= dec->len) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return -1;
+    }
+
+    *major = dec->data[dec->pos] >> 5;
+    *info = dec->data[dec->pos] & 0x1f;
+
+    if (*info < 24) {
+        dec->pos++;
+        *arg = (uint64_t)*info;
+        return 0;
+    }
+
+    switch (*info) {
+        case 24:
+            size = 1;
+            break;
+        case 25:
+            size = 2;
+            break;
+        case 26:
+            size = 4;
+            break;
+        case 27:
+            size = 8;
+            break;
+        case CBOR_LENGTH_INDEFINITE:
+            if (*major == CBOR_ARRAY || *major == CBOR_MAP || *major == CBOR_SIMPLE) {
+                dec->pos++;
+                *arg = 0;
+                return 0;
+            }
+            /* fall through */
+        default:
+            decoder_error(dec, json_error_invalid_syntax, "invalid initial byte");
+            return -1;
+    }
+
+    if (dec->len - dec->pos - 1 < size) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return -1;
+    }
+
+    for (i = 1; i <= size; i++)
+        value = (value << 8) | dec->data[dec->pos + i];
+
+    dec->pos += size + 1;
+    *arg = value;
+    return 0;
+}
+
+static int decode_real(int info, uint64_t bits, double *out) {
+    if (info == CBOR_HALF) {
+        int exponent = (int)((bits >> 10) & 0x1f);
+        uint64_t mantissa = bits & 0x3ff;
+
+        if (exponent == 0x1f) {
+            *out = 0.0;
+            return -1;
+        }
+
+        if (exponent == 0) {
+            *out = (double)mantissa / 16777216.0;
+        } else {
+            uint64_t double_bits =
+                ((uint64_t)(exponent - 15 + 1023) << 52) | (mantissa << 42);
+            memcpy(out, &double_bits, sizeof(double_bits));
+        }
+
+        if (bits & 0x8000)
+            *out = -*out;
+    } else if (info == CBOR_FLOAT) {
+        uint32_t single_bits = (uint32_t)bits;
+        float single;
+
+        memcpy(&single, &single_bits, sizeof(single));
+        *out = single;
+    } else {
+        memcpy(out, &bits, sizeof(bits));
+    }
+
+    /* NaN and infinity can't be represented */
+    return (*out - *out != *out - *out) ? -1 : 0;
+}
+
+static json_t *decode_value(cbor_decoder_t *dec);
+
+static int decode_at_break(cbor_decoder_t *dec) {
+    if (dec->pos >= dec->len) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return -1;
+    }
+
+    if (dec->data[dec->pos] == CBOR_BREAK) {
+        dec->pos++;
+        return 1;
+    }
+
+    return 0;
+}
+
+static json_t *decode_string(cbor_decoder_t *dec, uint64_t len) {
+    const char *value = (const char *)dec->data + dec->pos;
+    char *copy;
+
+    if (len > dec->len - dec->pos) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return NULL;
+    }
+
+    if (!utf8_check_string(value, (size_t)len)) {
+        decoder_error(dec, json_error_invalid_utf8, "invalid UTF-8 string");
+        return NULL;
+    }
+
+    if (!(dec->flags & JSON_ALLOW_NUL) && memchr(value, '\0', (size_t)len)) {
+        decoder_error(dec, json_error_null_character,
+                      "NUL byte is not allowed without JSON_ALLOW_NUL");
+        return NULL;
+    }
+
+    copy = jsonp_malloc((size_t)len + 1);
+    if (!copy)
+        return NULL;
+
+    memcpy(copy, value, (size_t)len);
+    copy[len] = '\0';
+    dec->pos += (size_t)len;
+
+    return jsonp_stringn_nocheck_own(copy, (size_t)len);
+}
+
+static json_t *decode_array(cbor_decoder_t *dec, int info, uint64_t count) {
+    json_t *array, *value;
+    uint64_t i;
+
+    /* every item takes at least one byte */
+    if (info != CBOR_LENGTH_INDEFINITE && count > dec->len - dec->pos) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return NULL;
+    }
+
+    array = json_array();
+    if (!array)
+        return NULL;
+
+    for (i = 0; info == CBOR_LENGTH_INDEFINITE || i < count; i++) {
+        if (info == CBOR_LENGTH_INDEFINITE) {
+            int at_break = decode_at_break(dec);
+            if (at_break < 0)
+                goto error;
+            if (at_break)
+                break;
+        }
+
+        value = decode_value(dec);
+        if (!value)
+            goto error;
+
+        if ((dec->flags & JSON_DECODE_PACKED_ARRAYS) && !json_array_size(array))
+            jsonp_array_pack(array, json_typeof(value));
+
+        if (json_array_append_new(array, value))
+            goto error;
+    }
+
+    return array;
+
+error:
+    json_decref(array);
+    return NULL;
+}
+
+static int decode_key(cbor_decoder_t *dec, const char **key, size_t *key_len) {
+    int major, info;
+    uint64_t len;
+
+    if (decode_head(dec, &major, &info, &len))
+        return -1;
+
+    if (major != CBOR_TEXT) {
+        decoder_error(dec, json_error_invalid_syntax, "object key must be a string");
+        return -1;
+    }
+
+    if (len > dec->len - dec->pos) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return -1;
+    }
+
+    if (!utf8_check_string((const char *)dec->data + dec->pos, (size_t)len)) {
+        decoder_error(dec, json_error_invalid_utf8, "invalid UTF-8 string");
+        return -1;
+    }
+
+    if (memchr(dec->data + dec->pos, '\0', (size_t)len)) {
+        decoder_error(dec, json_error_null_byte_in_key,
+                      "NUL byte in object key not supported");
+        return -1;
+    }
+
+    *key = (const char *)dec->data + dec->pos;
+    *key_len = (size_t)len;
+    dec->pos += (size_t)len;
+    return 0;
+}
+
+static json_t *decode_object(cbor_decoder_t *dec, int info, uint64_t count) {
+    json_t *object, *value;
+    uint64_t i;
+
+    /* every key and value takes at least one byte */
+    if (info != CBOR_LENGTH_INDEFINITE && count > (dec->len - dec->pos) / 2) {
+        decoder_error(dec, json_error_premature_end_of_input,
+                      "unexpected end of input");
+        return NULL;
+    }
+
+    object = json_object();
+    if (!object)
+        return NULL;
+
+    for (i = 0; info == CBOR_LENGTH_INDEFINITE || i < count; i++) {
+        const char *key;
+        size_t key_len;
+
+        if (info == CBOR_LENGTH_INDEFINITE) {
+            int at_break = decode_at_break(dec);
+            if (at_break < 0)
+                goto error;
+            if (at_break)
+                break;
+        }
+
+        if (decode_key(dec, &key, &key_len))
+            goto error;
+
+        if ((dec->flags & JSON_REJECT_DUPLICATES) &&
+            json_object_getn(object, key, key_len)) {
+            decoder_error(dec, json_error_duplicate_key, "duplicate object key");
+            goto error;
+        }
+
+        value = decode_value(dec);
+        if (!value || json_object_setn_new_nocheck(object, key, key_len, value))
+            goto error;
+    }
+
+    if (dec->flags & JSON_DECODE_SHARED_KEYS)
+        jsonp_shape_cache_add(&dec->shapes, dec->depth, object);
+    return object;
+
+error:
+    json_decref(object);
+    return NULL;
+}
+
+static json_t *decode_value(cbor_decoder_t *dec) {
+    json_t *json;
+    int major, info;
+    uint64_t arg;
+
+    dec->depth++;
+    if (dec->depth > JSON_PARSER_MAX_DEPTH) {
+        decoder_error(dec, json_error_stack_overflow, "maximum parsing depth reached");
+        return NULL;
+    }
+
+    /* tags carry no meaning in the JSON data model, skip them */
+    do {
+        if (decode_head(dec, &major, &info, &arg))
+            return NULL;
+    } while (major == CBOR_TAG);
+
+    switch (major) {
+        case CBOR_UNSIGNED:
+        case CBOR_NEGATIVE: {
+            json_int_t value;
+
+            /* arg must fit in the non-negative range of json_int_t */
+            if ((json_int_t)arg < 0 || (uint64_t)(json_int_t)arg != arg) {
+                decoder_error(dec, json_error_numeric_overflow, "too big integer");
+                return NULL;
+            }
+
+            value = (major == CBOR_UNSIGNED) ? (json_int_t)arg : -1 - (json_int_t)arg;
+
+            if (dec->flags & JSON_DECODE_INT_AS_REAL)
+                json = json_real((double)value);
+            else if (dec->flags & JSON_DECODE_SHARED_INTS)
+                json = json_integer_shared(value);
+            else
+                json = json_integer(value);
+            break;
+        }
+
+        case CBOR_TEXT:
+            json = decode_string(dec, arg);
+            break;
+
+        case CBOR_ARRAY:
+            json = decode_array(dec, info, arg);
+            break;
+
+        case CBOR_MAP:
+            json = decode_object(dec, info, arg);
+            break;
+
+        case CBOR_SIMPLE:
+            switch (info) {
+                case CBOR_FALSE:
+                    json = json_false();
+                    break;
+                case CBOR_TRUE:
+                    json = json_true();
+                    break;
+                case CBOR_NULL:
+                    json = json_null();
+                    break;
+                case CBOR_HALF:
+                case CBOR_FLOAT:
+                case CBOR_DOUBLE: {
+                    double value;
+
+                    if (decode_real(info, arg, &value)) {
+                        decoder_error(dec, json_error_invalid_syntax,
+                                      "NaN and infinity are not supported");
+                        return NULL;
+                    }
+
+                    json = json_real(value);
+                    break;
+                }
+                case CBOR_LENGTH_INDEFINITE:
+                    decoder_error(dec, json_error_invalid_syntax, "unexpected break");
+                    return NULL;
+                default:
+                    decoder_error(dec, json_error_invalid_syntax,
+                                  "unsupported simple value");
+                    return NULL;
+            }
+            break;
+
+        default:
+            decoder_error(dec, json_error_invalid_syntax,
+                          "byte strings are not supported");
+            return NULL;
+    }
+
+    if (!json)
+        return NULL;
+
+    dec->depth--;
+    return json;
+}
+
+json_t *json_loadb_cbor(const char *buffer, size_t buflen, size_t flags,
+                        json_error_t *error) {
+    cbor_decoder_t dec;
+    json_t *result;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if (buffer == NULL) {
+        jsonp_error_set(error, -1, -1, 0, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    dec.data = (const unsigned char *)buffer;
+    dec.len = buflen;
+    dec.pos = 0;
+    dec.flags = flags;
+    dec.depth = 0;
+    dec.error = error;
+
+    if (!(flags & JSON_DECODE_ANY)) {
+        int major = buflen ? dec.data[0] >> 5 : -1;
+        if (major != CBOR_ARRAY && major != CBOR_MAP) {
+            decoder_error(&dec, json_error_invalid_syntax, "array or map expected");
+            return NULL;
+        }
+    }
+
+    jsonp_shape_cache_init(&dec.shapes);
+    result = decode_value(&dec);
+    jsonp_shape_cache_close(&dec.shapes);
+    if (!result)
+        return NULL;
+
+    if (!(flags & JSON_DISABLE_EOF_CHECK) && dec.pos != dec.len) {
+        decoder_error(&dec, json_error_end_of_input_expected, "end of file expected");
+        json_decref(result);
+        return NULL;
+    }
+
+    if (error) {
+        /* Save the position even though there was no error */
+        error->position = (int)dec.pos;
+    }
+
+    return result;
+}
+
+json_t *json_load_file_cbor(const char *path, size_t flags, json_error_t *error) {
+    char chunk[CBOR_OUTPUT_BUFFER_SIZE];
+    strbuffer_t contents;
+    json_t *result;
+    size_t length;
+    FILE *fp;
+
+    jsonp_error_init(error, path);
+
+    if (path == NULL) {
+        jsonp_error_set(error, -1, -1, 0, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        jsonp_error_set(error, -1, -1, 0, json_error_cannot_open_file,
+                        "unable to open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (strbuffer_init(&contents)) {
+        fclose(fp);
+        jsonp_error_set(error, -1, -1, 0, json_error_out_of_memory, "out of memory");
+        return NULL;
+    }
+
+    while ((length = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        if (strbuffer_append_bytes(&contents, chunk, length)) {
+            strbuffer_close(&contents);
+            fclose(fp);
+            jsonp_error_set(error, -1, -1, 0, json_error_out_of_memory, "out of memory");
+            return NULL;
+        }
+    }
+
+    if (ferror(fp)) {
+        strbuffer_close(&contents);
+        fclose(fp);
+        jsonp_error_set(error, -1, -1, 0, json_error_cannot_open_file,
+                        "unable to read %s", path);
+        return NULL;
+    }
+
+    fclose(fp);
+
+    result = json_loadb_cbor(contents.value, contents.length, flags, error);
+    if (error) {
+        /* json_loadb_cbor() reset the source */
+        jsonp_error_set_source(error, path);
+    }
+
+    strbuffer_close(&contents);
+    return result;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "jansson_private.h"
+
+#include <stddef.h>
+
+#include "jansson.h"
+
+/* A column per key. Row i of every column is the value of that key in
+   the i'th object, or null. */
+struct json_columnar_t {
+    size_t rows;
+    json_t *columns;
+};
+
+/* Append nulls to column until it has rows values */
+static int column_fill(json_t *column, size_t rows) {
+    while (json_array_size(column) < rows) {
+        if (json_array_append_new(column, json_null()))
+            return -1;
+    }
+    return 0;
+}
+
+static int columnar_add_row(json_columnar_t *columnar, const json_t *object) {
+    const char *key;
+    size_t key_len;
+    json_t *value, *column;
+    void *iter;
+
+    /* the rows are only read, so values shared with a copy stay shared */
+    for (iter = jsonp_object_iter(object); iter;
+         iter = jsonp_object_iter_next(object, iter)) {
+        key = json_object_iter_key(iter);
+        key_len = json_object_iter_key_len(iter);
+        value = json_object_iter_value(iter);
+        column = json_object_getn(columnar->columns, key, key_len);
+        if (!column) {
+            column = json_array();
+            if (json_object_setn_new_nocheck(columnar->columns, key, key_len, column))
+                return -1;
+        }
+
+        if (column_fill(column, columnar->rows))
+            return -1;
+
+        /* a column that starts with a number or boolean is packed until
+           another type or a missing value turns up */
+        if (!json_array_size(column))
+            jsonp_array_pack(column, json_typeof(value));
+
+        if (json_array_append(column, value))
+            return -1;
+    }
+
+    return 0;
+}
+
+json_columnar_t *json_columnar(const json_t *array) {
+    json_columnar_t *columnar;
+    const char *key;
+    json_t *column;
+    size_t i;
+
+    if (!json_is_array(array))
+        return NULL;
+
+    columnar = jsonp_malloc(sizeof(json_columnar_t));
+    if (!columnar)
+        return NULL;
+
+    columnar->rows = 0;
+    columnar->columns = json_object();
+    if (!columnar->columns)
+        goto error;
+
+    for (i = 0; i < json_array_size(array); i++) {
+        jsonp_array_scratch_t scratch;
+        json_t *object = jsonp_array_peek(array, i, &scratch);
+
+        if (json_is_object(object) && columnar_add_row(columnar, object))
+            goto error;
+        columnar->rows++;
+    }
+
+    json_object_foreach(columnar->columns, key, column) {
+        if (column_fill(column, columnar->rows))
+            goto error;
+    }
+
+    return columnar;
+
+error:
+    json_columnar_free(columnar);
+    return NULL;
+}
+
+void json_columnar_free(json_columnar_t *columnar) {
+    if (!columnar)
+        return;
+
+    json_decref(columnar->columns);
+    jsonp_free(columnar);
+}
+
+size_t json_columnar_rows(const json_columnar_t *columnar) {
+    return columnar ? columnar->rows : 0;
+}
+
+json_t *json_columnar_column(const json_columnar_t *columnar, const char *key) {
+    if (!columnar || !key)
+        return NULL;
+
+    return json_object_get(columnar->columns, key);
+}
+
+json_t *json_columnar_columns(const json_columnar_t *columnar) {
+    return columnar ? columnar->columns : NULL;
+}
+
+static void stats_add(json_stats_t *stats, double value) {
+    if (!stats->count || value < stats->min)
+        stats->min = value;
+    if (!stats->count || value > stats->max)
+        stats->max = value;
+    stats->sum += value;
+    stats->count++;
+}
+
+int json_array_stats(const json_t *array, json_stats_t *stats) {
+    const json_int_t *integers;
+    const double *reals;
+    size_t i, size;
+
+    if (!json_is_array(array) || !stats)
+        return -1;
+
+    stats->count = 0;
+    stats->sum = stats->min = stats->max = 0.0;
+
+    size = json_array_size(array);
+    if (!size)
+        return 0;
+
+    /* packed columns are summed without looking at each value's type */
+    if ((integers = json_array_integers(array))) {
+        json_int_t min = integers[0], max = integers[0];
+        double sum = 0.0;
+
+        for (i = 0; i < size; i++) {
+            min = integers[i] < min ? integers[i] : min;
+            max = integers[i] > max ? integers[i] : max;
+            sum += (double)integers[i];
+        }
+
+        stats->count = size;
+        stats->sum = sum;
+        stats->min = (double)min;
+        stats->max = (double)max;
+        return 0;
+    }
+
+    if ((reals = json_array_reals(array))) {
+        for (i = 0; i < size; i++)
+            stats_add(stats, reals[i]);
+        return 0;
+    }
+
+    for (i = 0; i < size; i++) {
+        jsonp_array_scratch_t scratch;
+        json_t *value = jsonp_array_peek(array, i, &scratch);
+
+        if (json_is_number(value))
+            stats_add(stats, json_number_value(value));
+    }
+
+    return 0;
+}
@@ -18,6 +18,18 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#define HAVE_DUMP_THREADS 1
+#elif defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#define HAVE_DUMP_THREADS 1
+#endif
 
 #include "jansson.h"
 #include "strbuffer.h"
@@ -29,6 +41,19 @@
 #define FLAGS_TO_INDENT(f)    ((f)&0x1F)
 #define FLAGS_TO_PRECISION(f) (((f) >> 11) & 0x1F)
 
+/* JSON_PARALLEL: a worker is only started for at least this many items
+   of the top-level array or object, and never more than
+   MAX_DUMP_THREADS workers are used */
+#define PARALLEL_MIN_CHUNK_ITEMS 256
+#define MAX_DUMP_THREADS         8
+
+/* json_dump_file() collects output in a buffer of this size and hands
+   it to stdio in large blocks instead of one fwrite() per token */
+#define DUMP_FILE_BUFFER_SIZE 65536
+
+/* suffix of the temporary file used by JSON_ATOMIC_FILE */
+#define ATOMIC_FILE_SUFFIX ".tmp"
+
 struct buffer {
     const size_t size;
     size_t used;
@@ -195,8 +220,39 @@ static int dump_string(const char *str, size_t len, json_dump_callback_t dump, v
     return dump("\"", 1, data);
 }
 
+static int dump_integer(json_int_t value, json_dump_callback_t dump, void *data) {
+    char buffer[MAX_INTEGER_STR_LENGTH];
+    int size;
+
+    size = snprintf(buffer, MAX_INTEGER_STR_LENGTH, "%" JSON_INTEGER_FORMAT, value);
+    if (size < 0 || size >= MAX_INTEGER_STR_LENGTH)
+        return -1;
+
+    return dump(buffer, size, data);
+}
+
+static int dump_real(double value, size_t flags, json_dump_callback_t dump,
+                     void *data) {
+    char buffer[MAX_REAL_STR_LENGTH];
+    int size;
+
+    size = jsonp_dtostr(buffer, MAX_REAL_STR_LENGTH, value, FLAGS_TO_PRECISION(flags));
+    if (size < 0)
+        return -1;
+
+    return dump(buffer, size, data);
+}
+
 static int compare_keys(const void *key1, const void *key2) {
-    return strcmp(*(const char **)key1, *(const char **)key2);
+    const char *str1 = *(const char **)key1;
+    const char *str2 = *(const char **)key2;
+    size_t len1 = json_object_iter_key_len(json_object_key_to_iter(str1));
+    size_t len2 = json_object_iter_key_len(json_object_key_to_iter(str2));
+    int res = memcmp(str1, str2, len1 < len2 ? len1 : len2);
+
+    if (res)
+        return res;
+    return (len1 > len2) - (len1 < len2);
 }
 
 static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *parents,
@@ -218,30 +274,11 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
         case JSON_FALSE:
             return dump("false", 5, data);
 
-        case JSON_INTEGER: {
-            char buffer[MAX_INTEGER_STR_LENGTH];
-            int size;
-
-            size = snprintf(buffer, MAX_INTEGER_STR_LENGTH, "%" JSON_INTEGER_FORMAT,
-                            json_integer_value(json));
-            if (size < 0 || size >= MAX_INTEGER_STR_LENGTH)
-                return -1;
-
-            return dump(buffer, size, data);
-        }
-
-        case JSON_REAL: {
-            char buffer[MAX_REAL_STR_LENGTH];
-            int size;
-            double value = json_real_value(json);
+        case JSON_INTEGER:
+            return dump_integer(json_integer_value(json), dump, data);
 
-            size = jsonp_dtostr(buffer, MAX_REAL_STR_LENGTH, value,
-                                FLAGS_TO_PRECISION(flags));
-            if (size < 0)
-                return -1;
-
-            return dump(buffer, size, data);
-        }
+        case JSON_REAL:
+            return dump_real(json_real_value(json), flags, dump, data);
 
         case JSON_STRING:
             return dump_string(json_string_value(json), json_string_length(json), dump,
@@ -253,9 +290,10 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
             /* Space for "0x", double the sizeof a pointer for the hex and a
              * terminator. */
             char key[2 + (sizeof(json) * 2) + 1];
+            size_t key_len;
 
             /* detect circular references */
-            if (jsonp_loop_check(parents, json, key, sizeof(key)))
+            if (jsonp_loop_check(parents, json, key, sizeof(key), &key_len))
                 return -1;
 
             n = json_array_size(json);
@@ -263,15 +301,17 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
             if (!embed && dump("[", 1, data))
                 return -1;
             if (n == 0) {
-                hashtable_del(parents, key);
+                hashtable_del(parents, key, key_len);
                 return embed ? 0 : dump("]", 1, data);
             }
             if (dump_indent(flags, depth + 1, 0, dump, data))
                 return -1;
 
             for (i = 0; i < n; ++i) {
-                if (do_dump(json_array_get(json, i), flags, depth + 1, parents, dump,
-                            data))
+                jsonp_array_scratch_t scratch;
+
+                if (do_dump(jsonp_array_peek(json, i, &scratch), flags, depth + 1,
+                            parents, dump, data))
                     return -1;
 
                 if (i < n - 1) {
@@ -284,7 +324,7 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
                 }
             }
 
-            hashtable_del(parents, key);
+            hashtable_del(parents, key, key_len);
             return embed ? 0 : dump("]", 1, data);
         }
 
@@ -293,6 +333,7 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
             const char *separator;
             int separator_length;
             char loop_key[LOOP_KEY_LEN];
+            size_t loop_key_len;
 
             if (flags & JSON_COMPACT) {
                 separator = ":";
@@ -303,15 +344,16 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
             }
 
             /* detect circular references */
-            if (jsonp_loop_check(parents, json, loop_key, sizeof(loop_key)))
+            if (jsonp_loop_check(parents, json, loop_key, sizeof(loop_key),
+                                 &loop_key_len))
                 return -1;
 
-            iter = json_object_iter((json_t *)json);
+            iter = jsonp_object_iter(json);
 
             if (!embed && dump("{", 1, data))
                 return -1;
             if (!iter) {
-                hashtable_del(parents, loop_key);
+                hashtable_del(parents, loop_key, loop_key_len);
                 return embed ? 0 : dump("}", 1, data);
             }
             if (dump_indent(flags, depth + 1, 0, dump, data))
@@ -329,7 +371,7 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
                 i = 0;
                 while (iter) {
                     keys[i] = json_object_iter_key(iter);
-                    iter = json_object_iter_next((json_t *)json, iter);
+                    iter = jsonp_object_iter_next(json, iter);
                     i++;
                 }
                 assert(i == size);
@@ -338,13 +380,16 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
 
                 for (i = 0; i < size; i++) {
                     const char *key;
+                    void *key_iter;
                     json_t *value;
 
                     key = keys[i];
-                    value = json_object_get(json, key);
+                    key_iter = jsonp_object_key_iter(json, key);
+                    value = json_object_iter_value(key_iter);
                     assert(value);
 
-                    dump_string(key, strlen(key), dump, data, flags);
+                    dump_string(key, json_object_iter_key_len(key_iter), dump, data,
+                                flags);
                     if (dump(separator, separator_length, data) ||
                         do_dump(value, flags, depth + 1, parents, dump, data)) {
                         jsonp_free(keys);
@@ -370,10 +415,10 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
                 /* Don't sort keys */
 
                 while (iter) {
-                    void *next = json_object_iter_next((json_t *)json, iter);
+                    void *next = jsonp_object_iter_next(json, iter);
                     const char *key = json_object_iter_key(iter);
 
-                    dump_string(key, strlen(key), dump, data, flags);
+                    dump_string(key, json_object_iter_key_len(iter), dump, data, flags);
                     if (dump(separator, separator_length, data) ||
                         do_dump(json_object_iter_value(iter), flags, depth + 1, parents,
                                 dump, data))
@@ -392,7 +437,7 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
                 }
             }
 
-            hashtable_del(parents, loop_key);
+            hashtable_del(parents, loop_key, loop_key_len);
             return embed ? 0 : dump("}", 1, data);
         }
 
@@ -402,6 +447,254 @@ static int do_dump(const json_t *json, size_t flags, int depth, hashtable_t *par
     }
 }
 
+/*** parallel encoding ***/
+
+#ifdef HAVE_DUMP_THREADS
+struct dump_chunk {
+    const json_t *json;   /* the top-level array or object */
+    const char **keys;    /* object keys in output order, NULL for arrays */
+    json_t **values;      /* object values matching keys */
+    size_t first, last;   /* items [first, last) are encoded by this chunk */
+    size_t total;         /* number of items in json */
+    size_t flags;
+    strbuffer_t output;
+    int result;
+};
+
+/* Encode the items of one chunk exactly as the top-level loops in
+   do_dump() would, including the separators and indentation that
+   follow each item. */
+static void dump_chunk_run(struct dump_chunk *chunk) {
+    hashtable_t parents_set;
+    char loop_key[LOOP_KEY_LEN];
+    const char *separator;
+    int separator_length;
+    size_t i;
+
+    chunk->result = -1;
+
+    if (chunk->flags & JSON_COMPACT) {
+        separator = ":";
+        separator_length = 1;
+    } else {
+        separator = ": ";
+        separator_length = 2;
+    }
+
+    if (hashtable_init(&parents_set))
+        return;
+
+    /* each worker detects circular references on its own */
+    if (jsonp_loop_check(&parents_set, chunk->json, loop_key, sizeof(loop_key), NULL))
+        goto out;
+
+    for (i = chunk->first; i < chunk->last; i++) {
+        jsonp_array_scratch_t scratch;
+        json_t *value;
+
+        if (chunk->keys) {
+            const char *key = chunk->keys[i];
+            size_t key_len = json_object_iter_key_len(json_object_key_to_iter(key));
+
+            if (dump_string(key, key_len, dump_to_strbuffer, &chunk->output,
+                            chunk->flags) ||
+                dump_to_strbuffer(separator, separator_length, &chunk->output))
+                goto out;
+
+            value = chunk->values[i];
+        } else
+            value = jsonp_array_peek(chunk->json, i, &scratch);
+
+        if (do_dump(value, chunk->flags, 1, &parents_set, dump_to_strbuffer,
+                    &chunk->output))
+            goto out;
+
+        if (i < chunk->total - 1) {
+            if (dump_to_strbuffer(",", 1, &chunk->output) ||
+                dump_indent(chunk->flags, 1, 1, dump_to_strbuffer, &chunk->output))
+                goto out;
+        } else {
+            if (dump_indent(chunk->flags, 0, 0, dump_to_strbuffer, &chunk->output))
+                goto out;
+        }
+    }
+
+    chunk->result = 0;
+
+out:
+    hashtable_close(&parents_set);
+}
+
+#if defined(_WIN32)
+typedef HANDLE dump_thread_t;
+
+static DWORD WINAPI dump_thread_main(LPVOID arg) {
+    dump_chunk_run((struct dump_chunk *)arg);
+    return 0;
+}
+
+static int dump_thread_start(dump_thread_t *thread, struct dump_chunk *chunk) {
+    *thread = CreateThread(NULL, 0, dump_thread_main, chunk, 0, NULL);
+    return *thread ? 0 : -1;
+}
+
+static void dump_thread_join(dump_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static size_t dump_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+#else
+typedef pthread_t dump_thread_t;
+
+static void *dump_thread_main(void *arg) {
+    dump_chunk_run((struct dump_chunk *)arg);
+    return NULL;
+}
+
+static int dump_thread_start(dump_thread_t *thread, struct dump_chunk *chunk) {
+    return pthread_create(thread, NULL, dump_thread_main, chunk) ? -1 : 0;
+}
+
+static void dump_thread_join(dump_thread_t thread) { pthread_join(thread, NULL); }
+
+static size_t dump_cpu_count(void) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0)
+        return (size_t)count;
+#endif
+    return 1;
+}
+#endif
+
+/* Number of chunks a top-level value should be split into, or 1 if it
+   should be encoded sequentially */
+static size_t dump_parallel_chunks(const json_t *json) {
+    size_t items, chunks;
+
+    if (json_is_array(json))
+        items = json_array_size(json);
+    else if (json_is_object(json))
+        items = json_object_size(json);
+    else
+        return 1;
+
+    chunks = items / PARALLEL_MIN_CHUNK_ITEMS;
+    if (chunks > MAX_DUMP_THREADS)
+        chunks = MAX_DUMP_THREADS;
+    if (chunks > 1) {
+        size_t cpus = dump_cpu_count();
+        if (chunks > cpus)
+            chunks = cpus;
+    }
+    return chunks > 1 ? chunks : 1;
+}
+
+static int dump_parallel(const json_t *json, size_t flags, size_t num_chunks,
+                         json_dump_callback_t dump, void *data) {
+    struct dump_chunk chunks[MAX_DUMP_THREADS];
+    dump_thread_t threads[MAX_DUMP_THREADS];
+    int started[MAX_DUMP_THREADS];
+    const char **keys = NULL;
+    json_t **values = NULL;
+    size_t total, i;
+    int embed = flags & JSON_EMBED;
+    int res = -1;
+
+    flags &= ~(JSON_EMBED | JSON_PARALLEL);
+
+    if (json_is_object(json)) {
+        void *iter;
+
+        total = json_object_size(json);
+        keys = jsonp_malloc(total * sizeof(const char *));
+        values = jsonp_malloc(total * sizeof(json_t *));
+        if (!keys || !values)
+            goto out;
+
+        i = 0;
+        iter = jsonp_object_iter(json);
+        while (iter) {
+            keys[i] = json_object_iter_key(iter);
+            iter = jsonp_object_iter_next(json, iter);
+            i++;
+        }
+        assert(i == total);
+
+        if (flags & JSON_SORT_KEYS)
+            qsort(keys, total, sizeof(const char *), compare_keys);
+
+        for (i = 0; i < total; i++)
+            values[i] = json_object_iter_value(jsonp_object_key_iter(json, keys[i]));
+    } else
+        total = json_array_size(json);
+
+    for (i = 0; i < num_chunks; i++) {
+        chunks[i].json = json;
+        chunks[i].keys = keys;
+        chunks[i].values = values;
+        chunks[i].first = total * i / num_chunks;
+        chunks[i].last = total * (i + 1) / num_chunks;
+        chunks[i].total = total;
+        chunks[i].flags = flags;
+        chunks[i].result = -1;
+        started[i] = 0;
+        if (strbuffer_init(&chunks[i].output)) {
+            while (i-- > 0)
+                strbuffer_close(&chunks[i].output);
+            goto out;
+        }
+    }
+
+    /* The calling thread encodes the first chunk itself. If a worker
+       cannot be started, its chunk is encoded on the calling thread
+       too. */
+    for (i = 1; i < num_chunks; i++)
+        started[i] = dump_thread_start(&threads[i], &chunks[i]) == 0;
+
+    dump_chunk_run(&chunks[0]);
+
+    for (i = 1; i < num_chunks; i++) {
+        if (started[i])
+            dump_thread_join(threads[i]);
+        else
+            dump_chunk_run(&chunks[i]);
+    }
+
+    for (i = 0; i < num_chunks; i++) {
+        if (chunks[i].result)
+            goto close;
+    }
+
+    if (!embed && dump(keys ? "{" : "[", 1, data))
+        goto close;
+    if (dump_indent(flags, 1, 0, dump, data))
+        goto close;
+
+    for (i = 0; i < num_chunks; i++) {
+        if (dump(strbuffer_value(&chunks[i].output), chunks[i].output.length, data))
+            goto close;
+    }
+
+    res = embed ? 0 : dump(keys ? "}" : "]", 1, data);
+
+close:
+    for (i = 0; i < num_chunks; i++)
+        strbuffer_close(&chunks[i].output);
+
+out:
+    jsonp_free(keys);
+    jsonp_free(values);
+    return res;
+}
+#endif /* HAVE_DUMP_THREADS */
+
 char *json_dumps(const json_t *json, size_t flags) {
     strbuffer_t strbuff;
     char *result;
@@ -435,21 +728,165 @@ int json_dumpfd(const json_t *json, int output, size_t flags) {
     return json_dump_callback(json, dump_to_fd, (void *)&output, flags);
 }
 
-int json_dump_file(const json_t *json, const char *path, size_t flags) {
+struct file_buffer {
+    FILE *file;
+    size_t used;
+    char *data;
+};
+
+static int file_buffer_flush(struct file_buffer *buf) {
+    if (buf->used && fwrite(buf->data, buf->used, 1, buf->file) != 1)
+        return -1;
+
+    buf->used = 0;
+    return 0;
+}
+
+static int dump_to_file_buffer(const char *buffer, size_t size, void *data) {
+    struct file_buffer *buf = (struct file_buffer *)data;
+
+    if (buf->used + size > DUMP_FILE_BUFFER_SIZE) {
+        if (file_buffer_flush(buf))
+            return -1;
+
+        /* too large to be worth copying */
+        if (size > DUMP_FILE_BUFFER_SIZE)
+            return fwrite(buffer, size, 1, buf->file) == 1 ? 0 : -1;
+    }
+
+    memcpy(buf->data + buf->used, buffer, size);
+    buf->used += size;
+    return 0;
+}
+
+static int sync_file(FILE *file) {
+#if defined(_WIN32)
+    return _commit(_fileno(file));
+#elif defined(HAVE_UNISTD_H)
+    return fsync(fileno(file));
+#else
+    (void)file;
+    return 0;
+#endif
+}
+
+/* Make a rename inside the directory of path durable. Only needed
+   (and only possible) on POSIX systems; MoveFileEx() takes care of it
+   on Windows. */
+static int sync_parent_dir(const char *path) {
+#if !defined(_WIN32) && defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H)
+    const char *sep = strrchr(path, '/');
+    char *dir;
+    int fd, result;
+
+    if (!sep)
+        dir = jsonp_strdup(".");
+    else if (sep == path)
+        dir = jsonp_strdup("/");
+    else
+        dir = jsonp_strndup(path, sep - path);
+    if (!dir)
+        return -1;
+
+    fd = open(dir, O_RDONLY);
+    jsonp_free(dir);
+    if (fd < 0)
+        return -1;
+
+    result = fsync(fd);
+    close(fd);
+    return result;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+static int replace_file(const char *from, const char *to, size_t flags) {
+#if defined(_WIN32)
+    DWORD move_flags = MOVEFILE_REPLACE_EXISTING;
+    if (flags & JSON_FSYNC)
+        move_flags |= MOVEFILE_WRITE_THROUGH;
+
+    return MoveFileExA(from, to, move_flags) ? 0 : -1;
+#else
+    if (rename(from, to))
+        return -1;
+
+    if ((flags & JSON_FSYNC) && sync_parent_dir(to))
+        return -1;
+
+    return 0;
+#endif
+}
+
+static int dump_to_path(const json_t *json, const char *path, const char *mode,
+                        size_t flags, jsonp_dump_func dump) {
+    struct file_buffer buf;
     int result;
 
-    FILE *output = fopen(path, "w");
-    if (!output)
+    buf.used = 0;
+    buf.data = jsonp_malloc(DUMP_FILE_BUFFER_SIZE);
+    if (!buf.data)
         return -1;
 
-    result = json_dumpf(json, output, flags);
+    buf.file = fopen(path, mode);
+    if (!buf.file) {
+        jsonp_free(buf.data);
+        return -1;
+    }
+
+    result = dump(json, dump_to_file_buffer, (void *)&buf, flags);
+    if (!result)
+        result = file_buffer_flush(&buf);
 
-    if (fclose(output) != 0)
+    if (!result && (flags & JSON_FSYNC)) {
+        if (fflush(buf.file) || sync_file(buf.file))
+            result = -1;
+    }
+
+    if (fclose(buf.file) != 0)
+        result = -1;
+
+    jsonp_free(buf.data);
+    return result;
+}
+
+int jsonp_dump_file(const json_t *json, const char *path, const char *mode, size_t flags,
+                    jsonp_dump_func dump) {
+    char *temp_path;
+    size_t path_len;
+    int result;
+
+    if (!json || !path)
+        return -1;
+
+    if (!(flags & JSON_ATOMIC_FILE))
+        return dump_to_path(json, path, mode, flags, dump);
+
+    path_len = strlen(path);
+    temp_path = jsonp_malloc(path_len + sizeof(ATOMIC_FILE_SUFFIX));
+    if (!temp_path)
         return -1;
 
+    memcpy(temp_path, path, path_len);
+    memcpy(temp_path + path_len, ATOMIC_FILE_SUFFIX, sizeof(ATOMIC_FILE_SUFFIX));
+
+    result = dump_to_path(json, temp_path, mode, flags, dump);
+    if (!result)
+        result = replace_file(temp_path, path, flags);
+
+    if (result)
+        remove(temp_path);
+
+    jsonp_free(temp_path);
     return result;
 }
 
+int json_dump_file(const json_t *json, const char *path, size_t flags) {
+    return jsonp_dump_file(json, path, "w", flags, json_dump_callback);
+}
+
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data,
                        size_t flags) {
     int res;
@@ -460,6 +897,16 @@ int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *
             return -1;
     }
 
+#ifdef HAVE_DUMP_THREADS
+    /* the workers allocate, which the application's functions may not
+       allow from several threads */
+    if ((flags & JSON_PARALLEL) && jsonp_alloc_funcs_are_default()) {
+        size_t num_chunks = dump_parallel_chunks(json);
+        if (num_chunks > 1)
+            return dump_parallel(json, flags, num_chunks, callback, data);
+    }
+#endif
+
     if (hashtable_init(&parents_set))
         return -1;
     res = do_dump(json, flags, 0, &parents_set, callback, data);
@@ -467,3 +914,368 @@ int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *
 
     return res;
 }
+
+/*** streaming writer ***/
+
+/* Each open container is one byte on the writer stack */
+#define FRAME_OBJECT 0x1 /* the container is an object */
+#define FRAME_ITEMS  0x2 /* at least one item has been written */
+#define FRAME_KEY    0x4 /* a key has been written, its value is expected */
+
+#define WRITER_MIN_STACK_SIZE 16
+
+struct json_writer_t {
+    json_dump_callback_t dump;
+    void *data;
+    size_t flags;
+    int embed;
+    int done;
+    int error;
+    strbuffer_t output;
+    int own_output;
+    unsigned char *stack;
+    size_t depth;
+    size_t stack_size;
+};
+
+static json_writer_t *writer_create(json_dump_callback_t callback, void *data,
+                                    size_t flags) {
+    json_writer_t *writer = jsonp_malloc(sizeof(json_writer_t));
+    if (!writer)
+        return NULL;
+
+    writer->dump = callback;
+    writer->data = data;
+    writer->embed = flags & JSON_EMBED;
+    writer->flags = flags & ~(JSON_EMBED | JSON_PARALLEL);
+    writer->done = 0;
+    writer->error = 0;
+    writer->own_output = 0;
+    writer->depth = 0;
+    writer->stack_size = WRITER_MIN_STACK_SIZE;
+    writer->stack = jsonp_malloc(writer->stack_size);
+    if (!writer->stack) {
+        jsonp_free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+json_writer_t *json_writer(size_t flags) {
+    json_writer_t *writer = writer_create(dump_to_strbuffer, NULL, flags);
+    if (!writer)
+        return NULL;
+
+    if (strbuffer_init(&writer->output)) {
+        json_writer_free(writer);
+        return NULL;
+    }
+    writer->own_output = 1;
+    writer->data = &writer->output;
+
+    return writer;
+}
+
+json_writer_t *json_writer_file(FILE *output, size_t flags) {
+    if (!output)
+        return NULL;
+
+    return writer_create(dump_to_file, (void *)output, flags);
+}
+
+json_writer_t *json_writer_callback(json_dump_callback_t callback, void *data,
+                                    size_t flags) {
+    if (!callback)
+        return NULL;
+
+    return writer_create(callback, data, flags);
+}
+
+void json_writer_free(json_writer_t *writer) {
+    if (!writer)
+        return;
+
+    if (writer->own_output)
+        strbuffer_close(&writer->output);
+
+    jsonp_free(writer->stack);
+    jsonp_free(writer);
+}
+
+const char *json_writer_result(const json_writer_t *writer, size_t *length) {
+    if (!writer || !writer->own_output || !writer->done || writer->error)
+        return NULL;
+
+    if (length)
+        *length = writer->output.length;
+    return strbuffer_value(&writer->output);
+}
+
+int json_writer_done(const json_writer_t *writer) {
+    return writer && writer->done && !writer->error;
+}
+
+static int writer_fail(json_writer_t *writer) {
+    writer->error = 1;
+    return -1;
+}
+
+static int writer_write(json_writer_t *writer, const char *buffer, size_t size) {
+    if (writer->dump(buffer, size, writer->data))
+        return writer_fail(writer);
+    return 0;
+}
+
+/* Write the separator and indentation that precede an item of the
+   innermost container, just like do_dump() does between items */
+static int writer_separate(json_writer_t *writer, unsigned char *frame) {
+    if (*frame & FRAME_ITEMS) {
+        if (writer_write(writer, ",", 1))
+            return -1;
+        if (dump_indent(writer->flags, (int)writer->depth, 1, writer->dump, writer->data))
+            return writer_fail(writer);
+    } else {
+        if (dump_indent(writer->flags, (int)writer->depth, 0, writer->dump, writer->data))
+            return writer_fail(writer);
+        *frame |= FRAME_ITEMS;
+    }
+    return 0;
+}
+
+/* Prepare for writing a value. Values are allowed at the top level
+   (only one, and only arrays or objects unless JSON_ENCODE_ANY is
+   used), as array items and after an object key. */
+static int writer_begin_value(json_writer_t *writer, int is_container) {
+    unsigned char *frame;
+
+    if (writer->error)
+        return -1;
+
+    if (writer->depth == 0) {
+        if (writer->done)
+            return writer_fail(writer);
+        if (!is_container && !(writer->flags & JSON_ENCODE_ANY))
+            return writer_fail(writer);
+        return 0;
+    }
+
+    frame = &writer->stack[writer->depth - 1];
+    if (*frame & FRAME_OBJECT) {
+        if (!(*frame & FRAME_KEY))
+            return writer_fail(writer);
+        *frame &= ~FRAME_KEY;
+        return 0;
+    }
+
+    return writer_separate(writer, frame);
+}
+
+static int writer_end_value(json_writer_t *writer) {
+    if (writer->depth == 0)
+        writer->done = 1;
+    return 0;
+}
+
+static int writer_open(json_writer_t *writer, int is_object) {
+    if (writer_begin_value(writer, 1))
+        return -1;
+
+    if (writer->depth == writer->stack_size) {
+        unsigned char *new_stack;
+
+        new_stack = jsonp_malloc(writer->stack_size * 2);
+        if (!new_stack)
+            return writer_fail(writer);
+
+        memcpy(new_stack, writer->stack, writer->stack_size);
+        jsonp_free(writer->stack);
+        writer->stack = new_stack;
+        writer->stack_size *= 2;
+    }
+
+    if (writer->depth > 0 || !writer->embed) {
+        if (writer_write(writer, is_object ? "{" : "[", 1))
+            return -1;
+    }
+
+    writer->stack[writer->depth++] = is_object ? FRAME_OBJECT : 0;
+    return 0;
+}
+
+static int writer_close(json_writer_t *writer, int is_object) {
+    unsigned char frame;
+
+    if (writer->error)
+        return -1;
+
+    if (writer->depth == 0)
+        return writer_fail(writer);
+
+    frame = writer->stack[writer->depth - 1];
+    if (!(frame & FRAME_OBJECT) != !is_object || (frame & FRAME_KEY))
+        return writer_fail(writer);
+
+    writer->depth--;
+
+    if (frame & FRAME_ITEMS) {
+        if (dump_indent(writer->flags, (int)writer->depth, 0, writer->dump, writer->data))
+            return writer_fail(writer);
+    }
+
+    if (writer->depth > 0 || !writer->embed) {
+        if (writer_write(writer, is_object ? "}" : "]", 1))
+            return -1;
+    }
+
+    return writer_end_value(writer);
+}
+
+int json_writer_object_begin(json_writer_t *writer) {
+    if (!writer)
+        return -1;
+    return writer_open(writer, 1);
+}
+
+int json_writer_object_end(json_writer_t *writer) {
+    if (!writer)
+        return -1;
+    return writer_close(writer, 1);
+}
+
+int json_writer_array_begin(json_writer_t *writer) {
+    if (!writer)
+        return -1;
+    return writer_open(writer, 0);
+}
+
+int json_writer_array_end(json_writer_t *writer) {
+    if (!writer)
+        return -1;
+    return writer_close(writer, 0);
+}
+
+int json_writer_key(json_writer_t *writer, const char *key) {
+    if (!key)
+        return -1;
+    return json_writer_keyn(writer, key, strlen(key));
+}
+
+int json_writer_keyn(json_writer_t *writer, const char *key, size_t len) {
+    unsigned char *frame;
+
+    if (!writer || writer->error)
+        return -1;
+
+    if (!key || writer->depth == 0)
+        return writer_fail(writer);
+
+    frame = &writer->stack[writer->depth - 1];
+    if (!(*frame & FRAME_OBJECT) || (*frame & FRAME_KEY))
+        return writer_fail(writer);
+
+    if (writer_separate(writer, frame))
+        return -1;
+
+    if (dump_string(key, len, writer->dump, writer->data, writer->flags))
+        return writer_fail(writer);
+
+    if (writer->flags & JSON_COMPACT) {
+        if (writer_write(writer, ":", 1))
+            return -1;
+    } else {
+        if (writer_write(writer, ": ", 2))
+            return -1;
+    }
+
+    *frame |= FRAME_KEY;
+    return 0;
+}
+
+int json_writer_string(json_writer_t *writer, const char *value) {
+    if (!value)
+        return -1;
+    return json_writer_stringn(writer, value, strlen(value));
+}
+
+int json_writer_stringn(json_writer_t *writer, const char *value, size_t len) {
+    if (!writer || !value || writer_begin_value(writer, 0))
+        return -1;
+
+    if (dump_string(value, len, writer->dump, writer->data, writer->flags))
+        return writer_fail(writer);
+
+    return writer_end_value(writer);
+}
+
+int json_writer_integer(json_writer_t *writer, json_int_t value) {
+    if (!writer || writer_begin_value(writer, 0))
+        return -1;
+
+    if (dump_integer(value, writer->dump, writer->data))
+        return writer_fail(writer);
+
+    return writer_end_value(writer);
+}
+
+int json_writer_real(json_writer_t *writer, double value) {
+    /* NaN and infinity have no JSON representation; both give a NaN
+       when subtracted from themselves */
+    if (!writer || value - value != value - value)
+        return -1;
+
+    if (writer_begin_value(writer, 0))
+        return -1;
+
+    if (dump_real(value, writer->flags, writer->dump, writer->data))
+        return writer_fail(writer);
+
+    return writer_end_value(writer);
+}
+
+int json_writer_boolean(json_writer_t *writer, int value) {
+    if (!writer || writer_begin_value(writer, 0))
+        return -1;
+
+    if (value ? writer_write(writer, "true", 4) : writer_write(writer, "false", 5))
+        return -1;
+
+    return writer_end_value(writer);
+}
+
+int json_writer_null(json_writer_t *writer) {
+    if (!writer || writer_begin_value(writer, 0))
+        return -1;
+
+    if (writer_write(writer, "null", 4))
+        return -1;
+
+    return writer_end_value(writer);
+}
+
+int json_writer_value(json_writer_t *writer, const json_t *json) {
+    hashtable_t parents_set;
+    size_t flags;
+    int res;
+
+    if (!writer || !json)
+        return -1;
+
+    if (writer_begin_value(writer, json_is_array(json) || json_is_object(json)))
+        return -1;
+
+    flags = writer->flags;
+    if (writer->depth == 0 && writer->embed)
+        flags |= JSON_EMBED;
+
+    if (hashtable_init(&parents_set))
+        return writer_fail(writer);
+    res = do_dump(json, flags, (int)writer->depth, &parents_set, writer->dump,
+                  writer->data);
+    hashtable_close(&parents_set);
+
+    if (res)
+        return writer_fail(writer);
+
+    return writer_end_value(writer);
+}
@@ -24,295 +24,983 @@
 #define INITIAL_HASHTABLE_ORDER 3
 #endif
 
-typedef struct hashtable_list list_t;
+/* Tables with up to this many pairs are stored flat and searched
+   linearly, larger ones are hashed */
+#ifndef SMALL_HASHTABLE_MAX_PAIRS
+#define SMALL_HASHTABLE_MAX_PAIRS 8
+#endif
+
 typedef struct hashtable_pair pair_t;
-typedef struct hashtable_bucket bucket_t;
+typedef struct hashtable_slot slot_t;
+typedef struct hashtable_field field_t;
 
 extern volatile uint32_t hashtable_seed;
 
-/* Implementation of the hash function */
-#include "lookup3.h"
+#define hashsize(n) ((size_t)1 << (n))
+#define hashmask(n) (hashsize(n) - 1)
+
+/* the sizes of the allocations of a hashed table, for sized frees */
+#define slots_size(order_)   (hashsize(order_) * sizeof(slot_t))
+#define entries_size(order_) (max_pairs(order_) * sizeof(pair_t *))
+#define pair_size(key_len_)  (offsetof(pair_t, key) + (key_len_) + 1)
+
+/* Implementation of the hash function. This follows wyhash: keys of
+   up to 16 bytes are read as two possibly overlapping words and mixed
+   with a single 64x64->128 bit multiplication, longer keys are
+   consumed 16 bytes at a time. */
+
+#define HASH_SECRET0 0xa0761d6478bd642fULL
+#define HASH_SECRET1 0xe7037ed1a0b428dbULL
+
+static JSON_INLINE void hash_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), lo, hi;
+    uint64_t c = t < rl;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+#endif
+}
 
-#define list_to_pair(list_)         container_of(list_, pair_t, list)
-#define ordered_list_to_pair(list_) container_of(list_, pair_t, ordered_list)
-#define hash_str(key)               ((size_t)hashlittle((key), strlen(key), hashtable_seed))
+static JSON_INLINE uint64_t hash_mix(uint64_t a, uint64_t b) {
+    hash_mum(&a, &b);
+    return a ^ b;
+}
 
-static JSON_INLINE void list_init(list_t *list) {
-    list->next = list;
-    list->prev = list;
+static JSON_INLINE uint64_t hash_read8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
-static JSON_INLINE void list_insert(list_t *list, list_t *node) {
-    node->next = list;
-    node->prev = list->prev;
-    list->prev->next = node;
-    list->prev = node;
+static JSON_INLINE uint64_t hash_read4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
-static JSON_INLINE void list_remove(list_t *list) {
-    list->prev->next = list->next;
-    list->next->prev = list->prev;
+static size_t hash_str(const char *key, size_t len) {
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t seed = hashtable_seed;
+    uint64_t a, b;
+
+    seed ^= hash_mix(seed ^ HASH_SECRET0, HASH_SECRET1);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t offset = (len >> 3) << 2;
+            a = (hash_read4(p) << 32) | hash_read4(p + offset);
+            b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - offset);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        while (i > 16) {
+            seed = hash_mix(hash_read8(p) ^ HASH_SECRET1, hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+
+    a ^= HASH_SECRET1;
+    b ^= seed;
+    hash_mum(&a, &b);
+    return (size_t)hash_mix(a ^ HASH_SECRET0 ^ len, b ^ HASH_SECRET1);
 }
 
-static JSON_INLINE int bucket_is_empty(hashtable_t *hashtable, bucket_t *bucket) {
-    return bucket->first == &hashtable->list && bucket->first == bucket->last;
+/* The index is grown when more than 3/4 of its slots are in use. The
+   entries array always has room for exactly that many pairs, so it
+   fills up at the same time. */
+#define max_pairs(order_) (hashsize(order_) - hashsize(order_) / 4)
+
+#define NOT_FOUND ((size_t)-1)
+
+static JSON_INLINE size_t probe_distance(const hashtable_t *hashtable,
+                                         const slot_t *slot, size_t index) {
+    return (index - slot->hash) & hashmask(hashtable->order);
 }
 
-static void insert_to_bucket(hashtable_t *hashtable, bucket_t *bucket, list_t *list) {
-    if (bucket_is_empty(hashtable, bucket)) {
-        list_insert(&hashtable->list, list);
-        bucket->first = bucket->last = list;
-    } else {
-        list_insert(bucket->first, list);
-        bucket->first = list;
+static size_t hashtable_find_slot(const hashtable_t *hashtable, const char *key,
+                                  size_t key_len, size_t hash) {
+    size_t index, distance;
+    const slot_t *slot;
+    const pair_t *pair;
+
+    index = hash & hashmask(hashtable->order);
+    for (distance = 0;; distance++) {
+        slot = &hashtable->slots[index];
+
+        /* Robin Hood invariant: the key would have displaced any slot
+           that is closer to its home than we are to ours */
+        if (!slot->entry || probe_distance(hashtable, slot, index) < distance)
+            return NOT_FOUND;
+
+        if (slot->hash == (uint32_t)hash) {
+            pair = hashtable->entries[slot->entry - 1];
+            if (pair->key_len == key_len && memcmp(pair->key, key, key_len) == 0)
+                return index;
+        }
+
+        index = (index + 1) & hashmask(hashtable->order);
     }
 }
 
-static pair_t *hashtable_find_pair(hashtable_t *hashtable, bucket_t *bucket,
-                                   const char *key, size_t hash) {
-    list_t *list;
-    pair_t *pair;
+static void insert_to_slots(hashtable_t *hashtable, uint32_t entry, uint32_t hash) {
+    size_t index, distance;
+    slot_t new_slot, tmp;
 
-    if (bucket_is_empty(hashtable, bucket))
-        return NULL;
+    new_slot.entry = entry;
+    new_slot.hash = hash;
 
-    list = bucket->first;
-    while (1) {
-        pair = list_to_pair(list);
-        if (pair->hash == hash && strcmp(pair->key, key) == 0)
-            return pair;
+    index = hash & hashmask(hashtable->order);
+    for (distance = 0;; distance++) {
+        slot_t *slot = &hashtable->slots[index];
 
-        if (list == bucket->last)
-            break;
+        if (!slot->entry) {
+            *slot = new_slot;
+            return;
+        }
 
-        list = list->next;
+        /* take the place of a slot that is closer to its home and
+           continue inserting that one instead */
+        if (probe_distance(hashtable, slot, index) < distance) {
+            tmp = *slot;
+            *slot = new_slot;
+            new_slot = tmp;
+            distance = probe_distance(hashtable, &new_slot, index);
+        }
+
+        index = (index + 1) & hashmask(hashtable->order);
     }
+}
+
+static void remove_from_slots(hashtable_t *hashtable, size_t index) {
+    size_t next = (index + 1) & hashmask(hashtable->order);
+
+    /* shift the following slots back instead of leaving a tombstone */
+    while (hashtable->slots[next].entry &&
+           probe_distance(hashtable, &hashtable->slots[next], next) > 0) {
+        hashtable->slots[index] = hashtable->slots[next];
+        index = next;
+        next = (next + 1) & hashmask(hashtable->order);
+    }
+
+    hashtable->slots[index].entry = 0;
+}
+
+/*** small tables ***/
+
+/* A small table keeps its pairs back to back in a chain of blocks,
+   pointed to by hashtable->blocks, and hashtable->used counts the
+   pairs stored in them. A pair is never moved, so that iterators and
+   key pointers stay valid while keys are added. A removed pair stays
+   in place with a NULL value, and the blocks are kept as the pair
+   storage when the table is hashed. */
+
+typedef struct hashtable_block block_t;
+
+#define block_pairs(block_) ((char *)((block_) + 1))
+#define block_size(capacity_) (sizeof(block_t) + (capacity_))
+
+/* size of a packed pair, rounded up so that the next one is aligned */
+#define packed_pair_size(key_len_)                                                      \
+    ((offsetof(pair_t, key) + (key_len_) + sizeof(void *)) & ~(sizeof(void *) - 1))
 
+static block_t *block_of(const hashtable_t *hashtable, const pair_t *pair) {
+    block_t *block;
+
+    for (block = hashtable->blocks; block; block = block->next) {
+        if ((const char *)pair >= block_pairs(block) &&
+            (const char *)pair < block_pairs(block) + block->used)
+            return block;
+    }
     return NULL;
 }
 
-/* returns 0 on success, -1 if key was not found */
-static int hashtable_do_del(hashtable_t *hashtable, const char *key, size_t hash) {
+static pair_t *small_find(const hashtable_t *hashtable, const char *key,
+                          size_t key_len) {
+    block_t *block;
+    size_t offset;
     pair_t *pair;
-    bucket_t *bucket;
-    size_t index;
 
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
+    for (block = hashtable->blocks; block; block = block->next) {
+        for (offset = 0; offset < block->used;
+             offset += packed_pair_size(pair->key_len)) {
+            pair = (pair_t *)(block_pairs(block) + offset);
+            if (pair->value && pair->key_len == key_len &&
+                memcmp(pair->key, key, key_len) == 0)
+                return pair;
+        }
+    }
+    return NULL;
+}
+
+static pair_t *small_iter_from(block_t *block, size_t offset) {
+    pair_t *pair;
+
+    for (; block; block = block->next, offset = 0) {
+        for (; offset < block->used; offset += packed_pair_size(pair->key_len)) {
+            pair = (pair_t *)(block_pairs(block) + offset);
+            if (pair->value)
+                return pair;
+        }
+    }
+    return NULL;
+}
+
+static pair_t *small_iter_next(hashtable_t *hashtable, pair_t *pair) {
+    block_t *block = block_of(hashtable, pair);
+
+    if (!block)
+        return NULL;
+
+    return small_iter_from(block, (size_t)((char *)pair - block_pairs(block)) +
+                                      packed_pair_size(pair->key_len));
+}
+
+static int small_insert(hashtable_t *hashtable, const char *key, size_t key_len,
+                        json_t *value) {
+    size_t size, count, capacity;
+    block_t *block, **tail;
+    pair_t *pair;
+
+    if (key_len >= ((size_t)-1 - sizeof(block_t)) / SMALL_HASHTABLE_MAX_PAIRS -
+                       packed_pair_size(0)) {
+        /* Avoid an overflow if the key is very long */
+        return -1;
+    }
+
+    size = packed_pair_size(key_len);
+
+    tail = &hashtable->blocks;
+    while (*tail && (*tail)->next)
+        tail = &(*tail)->next;
+    block = *tail;
+
+    if (!block || size > block->capacity - block->used) {
+        /* Chain a block with room for as many pairs of this size as
+           are already stored, but no more than the table can hold
+           before it's hashed */
+        count = hashtable->used < 2 ? 2 : hashtable->used;
+        if (count > SMALL_HASHTABLE_MAX_PAIRS - hashtable->used)
+            count = SMALL_HASHTABLE_MAX_PAIRS - hashtable->used;
+        capacity = count * size;
+
+        block = jsonp_allocator_malloc(hashtable->allocator, block_size(capacity));
+        if (!block)
+            return -1;
+
+        block->next = NULL;
+        block->used = 0;
+        block->capacity = capacity;
+        if (*tail)
+            (*tail)->next = block;
+        else
+            *tail = block;
+    }
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+    pair = (pair_t *)(block_pairs(block) + block->used);
+    pair->hash = 0;
+    pair->index = (uint32_t)hashtable->size;
+    memcpy(pair->key, key, key_len);
+    pair->key[key_len] = '\0';
+    pair->key_len = key_len;
+    pair->value = value;
+
+    block->used += size;
+    hashtable->used++;
+    hashtable->size++;
+
+    return 0;
+}
+
+static void blocks_free(hashtable_t *hashtable, block_t *block) {
+    block_t *next;
+
+    for (; block; block = next) {
+        next = block->next;
+        jsonp_allocator_free(hashtable->allocator, block, block_size(block->capacity));
+    }
+}
+
+static int small_del(hashtable_t *hashtable, const char *key, size_t key_len) {
+    block_t *block;
+    pair_t *pair;
+    json_t *value;
+
+    pair = small_find(hashtable, key, key_len);
     if (!pair)
         return -1;
 
-    if (&pair->list == bucket->first && &pair->list == bucket->last)
-        bucket->first = bucket->last = &hashtable->list;
+    value = pair->value;
+    pair->value = NULL;
+    hashtable->size--;
+
+    if (hashtable->size == 0) {
+        /* keep the first block for the next keys */
+        block = hashtable->blocks->next;
+        hashtable->blocks->next = NULL;
+        hashtable->blocks->used = 0;
+        hashtable->used = 0;
+        blocks_free(hashtable, block);
+    } else {
+        /* the last pair can be trimmed, which keeps a table that
+           churns on one key, like the loop detection of the encoder,
+           from filling up */
+        block = block_of(hashtable, pair);
+        if (!block->next && (char *)pair + packed_pair_size(key_len) ==
+                                block_pairs(block) + block->used) {
+            block->used = (size_t)((char *)pair - block_pairs(block));
+            hashtable->used--;
+        }
+    }
+
+    json_decref(value);
+    return 0;
+}
 
-    else if (&pair->list == bucket->first)
-        bucket->first = pair->list.next;
+static void small_clear(hashtable_t *hashtable) {
+    pair_t *pair;
 
-    else if (&pair->list == bucket->last)
-        bucket->last = pair->list.prev;
+    for (pair = small_iter_from(hashtable->blocks, 0); pair;
+         pair = small_iter_next(hashtable, pair))
+        json_decref(pair->value);
+}
 
-    list_remove(&pair->list);
-    list_remove(&pair->ordered_list);
-    json_decref(pair->value);
 
-    jsonp_free(pair);
+/*** hashed tables ***/
+
+/* the pairs that were stored while the table was small belong to
+   its blocks */
+static void pair_free(hashtable_t *hashtable, pair_t *pair) {
+    if (!block_of(hashtable, pair))
+        jsonp_allocator_free(hashtable->allocator, pair, pair_size(pair->key_len));
+}
+
+/* returns 0 on success, -1 if key was not found */
+static int hashtable_do_del(hashtable_t *hashtable, const char *key, size_t key_len,
+                            size_t hash) {
+    pair_t *pair;
+    size_t index;
+
+    index = hashtable_find_slot(hashtable, key, key_len, hash);
+    if (index == NOT_FOUND)
+        return -1;
+
+    pair = hashtable->entries[hashtable->slots[index].entry - 1];
+    remove_from_slots(hashtable, index);
+
+    hashtable->entries[pair->index] = NULL;
+    while (hashtable->used > 0 && !hashtable->entries[hashtable->used - 1])
+        hashtable->used--;
+
+    json_decref(pair->value);
+    pair_free(hashtable, pair);
     hashtable->size--;
 
     return 0;
 }
 
 static void hashtable_do_clear(hashtable_t *hashtable) {
-    list_t *list, *next;
+    size_t i;
     pair_t *pair;
 
-    for (list = hashtable->list.next; list != &hashtable->list; list = next) {
-        next = list->next;
-        pair = list_to_pair(list);
-        json_decref(pair->value);
-        jsonp_free(pair);
+    if (!hashtable->slots) {
+        small_clear(hashtable);
+        return;
+    }
+
+    for (i = 0; i < hashtable->used; i++) {
+        pair = hashtable->entries[i];
+        if (pair) {
+            json_decref(pair->value);
+            pair_free(hashtable, pair);
+        }
     }
 }
 
-static int hashtable_do_rehash(hashtable_t *hashtable) {
-    list_t *list, *next;
-    pair_t *pair;
-    size_t i, index, new_size, new_order;
-    struct hashtable_bucket *new_buckets;
+/* Resize the index and the entries to the given order, dropping the
+   removed entries. Iterators stay valid because they point to the
+   pairs, whose index is updated. */
+static int hashtable_do_rehash(hashtable_t *hashtable, size_t new_order) {
+    slot_t *new_slots;
+    pair_t **new_entries;
+    size_t i, used;
 
-    new_order = hashtable->order + 1;
-    new_size = hashsize(new_order);
+    new_slots = jsonp_allocator_malloc(hashtable->allocator, slots_size(new_order));
+    if (!new_slots)
+        return -1;
 
-    new_buckets = jsonp_malloc(new_size * sizeof(bucket_t));
-    if (!new_buckets)
+    new_entries = jsonp_allocator_malloc(hashtable->allocator, entries_size(new_order));
+    if (!new_entries) {
+        jsonp_allocator_free(hashtable->allocator, new_slots, slots_size(new_order));
         return -1;
+    }
+
+    used = 0;
+    for (i = 0; i < hashtable->used; i++) {
+        if (hashtable->entries[i]) {
+            new_entries[used] = hashtable->entries[i];
+            new_entries[used]->index = (uint32_t)used;
+            used++;
+        }
+    }
 
-    jsonp_free(hashtable->buckets);
-    hashtable->buckets = new_buckets;
+    jsonp_allocator_free(hashtable->allocator, hashtable->slots,
+                         slots_size(hashtable->order));
+    jsonp_allocator_free(hashtable->allocator, hashtable->entries,
+                         entries_size(hashtable->order));
+    hashtable->slots = new_slots;
+    hashtable->entries = new_entries;
     hashtable->order = new_order;
+    hashtable->capacity = max_pairs(new_order);
+    hashtable->used = used;
 
-    for (i = 0; i < hashsize(hashtable->order); i++) {
-        hashtable->buckets[i].first = hashtable->buckets[i].last = &hashtable->list;
+    memset(hashtable->slots, 0, hashsize(new_order) * sizeof(slot_t));
+    for (i = 0; i < used; i++) {
+        insert_to_slots(hashtable, (uint32_t)(i + 1), hashtable->entries[i]->hash);
     }
 
-    list = hashtable->list.next;
-    list_init(&hashtable->list);
+    return 0;
+}
 
-    for (; list != &hashtable->list; list = next) {
-        next = list->next;
-        pair = list_to_pair(list);
-        index = pair->hash % new_size;
-        insert_to_bucket(hashtable, &hashtable->buckets[index], &pair->list);
+/* Switch a small table to the hashed layout. The pairs stay in the
+   blocks and are only indexed. */
+static int hashtable_do_unpack(hashtable_t *hashtable) {
+    size_t order, used = 0;
+    pair_t **entries, *pair;
+    slot_t *slots;
+
+    order = INITIAL_HASHTABLE_ORDER;
+    while (max_pairs(order) <= hashtable->size)
+        order++;
+
+    entries = jsonp_allocator_malloc(hashtable->allocator, entries_size(order));
+    slots = jsonp_allocator_malloc(hashtable->allocator, slots_size(order));
+    if (!entries || !slots) {
+        jsonp_allocator_free(hashtable->allocator, entries, entries_size(order));
+        jsonp_allocator_free(hashtable->allocator, slots, slots_size(order));
+        return -1;
     }
 
+    for (pair = small_iter_from(hashtable->blocks, 0); pair;
+         pair = small_iter_next(hashtable, pair)) {
+        pair->hash = (uint32_t)hash_str(pair->key, pair->key_len);
+        pair->index = (uint32_t)used;
+        entries[used++] = pair;
+    }
+
+    hashtable->entries = entries;
+    hashtable->slots = slots;
+    hashtable->order = order;
+    hashtable->capacity = max_pairs(order);
+    hashtable->used = used;
+
+    memset(slots, 0, hashsize(order) * sizeof(slot_t));
+    for (used = 0; used < hashtable->used; used++)
+        insert_to_slots(hashtable, (uint32_t)(used + 1), entries[used]->hash);
+
     return 0;
 }
 
-int hashtable_init(hashtable_t *hashtable) {
+/*** shared tables ***/
+
+/* A table that shares a shape keeps only an array of fields, pointed
+   to by hashtable->entries, in the order of the shape's keys. used is
+   the number of fields and size the number of those that weren't
+   removed, a removed field has a NULL value. Iterators point to the
+   fields and have the lowest bit set, which tells them apart from
+   pairs. */
+
+#define shared_fields(hashtable_) ((field_t *)(hashtable_)->entries)
+#define field_to_iter(field_) ((void *)((char *)(field_) + 1))
+#define iter_is_field(iter_) ((size_t)(iter_)&1)
+#define iter_to_field(iter_) ((field_t *)((char *)(iter_)-1))
+
+static void shared_clear(hashtable_t *hashtable) {
     size_t i;
 
+    for (i = 0; i < hashtable->used; i++)
+        json_decref(shared_fields(hashtable)[i].value);
+
+    jsonp_allocator_free(hashtable->allocator, hashtable->entries,
+                         hashtable->used * sizeof(field_t));
+    hashtable_shape_decref(hashtable->shape);
+    hashtable->shape = NULL;
+    hashtable->entries = NULL;
     hashtable->size = 0;
-    hashtable->order = INITIAL_HASHTABLE_ORDER;
-    hashtable->buckets = jsonp_malloc(hashsize(hashtable->order) * sizeof(bucket_t));
-    if (!hashtable->buckets)
+    hashtable->used = 0;
+}
+
+static field_t *shared_find(hashtable_t *hashtable, const char *key, size_t key_len,
+                            const size_t *hash) {
+    pair_t *pair;
+
+    if (hash)
+        pair = hashtable_iter_at_hashed(&hashtable->shape->keys, key, key_len, *hash);
+    else
+        pair = hashtable_iter_at(&hashtable->shape->keys, key, key_len);
+
+    return pair ? &shared_fields(hashtable)[pair->index] : NULL;
+}
+
+/* Removing a field keeps the shape, so that the other iterators stay
+   valid */
+static int shared_del(hashtable_t *hashtable, field_t *field) {
+    if (!field || !field->value)
         return -1;
 
-    list_init(&hashtable->list);
-    list_init(&hashtable->ordered_list);
+    json_decref(field->value);
+    field->value = NULL;
+    hashtable->size--;
+    return 0;
+}
+
+/* Give a shared table keys of its own, before a key is added */
+static int hashtable_do_unshare(hashtable_t *hashtable) {
+    hashtable_t private_table;
+    field_t *field;
+    size_t i;
 
-    for (i = 0; i < hashsize(hashtable->order); i++) {
-        hashtable->buckets[i].first = hashtable->buckets[i].last = &hashtable->list;
+    if (hashtable_init(&private_table))
+        return -1;
+    private_table.allocator = hashtable->allocator;
+
+    for (i = 0; i < hashtable->used; i++) {
+        field = &shared_fields(hashtable)[i];
+        if (!field->value)
+            continue;
+
+        if (hashtable_set(&private_table, field->pair->key, field->pair->key_len,
+                          json_incref(field->value))) {
+            json_decref(field->value);
+            hashtable_close(&private_table);
+            return -1;
+        }
     }
 
+    shared_clear(hashtable);
+    *hashtable = private_table;
     return 0;
 }
 
-void hashtable_close(hashtable_t *hashtable) {
-    hashtable_do_clear(hashtable);
-    jsonp_free(hashtable->buckets);
+hashtable_shape_t *hashtable_shape(hashtable_t *hashtable) {
+    hashtable_shape_t *shape;
+    void *iter;
+
+    if (hashtable->shape && hashtable->size == hashtable->used) {
+        JSON_INTERNAL_INCREF(hashtable->shape);
+        return hashtable->shape;
+    }
+
+    /* the shape keeps the allocator of the table it was made from,
+       whichever table releases it last */
+    shape = jsonp_allocator_malloc(hashtable->allocator, sizeof(hashtable_shape_t));
+    if (!shape)
+        return NULL;
+
+    shape->refcount = 1;
+    if (hashtable_init(&shape->keys)) {
+        jsonp_allocator_free(hashtable->allocator, shape, sizeof(hashtable_shape_t));
+        return NULL;
+    }
+    shape->keys.allocator = hashtable->allocator;
+
+    /* json_null() stands in for the values so that the keys are
+       found, the pair index is the position of the field */
+    for (iter = hashtable_iter(hashtable); iter;
+         iter = hashtable_iter_next(hashtable, iter)) {
+        if (hashtable_set(&shape->keys, hashtable_iter_key(iter),
+                          hashtable_iter_key_len(iter), json_null())) {
+            hashtable_shape_decref(shape);
+            return NULL;
+        }
+    }
+
+    return shape;
+}
+
+void hashtable_shape_decref(hashtable_shape_t *shape) {
+    if (shape && JSON_INTERNAL_DECREF(shape) == 0) {
+        const json_allocator_t *allocator = shape->keys.allocator;
+
+        hashtable_close(&shape->keys);
+        jsonp_allocator_free(allocator, shape, sizeof(hashtable_shape_t));
+    }
+}
+
+int hashtable_same_keys(hashtable_t *hashtable1, hashtable_t *hashtable2) {
+    void *iter1, *iter2;
+
+    if (hashtable1->size != hashtable2->size)
+        return 0;
+
+    if (hashtable1->shape && hashtable1->shape == hashtable2->shape)
+        return 1;
+
+    iter1 = hashtable_iter(hashtable1);
+    iter2 = hashtable_iter(hashtable2);
+    while (iter1 && iter2) {
+        size_t key_len = hashtable_iter_key_len(iter1);
+        if (key_len != hashtable_iter_key_len(iter2) ||
+            memcmp(hashtable_iter_key(iter1), hashtable_iter_key(iter2), key_len))
+            return 0;
+
+        iter1 = hashtable_iter_next(hashtable1, iter1);
+        iter2 = hashtable_iter_next(hashtable2, iter2);
+    }
+
+    return !iter1 && !iter2;
 }
 
-int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value) {
+int hashtable_share(hashtable_t *hashtable, hashtable_shape_t *shape) {
+    field_t *fields;
     pair_t *pair;
-    bucket_t *bucket;
-    size_t hash, index;
+    void *iter, *value_iter;
+    size_t i;
+
+    if (hashtable->shape == shape)
+        return 0;
 
-    /* rehash if the load ratio exceeds 1 */
-    if (hashtable->size >= hashsize(hashtable->order))
-        if (hashtable_do_rehash(hashtable))
+    fields = jsonp_allocator_malloc(hashtable->allocator,
+                                    shape->keys.size * sizeof(field_t));
+    if (!fields)
+        return -1;
+
+    i = 0;
+    for (iter = hashtable_iter(&shape->keys); iter;
+         iter = hashtable_iter_next(&shape->keys, iter)) {
+        pair = (pair_t *)iter;
+        value_iter = hashtable_iter_at(hashtable, pair->key, pair->key_len);
+        if (!value_iter) {
+            while (i > 0)
+                json_decref(fields[--i].value);
+            jsonp_allocator_free(hashtable->allocator, fields,
+                                 shape->keys.size * sizeof(field_t));
             return -1;
+        }
 
-    hash = hash_str(key);
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+        fields[i].pair = pair;
+        fields[i].value = json_incref(hashtable_iter_value(value_iter));
+        i++;
+    }
 
-    if (pair) {
-        json_decref(pair->value);
-        pair->value = value;
-    } else {
-        /* offsetof(...) returns the size of pair_t without the last,
-           flexible member. This way, the correct amount is
-           allocated. */
+    hashtable_close(hashtable);
+    JSON_INTERNAL_INCREF(shape);
+    hashtable->shape = shape;
+    hashtable->blocks = NULL;
+    hashtable->entries = (pair_t **)fields;
+    hashtable->size = i;
+    hashtable->used = i;
+    hashtable->capacity = 0;
+    hashtable->slots = NULL;
+    return 0;
+}
+
+/*** public interface ***/
+
+int hashtable_init(hashtable_t *hashtable) {
+    hashtable->size = 0;
+    hashtable->used = 0;
+    hashtable->capacity = 0;
+    hashtable->entries = NULL;
+    hashtable->slots = NULL;
+    hashtable->blocks = NULL;
+    hashtable->order = INITIAL_HASHTABLE_ORDER;
+    hashtable->shape = NULL;
+    hashtable->allocator = NULL;
+    return 0;
+}
+
+void hashtable_close(hashtable_t *hashtable) {
+    if (hashtable->shape) {
+        shared_clear(hashtable);
+        return;
+    }
+
+    hashtable_do_clear(hashtable);
+    if (hashtable->slots) {
+        jsonp_allocator_free(hashtable->allocator, hashtable->entries,
+                             entries_size(hashtable->order));
+        jsonp_allocator_free(hashtable->allocator, hashtable->slots,
+                             slots_size(hashtable->order));
+    }
+    blocks_free(hashtable, hashtable->blocks);
+}
+
+/* The hash is only used once the table is hashed, so the callers
+   that have to compute it skip that while the table stays small */
+#define hash_needed(hashtable_)                                                         \
+    ((hashtable_)->slots || (hashtable_)->used >= SMALL_HASHTABLE_MAX_PAIRS)
+
+size_t hashtable_hash(const char *key, size_t key_len) {
+    return hash_str(key, key_len);
+}
+
+int hashtable_set(hashtable_t *hashtable, const char *key, size_t key_len,
+                  json_t *value) {
+    size_t hash = hash_needed(hashtable) ? hash_str(key, key_len) : 0;
+    return hashtable_set_hashed(hashtable, key, key_len, hash, value);
+}
+
+int hashtable_set_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                         size_t hash, json_t *value) {
+    pair_t *pair;
+    size_t index;
+
+    if (hashtable->shape) {
+        field_t *field = shared_find(hashtable, key, key_len, &hash);
+        if (field && field->value) {
+            json_decref(field->value);
+            field->value = value;
+            return 0;
+        }
 
-        size_t len = strlen(key);
-        if (len >= (size_t)-1 - offsetof(pair_t, key)) {
-            /* Avoid an overflow if the key is very long */
+        if (hashtable_do_unshare(hashtable))
             return -1;
+    }
+
+    if (!hashtable->slots) {
+        pair = small_find(hashtable, key, key_len);
+        if (pair) {
+            json_decref(pair->value);
+            pair->value = value;
+            return 0;
         }
 
-        pair = jsonp_malloc(offsetof(pair_t, key) + len + 1);
-        if (!pair)
+        if (hashtable->used < SMALL_HASHTABLE_MAX_PAIRS)
+            return small_insert(hashtable, key, key_len, value);
+
+        if (hashtable_do_unpack(hashtable))
             return -1;
+    }
 
-        pair->hash = hash;
-        strncpy(pair->key, key, len + 1);
+    index = hashtable_find_slot(hashtable, key, key_len, hash);
+
+    if (index != NOT_FOUND) {
+        pair = hashtable->entries[hashtable->slots[index].entry - 1];
+        json_decref(pair->value);
         pair->value = value;
-        list_init(&pair->list);
-        list_init(&pair->ordered_list);
+        return 0;
+    }
+
+    if (hashtable->used == hashtable->capacity) {
+        /* grow if more than half of the entries are live, otherwise
+           reclaim the removed ones */
+        size_t order = hashtable->order;
+        if (hashtable->size > hashtable->capacity / 2)
+            order++;
+
+        if (order >= 32 || hashtable_do_rehash(hashtable, order))
+            return -1;
+    }
 
-        insert_to_bucket(hashtable, bucket, &pair->list);
-        list_insert(&hashtable->ordered_list, &pair->ordered_list);
+    /* offsetof(...) returns the size of pair_t without the last,
+       flexible member. This way, the correct amount is
+       allocated. */
 
-        hashtable->size++;
+    if (key_len >= (size_t)-1 - offsetof(pair_t, key)) {
+        /* Avoid an overflow if the key is very long */
+        return -1;
     }
+
+    pair = jsonp_allocator_malloc(hashtable->allocator, pair_size(key_len));
+    if (!pair)
+        return -1;
+
+    pair->hash = (uint32_t)hash;
+    pair->index = (uint32_t)hashtable->used;
+    memcpy(pair->key, key, key_len);
+    pair->key[key_len] = '\0';
+    pair->key_len = key_len;
+    pair->value = value;
+
+    hashtable->entries[hashtable->used++] = pair;
+    insert_to_slots(hashtable, (uint32_t)hashtable->used, (uint32_t)hash);
+    hashtable->size++;
+
     return 0;
 }
 
-void *hashtable_get(hashtable_t *hashtable, const char *key) {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
+void *hashtable_get(hashtable_t *hashtable, const char *key, size_t key_len) {
+    void *iter = hashtable_iter_at(hashtable, key, key_len);
+    return iter ? hashtable_iter_value(iter) : NULL;
+}
 
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
+void *hashtable_get_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                           size_t hash) {
+    void *iter = hashtable_iter_at_hashed(hashtable, key, key_len, hash);
+    return iter ? hashtable_iter_value(iter) : NULL;
+}
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if (!pair)
-        return NULL;
+int hashtable_del(hashtable_t *hashtable, const char *key, size_t key_len) {
+    if (hashtable->shape)
+        return shared_del(hashtable, shared_find(hashtable, key, key_len, NULL));
+
+    if (!hashtable->slots)
+        return small_del(hashtable, key, key_len);
 
-    return pair->value;
+    return hashtable_do_del(hashtable, key, key_len, hash_str(key, key_len));
 }
 
-int hashtable_del(hashtable_t *hashtable, const char *key) {
-    size_t hash = hash_str(key);
-    return hashtable_do_del(hashtable, key, hash);
+int hashtable_del_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                         size_t hash) {
+    if (hashtable->shape)
+        return shared_del(hashtable, shared_find(hashtable, key, key_len, &hash));
+
+    if (!hashtable->slots)
+        return small_del(hashtable, key, key_len);
+
+    return hashtable_do_del(hashtable, key, key_len, hash);
 }
 
 void hashtable_clear(hashtable_t *hashtable) {
-    size_t i;
+    if (hashtable->shape) {
+        shared_clear(hashtable);
+        return;
+    }
 
     hashtable_do_clear(hashtable);
 
-    for (i = 0; i < hashsize(hashtable->order); i++) {
-        hashtable->buckets[i].first = hashtable->buckets[i].last = &hashtable->list;
+    if (hashtable->slots) {
+        memset(hashtable->slots, 0, hashsize(hashtable->order) * sizeof(slot_t));
+        blocks_free(hashtable, hashtable->blocks);
+        hashtable->blocks = NULL;
+    } else if (hashtable->blocks) {
+        blocks_free(hashtable, hashtable->blocks->next);
+        hashtable->blocks->next = NULL;
+        hashtable->blocks->used = 0;
     }
 
-    list_init(&hashtable->list);
-    list_init(&hashtable->ordered_list);
+    hashtable->used = 0;
     hashtable->size = 0;
 }
 
+static void *hashtable_iter_from(hashtable_t *hashtable, size_t index) {
+    if (hashtable->shape) {
+        for (; index < hashtable->used; index++) {
+            if (shared_fields(hashtable)[index].value)
+                return field_to_iter(&shared_fields(hashtable)[index]);
+        }
+        return NULL;
+    }
+
+    if (!hashtable->slots)
+        return small_iter_from(hashtable->blocks, 0);
+
+    for (; index < hashtable->used; index++) {
+        if (hashtable->entries[index])
+            return hashtable->entries[index];
+    }
+    return NULL;
+}
+
 void *hashtable_iter(hashtable_t *hashtable) {
-    return hashtable_iter_next(hashtable, &hashtable->ordered_list);
+    return hashtable_iter_from(hashtable, 0);
 }
 
-void *hashtable_iter_at(hashtable_t *hashtable, const char *key) {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
+void *hashtable_iter_at(hashtable_t *hashtable, const char *key, size_t key_len) {
+    if (hashtable->shape) {
+        field_t *field = shared_find(hashtable, key, key_len, NULL);
+        return field && field->value ? field_to_iter(field) : NULL;
+    }
 
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
+    if (!hashtable->slots)
+        return small_find(hashtable, key, key_len);
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if (!pair)
+    return hashtable_iter_at_hashed(hashtable, key, key_len, hash_str(key, key_len));
+}
+
+void *hashtable_iter_at_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                               size_t hash) {
+    size_t index;
+
+    if (hashtable->shape) {
+        field_t *field = shared_find(hashtable, key, key_len, &hash);
+        return field && field->value ? field_to_iter(field) : NULL;
+    }
+
+    if (!hashtable->slots)
+        return small_find(hashtable, key, key_len);
+
+    index = hashtable_find_slot(hashtable, key, key_len, hash);
+    if (index == NOT_FOUND)
         return NULL;
 
-    return &pair->ordered_list;
+    return hashtable->entries[hashtable->slots[index].entry - 1];
 }
 
 void *hashtable_iter_next(hashtable_t *hashtable, void *iter) {
-    list_t *list = (list_t *)iter;
-    if (list->next == &hashtable->ordered_list)
-        return NULL;
-    return list->next;
+    pair_t *pair = (pair_t *)iter;
+
+    if (hashtable->shape) {
+        /* a pair of the shape, from hashtable_key_to_iter(), has the
+           position of the field as its index */
+        if (iter_is_field(iter))
+            return hashtable_iter_from(
+                hashtable, iter_to_field(iter) - shared_fields(hashtable) + 1);
+        return hashtable_iter_from(hashtable, pair->index + 1);
+    }
+
+    if (!hashtable->slots)
+        return small_iter_next(hashtable, pair);
+
+    return hashtable_iter_from(hashtable, pair->index + 1);
+}
+
+void *hashtable_key_iter(hashtable_t *hashtable, const char *key) {
+    pair_t *pair = hashtable_key_to_iter(key);
+
+    if (hashtable->shape)
+        return field_to_iter(&shared_fields(hashtable)[pair->index]);
+
+    return pair;
 }
 
 void *hashtable_iter_key(void *iter) {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
-    return pair->key;
+    if (iter_is_field(iter))
+        return iter_to_field(iter)->pair->key;
+
+    return ((pair_t *)iter)->key;
+}
+
+size_t hashtable_iter_key_len(void *iter) {
+    if (iter_is_field(iter))
+        return iter_to_field(iter)->pair->key_len;
+
+    return ((pair_t *)iter)->key_len;
 }
 
 void *hashtable_iter_value(void *iter) {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
-    return pair->value;
+    if (iter_is_field(iter))
+        return iter_to_field(iter)->value;
+
+    return ((pair_t *)iter)->value;
 }
 
 void hashtable_iter_set(void *iter, json_t *value) {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
+    json_t **slot;
 
-    json_decref(pair->value);
-    pair->value = value;
+    if (iter_is_field(iter))
+        slot = &iter_to_field(iter)->value;
+    else
+        slot = &((pair_t *)iter)->value;
+
+    json_decref(*slot);
+    *slot = value;
 }
@@ -8,40 +8,76 @@
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
+#ifdef HAVE_CONFIG_H
+#include <jansson_private_config.h>
+#endif
+
 #include "jansson.h"
 #include <stdlib.h>
-
-struct hashtable_list {
-    struct hashtable_list *prev;
-    struct hashtable_list *next;
-};
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
 
 /* "pair" may be a bit confusing a name, but think of it as a
    key-value pair. In this case, it just encodes some extra data,
    too */
 struct hashtable_pair {
-    struct hashtable_list list;
-    struct hashtable_list ordered_list;
-    size_t hash;
+    uint32_t hash;  /* unused while small */
+    uint32_t index; /* position in hashtable->entries, unused while small */
+    size_t key_len;
     json_t *value;
     char key[1];
 };
 
-struct hashtable_bucket {
-    struct hashtable_list *first;
-    struct hashtable_list *last;
+/* A slot of the open addressing index. entry is the position of the
+   pair in hashtable->entries plus one, or 0 for an empty slot. hash
+   holds the low bits of the pair's hash, so that probing doesn't
+   need to touch the pair. */
+struct hashtable_slot {
+    uint32_t entry;
+    uint32_t hash;
+};
+
+/* A field of a table that shares its keys with other tables. pair
+   belongs to the shape, value is NULL if the field was removed. */
+struct hashtable_field {
+    json_t *value;
+    struct hashtable_pair *pair;
+};
+
+/* A block of pairs of a small table, packed back to back after the
+   header. used and capacity count bytes. */
+struct hashtable_block {
+    struct hashtable_block *next;
+    size_t used;
+    size_t capacity;
 };
 
+struct hashtable_shape;
+
+/* Small tables have no slots and no entries. Their pairs are stored in
+   blocks, which are kept as the storage of those pairs once the table
+   is hashed. */
 typedef struct hashtable {
-    size_t size;
-    struct hashtable_bucket *buckets;
-    size_t order; /* hashtable has pow(2, order) buckets */
-    struct hashtable_list list;
-    struct hashtable_list ordered_list;
+    size_t size;     /* number of pairs */
+    size_t used;     /* number of entries in use, including removed ones */
+    size_t capacity; /* number of entries allocated */
+    struct hashtable_pair **entries; /* in insertion order, NULL if removed */
+    struct hashtable_slot *slots;    /* NULL while the table is small */
+    struct hashtable_block *blocks;  /* pairs stored while the table was small */
+    size_t order;                    /* slots has pow(2, order) elements */
+    struct hashtable_shape *shape;   /* shared keys, NULL if the keys are own */
+    const json_allocator_t *allocator; /* NULL for the global functions */
 } hashtable_t;
 
-#define hashtable_key_to_iter(key_)                                                      \
-    (&(container_of(key_, struct hashtable_pair, key)->ordered_list))
+/* The keys shared by tables that were created with the same keys in
+   the same order. keys maps them to the positions of the fields. */
+typedef struct hashtable_shape {
+    volatile size_t refcount;
+    hashtable_t keys;
+} hashtable_shape_t;
+
+#define hashtable_key_to_iter(key_) (container_of(key_, struct hashtable_pair, key))
 
 /**
  * hashtable_init - Initialize a hashtable object
@@ -50,6 +86,8 @@ typedef struct hashtable {
  *
  * Initializes a statically allocated hashtable object. The object
  * should be cleared with hashtable_close when it's no longer used.
+ * Its memory comes from the global functions unless
+ * hashtable->allocator is set while the table is empty.
  *
  * Returns 0 on success, -1 on error (out of memory).
  */
@@ -69,7 +107,7 @@ void hashtable_close(hashtable_t *hashtable);
  *
  * @hashtable: The hashtable object
  * @key: The key
- * @serial: For addition order of keys
+ * @key_len: The length of key
  * @value: The value
  *
  * If a value with the given key already exists, its value is replaced
@@ -79,27 +117,75 @@ void hashtable_close(hashtable_t *hashtable);
  *
  * Returns 0 on success, -1 on failure (out of memory).
  */
-int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value);
+int hashtable_set(hashtable_t *hashtable, const char *key, size_t key_len,
+                  json_t *value);
+
+/**
+ * hashtable_set_hashed - Like hashtable_set(), with a precomputed hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key
+ * @key_len: The length of key
+ * @hash: The hash of key, as returned by hashtable_hash()
+ * @value: The value
+ */
+int hashtable_set_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                         size_t hash, json_t *value);
+
+/**
+ * hashtable_hash - Compute the hash of a key
+ *
+ * @key: The key
+ * @key_len: The length of key
+ *
+ * The result depends on the hashtable seed, so it must not be
+ * computed before the seed is set.
+ */
+size_t hashtable_hash(const char *key, size_t key_len);
 
 /**
  * hashtable_get - Get a value associated with a key
  *
  * @hashtable: The hashtable object
  * @key: The key
+ * @key_len: The length of key
  *
  * Returns value if it is found, or NULL otherwise.
  */
-void *hashtable_get(hashtable_t *hashtable, const char *key);
+void *hashtable_get(hashtable_t *hashtable, const char *key, size_t key_len);
+
+/**
+ * hashtable_get_hashed - Like hashtable_get(), with a precomputed hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key
+ * @key_len: The length of key
+ * @hash: The hash of key, as returned by hashtable_hash()
+ */
+void *hashtable_get_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                           size_t hash);
 
 /**
  * hashtable_del - Remove a value from the hashtable
  *
  * @hashtable: The hashtable object
  * @key: The key
+ * @key_len: The length of key
  *
  * Returns 0 on success, or -1 if the key was not found.
  */
-int hashtable_del(hashtable_t *hashtable, const char *key);
+int hashtable_del(hashtable_t *hashtable, const char *key, size_t key_len);
+
+/**
+ * hashtable_del_hashed - Like hashtable_del(), with a precomputed hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key
+ * @key_len: The length of key
+ * @hash: The hash of key, as returned by hashtable_hash()
+ */
+int hashtable_del_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                         size_t hash);
 
 /**
  * hashtable_clear - Clear hashtable
@@ -117,11 +203,11 @@ void hashtable_clear(hashtable_t *hashtable);
  *
  * Returns an opaque iterator to the first element in the hashtable.
  * The iterator should be passed to hashtable_iter_* functions.
- * The hashtable items are not iterated over in any particular order.
+ * The hashtable items are iterated over in insertion order.
  *
  * There's no need to free the iterator in any way. The iterator is
  * valid as long as the item that is referenced by the iterator is not
- * deleted. Other values may be added or deleted. In particular,
+ * deleted. Other values may be deleted. In particular,
  * hashtable_iter_next() may be called on an iterator, and after that
  * the key/value pair pointed by the old iterator may be deleted.
  */
@@ -132,11 +218,23 @@ void *hashtable_iter(hashtable_t *hashtable);
  *
  * @hashtable: The hashtable object
  * @key: The key that the iterator should point to
+ * @key_len: The length of key
  *
  * Like hashtable_iter() but returns an iterator pointing to a
  * specific key.
  */
-void *hashtable_iter_at(hashtable_t *hashtable, const char *key);
+void *hashtable_iter_at(hashtable_t *hashtable, const char *key, size_t key_len);
+
+/**
+ * hashtable_iter_at_hashed - Like hashtable_iter_at(), with a precomputed hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key that the iterator should point to
+ * @key_len: The length of key
+ * @hash: The hash of key, as returned by hashtable_hash()
+ */
+void *hashtable_iter_at_hashed(hashtable_t *hashtable, const char *key, size_t key_len,
+                               size_t hash);
 
 /**
  * hashtable_iter_next - Advance an iterator
@@ -156,6 +254,13 @@ void *hashtable_iter_next(hashtable_t *hashtable, void *iter);
  */
 void *hashtable_iter_key(void *iter);
 
+/**
+ * hashtable_iter_key_len - Retrieve the key length pointed by an iterator
+ *
+ * @iter: The iterator
+ */
+size_t hashtable_iter_key_len(void *iter);
+
 /**
  * hashtable_iter_value - Retrieve the value pointed by an iterator
  *
@@ -171,4 +276,59 @@ void *hashtable_iter_value(void *iter);
  */
 void hashtable_iter_set(void *iter, json_t *value);
 
+/**
+ * hashtable_key_iter - Retrieve the iterator of a key
+ *
+ * @hashtable: The hashtable object
+ * @key: A key returned by hashtable_iter_key()
+ *
+ * Unlike hashtable_key_to_iter(), the iterator can be used to get the
+ * value of the key when the hashtable shares its keys.
+ */
+void *hashtable_key_iter(hashtable_t *hashtable, const char *key);
+
+/**
+ * hashtable_shape - Get the shape of the keys of a hashtable
+ *
+ * @hashtable: The hashtable object
+ *
+ * Returns a new reference to the shape of the hashtable or NULL on
+ * error (out of memory). The shape should be released with
+ * hashtable_shape_decref().
+ */
+hashtable_shape_t *hashtable_shape(hashtable_t *hashtable);
+
+/**
+ * hashtable_shape_decref - Release a reference to a shape
+ *
+ * @shape: The shape, may be NULL
+ */
+void hashtable_shape_decref(hashtable_shape_t *shape);
+
+/**
+ * hashtable_same_keys - Compare the keys of two hashtables
+ *
+ * @hashtable1: The first hashtable object
+ * @hashtable2: The second hashtable object
+ *
+ * Returns 1 if the hashtables have the same keys in the same order,
+ * 0 otherwise.
+ */
+int hashtable_same_keys(hashtable_t *hashtable1, hashtable_t *hashtable2);
+
+/**
+ * hashtable_share - Make a hashtable share the keys of a shape
+ *
+ * @hashtable: The hashtable object
+ * @shape: A shape with the same keys as the hashtable
+ *
+ * The hashtable keeps its values but stores them by the positions of
+ * the shape's keys. Adding a key gives the hashtable keys of its own
+ * again.
+ *
+ * Returns 0 on success, -1 on error (out of memory or the keys
+ * differ).
+ */
+int hashtable_share(hashtable_t *hashtable, hashtable_shape_t *shape);
+
 #endif
@@ -34,8 +34,10 @@ extern "C" {
      (JANSSON_MICRO_VERSION << 0))
 
 /* If __atomic or __sync builtins are available the library is thread
- * safe for all read-only functions plus reference counting. */
-#if JSON_HAVE_ATOMIC_BUILTINS || JSON_HAVE_SYNC_BUILTINS
+ * safe for all read-only functions plus reference counting, unless it
+ * was built with single threaded reference counts. */
+#if (JSON_HAVE_ATOMIC_BUILTINS || JSON_HAVE_SYNC_BUILTINS) &&                           \
+    !JSON_SINGLE_THREADED_REFCOUNT
 #define JANSSON_THREAD_SAFE_REFCOUNT 1
 #endif
 
@@ -58,11 +60,25 @@ typedef enum {
     JSON_NULL
 } json_type;
 
+/* flags is private to the library. type and flags share the space of
+   the json_type that type used to be, so json_t keeps its size. */
 typedef struct json_t {
-    json_type type;
+    unsigned short type;
+    unsigned short flags;
+#if JSON_COMPACT_NODES
+    volatile unsigned int refcount;
+#else
     volatile size_t refcount;
+#endif
 } json_t;
 
+/* the reference count of values that are never freed, like true */
+#if JSON_COMPACT_NODES
+#define JSON_REFCOUNT_IMMORTAL ((unsigned int)-1)
+#else
+#define JSON_REFCOUNT_IMMORTAL ((size_t)-1)
+#endif
+
 #ifndef JANSSON_USING_CMAKE /* disabled if using cmake */
 #if JSON_INTEGER_IS_LONG_LONG
 #ifdef _WIN32
@@ -77,7 +93,7 @@ typedef long json_int_t;
 #endif /* JSON_INTEGER_IS_LONG_LONG */
 #endif
 
-#define json_typeof(json)     ((json)->type)
+#define json_typeof(json)     ((json_type)(json)->type)
 #define json_is_object(json)  ((json) && json_typeof(json) == JSON_OBJECT)
 #define json_is_array(json)   ((json) && json_typeof(json) == JSON_ARRAY)
 #define json_is_string(json)  ((json) && json_typeof(json) == JSON_STRING)
@@ -94,11 +110,13 @@ typedef long json_int_t;
 
 json_t *json_object(void);
 json_t *json_array(void);
+json_t *json_packed_array(json_type type);
 json_t *json_string(const char *value);
 json_t *json_stringn(const char *value, size_t len);
 json_t *json_string_nocheck(const char *value);
 json_t *json_stringn_nocheck(const char *value, size_t len);
 json_t *json_integer(json_int_t value);
+json_t *json_integer_shared(json_int_t value);
 json_t *json_real(double value);
 json_t *json_true(void);
 json_t *json_false(void);
@@ -106,7 +124,10 @@ json_t *json_false(void);
 json_t *json_null(void);
 
 /* do not call JSON_INTERNAL_INCREF or JSON_INTERNAL_DECREF directly */
-#if JSON_HAVE_ATOMIC_BUILTINS
+#if JSON_SINGLE_THREADED_REFCOUNT
+#define JSON_INTERNAL_INCREF(json) (++json->refcount)
+#define JSON_INTERNAL_DECREF(json) (--json->refcount)
+#elif JSON_HAVE_ATOMIC_BUILTINS
 #define JSON_INTERNAL_INCREF(json)                                                       \
     __atomic_add_fetch(&json->refcount, 1, __ATOMIC_ACQUIRE)
 #define JSON_INTERNAL_DECREF(json)                                                       \
@@ -120,7 +141,7 @@ json_t *json_null(void);
 #endif
 
 static JSON_INLINE json_t *json_incref(json_t *json) {
-    if (json && json->refcount != (size_t)-1)
+    if (json && json->refcount != JSON_REFCOUNT_IMMORTAL)
         JSON_INTERNAL_INCREF(json);
     return json;
 }
@@ -129,7 +150,8 @@ static JSON_INLINE json_t *json_incref(json_t *json) {
 void json_delete(json_t *json);
 
 static JSON_INLINE void json_decref(json_t *json) {
-    if (json && json->refcount != (size_t)-1 && JSON_INTERNAL_DECREF(json) == 0)
+    if (json && json->refcount != JSON_REFCOUNT_IMMORTAL &&
+        JSON_INTERNAL_DECREF(json) == 0)
         json_delete(json);
 }
 
@@ -188,9 +210,15 @@ void json_object_seed(size_t seed);
 size_t json_object_size(const json_t *object);
 json_t *json_object_get(const json_t *object, const char *key)
     JANSSON_ATTRS((warn_unused_result));
+json_t *json_object_getn(const json_t *object, const char *key, size_t key_len)
+    JANSSON_ATTRS((warn_unused_result));
 int json_object_set_new(json_t *object, const char *key, json_t *value);
+int json_object_setn_new(json_t *object, const char *key, size_t key_len, json_t *value);
 int json_object_set_new_nocheck(json_t *object, const char *key, json_t *value);
+int json_object_setn_new_nocheck(json_t *object, const char *key, size_t key_len,
+                                 json_t *value);
 int json_object_del(json_t *object, const char *key);
+int json_object_deln(json_t *object, const char *key, size_t key_len);
 int json_object_clear(json_t *object);
 int json_object_update(json_t *object, json_t *other);
 int json_object_update_existing(json_t *object, json_t *other);
@@ -199,23 +227,25 @@ int json_object_update_recursive(json_t *object, json_t *other);
 void *json_object_iter(json_t *object);
 void *json_object_iter_at(json_t *object, const char *key);
 void *json_object_key_to_iter(const char *key);
+void *json_object_key_iter(json_t *object, const char *key);
 void *json_object_iter_next(json_t *object, void *iter);
 const char *json_object_iter_key(void *iter);
+size_t json_object_iter_key_len(void *iter);
 json_t *json_object_iter_value(void *iter);
 int json_object_iter_set_new(json_t *object, void *iter, json_t *value);
 
 #define json_object_foreach(object, key, value)                                          \
     for (key = json_object_iter_key(json_object_iter(object));                           \
-         key && (value = json_object_iter_value(json_object_key_to_iter(key)));          \
+         key && (value = json_object_iter_value(json_object_key_iter(object, key)));     \
          key = json_object_iter_key(                                                     \
-             json_object_iter_next(object, json_object_key_to_iter(key))))
+             json_object_iter_next(object, json_object_key_iter(object, key))))
 
 #define json_object_foreach_safe(object, n, key, value)                                  \
     for (key = json_object_iter_key(json_object_iter(object)),                           \
-        n = json_object_iter_next(object, json_object_key_to_iter(key));                 \
-         key && (value = json_object_iter_value(json_object_key_to_iter(key)));          \
+        n = json_object_iter_next(object, json_object_key_iter(object, key));            \
+         key && (value = json_object_iter_value(json_object_key_iter(object, key)));     \
          key = json_object_iter_key(n),                                                  \
-        n = json_object_iter_next(object, json_object_key_to_iter(key)))
+        n = json_object_iter_next(object, json_object_key_iter(object, key)))
 
 #define json_array_foreach(array, index, value)                                          \
     for (index = 0;                                                                      \
@@ -226,11 +256,21 @@ static JSON_INLINE int json_object_set(json_t *object, const char *key, json_t *
     return json_object_set_new(object, key, json_incref(value));
 }
 
+static JSON_INLINE int json_object_setn(json_t *object, const char *key, size_t key_len,
+                                        json_t *value) {
+    return json_object_setn_new(object, key, key_len, json_incref(value));
+}
+
 static JSON_INLINE int json_object_set_nocheck(json_t *object, const char *key,
                                                json_t *value) {
     return json_object_set_new_nocheck(object, key, json_incref(value));
 }
 
+static JSON_INLINE int json_object_setn_nocheck(json_t *object, const char *key,
+                                                size_t key_len, json_t *value) {
+    return json_object_setn_new_nocheck(object, key, key_len, json_incref(value));
+}
+
 static JSON_INLINE int json_object_iter_set(json_t *object, void *iter, json_t *value) {
     return json_object_iter_set_new(object, iter, json_incref(value));
 }
@@ -253,6 +293,38 @@ static JSON_INLINE int json_object_update_missing_new(json_t *object, json_t *ot
     return ret;
 }
 
+/* prehashed keys */
+
+typedef struct json_key_t json_key_t;
+
+json_key_t *json_key(const char *key) JANSSON_ATTRS((warn_unused_result));
+json_key_t *json_keyn(const char *key, size_t len) JANSSON_ATTRS((warn_unused_result));
+void json_key_free(json_key_t *key);
+const char *json_key_value(const json_key_t *key);
+size_t json_key_length(const json_key_t *key);
+
+json_t *json_object_get_by_key(const json_t *object, const json_key_t *key)
+    JANSSON_ATTRS((warn_unused_result));
+int json_object_set_by_key_new(json_t *object, const json_key_t *key, json_t *value);
+int json_object_del_by_key(json_t *object, const json_key_t *key);
+
+static JSON_INLINE int json_object_set_by_key(json_t *object, const json_key_t *key,
+                                              json_t *value) {
+    return json_object_set_by_key_new(object, key, json_incref(value));
+}
+
+/* integer keys */
+
+json_t *json_object_get_by_int(const json_t *object, json_int_t key)
+    JANSSON_ATTRS((warn_unused_result));
+int json_object_set_by_int_new(json_t *object, json_int_t key, json_t *value);
+int json_object_del_by_int(json_t *object, json_int_t key);
+
+static JSON_INLINE int json_object_set_by_int(json_t *object, json_int_t key,
+                                              json_t *value) {
+    return json_object_set_by_int_new(object, key, json_incref(value));
+}
+
 size_t json_array_size(const json_t *array);
 json_t *json_array_get(const json_t *array, size_t index)
     JANSSON_ATTRS((warn_unused_result));
@@ -262,6 +334,27 @@ int json_array_insert_new(json_t *array, size_t index, json_t *value);
 int json_array_remove(json_t *array, size_t index);
 int json_array_clear(json_t *array);
 int json_array_extend(json_t *array, json_t *other);
+int json_array_reserve(json_t *array, size_t size);
+int json_array_shrink_to_fit(json_t *array);
+const json_int_t *json_array_integers(const json_t *array);
+const double *json_array_reals(const json_t *array);
+
+typedef struct json_stats_t {
+    size_t count;
+    double sum;
+    double min;
+    double max;
+} json_stats_t;
+
+int json_array_stats(const json_t *array, json_stats_t *stats);
+
+typedef struct json_columnar_t json_columnar_t;
+
+json_columnar_t *json_columnar(const json_t *array) JANSSON_ATTRS((warn_unused_result));
+void json_columnar_free(json_columnar_t *columnar);
+size_t json_columnar_rows(const json_columnar_t *columnar);
+json_t *json_columnar_column(const json_columnar_t *columnar, const char *key);
+json_t *json_columnar_columns(const json_columnar_t *columnar);
 
 static JSON_INLINE int json_array_set(json_t *array, size_t ind, json_t *value) {
     return json_array_set_new(array, ind, json_incref(value));
@@ -288,6 +381,39 @@ int json_string_setn_nocheck(json_t *string, const char *value, size_t len);
 int json_integer_set(json_t *integer, json_int_t value);
 int json_real_set(json_t *real, double value);
 
+/* JSON pointers */
+
+json_t *json_pointer_get(const json_t *json, const char *pointer)
+    JANSSON_ATTRS((warn_unused_result));
+json_t *json_pointer_getn(const json_t *json, const char *pointer, size_t len)
+    JANSSON_ATTRS((warn_unused_result));
+int json_pointer_set_new(json_t *json, const char *pointer, json_t *value);
+
+static JSON_INLINE int json_pointer_set(json_t *json, const char *pointer,
+                                        json_t *value) {
+    return json_pointer_set_new(json, pointer, json_incref(value));
+}
+
+/* JSONPath queries */
+
+typedef struct json_query_t json_query_t;
+typedef int (*json_query_callback_t)(json_t *value, void *data);
+
+json_query_t *json_query(const char *path, json_error_t *error)
+    JANSSON_ATTRS((warn_unused_result));
+void json_query_free(json_query_t *query);
+json_t *json_query_select(const json_query_t *query, json_t *json)
+    JANSSON_ATTRS((warn_unused_result));
+int json_query_callback(const json_query_t *query, json_t *json,
+                        json_query_callback_t callback, void *data);
+
+/* JSON patches */
+
+json_t *json_diff(const json_t *json1, const json_t *json2)
+    JANSSON_ATTRS((warn_unused_result));
+int json_patch_apply(json_t *json, const json_t *patch);
+int json_object_merge_patch(json_t *object, const json_t *patch);
+
 /* pack, unpack */
 
 json_t *json_pack(const char *fmt, ...) JANSSON_ATTRS((warn_unused_result));
@@ -314,19 +440,58 @@ json_t *json_vsprintf(const char *fmt, va_list ap)
 /* equality */
 
 int json_equal(const json_t *value1, const json_t *value2);
+json_int_t json_hash(const json_t *value);
 
 /* copying */
 
 json_t *json_copy(json_t *value) JANSSON_ATTRS((warn_unused_result));
+json_t *json_cow_copy(json_t *value) JANSSON_ATTRS((warn_unused_result));
 json_t *json_deep_copy(const json_t *value) JANSSON_ATTRS((warn_unused_result));
 
+/* persistent values */
+
+typedef struct json_persistent_t json_persistent_t;
+
+json_persistent_t *json_persistent(const json_t *json)
+    JANSSON_ATTRS((warn_unused_result));
+json_t *json_persistent_value(const json_persistent_t *persistent)
+    JANSSON_ATTRS((warn_unused_result));
+json_persistent_t *json_persistent_incref(json_persistent_t *persistent);
+void json_persistent_decref(json_persistent_t *persistent);
+json_type json_persistent_type(const json_persistent_t *persistent);
+size_t json_persistent_size(const json_persistent_t *persistent);
+json_persistent_t *json_persistent_get(const json_persistent_t *object, const char *key);
+json_persistent_t *json_persistent_getn(const json_persistent_t *object, const char *key,
+                                        size_t key_len);
+json_persistent_t *json_persistent_set(const json_persistent_t *object, const char *key,
+                                       json_persistent_t *value)
+    JANSSON_ATTRS((warn_unused_result));
+json_persistent_t *json_persistent_setn(const json_persistent_t *object, const char *key,
+                                        size_t key_len, json_persistent_t *value)
+    JANSSON_ATTRS((warn_unused_result));
+json_persistent_t *json_persistent_del(const json_persistent_t *object, const char *key)
+    JANSSON_ATTRS((warn_unused_result));
+json_persistent_t *json_persistent_array_get(const json_persistent_t *array,
+                                             size_t index);
+json_persistent_t *json_persistent_array_set(const json_persistent_t *array,
+                                             size_t index, json_persistent_t *value)
+    JANSSON_ATTRS((warn_unused_result));
+json_persistent_t *json_persistent_array_append(const json_persistent_t *array,
+                                                json_persistent_t *value)
+    JANSSON_ATTRS((warn_unused_result));
+json_persistent_t *json_persistent_array_pop(const json_persistent_t *array)
+    JANSSON_ATTRS((warn_unused_result));
+
 /* decoding */
 
-#define JSON_REJECT_DUPLICATES  0x1
-#define JSON_DISABLE_EOF_CHECK  0x2
-#define JSON_DECODE_ANY         0x4
-#define JSON_DECODE_INT_AS_REAL 0x8
-#define JSON_ALLOW_NUL          0x10
+#define JSON_REJECT_DUPLICATES    0x1
+#define JSON_DISABLE_EOF_CHECK    0x2
+#define JSON_DECODE_ANY           0x4
+#define JSON_DECODE_INT_AS_REAL   0x8
+#define JSON_ALLOW_NUL            0x10
+#define JSON_DECODE_SHARED_INTS   0x20
+#define JSON_DECODE_PACKED_ARRAYS 0x40
+#define JSON_DECODE_SHARED_KEYS   0x80
 
 typedef size_t (*json_load_callback_t)(void *buffer, size_t buflen, void *data);
 
@@ -355,6 +520,9 @@ json_t *json_load_callback(json_load_callback_t callback, void *data, size_t fla
 #define JSON_ESCAPE_SLASH      0x400
 #define JSON_REAL_PRECISION(n) (((n)&0x1F) << 11)
 #define JSON_EMBED             0x10000
+#define JSON_PARALLEL          0x20000
+#define JSON_ATOMIC_FILE       0x40000
+#define JSON_FSYNC             0x80000
 
 typedef int (*json_dump_callback_t)(const char *buffer, size_t size, void *data);
 
@@ -366,13 +534,74 @@ int json_dump_file(const json_t *json, const char *path, size_t flags);
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data,
                        size_t flags);
 
+/* binary encoding (CBOR) */
+
+json_t *json_loadb_cbor(const char *buffer, size_t buflen, size_t flags,
+                        json_error_t *error) JANSSON_ATTRS((warn_unused_result));
+json_t *json_load_file_cbor(const char *path, size_t flags, json_error_t *error)
+    JANSSON_ATTRS((warn_unused_result));
+size_t json_dumpb_cbor(const json_t *json, char *buffer, size_t size, size_t flags);
+int json_dump_file_cbor(const json_t *json, const char *path, size_t flags);
+int json_dump_cbor_callback(const json_t *json, json_dump_callback_t callback, void *data,
+                            size_t flags);
+
+/* streaming encoding */
+
+typedef struct json_writer_t json_writer_t;
+
+json_writer_t *json_writer(size_t flags) JANSSON_ATTRS((warn_unused_result));
+json_writer_t *json_writer_file(FILE *output, size_t flags)
+    JANSSON_ATTRS((warn_unused_result));
+json_writer_t *json_writer_callback(json_dump_callback_t callback, void *data,
+                                    size_t flags) JANSSON_ATTRS((warn_unused_result));
+void json_writer_free(json_writer_t *writer);
+const char *json_writer_result(const json_writer_t *writer, size_t *length);
+int json_writer_done(const json_writer_t *writer);
+
+int json_writer_object_begin(json_writer_t *writer);
+int json_writer_object_end(json_writer_t *writer);
+int json_writer_array_begin(json_writer_t *writer);
+int json_writer_array_end(json_writer_t *writer);
+int json_writer_key(json_writer_t *writer, const char *key);
+int json_writer_keyn(json_writer_t *writer, const char *key, size_t len);
+int json_writer_string(json_writer_t *writer, const char *value);
+int json_writer_stringn(json_writer_t *writer, const char *value, size_t len);
+int json_writer_integer(json_writer_t *writer, json_int_t value);
+int json_writer_real(json_writer_t *writer, double value);
+int json_writer_boolean(json_writer_t *writer, int value);
+int json_writer_null(json_writer_t *writer);
+int json_writer_value(json_writer_t *writer, const json_t *json);
+
 /* custom memory allocation */
 
 typedef void *(*json_malloc_t)(size_t);
 typedef void (*json_free_t)(void *);
+typedef void *(*json_realloc_t)(void *, size_t);
 
 void json_set_alloc_funcs(json_malloc_t malloc_fn, json_free_t free_fn);
 void json_get_alloc_funcs(json_malloc_t *malloc_fn, json_free_t *free_fn);
+void json_set_realloc_func(json_realloc_t realloc_fn);
+void json_get_realloc_func(json_realloc_t *realloc_fn);
+
+/* per-document allocators */
+
+typedef struct json_allocator_t {
+    void *(*malloc_fn)(size_t size, void *data);
+    void *(*realloc_fn)(void *ptr, size_t old_size, size_t new_size, void *data);
+    void (*free_fn)(void *ptr, size_t size, void *data);
+    void *data;
+} json_allocator_t;
+
+json_t *json_object_alloc(const json_allocator_t *allocator);
+json_t *json_array_alloc(const json_allocator_t *allocator);
+json_t *json_stringn_alloc(const char *value, size_t len,
+                           const json_allocator_t *allocator);
+json_t *json_integer_alloc(json_int_t value, const json_allocator_t *allocator);
+json_t *json_real_alloc(double value, const json_allocator_t *allocator);
+json_t *json_loadb_alloc(const char *buffer, size_t buflen, size_t flags,
+                         const json_allocator_t *allocator, json_error_t *error)
+    JANSSON_ATTRS((warn_unused_result));
+const json_allocator_t *json_get_allocator(const json_t *json);
 
 /* runtime version checking */
 
@@ -32,32 +32,82 @@
 #endif
 #endif
 
+/* With JSON_COMPACT_NODES, json_t takes 8 bytes, so integers and reals
+   take 24 */
+
+/* The structural hash of an object or array, cached by json_hash().
+   It is valid while generation matches the generation of the
+   container, see value.c. */
+typedef struct {
+    uint64_t value;
+    uint64_t generation; /* 0 if not computed */
+} jsonp_hash_t;
+
+/* Advanced whenever a value below the object or array that owns it
+   changes. up is the generation of the container that the owner is
+   linked to. */
+typedef struct jsonp_generation {
+    volatile size_t refcount;
+    uint64_t value;
+    struct jsonp_generation *up;
+    const json_allocator_t *allocator;
+} jsonp_generation_t;
+
 typedef struct {
     json_t json;
     hashtable_t hashtable;
+    struct json_int_index *ints; /* NULL until an integer keyed set or delete */
+    int cow;                     /* may be shared with a json_cow_copy() */
+    jsonp_hash_t hash;
+    jsonp_generation_t *up;         /* of the container this was hashed in */
+    jsonp_generation_t *generation; /* NULL until this is hashed */
 } json_object_t;
 
+/* What the table of an array holds. A packed array keeps raw numbers
+   or booleans instead of json_t pointers while all of its values have
+   the same type, and is converted back when that stops being true. */
+typedef enum {
+    JSON_ARRAY_BOXED,
+    JSON_ARRAY_INTEGERS,
+    JSON_ARRAY_REALS,
+    JSON_ARRAY_BOOLEANS
+} json_array_kind;
+
+/* The values are table[head] .. table[head + entries - 1], so that
+   removing and inserting at the front doesn't move the others */
 typedef struct {
     json_t json;
+    json_array_kind kind;
+    int cow; /* may be shared with a json_cow_copy() */
     size_t size;
+    size_t head;
     size_t entries;
-    json_t **table;
+    void *table;
+    jsonp_hash_t hash;
+    jsonp_generation_t *up;         /* of the container this was hashed in */
+    jsonp_generation_t *generation; /* NULL until this is hashed */
 } json_array_t;
 
+/* value points to inline_value unless the string was given a buffer
+   of its own, see string_create() */
 typedef struct {
     json_t json;
     char *value;
     size_t length;
+    jsonp_generation_t *up; /* of the container this was hashed in */
+    char inline_value[1];
 } json_string_t;
 
 typedef struct {
     json_t json;
     double value;
+    jsonp_generation_t *up; /* of the container this was hashed in */
 } json_real_t;
 
 typedef struct {
     json_t json;
     json_int_t value;
+    jsonp_generation_t *up; /* of the container this was hashed in */
 } json_integer_t;
 
 #define json_to_object(json_)  container_of(json_, json_object_t, json)
@@ -69,6 +119,12 @@ typedef struct {
 /* Create a string by taking ownership of an existing buffer */
 json_t *jsonp_stringn_nocheck_own(const char *value, size_t len);
 
+/* Constructors for the loaders. With an allocator, the string is
+   copied and value is freed with jsonp_free(). */
+json_t *jsonp_stringn_nocheck_own_alloc(const char *value, size_t len,
+                                        const json_allocator_t *allocator);
+json_t *jsonp_integer_shared_alloc(json_int_t value, const json_allocator_t *allocator);
+
 /* Error message formatting */
 void jsonp_error_init(json_error_t *error, const char *source);
 void jsonp_error_set_source(json_error_t *error, const char *source);
@@ -84,15 +140,82 @@ int jsonp_dtostr(char *buffer, size_t size, double value, int prec);
 /* Wrappers for custom memory functions */
 void *jsonp_malloc(size_t size) JANSSON_ATTRS((warn_unused_result));
 void jsonp_free(void *ptr);
+void *jsonp_realloc(void *ptr, size_t old_size, size_t new_size)
+    JANSSON_ATTRS((warn_unused_result));
 char *jsonp_strndup(const char *str, size_t length) JANSSON_ATTRS((warn_unused_result));
 char *jsonp_strdup(const char *str) JANSSON_ATTRS((warn_unused_result));
 char *jsonp_strndup(const char *str, size_t len) JANSSON_ATTRS((warn_unused_result));
 
+/* Whether the functions above use the C library's, which are thread
+   safe, rather than ones set by the application */
+int jsonp_alloc_funcs_are_default(void);
+
+/* Wrappers for per-document allocators, NULL for the functions above */
+void *jsonp_allocator_malloc(const json_allocator_t *allocator, size_t size)
+    JANSSON_ATTRS((warn_unused_result));
+void jsonp_allocator_free(const json_allocator_t *allocator, void *ptr, size_t size);
+void *jsonp_allocator_realloc(const json_allocator_t *allocator, void *ptr,
+                              size_t old_size, size_t new_size)
+    JANSSON_ATTRS((warn_unused_result));
+
+/* Packed arrays. jsonp_array_pack() makes an empty array packed for
+   values of the given type, if they can be packed. jsonp_array_peek()
+   reads a value without converting the array: a packed number is
+   written to *scratch, which must outlive the returned value. */
+typedef union {
+    json_integer_t integer;
+    json_real_t real;
+} jsonp_array_scratch_t;
+int jsonp_array_pack(json_t *json, json_type type);
+json_t *jsonp_array_peek(const json_t *json, size_t index,
+                         jsonp_array_scratch_t *scratch);
+
+/* Like json_object_iter(), json_object_iter_next(), json_object_key_iter()
+   and json_object_getn(), but without copying the values shared with a
+   json_cow_copy(), for functions that only read them */
+void *jsonp_object_iter(const json_t *json);
+void *jsonp_object_iter_next(const json_t *json, void *iter);
+void *jsonp_object_key_iter(const json_t *json, const char *key);
+json_t *jsonp_object_getn(const json_t *json, const char *key, size_t key_len);
+
+/* JSON pointers. jsonp_pointer_target() finds the object or array
+   that the last token of a pointer other than "" refers into, and the
+   key or index it refers to. The index may be the size of the array,
+   which "-" refers to. */
+typedef struct {
+    json_t *parent;
+    const char *key;
+    size_t key_len;
+    size_t index;
+    char *buffer;
+} jsonp_pointer_target_t;
+int jsonp_pointer_target(json_t *json, const char *pointer,
+                         jsonp_pointer_target_t *target);
+void jsonp_pointer_target_close(jsonp_pointer_target_t *target);
+
 /* Circular reference check*/
 /* Space for "0x", double the sizeof a pointer for the hex and a terminator. */
 #define LOOP_KEY_LEN (2 + (sizeof(json_t *) * 2) + 1)
 int jsonp_loop_check(hashtable_t *parents, const json_t *json, char *key,
-                     size_t key_size);
+                     size_t key_size, size_t *key_len_out);
+
+/* Decoders share the keys of consecutive objects at the same depth
+   when they are the same, as in an array of records. last holds a
+   reference to the previous object at each depth. */
+#define JSONP_SHAPE_CACHE_DEPTH 16
+typedef struct {
+    json_t *last[JSONP_SHAPE_CACHE_DEPTH];
+} jsonp_shape_cache_t;
+void jsonp_shape_cache_init(jsonp_shape_cache_t *cache);
+void jsonp_shape_cache_close(jsonp_shape_cache_t *cache);
+void jsonp_shape_cache_add(jsonp_shape_cache_t *cache, size_t depth, json_t *object);
+
+/* Buffered, optionally atomic file output shared by the text and
+   binary encoders. mode is passed to fopen(). */
+typedef int (*jsonp_dump_func)(const json_t *json, json_dump_callback_t callback,
+                               void *data, size_t flags);
+int jsonp_dump_file(const json_t *json, const char *path, const char *mode, size_t flags,
+                    jsonp_dump_func dump);
 
 /* Windows compatibility */
 #if defined(_WIN32) || defined(WIN32)
@@ -67,6 +67,8 @@ typedef struct {
     strbuffer_t saved_text;
     size_t flags;
     size_t depth;
+    const json_allocator_t *allocator; /* of the values, NULL for the default */
+    jsonp_shape_cache_t shapes;
     int token;
     union {
         struct {
@@ -645,7 +647,9 @@ static int lex_init(lex_t *lex, get_func get, size_t flags, void *data) {
         return -1;
 
     lex->flags = flags;
+    lex->allocator = NULL;
     lex->token = TOKEN_INVALID;
+    jsonp_shape_cache_init(&lex->shapes);
     return 0;
 }
 
@@ -653,6 +657,7 @@ static void lex_close(lex_t *lex) {
     if (lex->token == TOKEN_STRING)
         lex_free_string(lex);
     strbuffer_close(&lex->saved_text);
+    jsonp_shape_cache_close(&lex->shapes);
 }
 
 /*** parser ***/
@@ -660,7 +665,7 @@ static void lex_close(lex_t *lex) {
 static json_t *parse_value(lex_t *lex, size_t flags, json_error_t *error);
 
 static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error) {
-    json_t *object = json_object();
+    json_t *object = json_object_alloc(lex->allocator);
     if (!object)
         return NULL;
 
@@ -689,7 +694,7 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error) {
         }
 
         if (flags & JSON_REJECT_DUPLICATES) {
-            if (json_object_get(object, key)) {
+            if (json_object_getn(object, key, len)) {
                 jsonp_free(key);
                 error_set(error, lex, json_error_duplicate_key, "duplicate object key");
                 goto error;
@@ -710,7 +715,7 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error) {
             goto error;
         }
 
-        if (json_object_set_new_nocheck(object, key, value)) {
+        if (json_object_setn_new_nocheck(object, key, len, value)) {
             jsonp_free(key);
             goto error;
         }
@@ -729,6 +734,8 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error) {
         goto error;
     }
 
+    if (flags & JSON_DECODE_SHARED_KEYS)
+        jsonp_shape_cache_add(&lex->shapes, lex->depth, object);
     return object;
 
 error:
@@ -737,7 +744,7 @@ error:
 }
 
 static json_t *parse_array(lex_t *lex, size_t flags, json_error_t *error) {
-    json_t *array = json_array();
+    json_t *array = json_array_alloc(lex->allocator);
     if (!array)
         return NULL;
 
@@ -750,6 +757,9 @@ static json_t *parse_array(lex_t *lex, size_t flags, json_error_t *error) {
         if (!elem)
             goto error;
 
+        if ((flags & JSON_DECODE_PACKED_ARRAYS) && !json_array_size(array))
+            jsonp_array_pack(array, json_typeof(elem));
+
         if (json_array_append_new(array, elem)) {
             goto error;
         }
@@ -795,19 +805,22 @@ static json_t *parse_value(lex_t *lex, size_t flags, json_error_t *error) {
                 }
             }
 
-            json = jsonp_stringn_nocheck_own(value, len);
+            json = jsonp_stringn_nocheck_own_alloc(value, len, lex->allocator);
             lex->value.string.val = NULL;
             lex->value.string.len = 0;
             break;
         }
 
         case TOKEN_INTEGER: {
-            json = json_integer(lex->value.integer);
+            if (flags & JSON_DECODE_SHARED_INTS)
+                json = jsonp_integer_shared_alloc(lex->value.integer, lex->allocator);
+            else
+                json = json_integer_alloc(lex->value.integer, lex->allocator);
             break;
         }
 
         case TOKEN_REAL: {
-            json = json_real(lex->value.real);
+            json = json_real_alloc(lex->value.real, lex->allocator);
             break;
         }
 
@@ -941,6 +954,11 @@ static int buffer_get(void *data) {
 }
 
 json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t *error) {
+    return json_loadb_alloc(buffer, buflen, flags, NULL, error);
+}
+
+json_t *json_loadb_alloc(const char *buffer, size_t buflen, size_t flags,
+                         const json_allocator_t *allocator, json_error_t *error) {
     lex_t lex;
     json_t *result;
     buffer_data_t stream_data;
@@ -958,6 +976,7 @@ json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t
 
     if (lex_init(&lex, buffer_get, flags, (void *)&stream_data))
         return NULL;
+    lex.allocator = allocator;
 
     result = parse_json(&lex, flags, error);
 
@@ -19,6 +19,7 @@
 /* memory function pointers */
 static json_malloc_t do_malloc = malloc;
 static json_free_t do_free = free;
+static json_realloc_t do_realloc = realloc;
 
 void *jsonp_malloc(size_t size) {
     if (!size)
@@ -34,6 +35,81 @@ void jsonp_free(void *ptr) {
     (*do_free)(ptr);
 }
 
+void *jsonp_realloc(void *ptr, size_t old_size, size_t new_size) {
+    void *new_ptr;
+
+    if (!new_size) {
+        jsonp_free(ptr);
+        return NULL;
+    }
+
+    if (!ptr)
+        return jsonp_malloc(new_size);
+
+    if (do_realloc)
+        return (*do_realloc)(ptr, new_size);
+
+    new_ptr = jsonp_malloc(new_size);
+    if (!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    jsonp_free(ptr);
+    return new_ptr;
+}
+
+/* A NULL allocator stands for the global functions above. The sizes
+   passed to the allocator are the ones that were allocated. */
+
+void *jsonp_allocator_malloc(const json_allocator_t *allocator, size_t size) {
+    if (!allocator)
+        return jsonp_malloc(size);
+
+    if (!size)
+        return NULL;
+
+    return allocator->malloc_fn(size, allocator->data);
+}
+
+void jsonp_allocator_free(const json_allocator_t *allocator, void *ptr, size_t size) {
+    if (!allocator) {
+        jsonp_free(ptr);
+        return;
+    }
+
+    if (!ptr)
+        return;
+
+    allocator->free_fn(ptr, size, allocator->data);
+}
+
+void *jsonp_allocator_realloc(const json_allocator_t *allocator, void *ptr,
+                              size_t old_size, size_t new_size) {
+    void *new_ptr;
+
+    if (!allocator)
+        return jsonp_realloc(ptr, old_size, new_size);
+
+    if (!new_size) {
+        jsonp_allocator_free(allocator, ptr, old_size);
+        return NULL;
+    }
+
+    if (!ptr)
+        return jsonp_allocator_malloc(allocator, new_size);
+
+    if (allocator->realloc_fn)
+        return allocator->realloc_fn(ptr, old_size, new_size, allocator->data);
+
+    new_ptr = jsonp_allocator_malloc(allocator, new_size);
+    if (!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    jsonp_allocator_free(allocator, ptr, old_size);
+    return new_ptr;
+}
+
 char *jsonp_strdup(const char *str) { return jsonp_strndup(str, strlen(str)); }
 
 char *jsonp_strndup(const char *str, size_t len) {
@@ -51,6 +127,20 @@ char *jsonp_strndup(const char *str, size_t len) {
 void json_set_alloc_funcs(json_malloc_t malloc_fn, json_free_t free_fn) {
     do_malloc = malloc_fn;
     do_free = free_fn;
+
+    /* realloc() can't resize blocks of other allocators */
+    do_realloc = (malloc_fn == malloc && free_fn == free) ? realloc : NULL;
+}
+
+void json_set_realloc_func(json_realloc_t realloc_fn) { do_realloc = realloc_fn; }
+
+void json_get_realloc_func(json_realloc_t *realloc_fn) {
+    if (realloc_fn)
+        *realloc_fn = do_realloc;
+}
+
+int jsonp_alloc_funcs_are_default(void) {
+    return do_malloc == malloc && do_free == free && do_realloc == realloc;
 }
 
 void json_get_alloc_funcs(json_malloc_t *malloc_fn, json_free_t *free_fn) {
@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "jansson_private.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "jansson.h"
+#include "strbuffer.h"
+
+/* JSON patches (RFC 6902) are arrays of operations on the values JSON
+   pointers refer to, like {"op": "add", "path": "/a/0", "value": 1}.
+   Merge patches (RFC 7396) are objects with the keys to change, in
+   which null removes a key. */
+
+/* The containers being visited, innermost first. A container that is
+   its own ancestor is a circular reference. */
+typedef struct ancestor_t {
+    const json_t *json;
+    const struct ancestor_t *parent;
+} ancestor_t;
+
+static int is_ancestor(const ancestor_t *ancestor, const json_t *json) {
+    for (; ancestor; ancestor = ancestor->parent) {
+        if (ancestor->json == json)
+            return 1;
+    }
+    return 0;
+}
+
+/*** diff ***/
+
+/* The patch being built and the pointer to the values being compared */
+typedef struct {
+    json_t *patch;
+    strbuffer_t path;
+} diff_t;
+
+/* Append a token for key to path, with '~' and '/' escaped */
+static int path_push_key(strbuffer_t *path, const char *key, size_t len) {
+    size_t i, start = 0;
+
+    if (strbuffer_append_byte(path, '/'))
+        return -1;
+
+    for (i = 0; i < len; i++) {
+        if (key[i] != '~' && key[i] != '/')
+            continue;
+
+        if (strbuffer_append_bytes(path, key + start, i - start) ||
+            strbuffer_append_bytes(path, key[i] == '~' ? "~0" : "~1", 2))
+            return -1;
+        start = i + 1;
+    }
+
+    return strbuffer_append_bytes(path, key + start, len - start);
+}
+
+static int path_push_index(strbuffer_t *path, size_t index) {
+    char buffer[32];
+    int len;
+
+    len = snprintf(buffer, sizeof(buffer), "/%" JSON_INTEGER_FORMAT, (json_int_t)index);
+    return strbuffer_append_bytes(path, buffer, (size_t)len);
+}
+
+static void path_pop(strbuffer_t *path, size_t length) {
+    path->length = length;
+    path->value[length] = '\0';
+}
+
+/* Add an operation on the current path to the patch. value is shared
+   with the value being compared to, not copied. */
+static int diff_op(diff_t *diff, const char *name, json_t *value) {
+    json_t *op, *path;
+
+    op = json_object();
+    if (!op)
+        return -1;
+
+    /* packed arrays give numbers that only live as long as scratch */
+    if (json_is_number(value) && value->refcount == JSON_REFCOUNT_IMMORTAL)
+        value = json_copy(value);
+    else
+        json_incref(value);
+
+    path = json_stringn_nocheck(diff->path.value, diff->path.length);
+    if (json_object_set_new_nocheck(op, "op", json_string_nocheck(name)) ||
+        json_object_set_new_nocheck(op, "path", path) ||
+        (value && json_object_set_new_nocheck(op, "value", value))) {
+        json_decref(op);
+        return -1;
+    }
+
+    return json_array_append_new(diff->patch, op);
+}
+
+static int diff_value(diff_t *diff, const json_t *json1, const json_t *json2,
+                      const ancestor_t *parent);
+
+static int diff_object(diff_t *diff, const json_t *json1, const json_t *json2,
+                       const ancestor_t *parent) {
+    size_t length = diff->path.length;
+    ancestor_t self;
+    const char *key;
+    json_t *value;
+    size_t len;
+    void *iter;
+    int ret;
+
+    if (is_ancestor(parent, json1))
+        return -1;
+    self.json = json1;
+    self.parent = parent;
+
+    for (iter = jsonp_object_iter(json1); iter;
+         iter = jsonp_object_iter_next(json1, iter)) {
+        key = json_object_iter_key(iter);
+        len = json_object_iter_key_len(iter);
+        if (path_push_key(&diff->path, key, len))
+            return -1;
+
+        value = jsonp_object_getn(json2, key, len);
+        if (!value)
+            ret = diff_op(diff, "remove", NULL);
+        else
+            ret = diff_value(diff, json_object_iter_value(iter), value, &self);
+
+        path_pop(&diff->path, length);
+        if (ret)
+            return -1;
+    }
+
+    for (iter = jsonp_object_iter(json2); iter;
+         iter = jsonp_object_iter_next(json2, iter)) {
+        key = json_object_iter_key(iter);
+        len = json_object_iter_key_len(iter);
+        if (jsonp_object_getn(json1, key, len))
+            continue;
+
+        if (path_push_key(&diff->path, key, len))
+            return -1;
+        ret = diff_op(diff, "add", json_object_iter_value(iter));
+        path_pop(&diff->path, length);
+        if (ret)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* The elements in common at the start and at the end are skipped, and
+   the rest are compared by position, with the extra elements removed
+   or added. Like this, inserting or removing elements anywhere in an
+   array gives one operation for each of them. */
+static int diff_array(diff_t *diff, const json_t *json1, const json_t *json2,
+                      const ancestor_t *parent) {
+    jsonp_array_scratch_t scratch1, scratch2;
+    size_t length = diff->path.length;
+    size_t size1, size2, start, end1, end2, i;
+    json_t *value1, *value2;
+    ancestor_t self;
+    int ret;
+
+    if (is_ancestor(parent, json1))
+        return -1;
+    self.json = json1;
+    self.parent = parent;
+
+    size1 = json_array_size(json1);
+    size2 = json_array_size(json2);
+
+    /* json_equal() rejects containers by their hashes */
+    for (start = 0; start < size1 && start < size2; start++) {
+        value1 = jsonp_array_peek(json1, start, &scratch1);
+        value2 = jsonp_array_peek(json2, start, &scratch2);
+        if (!json_equal(value1, value2))
+            break;
+    }
+    for (end1 = size1, end2 = size2; end1 > start && end2 > start; end1--, end2--) {
+        value1 = jsonp_array_peek(json1, end1 - 1, &scratch1);
+        value2 = jsonp_array_peek(json2, end2 - 1, &scratch2);
+        if (!json_equal(value1, value2))
+            break;
+    }
+
+    for (i = start; i < end1 && i < end2; i++) {
+        value1 = jsonp_array_peek(json1, i, &scratch1);
+        value2 = jsonp_array_peek(json2, i, &scratch2);
+        if (path_push_index(&diff->path, i))
+            return -1;
+        ret = diff_value(diff, value1, value2, &self);
+        path_pop(&diff->path, length);
+        if (ret)
+            return -1;
+    }
+
+    /* removed from the last, so that the indices stay valid */
+    for (i = end1; i > end2; i--) {
+        if (path_push_index(&diff->path, i - 1))
+            return -1;
+        ret = diff_op(diff, "remove", NULL);
+        path_pop(&diff->path, length);
+        if (ret)
+            return -1;
+    }
+
+    for (i = end1; i < end2; i++) {
+        value2 = jsonp_array_peek(json2, i, &scratch2);
+        if (path_push_index(&diff->path, i))
+            return -1;
+        ret = diff_op(diff, "add", value2);
+        path_pop(&diff->path, length);
+        if (ret)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int diff_value(diff_t *diff, const json_t *json1, const json_t *json2,
+                      const ancestor_t *parent) {
+    /* values shared with a json_cow_copy() are skipped right away */
+    if (json1 == json2)
+        return 0;
+
+    if (json_is_object(json1) && json_is_object(json2))
+        return diff_object(diff, json1, json2, parent);
+    if (json_is_array(json1) && json_is_array(json2))
+        return diff_array(diff, json1, json2, parent);
+
+    if (json_equal(json1, json2))
+        return 0;
+    return diff_op(diff, "replace", (json_t *)json2);
+}
+
+json_t *json_diff(const json_t *json1, const json_t *json2) {
+    diff_t diff;
+
+    if (!json1 || !json2)
+        return NULL;
+
+    diff.patch = json_array();
+    if (!diff.patch)
+        return NULL;
+
+    if (strbuffer_init(&diff.path)) {
+        json_decref(diff.patch);
+        return NULL;
+    }
+
+    if (diff_value(&diff, json1, json2, NULL)) {
+        json_decref(diff.patch);
+        diff.patch = NULL;
+    }
+
+    strbuffer_close(&diff.path);
+    return diff.patch;
+}
+
+/*** apply ***/
+
+/* A member of op that is a pointer, or NULL */
+static const char *op_pointer(const json_t *op, const char *key) {
+    const json_t *value = jsonp_object_getn(op, key, strlen(key));
+    const char *pointer = json_string_value(value);
+
+    /* a null byte would end the pointer early */
+    if (!pointer || strlen(pointer) != json_string_length(value))
+        return NULL;
+    return pointer;
+}
+
+/* Replace the contents of the document, which keeps its type */
+static int patch_root(json_t *json, json_t *value) {
+    int ret = -1;
+
+    if (json == value)
+        ret = 0;
+    else if (json_is_object(json) && json_is_object(value))
+        ret = json_object_clear(json) || json_object_update(json, value) ? -1 : 0;
+    else if (json_is_array(json) && json_is_array(value))
+        ret = json_array_clear(json) || json_array_extend(json, value) ? -1 : 0;
+
+    json_decref(value);
+    return ret;
+}
+
+/* Add or replace the value path refers to. Steals value. */
+static int patch_set(json_t *json, const char *path, json_t *value, int add) {
+    jsonp_pointer_target_t target;
+    json_t *parent;
+    int ret = -1;
+
+    if (!value)
+        return -1;
+    if (!*path)
+        return patch_root(json, value);
+
+    if (jsonp_pointer_target(json, path, &target)) {
+        json_decref(value);
+        return -1;
+    }
+
+    parent = target.parent;
+    if (json_is_object(parent)) {
+        if (add || jsonp_object_getn(parent, target.key, target.key_len))
+            ret = json_object_setn_new(parent, target.key, target.key_len, value);
+        else
+            json_decref(value);
+    } else if (add) {
+        ret = json_array_insert_new(parent, target.index, value);
+    } else {
+        ret = json_array_set_new(parent, target.index, value);
+    }
+
+    jsonp_pointer_target_close(&target);
+    return ret;
+}
+
+static int patch_remove(json_t *json, const char *path) {
+    jsonp_pointer_target_t target;
+    int ret;
+
+    if (jsonp_pointer_target(json, path, &target))
+        return -1;
+
+    if (json_is_object(target.parent))
+        ret = json_object_deln(target.parent, target.key, target.key_len);
+    else
+        ret = json_array_remove(target.parent, target.index);
+
+    jsonp_pointer_target_close(&target);
+    return ret;
+}
+
+static int patch_op(json_t *json, const json_t *op) {
+    const char *name, *path, *from;
+    json_t *value;
+    size_t len;
+
+    name = json_string_value(jsonp_object_getn(op, "op", 2));
+    path = op_pointer(op, "path");
+    if (!name || !path)
+        return -1;
+
+    value = jsonp_object_getn(op, "value", 5);
+    if (!strcmp(name, "add") || !strcmp(name, "replace")) {
+        /* the value stays separate from the patch */
+        return value ? patch_set(json, path, json_cow_copy(value), *name == 'a') : -1;
+    }
+    if (!strcmp(name, "remove"))
+        return patch_remove(json, path);
+    if (!strcmp(name, "test"))
+        return json_equal(json_pointer_get(json, path), value) ? 0 : -1;
+
+    from = op_pointer(op, "from");
+    value = from ? json_pointer_get(json, from) : NULL;
+    if (!value)
+        return -1;
+
+    if (!strcmp(name, "copy"))
+        return patch_set(json, path, json_cow_copy(value), 1);
+
+    if (!strcmp(name, "move")) {
+        if (!strcmp(from, path))
+            return 0;
+
+        /* a value can't be moved into itself */
+        len = strlen(from);
+        if (!strncmp(path, from, len) && path[len] == '/')
+            return -1;
+
+        json_incref(value);
+        if (patch_remove(json, from)) {
+            json_decref(value);
+            return -1;
+        }
+        return patch_set(json, path, value, 1);
+    }
+
+    return -1;
+}
+
+int json_patch_apply(json_t *json, const json_t *patch) {
+    jsonp_array_scratch_t scratch;
+    size_t i;
+
+    if (!json || !json_is_array(patch))
+        return -1;
+
+    for (i = 0; i < json_array_size(patch); i++) {
+        if (patch_op(json, jsonp_array_peek(patch, i, &scratch)))
+            return -1;
+    }
+
+    return 0;
+}
+
+/*** merge patch ***/
+
+/* Set a number or string to value in place, if it has the same type
+   and nothing else refers to it */
+static int merge_scalar(json_t *json, const json_t *value) {
+    if (json_typeof(json) != json_typeof(value))
+        return -1;
+    if (json_equal(json, value))
+        return 0;
+    if (json->refcount != 1)
+        return -1;
+
+    switch (json_typeof(json)) {
+        case JSON_STRING:
+            return json_string_setn_nocheck(json, json_string_value(value),
+                                            json_string_length(value));
+        case JSON_INTEGER:
+            return json_integer_set(json, json_integer_value(value));
+        case JSON_REAL:
+            return json_real_set(json, json_real_value(value));
+        default:
+            return -1;
+    }
+}
+
+/* parent holds the objects of the patch being iterated. Merging into
+   one of them would change it under its iterator. */
+static int merge_object(json_t *object, const json_t *patch, const ancestor_t *parent) {
+    json_t *value, *target;
+    ancestor_t self;
+    const char *key;
+    size_t len;
+    void *iter;
+
+    self.json = patch;
+    self.parent = parent;
+    if (is_ancestor(parent, patch) || is_ancestor(&self, object))
+        return -1;
+
+    for (iter = jsonp_object_iter(patch); iter;
+         iter = jsonp_object_iter_next(patch, iter)) {
+        key = json_object_iter_key(iter);
+        len = json_object_iter_key_len(iter);
+        value = json_object_iter_value(iter);
+
+        if (json_is_null(value)) {
+            json_object_deln(object, key, len);
+            continue;
+        }
+
+        target = json_object_getn(object, key, len);
+        if (target == value)
+            continue;
+
+        /* a new object is built so that the nulls in value are left out */
+        if (json_is_object(value)) {
+            if (!json_is_object(target)) {
+                target = json_object();
+                if (json_object_setn_new_nocheck(object, key, len, target))
+                    return -1;
+            }
+            if (merge_object(target, value, &self))
+                return -1;
+        } else if (!target || merge_scalar(target, value)) {
+            if (json_object_setn_nocheck(object, key, len, value))
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int json_object_merge_patch(json_t *object, const json_t *patch) {
+    if (!json_is_object(object) || !json_is_object(patch))
+        return -1;
+
+    return merge_object(object, patch, NULL);
+}
@@ -0,0 +1,906 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <jansson_private_config.h>
+#endif
+
+#include "jansson_private.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "hashtable.h"
+#include "jansson.h"
+#include "utf.h"
+
+/* Objects are hash array mapped tries and arrays are radix trees, both
+   with 32 way nodes. A new version copies the nodes on the path to the
+   change and shares all the others with the old one. Scalars are
+   plain json_t values, shared with the values they were converted
+   from, so a json_persistent_t of a scalar is its json_t. */
+
+#define BITS  5
+#define WIDTH (1 << BITS)
+#define MASK  (WIDTH - 1)
+
+/* Hashes are cut to 32 bits. Keys whose hashes are equal share a
+   collision node below the last level. */
+#define HASH_BITS 32
+
+extern volatile uint32_t hashtable_seed;
+
+struct json_persistent_t {
+    json_t json;        /* JSON_OBJECT or JSON_ARRAY */
+    size_t size;        /* pairs or values */
+    size_t next;        /* objects: the order of the next new key */
+    unsigned int shift; /* arrays: BITS times the levels above the leaves */
+    void *root;         /* NULL if empty */
+};
+
+/* A key and its value. Immutable, so versions share them. Keys are
+   converted back in order. */
+typedef struct {
+    volatile size_t refcount;
+    size_t order;
+    uint32_t hash;
+    json_persistent_t *value;
+    size_t key_len;
+    char key[1];
+} entry_t;
+
+/* datamap has a bit for each 5 bit chunk of the hash that has an entry
+   in this node, nodemap one for each that has a child node. slots holds
+   the entries in bit order, then the children. A collision node has
+   neither bitmap and only entries. */
+typedef struct {
+    volatile size_t refcount;
+    uint32_t datamap;
+    uint32_t nodemap;
+    size_t count;
+    void *slots[1];
+} map_node_t;
+
+/* Leaves hold values, the other nodes hold nodes. Unused slots are
+   NULL. */
+typedef struct {
+    volatile size_t refcount;
+    void *slots[WIDTH];
+} vector_node_t;
+
+#define is_container(json) (json_is_object(json) || json_is_array(json))
+#define is_collision(node) (!(node)->datamap && !(node)->nodemap)
+
+static unsigned int popcount(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/* The position of bit among the bits set in map */
+#define bit_index(map, bit) popcount((map) & ((bit)-1))
+#define chunk_bit(hash, shift) ((uint32_t)1 << (((hash) >> (shift)) & MASK))
+#define entries_of(node) (is_collision(node) ? (node)->count : popcount((node)->datamap))
+
+/*** reference counting ***/
+
+static void persistent_delete(json_persistent_t *persistent);
+
+json_persistent_t *json_persistent_incref(json_persistent_t *persistent) {
+    if (persistent)
+        json_incref(&persistent->json);
+    return persistent;
+}
+
+void json_persistent_decref(json_persistent_t *persistent) {
+    json_t *json;
+
+    if (!persistent)
+        return;
+
+    json = &persistent->json;
+    if (!is_container(json))
+        json_decref(json);
+    else if (JSON_INTERNAL_DECREF(json) == 0)
+        persistent_delete(persistent);
+}
+
+static entry_t *entry_incref(entry_t *entry) {
+    JSON_INTERNAL_INCREF(entry);
+    return entry;
+}
+
+static void entry_decref(entry_t *entry) {
+    if (JSON_INTERNAL_DECREF(entry) == 0) {
+        json_persistent_decref(entry->value);
+        jsonp_free(entry);
+    }
+}
+
+static map_node_t *map_node_incref(map_node_t *node) {
+    JSON_INTERNAL_INCREF(node);
+    return node;
+}
+
+static void map_node_decref(map_node_t *node) {
+    size_t i, entries;
+
+    if (!node || JSON_INTERNAL_DECREF(node) != 0)
+        return;
+
+    entries = entries_of(node);
+    for (i = 0; i < node->count; i++) {
+        if (i < entries)
+            entry_decref(node->slots[i]);
+        else
+            map_node_decref(node->slots[i]);
+    }
+    jsonp_free(node);
+}
+
+static void vector_node_decref(vector_node_t *node, unsigned int shift) {
+    size_t i;
+
+    if (!node || JSON_INTERNAL_DECREF(node) != 0)
+        return;
+
+    for (i = 0; i < WIDTH; i++) {
+        if (shift)
+            vector_node_decref(node->slots[i], shift - BITS);
+        else
+            json_persistent_decref(node->slots[i]);
+    }
+    jsonp_free(node);
+}
+
+static void persistent_delete(json_persistent_t *persistent) {
+    if (json_is_object(&persistent->json))
+        map_node_decref(persistent->root);
+    else
+        vector_node_decref(persistent->root, persistent->shift);
+    jsonp_free(persistent);
+}
+
+/* Steals root, which is released on error */
+static json_persistent_t *persistent_new(json_type type, size_t size, size_t next,
+                                         unsigned int shift, void *root) {
+    json_persistent_t *persistent = jsonp_malloc(sizeof(json_persistent_t));
+
+    if (!persistent) {
+        if (type == JSON_OBJECT)
+            map_node_decref(root);
+        else
+            vector_node_decref(root, shift);
+        return NULL;
+    }
+
+    persistent->json.type = type;
+    persistent->json.flags = 0;
+    persistent->json.refcount = 1;
+    persistent->size = size;
+    persistent->next = next;
+    persistent->shift = shift;
+    persistent->root = root;
+    return persistent;
+}
+
+/*** objects ***/
+
+static uint32_t key_hash(const char *key, size_t key_len) {
+    /* the hash depends on the seed, so it must be chosen first */
+    if (!hashtable_seed)
+        json_object_seed(0);
+
+    return (uint32_t)hashtable_hash(key, key_len);
+}
+
+static int entry_has_key(const entry_t *entry, const char *key, size_t key_len) {
+    return entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0;
+}
+
+/* Takes a reference to value */
+static entry_t *entry_new(const char *key, size_t key_len, uint32_t hash, size_t order,
+                          json_persistent_t *value) {
+    entry_t *entry;
+
+    if (key_len >= (size_t)-1 - offsetof(entry_t, key))
+        return NULL;
+
+    entry = jsonp_malloc(offsetof(entry_t, key) + key_len + 1);
+    if (!entry)
+        return NULL;
+
+    entry->refcount = 1;
+    entry->order = order;
+    entry->hash = hash;
+    entry->value = json_persistent_incref(value);
+    entry->key_len = key_len;
+    memcpy(entry->key, key, key_len);
+    entry->key[key_len] = '\0';
+    return entry;
+}
+
+static map_node_t *map_node_new(uint32_t datamap, uint32_t nodemap, size_t count) {
+    map_node_t *node = jsonp_malloc(offsetof(map_node_t, slots) + count * sizeof(void *));
+    if (!node)
+        return NULL;
+
+    node->refcount = 1;
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->count = count;
+    return node;
+}
+
+/* Copy count slots of node from position from to position to of copy,
+   taking references to them */
+static void map_node_share(map_node_t *copy, size_t to, const map_node_t *node,
+                           size_t from, size_t count) {
+    size_t entries = entries_of(node), i;
+
+    for (i = 0; i < count; i++) {
+        void *slot = node->slots[from + i];
+
+        if (from + i < entries)
+            entry_incref(slot);
+        else
+            map_node_incref(slot);
+        copy->slots[to + i] = slot;
+    }
+}
+
+/* A copy of node with slot i replaced by the new reference slot */
+static map_node_t *map_node_replace(const map_node_t *node, size_t i, void *slot) {
+    map_node_t *copy = map_node_new(node->datamap, node->nodemap, node->count);
+    if (!copy)
+        return NULL;
+
+    map_node_share(copy, 0, node, 0, i);
+    copy->slots[i] = slot;
+    map_node_share(copy, i + 1, node, i + 1, node->count - i - 1);
+    return copy;
+}
+
+/* A node holding the two entries, which differ below shift */
+static map_node_t *map_merge(entry_t *entry1, entry_t *entry2, unsigned int shift) {
+    uint32_t bit1, bit2;
+    map_node_t *node, *child;
+
+    if (shift >= HASH_BITS) {
+        node = map_node_new(0, 0, 2);
+        if (!node)
+            return NULL;
+        node->slots[0] = entry_incref(entry1);
+        node->slots[1] = entry_incref(entry2);
+        return node;
+    }
+
+    bit1 = chunk_bit(entry1->hash, shift);
+    bit2 = chunk_bit(entry2->hash, shift);
+    if (bit1 != bit2) {
+        node = map_node_new(bit1 | bit2, 0, 2);
+        if (!node)
+            return NULL;
+        node->slots[bit1 < bit2 ? 0 : 1] = entry_incref(entry1);
+        node->slots[bit1 < bit2 ? 1 : 0] = entry_incref(entry2);
+        return node;
+    }
+
+    child = map_merge(entry1, entry2, shift + BITS);
+    if (!child)
+        return NULL;
+
+    node = map_node_new(0, bit1, 1);
+    if (!node) {
+        map_node_decref(child);
+        return NULL;
+    }
+    node->slots[0] = child;
+    return node;
+}
+
+static entry_t *map_find(const map_node_t *node, uint32_t hash, const char *key,
+                         size_t key_len) {
+    unsigned int shift = 0;
+    uint32_t bit;
+    size_t i;
+
+    while (node) {
+        if (is_collision(node)) {
+            for (i = 0; i < node->count; i++) {
+                if (entry_has_key(node->slots[i], key, key_len))
+                    return node->slots[i];
+            }
+            return NULL;
+        }
+
+        bit = chunk_bit(hash, shift);
+        if (node->datamap & bit) {
+            entry_t *entry = node->slots[bit_index(node->datamap, bit)];
+            return entry_has_key(entry, key, key_len) ? entry : NULL;
+        }
+        if (!(node->nodemap & bit))
+            return NULL;
+
+        node = node->slots[popcount(node->datamap) + bit_index(node->nodemap, bit)];
+        shift += BITS;
+    }
+
+    return NULL;
+}
+
+/* A copy of node with entry added, or replacing the entry with the same
+   key, in which case *replaced is set */
+static map_node_t *map_set(const map_node_t *node, unsigned int shift, entry_t *entry,
+                           int *replaced) {
+    size_t entries, i, j;
+    map_node_t *copy, *child;
+    uint32_t bit;
+
+    if (!node) {
+        copy = map_node_new(chunk_bit(entry->hash, shift), 0, 1);
+        if (copy)
+            copy->slots[0] = entry_incref(entry);
+        return copy;
+    }
+
+    if (is_collision(node)) {
+        for (i = 0; i < node->count; i++) {
+            if (entry_has_key(node->slots[i], entry->key, entry->key_len)) {
+                *replaced = 1;
+                return map_node_replace(node, i, entry_incref(entry));
+            }
+        }
+
+        copy = map_node_new(0, 0, node->count + 1);
+        if (!copy)
+            return NULL;
+        map_node_share(copy, 0, node, 0, node->count);
+        copy->slots[node->count] = entry_incref(entry);
+        return copy;
+    }
+
+    entries = popcount(node->datamap);
+    bit = chunk_bit(entry->hash, shift);
+
+    if (node->nodemap & bit) {
+        j = entries + bit_index(node->nodemap, bit);
+        child = map_set(node->slots[j], shift + BITS, entry, replaced);
+        if (!child)
+            return NULL;
+
+        copy = map_node_replace(node, j, child);
+        if (!copy)
+            map_node_decref(child);
+        return copy;
+    }
+
+    i = bit_index(node->datamap, bit);
+    if (!(node->datamap & bit)) {
+        copy = map_node_new(node->datamap | bit, node->nodemap, node->count + 1);
+        if (!copy)
+            return NULL;
+
+        map_node_share(copy, 0, node, 0, i);
+        copy->slots[i] = entry_incref(entry);
+        map_node_share(copy, i + 1, node, i, node->count - i);
+        return copy;
+    }
+
+    if (entry_has_key(node->slots[i], entry->key, entry->key_len)) {
+        *replaced = 1;
+        return map_node_replace(node, i, entry_incref(entry));
+    }
+
+    /* another key in the same chunk: both move to a new child */
+    child = map_merge(node->slots[i], entry, shift + BITS);
+    if (!child)
+        return NULL;
+
+    copy = map_node_new(node->datamap ^ bit, node->nodemap | bit, node->count);
+    if (!copy) {
+        map_node_decref(child);
+        return NULL;
+    }
+
+    j = entries - 1 + bit_index(node->nodemap, bit);
+    map_node_share(copy, 0, node, 0, i);
+    map_node_share(copy, i, node, i + 1, j - i);
+    copy->slots[j] = child;
+    map_node_share(copy, j + 1, node, j + 1, node->count - j - 1);
+    return copy;
+}
+
+/* Set *result to a copy of node without key, NULL if that leaves it
+   empty. Returns 1 if key was found, 0 if not and -1 on error. */
+static int map_del(const map_node_t *node, unsigned int shift, uint32_t hash,
+                   const char *key, size_t key_len, map_node_t **result) {
+    size_t entries, i, j;
+    map_node_t *copy, *child;
+    uint32_t bit = 0;
+    int found;
+
+    if (is_collision(node)) {
+        for (i = 0; i < node->count; i++) {
+            if (entry_has_key(node->slots[i], key, key_len))
+                break;
+        }
+        if (i == node->count)
+            return 0;
+    } else {
+        bit = chunk_bit(hash, shift);
+        entries = popcount(node->datamap);
+
+        if (node->nodemap & bit) {
+            j = entries + bit_index(node->nodemap, bit);
+            found = map_del(node->slots[j], shift + BITS, hash, key, key_len, &child);
+            if (found <= 0)
+                return found;
+
+            if (child->count > 1 || entries_of(child) == 0) {
+                *result = map_node_replace(node, j, child);
+                if (!*result) {
+                    map_node_decref(child);
+                    return -1;
+                }
+                return 1;
+            }
+
+            /* a child that is left with one entry is merged into this node */
+            copy = map_node_new(node->datamap | bit, node->nodemap ^ bit, node->count);
+            if (!copy) {
+                map_node_decref(child);
+                return -1;
+            }
+
+            i = bit_index(node->datamap, bit);
+            map_node_share(copy, 0, node, 0, i);
+            copy->slots[i] = entry_incref(child->slots[0]);
+            map_node_share(copy, i + 1, node, i, j - i);
+            map_node_share(copy, j + 1, node, j + 1, node->count - j - 1);
+            map_node_decref(child);
+
+            *result = copy;
+            return 1;
+        }
+
+        if (!(node->datamap & bit))
+            return 0;
+
+        i = bit_index(node->datamap, bit);
+        if (!entry_has_key(node->slots[i], key, key_len))
+            return 0;
+    }
+
+    if (node->count == 1) {
+        *result = NULL;
+        return 1;
+    }
+
+    copy = map_node_new(is_collision(node) ? 0 : node->datamap ^ bit, node->nodemap,
+                        node->count - 1);
+    if (!copy)
+        return -1;
+
+    map_node_share(copy, 0, node, 0, i);
+    map_node_share(copy, i, node, i + 1, node->count - i - 1);
+    *result = copy;
+    return 1;
+}
+
+/* Add the entries of node to entries, in no particular order */
+static size_t map_collect(const map_node_t *node, entry_t **entries, size_t count) {
+    size_t i, data;
+
+    if (!node)
+        return count;
+
+    data = entries_of(node);
+    for (i = 0; i < node->count; i++) {
+        if (i < data)
+            entries[count++] = node->slots[i];
+        else
+            count = map_collect(node->slots[i], entries, count);
+    }
+    return count;
+}
+
+static int compare_order(const void *entry1, const void *entry2) {
+    size_t order1 = (*(entry_t *const *)entry1)->order;
+    size_t order2 = (*(entry_t *const *)entry2)->order;
+
+    return order1 < order2 ? -1 : order1 > order2;
+}
+
+/*** arrays ***/
+
+static vector_node_t *vector_node_copy(const vector_node_t *node, unsigned int shift) {
+    vector_node_t *copy = jsonp_malloc(sizeof(vector_node_t));
+    size_t i;
+
+    if (!copy)
+        return NULL;
+
+    copy->refcount = 1;
+    for (i = 0; i < WIDTH; i++) {
+        copy->slots[i] = node ? node->slots[i] : NULL;
+        if (!copy->slots[i])
+            continue;
+
+        if (shift)
+            JSON_INTERNAL_INCREF(((vector_node_t *)copy->slots[i]));
+        else
+            json_persistent_incref(copy->slots[i]);
+    }
+    return copy;
+}
+
+static json_persistent_t *vector_find(const json_persistent_t *array, size_t index) {
+    const vector_node_t *node = array->root;
+    unsigned int shift;
+
+    for (shift = array->shift; shift > 0; shift -= BITS)
+        node = node->slots[(index >> shift) & MASK];
+
+    return node->slots[index & MASK];
+}
+
+/* A copy of node with value at index, creating the nodes on the way */
+static vector_node_t *vector_set(const vector_node_t *node, unsigned int shift,
+                                 size_t index, json_persistent_t *value) {
+    size_t i = (index >> shift) & MASK;
+    vector_node_t *copy, *child;
+
+    copy = vector_node_copy(node, shift);
+    if (!copy)
+        return NULL;
+
+    if (!shift) {
+        json_persistent_decref(copy->slots[i]);
+        copy->slots[i] = json_persistent_incref(value);
+        return copy;
+    }
+
+    child = vector_set(copy->slots[i], shift - BITS, index, value);
+    if (!child) {
+        vector_node_decref(copy, shift);
+        return NULL;
+    }
+
+    vector_node_decref(copy->slots[i], shift - BITS);
+    copy->slots[i] = child;
+    return copy;
+}
+
+/* Set *result to a copy of node without the value at index, which is
+   the last one, or NULL if that leaves it empty */
+static int vector_pop(const vector_node_t *node, unsigned int shift, size_t index,
+                      vector_node_t **result) {
+    size_t i = (index >> shift) & MASK;
+    vector_node_t *child = NULL, *copy;
+
+    if (shift && vector_pop(node->slots[i], shift - BITS, index, &child))
+        return -1;
+
+    if (i == 0 && !child) {
+        *result = NULL;
+        return 0;
+    }
+
+    copy = vector_node_copy(node, shift);
+    if (!copy) {
+        vector_node_decref(child, shift - BITS);
+        return -1;
+    }
+
+    if (shift)
+        vector_node_decref(copy->slots[i], shift - BITS);
+    else
+        json_persistent_decref(copy->slots[i]);
+    copy->slots[i] = child;
+
+    *result = copy;
+    return 0;
+}
+
+/*** conversion ***/
+
+static json_persistent_t *do_persistent(const json_t *json, hashtable_t *parents);
+
+static json_persistent_t *persistent_object(const json_t *object, hashtable_t *parents) {
+    json_persistent_t *result, *value, *next;
+    void *iter;
+
+    result = persistent_new(JSON_OBJECT, 0, 0, 0, NULL);
+    for (iter = jsonp_object_iter(object); iter && result;
+         iter = jsonp_object_iter_next(object, iter)) {
+        value = do_persistent(json_object_iter_value(iter), parents);
+        if (!value) {
+            json_persistent_decref(result);
+            return NULL;
+        }
+
+        next = json_persistent_setn(result, json_object_iter_key(iter),
+                                    json_object_iter_key_len(iter), value);
+        json_persistent_decref(value);
+        json_persistent_decref(result);
+        result = next;
+    }
+    return result;
+}
+
+static json_persistent_t *persistent_array(const json_t *array, hashtable_t *parents) {
+    json_persistent_t *result, *value, *next;
+    size_t i;
+
+    result = persistent_new(JSON_ARRAY, 0, 0, 0, NULL);
+    for (i = 0; i < json_array_size(array) && result; i++) {
+        jsonp_array_scratch_t scratch;
+
+        value = do_persistent(jsonp_array_peek(array, i, &scratch), parents);
+        if (!value) {
+            json_persistent_decref(result);
+            return NULL;
+        }
+
+        next = json_persistent_array_append(result, value);
+        json_persistent_decref(value);
+        json_persistent_decref(result);
+        result = next;
+    }
+    return result;
+}
+
+static json_persistent_t *do_persistent(const json_t *json, hashtable_t *parents) {
+    json_persistent_t *result;
+    char loop_key[LOOP_KEY_LEN];
+    size_t loop_key_len;
+
+    if (!is_container(json)) {
+        /* packed arrays give numbers that only live as long as scratch */
+        if (json_is_number(json) && json->refcount == JSON_REFCOUNT_IMMORTAL)
+            return (json_persistent_t *)json_copy((json_t *)json);
+        return (json_persistent_t *)json_incref((json_t *)json);
+    }
+
+    if (jsonp_loop_check(parents, json, loop_key, sizeof(loop_key), &loop_key_len))
+        return NULL;
+
+    if (json_is_object(json))
+        result = persistent_object(json, parents);
+    else
+        result = persistent_array(json, parents);
+
+    hashtable_del(parents, loop_key, loop_key_len);
+    return result;
+}
+
+json_persistent_t *json_persistent(const json_t *json) {
+    json_persistent_t *result;
+    hashtable_t parents_set;
+
+    if (!json)
+        return NULL;
+
+    if (hashtable_init(&parents_set))
+        return NULL;
+    result = do_persistent(json, &parents_set);
+    hashtable_close(&parents_set);
+
+    return result;
+}
+
+json_t *json_persistent_value(const json_persistent_t *persistent) {
+    entry_t **entries;
+    json_t *result;
+    size_t i;
+
+    if (!persistent)
+        return NULL;
+
+    if (!is_container(&persistent->json))
+        return json_incref((json_t *)&persistent->json);
+
+    if (json_is_array(&persistent->json)) {
+        result = json_array();
+        if (!result || json_array_reserve(result, persistent->size))
+            goto error;
+
+        for (i = 0; i < persistent->size; i++) {
+            if (json_array_append_new(result,
+                                      json_persistent_value(vector_find(persistent, i))))
+                goto error;
+        }
+        return result;
+    }
+
+    result = json_object();
+    if (!result || !persistent->size)
+        return result;
+
+    entries = jsonp_malloc(persistent->size * sizeof(entry_t *));
+    if (!entries)
+        goto error;
+
+    map_collect(persistent->root, entries, 0);
+    qsort(entries, persistent->size, sizeof(entry_t *), compare_order);
+
+    for (i = 0; i < persistent->size; i++) {
+        if (json_object_setn_new_nocheck(result, entries[i]->key, entries[i]->key_len,
+                                         json_persistent_value(entries[i]->value))) {
+            jsonp_free(entries);
+            goto error;
+        }
+    }
+
+    jsonp_free(entries);
+    return result;
+
+error:
+    json_decref(result);
+    return NULL;
+}
+
+/*** access ***/
+
+json_type json_persistent_type(const json_persistent_t *persistent) {
+    return persistent ? json_typeof(&persistent->json) : JSON_NULL;
+}
+
+size_t json_persistent_size(const json_persistent_t *persistent) {
+    if (!persistent || !is_container(&persistent->json))
+        return 0;
+
+    return persistent->size;
+}
+
+json_persistent_t *json_persistent_get(const json_persistent_t *object, const char *key) {
+    if (!key)
+        return NULL;
+
+    return json_persistent_getn(object, key, strlen(key));
+}
+
+json_persistent_t *json_persistent_getn(const json_persistent_t *object, const char *key,
+                                        size_t key_len) {
+    entry_t *entry;
+
+    if (!object || !key || !json_is_object(&object->json))
+        return NULL;
+
+    entry = map_find(object->root, key_hash(key, key_len), key, key_len);
+    return entry ? entry->value : NULL;
+}
+
+json_persistent_t *json_persistent_set(const json_persistent_t *object, const char *key,
+                                       json_persistent_t *value) {
+    if (!key)
+        return NULL;
+
+    return json_persistent_setn(object, key, strlen(key), value);
+}
+
+json_persistent_t *json_persistent_setn(const json_persistent_t *object, const char *key,
+                                        size_t key_len, json_persistent_t *value) {
+    entry_t *old, *entry;
+    map_node_t *root;
+    uint32_t hash;
+    int replaced = 0;
+
+    if (!object || !key || !value || !json_is_object(&object->json) ||
+        !utf8_check_string(key, key_len))
+        return NULL;
+
+    /* a key that is set again keeps its place */
+    hash = key_hash(key, key_len);
+    old = map_find(object->root, hash, key, key_len);
+    entry = entry_new(key, key_len, hash, old ? old->order : object->next, value);
+    if (!entry)
+        return NULL;
+
+    root = map_set(object->root, 0, entry, &replaced);
+    entry_decref(entry);
+    if (!root)
+        return NULL;
+
+    return persistent_new(JSON_OBJECT, object->size + !replaced,
+                          object->next + !replaced, 0, root);
+}
+
+json_persistent_t *json_persistent_del(const json_persistent_t *object, const char *key) {
+    map_node_t *root;
+    size_t key_len;
+
+    if (!object || !key || !json_is_object(&object->json) || !object->root)
+        return NULL;
+
+    key_len = strlen(key);
+    if (map_del(object->root, 0, key_hash(key, key_len), key, key_len, &root) <= 0)
+        return NULL;
+
+    return persistent_new(JSON_OBJECT, object->size - 1, object->next, 0, root);
+}
+
+json_persistent_t *json_persistent_array_get(const json_persistent_t *array,
+                                             size_t index) {
+    if (!array || !json_is_array(&array->json) || index >= array->size)
+        return NULL;
+
+    return vector_find(array, index);
+}
+
+json_persistent_t *json_persistent_array_set(const json_persistent_t *array,
+                                             size_t index, json_persistent_t *value) {
+    vector_node_t *root;
+
+    if (!array || !value || !json_is_array(&array->json) || index >= array->size)
+        return NULL;
+
+    root = vector_set(array->root, array->shift, index, value);
+    if (!root)
+        return NULL;
+
+    return persistent_new(JSON_ARRAY, array->size, 0, array->shift, root);
+}
+
+json_persistent_t *json_persistent_array_append(const json_persistent_t *array,
+                                                json_persistent_t *value) {
+    vector_node_t *root, *grown = NULL;
+    unsigned int shift;
+
+    if (!array || !value || !json_is_array(&array->json))
+        return NULL;
+
+    /* a full tree gets a new root above it */
+    shift = array->shift;
+    if (array->root && array->size == (size_t)WIDTH << shift) {
+        grown = vector_node_copy(NULL, shift + BITS);
+        if (!grown)
+            return NULL;
+
+        grown->slots[0] = array->root;
+        JSON_INTERNAL_INCREF(((vector_node_t *)array->root));
+        shift += BITS;
+    }
+
+    root = vector_set(grown ? grown : array->root, shift, array->size, value);
+    vector_node_decref(grown, shift);
+    if (!root)
+        return NULL;
+
+    return persistent_new(JSON_ARRAY, array->size + 1, 0, shift, root);
+}
+
+json_persistent_t *json_persistent_array_pop(const json_persistent_t *array) {
+    vector_node_t *root, *child;
+    unsigned int shift;
+    size_t size;
+
+    if (!array || !json_is_array(&array->json) || !array->size)
+        return NULL;
+
+    size = array->size - 1;
+    if (vector_pop(array->root, array->shift, size, &root))
+        return NULL;
+
+    /* drop the levels that are no longer needed */
+    shift = array->shift;
+    while (root && shift && size <= (size_t)WIDTH << (shift - BITS)) {
+        child = root->slots[0];
+        JSON_INTERNAL_INCREF(child);
+        vector_node_decref(root, shift);
+        root = child;
+        shift -= BITS;
+    }
+
+    return persistent_new(JSON_ARRAY, size, 0, root ? shift : 0, root);
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "jansson_private.h"
+
+#include <string.h>
+
+#include "jansson.h"
+
+/* JSON pointers (RFC 6901) are a '/' before each reference token, which
+   is an object key with '~' escaped as ~0 and '/' as ~1, or an array
+   index. */
+
+/* The key a token refers to: the token itself, or a copy with the
+   escapes replaced that the caller frees. NULL if an escape is bad. */
+static const char *token_key(const char *token, size_t *len) {
+    char *key;
+    size_t i, j;
+
+    if (!memchr(token, '~', *len))
+        return token;
+
+    key = jsonp_malloc(*len);
+    if (!key)
+        return NULL;
+
+    for (i = 0, j = 0; i < *len; i++, j++) {
+        if (token[i] != '~') {
+            key[j] = token[i];
+            continue;
+        }
+        if (i + 1 == *len || (token[i + 1] != '0' && token[i + 1] != '1')) {
+            jsonp_free(key);
+            return NULL;
+        }
+        key[j] = token[++i] == '0' ? '~' : '/';
+    }
+
+    *len = j;
+    return key;
+}
+
+/* Parse an array index, which has no sign or leading zeros */
+static int token_index(const char *token, size_t len, size_t *index) {
+    size_t i;
+
+    if (len == 0 || (len > 1 && token[0] == '0'))
+        return -1;
+
+    *index = 0;
+    for (i = 0; i < len; i++) {
+        if (token[i] < '0' || token[i] > '9' || *index > ((size_t)-1 - 9) / 10)
+            return -1;
+        *index = *index * 10 + (size_t)(token[i] - '0');
+    }
+    return 0;
+}
+
+static json_t *token_get(const json_t *json, const char *token, size_t len) {
+    const char *key;
+    json_t *value;
+    size_t index;
+
+    if (json_is_object(json)) {
+        key = token_key(token, &len);
+        if (!key)
+            return NULL;
+
+        value = json_object_getn(json, key, len);
+        if (key != token)
+            jsonp_free((char *)key);
+        return value;
+    }
+
+    if (json_is_array(json) && !token_index(token, len, &index))
+        return json_array_get(json, index);
+
+    return NULL;
+}
+
+/* The value the part of pointer before end refers to */
+static json_t *pointer_get(const json_t *json, const char *pointer, const char *end) {
+    const char *token, *next;
+
+    if (pointer != end && *pointer != '/')
+        return NULL;
+
+    while (json && pointer != end) {
+        token = pointer + 1;
+        next = memchr(token, '/', (size_t)(end - token));
+        if (!next)
+            next = end;
+
+        json = token_get(json, token, (size_t)(next - token));
+        pointer = next;
+    }
+
+    return (json_t *)json;
+}
+
+json_t *json_pointer_get(const json_t *json, const char *pointer) {
+    if (!json || !pointer)
+        return NULL;
+
+    return pointer_get(json, pointer, pointer + strlen(pointer));
+}
+
+json_t *json_pointer_getn(const json_t *json, const char *pointer, size_t len) {
+    if (!json || !pointer)
+        return NULL;
+
+    return pointer_get(json, pointer, pointer + len);
+}
+
+int jsonp_pointer_target(json_t *json, const char *pointer,
+                         jsonp_pointer_target_t *target) {
+    const char *end, *token;
+    size_t len;
+
+    if (*pointer != '/')
+        return -1;
+
+    end = pointer + strlen(pointer);
+    token = end;
+    while (token[-1] != '/')
+        token--;
+    len = (size_t)(end - token);
+
+    target->parent = pointer_get(json, pointer, token - 1);
+    target->key = NULL;
+    target->buffer = NULL;
+
+    if (json_is_object(target->parent)) {
+        target->key = token_key(token, &len);
+        if (!target->key)
+            return -1;
+
+        if (target->key != token)
+            target->buffer = (char *)target->key;
+        target->key_len = len;
+        return 0;
+    }
+
+    if (json_is_array(target->parent)) {
+        /* "-" is the element after the last one */
+        if (len == 1 && *token == '-')
+            target->index = json_array_size(target->parent);
+        else if (token_index(token, len, &target->index) ||
+                 target->index > json_array_size(target->parent))
+            return -1;
+        return 0;
+    }
+
+    return -1;
+}
+
+void jsonp_pointer_target_close(jsonp_pointer_target_t *target) {
+    jsonp_free(target->buffer);
+}
+
+int json_pointer_set_new(json_t *json, const char *pointer, json_t *value) {
+    jsonp_pointer_target_t target;
+    json_t *parent;
+    int ret;
+
+    if (!value)
+        return -1;
+
+    /* the root can't be replaced */
+    if (!json || !pointer || jsonp_pointer_target(json, pointer, &target)) {
+        json_decref(value);
+        return -1;
+    }
+
+    parent = target.parent;
+    if (json_is_object(parent))
+        ret = json_object_setn_new(parent, target.key, target.key_len, value);
+    else if (target.index == json_array_size(parent))
+        ret = json_array_append_new(parent, value);
+    else
+        ret = json_array_set_new(parent, target.index, value);
+
+    jsonp_pointer_target_close(&target);
+    return ret;
+}
@@ -0,0 +1,901 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "jansson_private.h"
+
+#include <string.h>
+
+#include "jansson.h"
+
+/* A JSONPath query is compiled into a list of steps, each of which
+   selects values from every value the previous step selected. */
+
+typedef enum {
+    STEP_KEY,      /* .name or ['name'] */
+    STEP_WILDCARD, /* .* or [*] */
+    STEP_INDEX,    /* [index] */
+    STEP_SLICE,    /* [start:end:stride] */
+    STEP_FILTER    /* [?(condition)] */
+} step_type_t;
+
+typedef enum { OP_EXISTS, OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE } op_t;
+
+/* A key, or an index if key is NULL, of a path relative to @ */
+typedef struct {
+    char *key;
+    size_t key_len;
+    json_int_t index;
+} segment_t;
+
+/* The value at a path relative to @ compared to a literal. A filter
+   is an || of &&s, and group marks the first comparison of each &&. */
+typedef struct {
+    segment_t *segments;
+    size_t count, size;
+    op_t op;
+    json_t *literal;
+    int group;
+} comparison_t;
+
+typedef struct {
+    step_type_t type;
+    int descendants; /* preceded by .. */
+    json_key_t *key;
+    json_int_t start, end, stride; /* start is the index of STEP_INDEX */
+    int has_start, has_end;
+    comparison_t *comparisons;
+    size_t count, size;
+} step_t;
+
+struct json_query_t {
+    step_t *steps;
+    size_t count, size;
+};
+
+/*** compiling ***/
+
+typedef struct {
+    const char *start;
+    const char *pos;
+    json_error_t *error;
+} scanner_t;
+
+static void set_error(scanner_t *s, enum json_error_code code, const char *msg) {
+    size_t position = (size_t)(s->pos - s->start);
+    jsonp_error_set(s->error, 1, (int)position + 1, position, code, "%s", msg);
+}
+
+/* Make room for one more of the count elements of *array */
+static int grow(void **array, size_t count, size_t *size, size_t elem_size) {
+    void *new_array;
+    size_t new_size;
+
+    if (count < *size)
+        return 0;
+
+    new_size = *size ? *size * 2 : 4;
+    new_array = jsonp_realloc(*array, *size * elem_size, new_size * elem_size);
+    if (!new_array)
+        return -1;
+
+    *array = new_array;
+    *size = new_size;
+    return 0;
+}
+
+static void skip_space(scanner_t *s) {
+    while (*s->pos == ' ' || *s->pos == '\t' || *s->pos == '\n' || *s->pos == '\r')
+        s->pos++;
+}
+
+static int is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || (unsigned char)c >= 0x80;
+}
+
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+
+/* A name after '.', which is returned in place */
+static int parse_name(scanner_t *s, const char **name, size_t *len) {
+    *name = s->pos;
+    while (is_name_char(*s->pos))
+        s->pos++;
+
+    *len = (size_t)(s->pos - *name);
+    if (!*len) {
+        set_error(s, json_error_invalid_syntax, "expected a name");
+        return -1;
+    }
+    return 0;
+}
+
+/* A string in single or double quotes, with backslash escapes for the
+   quotes, the backslash and control characters */
+static char *parse_string(scanner_t *s, size_t *len) {
+    char quote = *s->pos++, *result;
+    const char *start = s->pos;
+    size_t i = 0;
+
+    while (*s->pos != quote) {
+        if (!*s->pos || (*s->pos == '\\' && !*++s->pos)) {
+            set_error(s, json_error_premature_end_of_input, "unterminated string");
+            return NULL;
+        }
+        s->pos++;
+    }
+
+    /* the string is no longer than its escaped form */
+    result = jsonp_malloc((size_t)(s->pos - start) + 1);
+    if (!result) {
+        set_error(s, json_error_out_of_memory, "out of memory");
+        return NULL;
+    }
+
+    for (; start != s->pos; start++) {
+        if (*start != '\\') {
+            result[i++] = *start;
+            continue;
+        }
+
+        switch (*++start) {
+            case 'b':
+                result[i++] = '\b';
+                break;
+            case 'f':
+                result[i++] = '\f';
+                break;
+            case 'n':
+                result[i++] = '\n';
+                break;
+            case 'r':
+                result[i++] = '\r';
+                break;
+            case 't':
+                result[i++] = '\t';
+                break;
+            case '\\':
+            case '/':
+            case '\'':
+            case '"':
+                result[i++] = *start;
+                break;
+            default:
+                s->pos = start;
+                set_error(s, json_error_invalid_syntax, "invalid escape");
+                jsonp_free(result);
+                return NULL;
+        }
+    }
+
+    s->pos++;
+    result[i] = '\0';
+    *len = i;
+    return result;
+}
+
+/* A number, which is decoded like the numbers of a document */
+static json_t *parse_number(scanner_t *s) {
+    const char *start = s->pos;
+    json_t *number;
+
+    if (*s->pos == '-')
+        s->pos++;
+    if (!is_digit(*s->pos)) {
+        set_error(s, json_error_invalid_syntax, "expected a number");
+        return NULL;
+    }
+
+    while (is_digit(*s->pos) || *s->pos == '.' || *s->pos == 'e' || *s->pos == 'E' ||
+           ((*s->pos == '+' || *s->pos == '-') &&
+            (s->pos[-1] == 'e' || s->pos[-1] == 'E')))
+        s->pos++;
+
+    number = json_loadb(start, (size_t)(s->pos - start), JSON_DECODE_ANY, NULL);
+    if (!number) {
+        s->pos = start;
+        set_error(s, json_error_invalid_syntax, "invalid number");
+    }
+    return number;
+}
+
+static int parse_int(scanner_t *s, json_int_t *value) {
+    const char *start = s->pos;
+    json_t *number = parse_number(s);
+
+    if (!number)
+        return -1;
+
+    if (!json_is_integer(number)) {
+        json_decref(number);
+        s->pos = start;
+        set_error(s, json_error_invalid_syntax, "expected an integer");
+        return -1;
+    }
+
+    *value = json_integer_value(number);
+    json_decref(number);
+    return 0;
+}
+
+static int parse_word(scanner_t *s, const char *word) {
+    size_t len = strlen(word);
+
+    if (strncmp(s->pos, word, len) || is_name_char(s->pos[len]))
+        return 0;
+
+    s->pos += len;
+    return 1;
+}
+
+static json_t *parse_literal(scanner_t *s) {
+    json_t *literal;
+    char *string;
+    size_t len;
+
+    if (*s->pos == '\'' || *s->pos == '"') {
+        string = parse_string(s, &len);
+        if (!string)
+            return NULL;
+
+        literal = json_stringn(string, len);
+        jsonp_free(string);
+        if (!literal)
+            set_error(s, json_error_invalid_utf8, "invalid UTF-8 in string");
+        return literal;
+    }
+
+    if (*s->pos == '-' || is_digit(*s->pos))
+        return parse_number(s);
+    if (parse_word(s, "true"))
+        return json_true();
+    if (parse_word(s, "false"))
+        return json_false();
+    if (parse_word(s, "null"))
+        return json_null();
+
+    set_error(s, json_error_invalid_syntax, "expected a value");
+    return NULL;
+}
+
+/* A path relative to @, such as @.stats.kills or @['name'][0] */
+static int parse_relative_path(scanner_t *s, comparison_t *comparison) {
+    segment_t *segment;
+    const char *name;
+
+    if (*s->pos != '@') {
+        set_error(s, json_error_invalid_syntax, "expected '@'");
+        return -1;
+    }
+    s->pos++;
+
+    while (*s->pos == '.' || *s->pos == '[') {
+        if (grow((void **)&comparison->segments, comparison->count, &comparison->size,
+                 sizeof(segment_t))) {
+            set_error(s, json_error_out_of_memory, "out of memory");
+            return -1;
+        }
+        segment = &comparison->segments[comparison->count];
+        memset(segment, 0, sizeof(segment_t));
+
+        if (*s->pos++ == '.') {
+            if (parse_name(s, &name, &segment->key_len))
+                return -1;
+            segment->key = jsonp_strndup(name, segment->key_len);
+            if (!segment->key) {
+                set_error(s, json_error_out_of_memory, "out of memory");
+                return -1;
+            }
+            comparison->count++;
+            continue;
+        }
+
+        skip_space(s);
+        if (*s->pos == '\'' || *s->pos == '"') {
+            segment->key = parse_string(s, &segment->key_len);
+            if (!segment->key)
+                return -1;
+        } else if (parse_int(s, &segment->index))
+            return -1;
+        comparison->count++;
+
+        skip_space(s);
+        if (*s->pos != ']') {
+            set_error(s, json_error_invalid_syntax, "expected ']'");
+            return -1;
+        }
+        s->pos++;
+    }
+
+    return 0;
+}
+
+static int parse_comparison(scanner_t *s, comparison_t *comparison) {
+    static const struct {
+        const char *text;
+        op_t op;
+    } ops[] = {{"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE},
+               {">=", OP_GE}, {"<", OP_LT},  {">", OP_GT}};
+    size_t i;
+
+    skip_space(s);
+    if (parse_relative_path(s, comparison))
+        return -1;
+
+    skip_space(s);
+    comparison->op = OP_EXISTS;
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (!strncmp(s->pos, ops[i].text, strlen(ops[i].text))) {
+            comparison->op = ops[i].op;
+            s->pos += strlen(ops[i].text);
+            break;
+        }
+    }
+    if (comparison->op == OP_EXISTS)
+        return 0;
+
+    skip_space(s);
+    comparison->literal = parse_literal(s);
+    if (!comparison->literal)
+        return -1;
+
+    skip_space(s);
+    return 0;
+}
+
+/* The condition of [?(condition)], or of [?condition] */
+static int parse_filter(scanner_t *s, step_t *step) {
+    comparison_t *comparison;
+    int parens = *s->pos == '(', group = 1;
+
+    if (parens)
+        s->pos++;
+
+    do {
+        if (grow((void **)&step->comparisons, step->count, &step->size,
+                 sizeof(comparison_t))) {
+            set_error(s, json_error_out_of_memory, "out of memory");
+            return -1;
+        }
+        comparison = &step->comparisons[step->count++];
+        memset(comparison, 0, sizeof(comparison_t));
+        comparison->group = group;
+
+        if (parse_comparison(s, comparison))
+            return -1;
+
+        if (s->pos[0] == '&' && s->pos[1] == '&')
+            group = 0;
+        else if (s->pos[0] == '|' && s->pos[1] == '|')
+            group = 1;
+        else
+            break;
+        s->pos += 2;
+    } while (1);
+
+    if (parens) {
+        if (*s->pos != ')') {
+            set_error(s, json_error_invalid_syntax, "expected ')'");
+            return -1;
+        }
+        s->pos++;
+    }
+    return 0;
+}
+
+/* An index or a slice */
+static int parse_slice(scanner_t *s, step_t *step) {
+    json_int_t *bounds[3];
+    int i;
+
+    bounds[0] = &step->start;
+    bounds[1] = &step->end;
+    bounds[2] = &step->stride;
+
+    step->stride = 1;
+    for (i = 0; i < 3; i++) {
+        skip_space(s);
+        if (*s->pos == '-' || is_digit(*s->pos)) {
+            if (parse_int(s, bounds[i]))
+                return -1;
+            step->has_start |= i == 0;
+            step->has_end |= i == 1;
+            skip_space(s);
+        }
+
+        if (*s->pos != ':')
+            break;
+        s->pos++;
+        step->type = STEP_SLICE;
+    }
+
+    if (step->type == STEP_INDEX && !step->has_start) {
+        set_error(s, json_error_invalid_syntax, "expected an index");
+        return -1;
+    }
+    return 0;
+}
+
+/* The selector between '[' and ']' */
+static int parse_bracket(scanner_t *s, step_t *step) {
+    char *key;
+    size_t len;
+
+    skip_space(s);
+    if (*s->pos == '\'' || *s->pos == '"') {
+        key = parse_string(s, &len);
+        if (!key)
+            return -1;
+
+        step->type = STEP_KEY;
+        step->key = json_keyn(key, len);
+        jsonp_free(key);
+        if (!step->key) {
+            set_error(s, json_error_invalid_utf8, "invalid UTF-8 in key");
+            return -1;
+        }
+    } else if (*s->pos == '*') {
+        step->type = STEP_WILDCARD;
+        s->pos++;
+    } else if (*s->pos == '?') {
+        step->type = STEP_FILTER;
+        s->pos++;
+        skip_space(s);
+        if (parse_filter(s, step))
+            return -1;
+    } else {
+        step->type = STEP_INDEX;
+        if (parse_slice(s, step))
+            return -1;
+    }
+
+    skip_space(s);
+    if (*s->pos != ']') {
+        set_error(s, json_error_invalid_syntax, "expected ']'");
+        return -1;
+    }
+    s->pos++;
+    return 0;
+}
+
+static int parse_step(scanner_t *s, step_t *step) {
+    const char *name;
+    size_t len;
+
+    if (*s->pos == '[') {
+        s->pos++;
+        return parse_bracket(s, step);
+    }
+
+    if (*s->pos != '.') {
+        set_error(s, json_error_invalid_syntax, "expected '.' or '['");
+        return -1;
+    }
+    s->pos++;
+
+    if (*s->pos == '.') {
+        step->descendants = 1;
+        s->pos++;
+        if (*s->pos == '[') {
+            s->pos++;
+            return parse_bracket(s, step);
+        }
+    }
+
+    if (*s->pos == '*') {
+        step->type = STEP_WILDCARD;
+        s->pos++;
+        return 0;
+    }
+
+    if (parse_name(s, &name, &len))
+        return -1;
+
+    step->type = STEP_KEY;
+    step->key = json_keyn(name, len);
+    if (!step->key) {
+        set_error(s, json_error_invalid_utf8, "invalid UTF-8 in key");
+        return -1;
+    }
+    return 0;
+}
+
+json_query_t *json_query(const char *path, json_error_t *error) {
+    json_query_t *query;
+    scanner_t s;
+
+    jsonp_error_init(error, "<query>");
+
+    if (!path) {
+        jsonp_error_set(error, -1, -1, 0, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    s.start = s.pos = path;
+    s.error = error;
+
+    if (*s.pos != '$') {
+        set_error(&s, json_error_invalid_syntax, "expected '$'");
+        return NULL;
+    }
+    s.pos++;
+
+    query = jsonp_malloc(sizeof(json_query_t));
+    if (!query) {
+        set_error(&s, json_error_out_of_memory, "out of memory");
+        return NULL;
+    }
+    memset(query, 0, sizeof(json_query_t));
+
+    while (*s.pos) {
+        if (grow((void **)&query->steps, query->count, &query->size, sizeof(step_t))) {
+            set_error(&s, json_error_out_of_memory, "out of memory");
+            goto error;
+        }
+        memset(&query->steps[query->count], 0, sizeof(step_t));
+
+        if (parse_step(&s, &query->steps[query->count++]))
+            goto error;
+    }
+
+    return query;
+
+error:
+    json_query_free(query);
+    return NULL;
+}
+
+void json_query_free(json_query_t *query) {
+    step_t *step;
+    comparison_t *comparison;
+    size_t i, j, k;
+
+    if (!query)
+        return;
+
+    for (i = 0; i < query->count; i++) {
+        step = &query->steps[i];
+        json_key_free(step->key);
+
+        for (j = 0; j < step->count; j++) {
+            comparison = &step->comparisons[j];
+            for (k = 0; k < comparison->count; k++)
+                jsonp_free(comparison->segments[k].key);
+            jsonp_free(comparison->segments);
+            json_decref(comparison->literal);
+        }
+        jsonp_free(step->comparisons);
+    }
+
+    jsonp_free(query->steps);
+    jsonp_free(query);
+}
+
+/*** matching ***/
+
+typedef struct {
+    const json_query_t *query;
+    json_query_callback_t callback;
+    void *data;
+} run_t;
+
+/* The containers whose descendants are being visited, innermost first.
+   A container that is its own ancestor is a circular reference. */
+typedef struct ancestor_t {
+    const json_t *json;
+    const struct ancestor_t *parent;
+} ancestor_t;
+
+static int is_container(const json_t *json) {
+    return json_is_object(json) || json_is_array(json);
+}
+
+/* Negative indices count from the end */
+static json_int_t normalize_index(json_int_t index, size_t size) {
+    return index < 0 ? index + (json_int_t)size : index;
+}
+
+/* A packed number is read into scratch. A container is claimed like
+   json_array_get() does, since it may be handed out. */
+static json_t *array_child(json_t *array, size_t index, jsonp_array_scratch_t *scratch) {
+    json_t *value = jsonp_array_peek(array, index, scratch);
+
+    if (is_container(value))
+        value = json_array_get(array, index);
+    return value;
+}
+
+/* Comparisons only read @, so nothing is claimed */
+static const json_t *relative_get(const comparison_t *comparison, const json_t *json,
+                                  jsonp_array_scratch_t *scratch) {
+    const segment_t *segment;
+    json_int_t index;
+    size_t i;
+
+    for (i = 0; json && i < comparison->count; i++) {
+        segment = &comparison->segments[i];
+        if (segment->key) {
+            json = jsonp_object_getn(json, segment->key, segment->key_len);
+        } else {
+            index = normalize_index(segment->index, json_array_size(json));
+            json = index < 0 ? NULL : jsonp_array_peek(json, (size_t)index, scratch);
+        }
+    }
+
+    return json;
+}
+
+static int compare_values(const json_t *value, const json_t *literal, int *order) {
+    json_int_t i1, i2;
+    double d1, d2;
+    size_t len1, len2;
+    int cmp;
+
+    if (json_is_integer(value) && json_is_integer(literal)) {
+        i1 = json_integer_value(value);
+        i2 = json_integer_value(literal);
+        *order = (i1 > i2) - (i1 < i2);
+        return 1;
+    }
+    if (json_is_number(value) && json_is_number(literal)) {
+        d1 = json_number_value(value);
+        d2 = json_number_value(literal);
+        *order = (d1 > d2) - (d1 < d2);
+        return 1;
+    }
+    if (json_is_string(value) && json_is_string(literal)) {
+        len1 = json_string_length(value);
+        len2 = json_string_length(literal);
+        cmp = memcmp(json_string_value(value), json_string_value(literal),
+                     len1 < len2 ? len1 : len2);
+        *order = cmp ? cmp : (len1 > len2) - (len1 < len2);
+        return 1;
+    }
+
+    /* other values are only equal or not */
+    return 0;
+}
+
+static int comparison_match(const comparison_t *comparison, const json_t *json) {
+    jsonp_array_scratch_t scratch;
+    const json_t *value = relative_get(comparison, json, &scratch);
+    int order;
+
+    if (comparison->op == OP_EXISTS)
+        return value != NULL;
+    if (!value)
+        return comparison->op == OP_NE;
+
+    if (!compare_values(value, comparison->literal, &order)) {
+        if (comparison->op == OP_EQ)
+            return json_equal(value, comparison->literal);
+        if (comparison->op == OP_NE)
+            return !json_equal(value, comparison->literal);
+        return 0;
+    }
+
+    switch (comparison->op) {
+        case OP_EQ:
+            return order == 0;
+        case OP_NE:
+            return order != 0;
+        case OP_LT:
+            return order < 0;
+        case OP_LE:
+            return order <= 0;
+        case OP_GT:
+            return order > 0;
+        default:
+            return order >= 0;
+    }
+}
+
+static int filter_match(const step_t *step, const json_t *json) {
+    int all = 1;
+    size_t i;
+
+    for (i = 0; i < step->count; i++) {
+        if (step->comparisons[i].group && i) {
+            if (all)
+                return 1;
+            all = 1;
+        }
+        if (all && !comparison_match(&step->comparisons[i], json))
+            all = 0;
+    }
+
+    return all;
+}
+
+static int query_step(const run_t *run, size_t i, json_t *json);
+
+static int emit(const run_t *run, json_t *json) {
+    int ret;
+
+    /* packed arrays give numbers that only live as long as scratch */
+    if (json_is_number(json) && json->refcount == JSON_REFCOUNT_IMMORTAL) {
+        json = json_copy(json);
+        if (!json)
+            return -1;
+
+        ret = run->callback(json, run->data);
+        json_decref(json);
+        return ret ? -1 : 0;
+    }
+
+    return run->callback(json, run->data) ? -1 : 0;
+}
+
+/* Select from the values of an object or array, by a filter if given */
+static int select_all(const run_t *run, size_t i, json_t *json, const step_t *filter) {
+    jsonp_array_scratch_t scratch;
+    json_t *value;
+    void *iter;
+    size_t j;
+
+    if (json_is_object(json)) {
+        for (iter = json_object_iter(json); iter;
+             iter = json_object_iter_next(json, iter)) {
+            value = json_object_iter_value(iter);
+            if ((!filter || filter_match(filter, value)) && query_step(run, i, value))
+                return -1;
+        }
+        return 0;
+    }
+
+    for (j = 0; j < json_array_size(json); j++) {
+        value = array_child(json, j, &scratch);
+        if (!value)
+            return -1;
+        if ((!filter || filter_match(filter, value)) && query_step(run, i, value))
+            return -1;
+    }
+    return 0;
+}
+
+static int select_slice(const run_t *run, size_t i, json_t *json, const step_t *step) {
+    jsonp_array_scratch_t scratch;
+    json_int_t size = (json_int_t)json_array_size(json), start, end, j;
+    json_t *value;
+
+    if (!step->stride)
+        return 0;
+
+    /* clamp the bounds like Python does */
+    if (step->stride > 0) {
+        start = step->has_start ? normalize_index(step->start, (size_t)size) : 0;
+        end = step->has_end ? normalize_index(step->end, (size_t)size) : size;
+        start = start < 0 ? 0 : start > size ? size : start;
+        end = end < 0 ? 0 : end > size ? size : end;
+    } else {
+        start = step->has_start ? normalize_index(step->start, (size_t)size) : size - 1;
+        end = step->has_end ? normalize_index(step->end, (size_t)size) : -1;
+        start = start < -1 ? -1 : start >= size ? size - 1 : start;
+        end = end < -1 ? -1 : end >= size ? size - 1 : end;
+    }
+
+    for (j = start; step->stride > 0 ? j < end : j > end; j += step->stride) {
+        value = array_child(json, (size_t)j, &scratch);
+        if (!value || query_step(run, i, value))
+            return -1;
+
+        /* stop before a stride that passes the end can overflow j */
+        if (step->stride > 0 ? step->stride >= end - j : step->stride <= end - j)
+            break;
+    }
+    return 0;
+}
+
+/* Apply step i to json and the rest of the steps to what it selects */
+static int step_select(const run_t *run, size_t i, json_t *json) {
+    const step_t *step = &run->query->steps[i];
+    jsonp_array_scratch_t scratch;
+    json_int_t index;
+    json_t *value;
+
+    switch (step->type) {
+        case STEP_KEY:
+            value = json_object_get_by_key(json, step->key);
+            return value ? query_step(run, i + 1, value) : 0;
+
+        case STEP_WILDCARD:
+            return is_container(json) ? select_all(run, i + 1, json, NULL) : 0;
+
+        case STEP_FILTER:
+            return is_container(json) ? select_all(run, i + 1, json, step) : 0;
+
+        case STEP_INDEX:
+            if (!json_is_array(json))
+                return 0;
+            index = normalize_index(step->start, json_array_size(json));
+            if (index < 0 || (size_t)index >= json_array_size(json))
+                return 0;
+
+            value = array_child(json, (size_t)index, &scratch);
+            return value ? query_step(run, i + 1, value) : -1;
+
+        default:
+            return json_is_array(json) ? select_slice(run, i + 1, json, step) : 0;
+    }
+}
+
+/* Apply step i to json and to each container in it */
+static int step_descend(const run_t *run, size_t i, json_t *json,
+                        const ancestor_t *parent) {
+    jsonp_array_scratch_t scratch;
+    const ancestor_t *ancestor;
+    ancestor_t self;
+    json_t *value;
+    void *iter;
+    size_t j;
+
+    for (ancestor = parent; ancestor; ancestor = ancestor->parent) {
+        if (ancestor->json == json)
+            return -1;
+    }
+
+    if (step_select(run, i, json))
+        return -1;
+
+    self.json = json;
+    self.parent = parent;
+
+    if (json_is_object(json)) {
+        for (iter = json_object_iter(json); iter;
+             iter = json_object_iter_next(json, iter)) {
+            value = json_object_iter_value(iter);
+            if (is_container(value) && step_descend(run, i, value, &self))
+                return -1;
+        }
+    } else if (json_is_array(json)) {
+        for (j = 0; j < json_array_size(json); j++) {
+            value = array_child(json, j, &scratch);
+            if (!value || (is_container(value) && step_descend(run, i, value, &self)))
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int query_step(const run_t *run, size_t i, json_t *json) {
+    if (i == run->query->count)
+        return emit(run, json);
+
+    if (run->query->steps[i].descendants)
+        return step_descend(run, i, json, NULL);
+    return step_select(run, i, json);
+}
+
+int json_query_callback(const json_query_t *query, json_t *json,
+                        json_query_callback_t callback, void *data) {
+    run_t run;
+
+    if (!query || !json || !callback)
+        return -1;
+
+    run.query = query;
+    run.callback = callback;
+    run.data = data;
+    return query_step(&run, 0, json);
+}
+
+static int append_match(json_t *value, void *data) {
+    return json_array_append((json_t *)data, value);
+}
+
+json_t *json_query_select(const json_query_t *query, json_t *json) {
+    json_t *result = json_array();
+
+    if (!result)
+        return NULL;
+
+    if (json_query_callback(query, json, append_match, result)) {
+        json_decref(result);
+        return NULL;
+    }
+    return result;
+}
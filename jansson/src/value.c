@@ -38,27 +38,441 @@ static JSON_INLINE int isinf(double x) { return !isnan(x) && isnan(x - x); }
 #endif
 
 json_t *do_deep_copy(const json_t *json, hashtable_t *parents);
+static int cow_shared(json_t *json);
+static json_t *cow_copy(json_t *json);
 
-static JSON_INLINE void json_init(json_t *json, json_type type) {
+/*** allocation ***/
+
+/* A value created with an allocator is preceded by a header that
+   tells how to free it, and has NODE_ALLOCATOR set in its flags */
+#define NODE_ALLOCATOR 0x1
+
+typedef struct {
+    const json_allocator_t *allocator;
+    size_t size; /* of the allocation, including the header */
+} node_header_t;
+
+#define node_header(json_) ((node_header_t *)(json_)-1)
+
+static void *node_alloc(const json_allocator_t *allocator, size_t size) {
+    node_header_t *header;
+
+    if (!allocator)
+        return jsonp_malloc(size);
+
+    if (size > (size_t)-1 - sizeof(node_header_t))
+        return NULL;
+
+    header = jsonp_allocator_malloc(allocator, sizeof(node_header_t) + size);
+    if (!header)
+        return NULL;
+
+    header->allocator = allocator;
+    header->size = sizeof(node_header_t) + size;
+    return header + 1;
+}
+
+/* json must be the first member of the node */
+static void node_free(json_t *json) {
+    node_header_t *header;
+
+    if (!(json->flags & NODE_ALLOCATOR)) {
+        jsonp_free(json);
+        return;
+    }
+
+    header = node_header(json);
+    jsonp_allocator_free(header->allocator, header, header->size);
+}
+
+static JSON_INLINE void json_init(json_t *json, json_type type,
+                                  const json_allocator_t *allocator) {
     json->type = type;
+    json->flags = allocator ? NODE_ALLOCATOR : 0;
     json->refcount = 1;
 }
 
+const json_allocator_t *json_get_allocator(const json_t *json) {
+    if (!json || !(json->flags & NODE_ALLOCATOR))
+        return NULL;
+
+    return node_header(json)->allocator;
+}
+
 int jsonp_loop_check(hashtable_t *parents, const json_t *json, char *key,
-                     size_t key_size) {
-    snprintf(key, key_size, "%p", json);
-    if (hashtable_get(parents, key))
+                     size_t key_size, size_t *key_len_out) {
+    size_t key_len = snprintf(key, key_size, "%p", json);
+
+    if (key_len_out)
+        *key_len_out = key_len;
+
+    if (hashtable_get(parents, key, key_len))
         return -1;
 
-    return hashtable_set(parents, key, json_null());
+    return hashtable_set(parents, key, key_len, json_null());
+}
+
+/*** hash invalidation ***/
+
+/* The hashes cached by json_hash() are dropped per document. A value
+   that is part of a cached hash links to the generation of the object
+   or array it was hashed in. Changing a value advances the generations
+   above it, and changing an object or array also drops its own hash.
+   The hash of an object or array is valid as long as its generation
+   hasn't advanced since the hash was taken.
+
+   Values are linked when they are hashed. A value can only link to one
+   object or array. One that is stored in several is linked to the
+   first that hashes it, and the others don't cache their hashes while
+   they hold it. Shared integers can't change and aren't linked. */
+
+static jsonp_hash_t *hash_cache(const json_t *json, jsonp_generation_t ***generation) {
+    if (json_is_object(json)) {
+        *generation = &json_to_object(json)->generation;
+        return &json_to_object(json)->hash;
+    }
+    if (json_is_array(json)) {
+        *generation = &json_to_array(json)->generation;
+        return &json_to_array(json)->hash;
+    }
+    *generation = NULL;
+    return NULL;
+}
+
+/* The link of json to the generation above it, NULL for values that
+   can't change */
+static jsonp_generation_t **hash_up(const json_t *json) {
+    if (json->refcount == JSON_REFCOUNT_IMMORTAL)
+        return NULL;
+
+    switch (json_typeof(json)) {
+        case JSON_OBJECT:
+            return &json_to_object(json)->up;
+        case JSON_ARRAY:
+            return &json_to_array(json)->up;
+        case JSON_STRING:
+            return &json_to_string(json)->up;
+        case JSON_INTEGER:
+            return &json_to_integer(json)->up;
+        case JSON_REAL:
+            return &json_to_real(json)->up;
+        default:
+            return NULL;
+    }
+}
+
+static void generation_decref(jsonp_generation_t *generation) {
+    if (generation && JSON_INTERNAL_DECREF(generation) == 0) {
+        generation_decref(generation->up);
+        jsonp_allocator_free(generation->allocator, generation,
+                             sizeof(jsonp_generation_t));
+    }
+}
+
+static jsonp_generation_t *generation_incref(jsonp_generation_t *generation) {
+    if (generation)
+        JSON_INTERNAL_INCREF(generation);
+    return generation;
+}
+
+/* Called when a value is freed. The generation of an object or array
+   lives on while the values linked to it do, but no longer leads up. */
+static void hash_release(json_t *json) {
+    jsonp_generation_t **up = hash_up(json), **generation;
+
+    if (up)
+        generation_decref(*up);
+    if (hash_cache(json, &generation) && *generation) {
+        generation_decref((*generation)->up);
+        (*generation)->up = NULL;
+        generation_decref(*generation);
+    }
+}
+
+/* Return the generation of the object or array json, creating it if
+   needed, or NULL if it can't be allocated */
+static jsonp_generation_t *hash_generation(json_t *json) {
+    jsonp_generation_t **generation;
+
+    hash_cache(json, &generation);
+    if (!*generation) {
+        *generation = jsonp_allocator_malloc(json_get_allocator(json),
+                                             sizeof(jsonp_generation_t));
+        if (!*generation)
+            return NULL;
+
+        (*generation)->refcount = 1;
+        (*generation)->value = 1;
+        (*generation)->up = generation_incref(*hash_up(json));
+        (*generation)->allocator = json_get_allocator(json);
+    }
+    return *generation;
+}
+
+/* Link value to generation, the generation of an object or array that
+   holds it. Return 0 if value is linked to another one that may still
+   hold it. */
+static int hash_link(json_t *value, jsonp_generation_t *generation) {
+    jsonp_generation_t **up = hash_up(value), **value_generation, *above;
+
+    if (!up || *up == generation)
+        return 1;
+
+    /* a value that is only referred to by one container isn't in
+       another any more */
+    if (*up && value->refcount > 1)
+        return 0;
+
+    /* values keep their link when they are removed, so a container
+       that held the one holding value may be stored in value now */
+    if (hash_cache(value, &value_generation) && *value_generation) {
+        for (above = generation; above; above = above->up) {
+            if (above == *value_generation)
+                return 0;
+        }
+    }
+
+    generation_decref(*up);
+    *up = generation_incref(generation);
+    if (value_generation && *value_generation) {
+        generation_decref((*value_generation)->up);
+        (*value_generation)->up = generation_incref(generation);
+    }
+    return 1;
+}
+
+/* Called when a value has changed */
+static void hash_changed(json_t *json) {
+    jsonp_generation_t **up = hash_up(json), **generation, *above;
+    jsonp_hash_t *cache = hash_cache(json, &generation);
+
+    if (cache)
+        cache->generation = 0;
+    for (above = up ? *up : NULL; above; above = above->up)
+        above->value++;
+}
+
+/*** integer key index ***/
+
+/* Keys of this many digits or more are left to the string table, so
+   that parsing a key never overflows */
+#define INT_KEY_BOUND ((json_int_t)(sizeof(json_int_t) >= 8 ? 1e18 : 1e9))
+
+/* Long enough for any json_int_t and a terminating NUL */
+#define INT_KEY_SIZE 24
+
+/* An index from the integers spelled by an object's keys to the
+   values. The string table still owns the values, so dumping and
+   iteration don't know about it. Linear probing in a power of two
+   table that is at most half full; a NULL value is an empty slot. */
+typedef struct {
+    json_int_t key;
+    json_t *value;
+} int_slot_t;
+
+struct json_int_index {
+    size_t size;
+    size_t used;
+    int_slot_t slots[1];
+};
+
+static size_t int_key_hash(json_int_t key) {
+    size_t hash = (size_t)key;
+
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* Write the decimal form of key to buffer, return its length */
+static size_t int_key_format(json_int_t key, char *buffer) {
+    char digits[INT_KEY_SIZE];
+    size_t len = 0, i = 0;
+    int digit;
+
+    if (key < 0)
+        buffer[i++] = '-';
+
+    /* the remainder takes the sign of key, so the most negative value
+       needs no special case */
+    do {
+        digit = (int)(key % 10);
+        digits[len++] = (char)('0' + (digit < 0 ? -digit : digit));
+        key /= 10;
+    } while (key);
+
+    while (len)
+        buffer[i++] = digits[--len];
+    buffer[i] = '\0';
+    return i;
+}
+
+/* Return 1 and store the integer in out if key is the canonical
+   decimal form of an indexed integer: no '+', no leading zeros, no
+   "-0" */
+static int int_key_parse(const char *key, size_t key_len, json_int_t *out) {
+    json_int_t value = 0;
+    size_t i = 0;
+    int negative = key_len && key[0] == '-';
+
+    i = negative;
+    if (i == key_len || (key[i] == '0' && (negative || key_len > 1)))
+        return 0;
+
+    for (; i < key_len; i++) {
+        if (key[i] < '0' || key[i] > '9' || value >= INT_KEY_BOUND / 10)
+            return 0;
+        value = value * 10 + (key[i] - '0');
+    }
+
+    *out = negative ? -value : value;
+    return 1;
+}
+
+static int_slot_t *int_index_find(const struct json_int_index *index, json_int_t key) {
+    size_t mask = index->size - 1;
+    size_t i = int_key_hash(key) & mask;
+
+    while (index->slots[i].value) {
+        if (index->slots[i].key == key)
+            return (int_slot_t *)&index->slots[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+#define int_index_size(size_)                                                           \
+    (offsetof(struct json_int_index, slots) + (size_) * sizeof(int_slot_t))
+
+static struct json_int_index *int_index_new(size_t size,
+                                            const json_allocator_t *allocator) {
+    struct json_int_index *index;
+
+    index = jsonp_allocator_malloc(allocator, int_index_size(size));
+    if (!index)
+        return NULL;
+
+    index->size = size;
+    index->used = 0;
+    memset(index->slots, 0, size * sizeof(int_slot_t));
+    return index;
+}
+
+static void int_index_free(struct json_int_index *index,
+                           const json_allocator_t *allocator) {
+    if (index)
+        jsonp_allocator_free(allocator, index, int_index_size(index->size));
+}
+
+/* Insert or replace key; the index is reallocated when it grows */
+static int int_index_set(struct json_int_index **index_ptr, json_int_t key,
+                         json_t *value, const json_allocator_t *allocator) {
+    struct json_int_index *index = *index_ptr, *grown;
+    int_slot_t *slot;
+    size_t i, mask;
+
+    slot = int_index_find(index, key);
+    if (slot) {
+        slot->value = value;
+        return 0;
+    }
+
+    if ((index->used + 1) * 2 > index->size) {
+        grown = int_index_new(index->size * 2, allocator);
+        if (!grown)
+            return -1;
+
+        for (i = 0; i < index->size; i++) {
+            if (index->slots[i].value)
+                int_index_set(&grown, index->slots[i].key, index->slots[i].value,
+                              allocator);
+        }
+        int_index_free(index, allocator);
+        *index_ptr = index = grown;
+    }
+
+    mask = index->size - 1;
+    i = int_key_hash(key) & mask;
+    while (index->slots[i].value)
+        i = (i + 1) & mask;
+
+    index->slots[i].key = key;
+    index->slots[i].value = value;
+    index->used++;
+    return 0;
+}
+
+static void int_index_del(struct json_int_index *index, json_int_t key) {
+    int_slot_t *slot = int_index_find(index, key);
+    size_t mask = index->size - 1, i, j, home;
+
+    if (!slot)
+        return;
+
+    /* shift the following slots back into the hole unless that would
+       move one before its home slot */
+    i = (size_t)(slot - index->slots);
+    for (j = (i + 1) & mask; index->slots[j].value; j = (j + 1) & mask) {
+        home = int_key_hash(index->slots[j].key) & mask;
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            index->slots[i] = index->slots[j];
+            i = j;
+        }
+    }
+
+    index->slots[i].value = NULL;
+    index->used--;
+}
+
+static void object_drop_index(json_object_t *object) {
+    int_index_free(object->ints, object->hashtable.allocator);
+    object->ints = NULL;
+}
+
+/* Build the index of an object that has none. Failing is not an error,
+   the integer keyed functions fall back to formatting the key. */
+static void object_build_index(json_object_t *object) {
+    json_int_t key;
+    void *iter;
+
+    object->ints = int_index_new(8, object->hashtable.allocator);
+    if (!object->ints)
+        return;
+
+    for (iter = hashtable_iter(&object->hashtable); iter;
+         iter = hashtable_iter_next(&object->hashtable, iter)) {
+        if (int_key_parse(hashtable_iter_key(iter), hashtable_iter_key_len(iter), &key) &&
+            int_index_set(&object->ints, key, hashtable_iter_value(iter),
+                          object->hashtable.allocator)) {
+            object_drop_index(object);
+            return;
+        }
+    }
+}
+
+/* Keep the index, if any, in step with a string keyed set or delete */
+static void object_index_key(json_object_t *object, const char *key, size_t key_len,
+                             json_t *value) {
+    json_int_t int_key;
+
+    if (!object->ints || !int_key_parse(key, key_len, &int_key))
+        return;
+
+    if (!value)
+        int_index_del(object->ints, int_key);
+    else if (int_index_set(&object->ints, int_key, value, object->hashtable.allocator))
+        object_drop_index(object);
 }
 
 /*** object ***/
 
 extern volatile uint32_t hashtable_seed;
 
-json_t *json_object(void) {
-    json_object_t *object = jsonp_malloc(sizeof(json_object_t));
+json_t *json_object(void) { return json_object_alloc(NULL); }
+
+json_t *json_object_alloc(const json_allocator_t *allocator) {
+    json_object_t *object = node_alloc(allocator, sizeof(json_object_t));
     if (!object)
         return NULL;
 
@@ -67,19 +481,27 @@ json_t *json_object(void) {
         json_object_seed(0);
     }
 
-    json_init(&object->json, JSON_OBJECT);
+    json_init(&object->json, JSON_OBJECT, allocator);
+    object->ints = NULL;
+    object->cow = 0;
+    object->hash.generation = 0;
+    object->up = NULL;
+    object->generation = NULL;
 
     if (hashtable_init(&object->hashtable)) {
-        jsonp_free(object);
+        node_free(&object->json);
         return NULL;
     }
+    object->hashtable.allocator = allocator;
 
     return &object->json;
 }
 
 static void json_delete_object(json_object_t *object) {
+    hash_release(&object->json);
     hashtable_close(&object->hashtable);
-    jsonp_free(object);
+    int_index_free(object->ints, object->hashtable.allocator);
+    node_free(&object->json);
 }
 
 size_t json_object_size(const json_t *json) {
@@ -93,16 +515,70 @@ size_t json_object_size(const json_t *json) {
 }
 
 json_t *json_object_get(const json_t *json, const char *key) {
+    if (!key)
+        return NULL;
+
+    return json_object_getn(json, key, strlen(key));
+}
+
+/* Copy the value at iter into the object if it is shared with a
+   json_cow_copy(), before it's handed out and possibly modified */
+static json_t *object_claim(json_object_t *object, void *iter) {
+    json_t *value = hashtable_iter_value(iter), *copy;
+
+    if (!cow_shared(value))
+        return value;
+
+    copy = cow_copy(value);
+    if (!copy)
+        return NULL;
+
+    hashtable_iter_set(iter, copy);
+    object_index_key(object, hashtable_iter_key(iter), hashtable_iter_key_len(iter),
+                     copy);
+    return copy;
+}
+
+/* An iterator that can't be claimed is still returned, so that
+   iteration goes on; its value stays shared */
+static void *object_claim_iter(const json_t *json, void *iter) {
+    if (iter)
+        object_claim(json_to_object(json), iter);
+
+    return iter;
+}
+
+json_t *jsonp_object_getn(const json_t *json, const char *key, size_t key_len) {
     json_object_t *object;
 
     if (!key || !json_is_object(json))
         return NULL;
 
     object = json_to_object(json);
-    return hashtable_get(&object->hashtable, key);
+    return hashtable_get(&object->hashtable, key, key_len);
+}
+
+json_t *json_object_getn(const json_t *json, const char *key, size_t key_len) {
+    json_t *value = jsonp_object_getn(json, key, key_len);
+
+    if (value && cow_shared(value))
+        return object_claim(json_to_object(json),
+                            hashtable_iter_at(&json_to_object(json)->hashtable, key,
+                                              key_len));
+    return value;
 }
 
 int json_object_set_new_nocheck(json_t *json, const char *key, json_t *value) {
+    if (!key) {
+        json_decref(value);
+        return -1;
+    }
+
+    return json_object_setn_new_nocheck(json, key, strlen(key), value);
+}
+
+int json_object_setn_new_nocheck(json_t *json, const char *key, size_t key_len,
+                                 json_t *value) {
     json_object_t *object;
 
     if (!value)
@@ -114,31 +590,54 @@ int json_object_set_new_nocheck(json_t *json, const char *key, json_t *value) {
     }
     object = json_to_object(json);
 
-    if (hashtable_set(&object->hashtable, key, value)) {
+    if (hashtable_set(&object->hashtable, key, key_len, value)) {
         json_decref(value);
         return -1;
     }
 
+    object_index_key(object, key, key_len, value);
+    hash_changed(json);
     return 0;
 }
 
 int json_object_set_new(json_t *json, const char *key, json_t *value) {
-    if (!key || !utf8_check_string(key, strlen(key))) {
+    if (!key) {
         json_decref(value);
         return -1;
     }
 
-    return json_object_set_new_nocheck(json, key, value);
+    return json_object_setn_new(json, key, strlen(key), value);
+}
+
+int json_object_setn_new(json_t *json, const char *key, size_t key_len, json_t *value) {
+    if (!key || !utf8_check_string(key, key_len)) {
+        json_decref(value);
+        return -1;
+    }
+
+    return json_object_setn_new_nocheck(json, key, key_len, value);
 }
 
 int json_object_del(json_t *json, const char *key) {
+    if (!key)
+        return -1;
+
+    return json_object_deln(json, key, strlen(key));
+}
+
+int json_object_deln(json_t *json, const char *key, size_t key_len) {
     json_object_t *object;
 
     if (!key || !json_is_object(json))
         return -1;
 
     object = json_to_object(json);
-    return hashtable_del(&object->hashtable, key);
+    object_index_key(object, key, key_len, NULL);
+    if (hashtable_del(&object->hashtable, key, key_len))
+        return -1;
+
+    hash_changed(json);
+    return 0;
 }
 
 int json_object_clear(json_t *json) {
@@ -149,6 +648,8 @@ int json_object_clear(json_t *json) {
 
     object = json_to_object(json);
     hashtable_clear(&object->hashtable);
+    object_drop_index(object);
+    hash_changed(json);
 
     return 0;
 }
@@ -161,7 +662,8 @@ int json_object_update(json_t *object, json_t *other) {
         return -1;
 
     json_object_foreach(other, key, value) {
-        if (json_object_set_nocheck(object, key, value))
+        size_t key_len = json_object_iter_key_len(json_object_key_to_iter(key));
+        if (json_object_setn_nocheck(object, key, key_len, value))
             return -1;
     }
 
@@ -176,8 +678,9 @@ int json_object_update_existing(json_t *object, json_t *other) {
         return -1;
 
     json_object_foreach(other, key, value) {
-        if (json_object_get(object, key))
-            json_object_set_nocheck(object, key, value);
+        size_t key_len = json_object_iter_key_len(json_object_key_to_iter(key));
+        if (json_object_getn(object, key, key_len))
+            json_object_setn_nocheck(object, key, key_len, value);
     }
 
     return 0;
@@ -191,8 +694,9 @@ int json_object_update_missing(json_t *object, json_t *other) {
         return -1;
 
     json_object_foreach(other, key, value) {
-        if (!json_object_get(object, key))
-            json_object_set_nocheck(object, key, value);
+        size_t key_len = json_object_iter_key_len(json_object_key_to_iter(key));
+        if (!json_object_getn(object, key, key_len))
+            json_object_setn_nocheck(object, key, key_len, value);
     }
 
     return 0;
@@ -202,16 +706,18 @@ int do_object_update_recursive(json_t *object, json_t *other, hashtable_t *paren
     const char *key;
     json_t *value;
     char loop_key[LOOP_KEY_LEN];
+    size_t loop_key_len;
     int res = 0;
 
     if (!json_is_object(object) || !json_is_object(other))
         return -1;
 
-    if (jsonp_loop_check(parents, other, loop_key, sizeof(loop_key)))
+    if (jsonp_loop_check(parents, other, loop_key, sizeof(loop_key), &loop_key_len))
         return -1;
 
     json_object_foreach(other, key, value) {
-        json_t *v = json_object_get(object, key);
+        size_t key_len = json_object_iter_key_len(json_object_key_to_iter(key));
+        json_t *v = json_object_getn(object, key, key_len);
 
         if (json_is_object(v) && json_is_object(value)) {
             if (do_object_update_recursive(v, value, parents)) {
@@ -219,14 +725,14 @@ int do_object_update_recursive(json_t *object, json_t *other, hashtable_t *paren
                 break;
             }
         } else {
-            if (json_object_set_nocheck(object, key, value)) {
+            if (json_object_setn_nocheck(object, key, key_len, value)) {
                 res = -1;
                 break;
             }
         }
     }
 
-    hashtable_del(parents, loop_key);
+    hashtable_del(parents, loop_key, loop_key_len);
 
     return res;
 }
@@ -243,7 +749,7 @@ int json_object_update_recursive(json_t *object, json_t *other) {
     return res;
 }
 
-void *json_object_iter(json_t *json) {
+void *jsonp_object_iter(const json_t *json) {
     json_object_t *object;
 
     if (!json_is_object(json))
@@ -253,6 +759,10 @@ void *json_object_iter(json_t *json) {
     return hashtable_iter(&object->hashtable);
 }
 
+void *json_object_iter(json_t *json) {
+    return object_claim_iter(json, jsonp_object_iter(json));
+}
+
 void *json_object_iter_at(json_t *json, const char *key) {
     json_object_t *object;
 
@@ -260,10 +770,11 @@ void *json_object_iter_at(json_t *json, const char *key) {
         return NULL;
 
     object = json_to_object(json);
-    return hashtable_iter_at(&object->hashtable, key);
+    return object_claim_iter(json,
+                             hashtable_iter_at(&object->hashtable, key, strlen(key)));
 }
 
-void *json_object_iter_next(json_t *json, void *iter) {
+void *jsonp_object_iter_next(const json_t *json, void *iter) {
     json_object_t *object;
 
     if (!json_is_object(json) || iter == NULL)
@@ -273,6 +784,10 @@ void *json_object_iter_next(json_t *json, void *iter) {
     return hashtable_iter_next(&object->hashtable, iter);
 }
 
+void *json_object_iter_next(json_t *json, void *iter) {
+    return object_claim_iter(json, jsonp_object_iter_next(json, iter));
+}
+
 const char *json_object_iter_key(void *iter) {
     if (!iter)
         return NULL;
@@ -280,6 +795,13 @@ const char *json_object_iter_key(void *iter) {
     return hashtable_iter_key(iter);
 }
 
+size_t json_object_iter_key_len(void *iter) {
+    if (!iter)
+        return 0;
+
+    return hashtable_iter_key_len(iter);
+}
+
 json_t *json_object_iter_value(void *iter) {
     if (!iter)
         return NULL;
@@ -288,12 +810,20 @@ json_t *json_object_iter_value(void *iter) {
 }
 
 int json_object_iter_set_new(json_t *json, void *iter, json_t *value) {
+    json_object_t *object;
+
     if (!json_is_object(json) || !iter || !value) {
         json_decref(value);
         return -1;
     }
+    object = json_to_object(json);
 
-    hashtable_iter_set(iter, value);
+    /* a key of a shared table gives a pair of the shape */
+    hashtable_iter_set(hashtable_key_iter(&object->hashtable, hashtable_iter_key(iter)),
+                       value);
+    object_index_key(object, hashtable_iter_key(iter), hashtable_iter_key_len(iter),
+                     value);
+    hash_changed(json);
     return 0;
 }
 
@@ -304,15 +834,69 @@ void *json_object_key_to_iter(const char *key) {
     return hashtable_key_to_iter(key);
 }
 
+void jsonp_shape_cache_init(jsonp_shape_cache_t *cache) {
+    memset(cache->last, 0, sizeof(cache->last));
+}
+
+void jsonp_shape_cache_close(jsonp_shape_cache_t *cache) {
+    size_t i;
+
+    for (i = 0; i < JSONP_SHAPE_CACHE_DEPTH; i++)
+        json_decref(cache->last[i]);
+}
+
+void jsonp_shape_cache_add(jsonp_shape_cache_t *cache, size_t depth, json_t *json) {
+    hashtable_t *hashtable, *previous;
+    hashtable_shape_t *shape;
+
+    if (depth >= JSONP_SHAPE_CACHE_DEPTH || !json_object_size(json))
+        return;
+
+    hashtable = &json_to_object(json)->hashtable;
+    if (cache->last[depth]) {
+        previous = &json_to_object(cache->last[depth])->hashtable;
+
+        /* sharing is only an optimization, so errors are ignored */
+        if (hashtable_same_keys(previous, hashtable)) {
+            shape = hashtable_shape(previous);
+            if (shape) {
+                if (!hashtable_share(previous, shape))
+                    hashtable_share(hashtable, shape);
+                hashtable_shape_decref(shape);
+            }
+        }
+        json_decref(cache->last[depth]);
+    }
+
+    cache->last[depth] = json_incref(json);
+}
+
+void *jsonp_object_key_iter(const json_t *json, const char *key) {
+    json_object_t *object;
+
+    if (!key || !json_is_object(json))
+        return NULL;
+
+    object = json_to_object(json);
+    return hashtable_key_iter(&object->hashtable, key);
+}
+
+void *json_object_key_iter(json_t *json, const char *key) {
+    return object_claim_iter(json, jsonp_object_key_iter(json, key));
+}
+
 static int json_object_equal(const json_t *object1, const json_t *object2) {
-    const char *key;
     const json_t *value1, *value2;
+    void *iter;
 
     if (json_object_size(object1) != json_object_size(object2))
         return 0;
 
-    json_object_foreach((json_t *)object1, key, value1) {
-        value2 = json_object_get(object2, key);
+    for (iter = jsonp_object_iter(object1); iter;
+         iter = jsonp_object_iter_next(object1, iter)) {
+        value1 = json_object_iter_value(iter);
+        value2 = jsonp_object_getn(object2, json_object_iter_key(iter),
+                                   json_object_iter_key_len(iter));
 
         if (!json_equal(value1, value2))
             return 0;
@@ -327,11 +911,14 @@ static json_t *json_object_copy(json_t *object) {
     const char *key;
     json_t *value;
 
-    result = json_object();
+    result = json_object_alloc(json_get_allocator(object));
     if (!result)
         return NULL;
 
-    json_object_foreach(object, key, value) json_object_set_nocheck(result, key, value);
+    json_object_foreach(object, key, value) {
+        size_t key_len = json_object_iter_key_len(json_object_key_to_iter(key));
+        json_object_setn_nocheck(result, key, key_len, value);
+    }
 
     return result;
 }
@@ -340,84 +927,461 @@ static json_t *json_object_deep_copy(const json_t *object, hashtable_t *parents)
     json_t *result;
     void *iter;
     char loop_key[LOOP_KEY_LEN];
+    size_t loop_key_len;
 
-    if (jsonp_loop_check(parents, object, loop_key, sizeof(loop_key)))
+    if (jsonp_loop_check(parents, object, loop_key, sizeof(loop_key), &loop_key_len))
         return NULL;
 
-    result = json_object();
+    result = json_object_alloc(json_get_allocator(object));
     if (!result)
         goto out;
 
-    /* Cannot use json_object_foreach because object has to be cast
-       non-const */
-    iter = json_object_iter((json_t *)object);
+    /* Cannot use json_object_foreach because object is const */
+    iter = jsonp_object_iter(object);
     while (iter) {
         const char *key;
+        size_t key_len;
         const json_t *value;
         key = json_object_iter_key(iter);
+        key_len = json_object_iter_key_len(iter);
         value = json_object_iter_value(iter);
 
-        if (json_object_set_new_nocheck(result, key, do_deep_copy(value, parents))) {
+        if (json_object_setn_new_nocheck(result, key, key_len,
+                                         do_deep_copy(value, parents))) {
             json_decref(result);
             result = NULL;
             break;
         }
-        iter = json_object_iter_next((json_t *)object, iter);
+        iter = jsonp_object_iter_next(object, iter);
     }
 
 out:
-    hashtable_del(parents, loop_key);
+    hashtable_del(parents, loop_key, loop_key_len);
 
     return result;
 }
 
+/*** prehashed keys ***/
+
+struct json_key_t {
+    size_t hash;
+    size_t len;
+    char key[1];
+};
+
+json_key_t *json_key(const char *key) {
+    if (!key)
+        return NULL;
+
+    return json_keyn(key, strlen(key));
+}
+
+json_key_t *json_keyn(const char *key, size_t len) {
+    json_key_t *result;
+
+    if (!key || !utf8_check_string(key, len))
+        return NULL;
+
+    if (len >= (size_t)-1 - offsetof(json_key_t, key))
+        return NULL;
+
+    result = jsonp_malloc(offsetof(json_key_t, key) + len + 1);
+    if (!result)
+        return NULL;
+
+    /* the hash depends on the seed, so it must be chosen first */
+    if (!hashtable_seed)
+        json_object_seed(0);
+
+    memcpy(result->key, key, len);
+    result->key[len] = '\0';
+    result->len = len;
+    result->hash = hashtable_hash(key, len);
+    return result;
+}
+
+void json_key_free(json_key_t *key) { jsonp_free(key); }
+
+const char *json_key_value(const json_key_t *key) { return key ? key->key : NULL; }
+
+size_t json_key_length(const json_key_t *key) { return key ? key->len : 0; }
+
+json_t *json_object_get_by_key(const json_t *json, const json_key_t *key) {
+    json_object_t *object;
+    json_t *value;
+
+    if (!key || !json_is_object(json))
+        return NULL;
+
+    object = json_to_object(json);
+    value = hashtable_get_hashed(&object->hashtable, key->key, key->len, key->hash);
+    if (value && cow_shared(value))
+        return object_claim(object, hashtable_iter_at_hashed(&object->hashtable, key->key,
+                                                             key->len, key->hash));
+    return value;
+}
+
+int json_object_set_by_key_new(json_t *json, const json_key_t *key, json_t *value) {
+    json_object_t *object;
+
+    if (!value)
+        return -1;
+
+    if (!key || !json_is_object(json) || json == value) {
+        json_decref(value);
+        return -1;
+    }
+    object = json_to_object(json);
+
+    if (hashtable_set_hashed(&object->hashtable, key->key, key->len, key->hash,
+                             value)) {
+        json_decref(value);
+        return -1;
+    }
+
+    object_index_key(object, key->key, key->len, value);
+    hash_changed(json);
+    return 0;
+}
+
+int json_object_del_by_key(json_t *json, const json_key_t *key) {
+    json_object_t *object;
+
+    if (!key || !json_is_object(json))
+        return -1;
+
+    object = json_to_object(json);
+    object_index_key(object, key->key, key->len, NULL);
+    if (hashtable_del_hashed(&object->hashtable, key->key, key->len, key->hash))
+        return -1;
+
+    hash_changed(json);
+    return 0;
+}
+
+/*** integer keys ***/
+
+json_t *json_object_get_by_int(const json_t *json, json_int_t key) {
+    json_object_t *object;
+    char buffer[INT_KEY_SIZE];
+    int_slot_t *slot;
+
+    if (!json_is_object(json))
+        return NULL;
+
+    object = json_to_object(json);
+    if (object->ints && key > -INT_KEY_BOUND && key < INT_KEY_BOUND) {
+        slot = int_index_find(object->ints, key);
+        if (!slot)
+            return NULL;
+        if (!cow_shared(slot->value))
+            return slot->value;
+    }
+
+    return json_object_getn(json, buffer, int_key_format(key, buffer));
+}
+
+int json_object_set_by_int_new(json_t *json, json_int_t key, json_t *value) {
+    json_object_t *object;
+    char buffer[INT_KEY_SIZE];
+
+    if (!value)
+        return -1;
+
+    if (!json_is_object(json) || json == value) {
+        json_decref(value);
+        return -1;
+    }
+    object = json_to_object(json);
+
+    if (!object->ints)
+        object_build_index(object);
+
+    return json_object_setn_new_nocheck(json, buffer, int_key_format(key, buffer), value);
+}
+
+int json_object_del_by_int(json_t *json, json_int_t key) {
+    json_object_t *object;
+    char buffer[INT_KEY_SIZE];
+
+    if (!json_is_object(json))
+        return -1;
+    object = json_to_object(json);
+
+    if (!object->ints)
+        object_build_index(object);
+
+    return json_object_deln(json, buffer, int_key_format(key, buffer));
+}
+
 /*** array ***/
 
-json_t *json_array(void) {
-    json_array_t *array = jsonp_malloc(sizeof(json_array_t));
+#define array_values(array)   ((json_t **)(array)->table)
+#define array_integers(array) ((json_int_t *)(array)->table)
+#define array_reals(array)    ((double *)(array)->table)
+#define array_booleans(array) ((unsigned char *)(array)->table)
+
+static const size_t array_widths[] = {sizeof(json_t *), sizeof(json_int_t),
+                                      sizeof(double), sizeof(unsigned char)};
+
+#define array_width(array) (array_widths[(array)->kind])
+
+json_t *json_array(void) { return json_array_alloc(NULL); }
+
+json_t *json_array_alloc(const json_allocator_t *allocator) {
+    json_array_t *array = node_alloc(allocator, sizeof(json_array_t));
     if (!array)
         return NULL;
-    json_init(&array->json, JSON_ARRAY);
+    json_init(&array->json, JSON_ARRAY, allocator);
+
+    /* the table is allocated when the first value is added */
+    array->kind = JSON_ARRAY_BOXED;
+    array->cow = 0;
+    array->hash.generation = 0;
+    array->up = NULL;
+    array->generation = NULL;
+    array->entries = 0;
+    array->size = 0;
+    array->head = 0;
+    array->table = NULL;
+
+    return &array->json;
+}
+
+int jsonp_array_pack(json_t *json, json_type type) {
+    json_array_t *array;
+
+    if (!json_is_array(json))
+        return -1;
+    array = json_to_array(json);
+
+    if (array->entries || array->table)
+        return -1;
+
+    switch (type) {
+        case JSON_INTEGER:
+            array->kind = JSON_ARRAY_INTEGERS;
+            return 0;
+        case JSON_REAL:
+            array->kind = JSON_ARRAY_REALS;
+            return 0;
+        case JSON_TRUE:
+        case JSON_FALSE:
+            array->kind = JSON_ARRAY_BOOLEANS;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+json_t *json_packed_array(json_type type) {
+    json_t *json = json_array();
+
+    if (json && jsonp_array_pack(json, type)) {
+        json_decref(json);
+        return NULL;
+    }
+    return json;
+}
+
+static void json_delete_array(json_array_t *array) {
+    size_t i;
+
+    hash_release(&array->json);
+    if (array->kind == JSON_ARRAY_BOXED) {
+        for (i = 0; i < array->entries; i++)
+            json_decref(array_values(array)[array->head + i]);
+    }
+
+    jsonp_allocator_free(json_get_allocator(&array->json), array->table,
+                         array->size * array_width(array));
+    node_free(&array->json);
+}
+
+/* Check whether value can be stored in a packed array as it is */
+static int array_fits(const json_array_t *array, const json_t *value) {
+    switch (array->kind) {
+        case JSON_ARRAY_INTEGERS:
+            return json_is_integer(value);
+        case JSON_ARRAY_REALS:
+            return json_is_real(value);
+        case JSON_ARRAY_BOOLEANS:
+            return json_is_boolean(value);
+        default:
+            return 1;
+    }
+}
+
+/* Store value at slot, stealing the reference */
+static void array_store(json_array_t *array, size_t slot, json_t *value) {
+    switch (array->kind) {
+        case JSON_ARRAY_BOXED:
+            array_values(array)[slot] = value;
+            return;
+        case JSON_ARRAY_INTEGERS:
+            array_integers(array)[slot] = json_integer_value(value);
+            break;
+        case JSON_ARRAY_REALS:
+            array_reals(array)[slot] = json_real_value(value);
+            break;
+        case JSON_ARRAY_BOOLEANS:
+            array_booleans(array)[slot] = json_is_true(value);
+            break;
+    }
+    json_decref(value);
+}
+
+/* Return a new reference to the value at index */
+static json_t *array_value_new(const json_array_t *array, size_t index) {
+    size_t slot = array->head + index;
+
+    switch (array->kind) {
+        case JSON_ARRAY_INTEGERS:
+            return json_integer_alloc(array_integers(array)[slot],
+                                      json_get_allocator(&array->json));
+        case JSON_ARRAY_REALS:
+            return json_real_alloc(array_reals(array)[slot],
+                                   json_get_allocator(&array->json));
+        case JSON_ARRAY_BOOLEANS:
+            return json_boolean(array_booleans(array)[slot]);
+        default:
+            return json_incref(array_values(array)[slot]);
+    }
+}
+
+/* Convert a packed array to a table of values */
+static int json_array_unpack(json_array_t *array) {
+    const json_allocator_t *allocator = json_get_allocator(&array->json);
+    json_t **table;
+    size_t i;
+
+    if (array->kind == JSON_ARRAY_BOXED)
+        return 0;
+
+    if (!array->size) {
+        array->kind = JSON_ARRAY_BOXED;
+        return 0;
+    }
+
+    if (array->size > (size_t)-1 / sizeof(json_t *))
+        return -1;
+
+    table = jsonp_allocator_malloc(allocator, array->size * sizeof(json_t *));
+    if (!table)
+        return -1;
+
+    for (i = 0; i < array->entries; i++) {
+        table[i] = array_value_new(array, i);
+        if (!table[i]) {
+            while (i-- > 0)
+                json_decref(table[i]);
+            jsonp_allocator_free(allocator, table, array->size * sizeof(json_t *));
+            return -1;
+        }
+    }
+
+    jsonp_allocator_free(allocator, array->table, array->size * array_width(array));
+    array->table = table;
+    array->head = 0;
+    array->kind = JSON_ARRAY_BOXED;
+    return 0;
+}
+
+json_t *jsonp_array_peek(const json_t *json, size_t index,
+                         jsonp_array_scratch_t *scratch) {
+    const json_array_t *array;
+    size_t slot;
+
+    if (!json_is_array(json))
+        return NULL;
+    array = json_to_array(json);
+
+    if (index >= array->entries)
+        return NULL;
+    slot = array->head + index;
+
+    switch (array->kind) {
+        case JSON_ARRAY_INTEGERS:
+            scratch->integer.json.type = JSON_INTEGER;
+            scratch->integer.json.flags = 0;
+            scratch->integer.json.refcount = JSON_REFCOUNT_IMMORTAL;
+            scratch->integer.value = array_integers(array)[slot];
+            scratch->integer.up = NULL;
+            return &scratch->integer.json;
+        case JSON_ARRAY_REALS:
+            scratch->real.json.type = JSON_REAL;
+            scratch->real.json.flags = 0;
+            scratch->real.json.refcount = JSON_REFCOUNT_IMMORTAL;
+            scratch->real.value = array_reals(array)[slot];
+            scratch->real.up = NULL;
+            return &scratch->real.json;
+        case JSON_ARRAY_BOOLEANS:
+            return json_boolean(array_booleans(array)[slot]);
+        default:
+            return array_values(array)[slot];
+    }
+}
+
+size_t json_array_size(const json_t *json) {
+    if (!json_is_array(json))
+        return 0;
+
+    return json_to_array(json)->entries;
+}
 
-    array->entries = 0;
-    array->size = 8;
+json_t *json_array_get(const json_t *json, size_t index) {
+    json_array_t *array;
+    json_t *value, *copy;
+    if (!json_is_array(json))
+        return NULL;
+    array = json_to_array(json);
 
-    array->table = jsonp_malloc(array->size * sizeof(json_t *));
-    if (!array->table) {
-        jsonp_free(array);
+    if (index >= array->entries)
         return NULL;
-    }
 
-    return &array->json;
-}
+    /* Booleans are singletons and can be returned as they are. Packed
+       numbers have no json_t to return, so the array is converted. */
+    if (array->kind == JSON_ARRAY_BOOLEANS)
+        return json_boolean(array_booleans(array)[array->head + index]);
+    if (json_array_unpack(array))
+        return NULL;
 
-static void json_delete_array(json_array_t *array) {
-    size_t i;
+    value = array_values(array)[array->head + index];
+    if (cow_shared(value)) {
+        copy = cow_copy(value);
+        if (!copy)
+            return NULL;
 
-    for (i = 0; i < array->entries; i++)
-        json_decref(array->table[i]);
+        array_values(array)[array->head + index] = copy;
+        json_decref(value);
+        value = copy;
+    }
 
-    jsonp_free(array->table);
-    jsonp_free(array);
+    return value;
 }
 
-size_t json_array_size(const json_t *json) {
+const json_int_t *json_array_integers(const json_t *json) {
+    json_array_t *array;
     if (!json_is_array(json))
-        return 0;
+        return NULL;
+    array = json_to_array(json);
 
-    return json_to_array(json)->entries;
+    if (array->kind != JSON_ARRAY_INTEGERS || !array->table)
+        return NULL;
+
+    return array_integers(array) + array->head;
 }
 
-json_t *json_array_get(const json_t *json, size_t index) {
+const double *json_array_reals(const json_t *json) {
     json_array_t *array;
     if (!json_is_array(json))
         return NULL;
     array = json_to_array(json);
 
-    if (index >= array->entries)
+    if (array->kind != JSON_ARRAY_REALS || !array->table)
         return NULL;
 
-    return array->table[index];
+    return array_reals(array) + array->head;
 }
 
 int json_array_set_new(json_t *json, size_t index, json_t *value) {
@@ -437,45 +1401,102 @@ int json_array_set_new(json_t *json, size_t index, json_t *value) {
         return -1;
     }
 
-    json_decref(array->table[index]);
-    array->table[index] = value;
+    if (!array_fits(array, value) && json_array_unpack(array)) {
+        json_decref(value);
+        return -1;
+    }
+
+    if (array->kind == JSON_ARRAY_BOXED)
+        json_decref(array_values(array)[array->head + index]);
+    array_store(array, array->head + index, value);
+    hash_changed(json);
 
     return 0;
 }
 
 static void array_move(json_array_t *array, size_t dest, size_t src, size_t count) {
-    memmove(&array->table[dest], &array->table[src], count * sizeof(json_t *));
+    char *table = array->table;
+    size_t width = array_width(array);
+
+    memmove(table + dest * width, table + src * width, count * width);
 }
 
-static void array_copy(json_t **dest, size_t dpos, json_t **src, size_t spos,
-                       size_t count) {
-    memcpy(&dest[dpos], &src[spos], count * sizeof(json_t *));
+static void array_copy(json_array_t *dest, size_t dpos, const json_array_t *src,
+                       size_t spos, size_t count) {
+    size_t width = array_width(dest);
+
+    memcpy((char *)dest->table + dpos * width, (char *)src->table + spos * width,
+           count * width);
 }
 
-static json_t **json_array_grow(json_array_t *array, size_t amount, int copy) {
-    size_t new_size;
-    json_t **old_table, **new_table;
+/* Move the values to the start of the table */
+static void array_rewind(json_array_t *array) {
+    if (!array->head)
+        return;
 
-    if (array->entries + amount <= array->size)
-        return array->table;
+    array_move(array, 0, array->head, array->entries);
+    array->head = 0;
+}
 
-    old_table = array->table;
+/* Reallocate the table for exactly size slots. The values are kept
+   at their offset, so head + entries must not exceed size. */
+static int json_array_resize(json_array_t *array, size_t size) {
+    size_t width = array_width(array);
+    void *new_table;
 
-    new_size = max(array->size + amount, array->size * 2);
-    new_table = jsonp_malloc(new_size * sizeof(json_t *));
-    if (!new_table)
-        return NULL;
+    if (size > (size_t)-1 / width)
+        return -1;
+
+    new_table = jsonp_allocator_realloc(json_get_allocator(&array->json), array->table,
+                                        array->size * width, size * width);
+    if (!new_table && size)
+        return -1;
 
-    array->size = new_size;
     array->table = new_table;
+    array->size = size;
+    return 0;
+}
+
+/* Make room for amount values after the last one */
+static int json_array_grow(json_array_t *array, size_t amount) {
+    size_t new_size;
+
+    if (amount <= array->size - array->head - array->entries)
+        return 0;
+
+    if (amount > (size_t)-1 - array->head - array->entries)
+        return -1;
 
-    if (copy) {
-        array_copy(array->table, 0, old_table, 0, array->entries);
-        jsonp_free(old_table);
-        return array->table;
+    /* When at least half of the table is free in front, e.g. when the
+       array is used as a queue, reuse that room instead of growing.
+       The values were shifted out one by one, which pays for moving
+       the rest. */
+    if (array->head >= array->size / 2) {
+        array_rewind(array);
+        if (amount <= array->size - array->entries)
+            return 0;
     }
 
-    return old_table;
+    new_size = max(array->head + array->entries + amount, max(array->size * 2, 8));
+    return json_array_resize(array, new_size);
+}
+
+/* Make room for a value before the first one */
+static int json_array_grow_front(json_array_t *array) {
+    size_t head;
+
+    if (array->head)
+        return 0;
+
+    /* Leave as many free slots in front as there are values, so that
+       inserting at the front is amortized O(1) like appending */
+    if (json_array_grow(array, max(array->entries, 4)))
+        return -1;
+
+    head = (array->size - array->entries + 1) / 2;
+    array_move(array, head, 0, array->entries);
+    array->head = head;
+    return 0;
 }
 
 int json_array_append_new(json_t *json, json_t *value) {
@@ -490,20 +1511,21 @@ int json_array_append_new(json_t *json, json_t *value) {
     }
     array = json_to_array(json);
 
-    if (!json_array_grow(array, 1, 1)) {
+    if ((!array_fits(array, value) && json_array_unpack(array)) ||
+        json_array_grow(array, 1)) {
         json_decref(value);
         return -1;
     }
 
-    array->table[array->entries] = value;
+    array_store(array, array->head + array->entries, value);
     array->entries++;
+    hash_changed(json);
 
     return 0;
 }
 
 int json_array_insert_new(json_t *json, size_t index, json_t *value) {
     json_array_t *array;
-    json_t **old_table;
 
     if (!value)
         return -1;
@@ -514,26 +1536,34 @@ int json_array_insert_new(json_t *json, size_t index, json_t *value) {
     }
     array = json_to_array(json);
 
-    if (index > array->entries) {
+    if (index > array->entries ||
+        (!array_fits(array, value) && json_array_unpack(array))) {
         json_decref(value);
         return -1;
     }
 
-    old_table = json_array_grow(array, 1, 0);
-    if (!old_table) {
-        json_decref(value);
-        return -1;
-    }
+    /* Move the shorter side of the array to make room */
+    if (index < array->entries - index) {
+        if (json_array_grow_front(array)) {
+            json_decref(value);
+            return -1;
+        }
+
+        array->head--;
+        array_move(array, array->head, array->head + 1, index);
+    } else {
+        if (json_array_grow(array, 1)) {
+            json_decref(value);
+            return -1;
+        }
 
-    if (old_table != array->table) {
-        array_copy(array->table, 0, old_table, 0, index);
-        array_copy(array->table, index + 1, old_table, index, array->entries - index);
-        jsonp_free(old_table);
-    } else
-        array_move(array, index + 1, index, array->entries - index);
+        array_move(array, array->head + index + 1, array->head + index,
+                   array->entries - index);
+    }
 
-    array->table[index] = value;
+    array_store(array, array->head + index, value);
     array->entries++;
+    hash_changed(json);
 
     return 0;
 }
@@ -548,14 +1578,24 @@ int json_array_remove(json_t *json, size_t index) {
     if (index >= array->entries)
         return -1;
 
-    json_decref(array->table[index]);
-
-    /* If we're removing the last element, nothing has to be moved */
-    if (index < array->entries - 1)
-        array_move(array, index, index + 1, array->entries - index - 1);
+    if (array->kind == JSON_ARRAY_BOXED)
+        json_decref(array_values(array)[array->head + index]);
+
+    /* Close the gap from the shorter side, so removing the first or
+       the last value doesn't move anything */
+    if (index < array->entries - index - 1) {
+        array_move(array, array->head + 1, array->head, index);
+        array->head++;
+    } else {
+        array_move(array, array->head + index, array->head + index + 1,
+                   array->entries - index - 1);
+    }
 
     array->entries--;
+    if (!array->entries)
+        array->head = 0;
 
+    hash_changed(json);
     return 0;
 }
 
@@ -567,10 +1607,14 @@ int json_array_clear(json_t *json) {
         return -1;
     array = json_to_array(json);
 
-    for (i = 0; i < array->entries; i++)
-        json_decref(array->table[i]);
+    if (array->kind == JSON_ARRAY_BOXED) {
+        for (i = 0; i < array->entries; i++)
+            json_decref(array_values(array)[array->head + i]);
+    }
 
     array->entries = 0;
+    array->head = 0;
+    hash_changed(json);
     return 0;
 }
 
@@ -583,18 +1627,73 @@ int json_array_extend(json_t *json, json_t *other_json) {
     array = json_to_array(json);
     other = json_to_array(other_json);
 
-    if (!json_array_grow(array, other->entries, 1))
+    if (!other->entries)
+        return 0;
+
+    if (array->kind != other->kind && json_array_unpack(array))
+        return -1;
+
+    if (json_array_grow(array, other->entries))
         return -1;
 
-    for (i = 0; i < other->entries; i++)
-        json_incref(other->table[i]);
+    if (array->kind != other->kind) {
+        /* box the values of a packed array */
+        json_t **values = array_values(array) + array->head + array->entries;
 
-    array_copy(array->table, array->entries, other->table, 0, other->entries);
+        for (i = 0; i < other->entries; i++) {
+            values[i] = array_value_new(other, i);
+            if (!values[i]) {
+                while (i-- > 0)
+                    json_decref(values[i]);
+                return -1;
+            }
+        }
+    } else {
+        if (array->kind == JSON_ARRAY_BOXED) {
+            for (i = 0; i < other->entries; i++)
+                json_incref(array_values(other)[other->head + i]);
+        }
+
+        array_copy(array, array->head + array->entries, other, other->head,
+                   other->entries);
+    }
 
     array->entries += other->entries;
+    hash_changed(json);
     return 0;
 }
 
+int json_array_reserve(json_t *json, size_t size) {
+    json_array_t *array;
+
+    if (!json_is_array(json))
+        return -1;
+    array = json_to_array(json);
+
+    if (size <= array->size - array->head)
+        return 0;
+
+    array_rewind(array);
+    if (size <= array->size)
+        return 0;
+
+    return json_array_resize(array, size);
+}
+
+int json_array_shrink_to_fit(json_t *json) {
+    json_array_t *array;
+
+    if (!json_is_array(json))
+        return -1;
+    array = json_to_array(json);
+
+    if (array->entries == array->size)
+        return 0;
+
+    array_rewind(array);
+    return json_array_resize(array, array->entries);
+}
+
 static int json_array_equal(const json_t *array1, const json_t *array2) {
     size_t i, size;
 
@@ -603,10 +1702,11 @@ static int json_array_equal(const json_t *array1, const json_t *array2) {
         return 0;
 
     for (i = 0; i < size; i++) {
+        jsonp_array_scratch_t scratch1, scratch2;
         json_t *value1, *value2;
 
-        value1 = json_array_get(array1, i);
-        value2 = json_array_get(array2, i);
+        value1 = jsonp_array_peek(array1, i, &scratch1);
+        value2 = jsonp_array_peek(array2, i, &scratch2);
 
         if (!json_equal(value1, value2))
             return 0;
@@ -615,11 +1715,34 @@ static int json_array_equal(const json_t *array1, const json_t *array2) {
     return 1;
 }
 
+static json_t *json_array_copy_packed(const json_array_t *array) {
+    json_t *result;
+    json_array_t *copy;
+
+    result = json_array_alloc(json_get_allocator(&array->json));
+    if (!result)
+        return NULL;
+    copy = json_to_array(result);
+
+    copy->kind = array->kind;
+    if (json_array_resize(copy, array->entries)) {
+        json_decref(result);
+        return NULL;
+    }
+
+    array_copy(copy, 0, array, array->head, array->entries);
+    copy->entries = array->entries;
+    return result;
+}
+
 static json_t *json_array_copy(json_t *array) {
     json_t *result;
     size_t i;
 
-    result = json_array();
+    if (json_to_array(array)->kind != JSON_ARRAY_BOXED)
+        return json_array_copy_packed(json_to_array(array));
+
+    result = json_array_alloc(json_get_allocator(array));
     if (!result)
         return NULL;
 
@@ -633,17 +1756,24 @@ static json_t *json_array_deep_copy(const json_t *array, hashtable_t *parents) {
     json_t *result;
     size_t i;
     char loop_key[LOOP_KEY_LEN];
+    size_t loop_key_len;
+
+    /* packed arrays hold no containers */
+    if (json_to_array(array)->kind != JSON_ARRAY_BOXED)
+        return json_array_copy_packed(json_to_array(array));
 
-    if (jsonp_loop_check(parents, array, loop_key, sizeof(loop_key)))
+    if (jsonp_loop_check(parents, array, loop_key, sizeof(loop_key), &loop_key_len))
         return NULL;
 
-    result = json_array();
+    result = json_array_alloc(json_get_allocator(array));
     if (!result)
         goto out;
 
     for (i = 0; i < json_array_size(array); i++) {
-        if (json_array_append_new(result,
-                                  do_deep_copy(json_array_get(array, i), parents))) {
+        jsonp_array_scratch_t scratch;
+
+        if (json_array_append_new(
+                result, do_deep_copy(jsonp_array_peek(array, i, &scratch), parents))) {
             json_decref(result);
             result = NULL;
             break;
@@ -651,36 +1781,58 @@ static json_t *json_array_deep_copy(const json_t *array, hashtable_t *parents) {
     }
 
 out:
-    hashtable_del(parents, loop_key);
+    hashtable_del(parents, loop_key, loop_key_len);
 
     return result;
 }
 
 /*** string ***/
 
-static json_t *string_create(const char *value, size_t len, int own) {
-    char *v;
+/* Strings are stored in the same allocation as the json_string_t,
+   except for long strings whose buffer is taken over. A buffer given
+   to a string with an allocator comes from jsonp_malloc(), so it is
+   always copied; the own buffers of those strings are length + 1
+   bytes. */
+#define STRING_INLINE_MAX_OWN 22
+
+static json_t *string_create(const char *value, size_t len, int own,
+                             const json_allocator_t *allocator) {
     json_string_t *string;
 
     if (!value)
         return NULL;
 
-    if (own)
-        v = (char *)value;
-    else {
-        v = jsonp_strndup(value, len);
-        if (!v)
+    if (own && len > STRING_INLINE_MAX_OWN && !allocator) {
+        string = jsonp_malloc(sizeof(json_string_t));
+        if (!string) {
+            jsonp_free((char *)value);
             return NULL;
-    }
+        }
+        string->value = (char *)value;
+    } else {
+        /* offsetof(...) returns the size of json_string_t without the
+           inline value */
+        if (len >= (size_t)-1 - offsetof(json_string_t, inline_value))
+            string = NULL;
+        else
+            string =
+                node_alloc(allocator, offsetof(json_string_t, inline_value) + len + 1);
+        if (!string) {
+            if (own)
+                jsonp_free((char *)value);
+            return NULL;
+        }
+        string->value = string->inline_value;
+        memcpy(string->value, value, len);
+        string->value[len] = '\0';
 
-    string = jsonp_malloc(sizeof(json_string_t));
-    if (!string) {
-        jsonp_free(v);
-        return NULL;
+        if (own)
+            jsonp_free((char *)value);
     }
-    json_init(&string->json, JSON_STRING);
-    string->value = v;
+
+    json_init(&string->json, JSON_STRING, allocator);
     string->length = len;
+    string->up = NULL;
 
     return &string->json;
 }
@@ -689,16 +1841,21 @@ json_t *json_string_nocheck(const char *value) {
     if (!value)
         return NULL;
 
-    return string_create(value, strlen(value), 0);
+    return string_create(value, strlen(value), 0, NULL);
 }
 
 json_t *json_stringn_nocheck(const char *value, size_t len) {
-    return string_create(value, len, 0);
+    return string_create(value, len, 0, NULL);
 }
 
 /* this is private; "steal" is not a public API concept */
 json_t *jsonp_stringn_nocheck_own(const char *value, size_t len) {
-    return string_create(value, len, 1);
+    return string_create(value, len, 1, NULL);
+}
+
+json_t *jsonp_stringn_nocheck_own_alloc(const char *value, size_t len,
+                                        const json_allocator_t *allocator) {
+    return string_create(value, len, 1, allocator);
 }
 
 json_t *json_string(const char *value) {
@@ -709,10 +1866,15 @@ json_t *json_string(const char *value) {
 }
 
 json_t *json_stringn(const char *value, size_t len) {
+    return json_stringn_alloc(value, len, NULL);
+}
+
+json_t *json_stringn_alloc(const char *value, size_t len,
+                           const json_allocator_t *allocator) {
     if (!value || !utf8_check_string(value, len))
         return NULL;
 
-    return json_stringn_nocheck(value, len);
+    return string_create(value, len, 0, allocator);
 }
 
 const char *json_string_value(const json_t *json) {
@@ -737,20 +1899,36 @@ int json_string_set_nocheck(json_t *json, const char *value) {
 }
 
 int json_string_setn_nocheck(json_t *json, const char *value, size_t len) {
+    const json_allocator_t *allocator;
     char *dup;
     json_string_t *string;
 
     if (!json_is_string(json) || !value)
         return -1;
 
-    dup = jsonp_strndup(value, len);
+    string = json_to_string(json);
+
+    /* the inline value has room for at least its current length */
+    if (string->value == string->inline_value && len <= string->length) {
+        memmove(string->value, value, len);
+        string->value[len] = '\0';
+        string->length = len;
+        hash_changed(json);
+        return 0;
+    }
+
+    allocator = json_get_allocator(json);
+    dup = jsonp_allocator_malloc(allocator, len + 1);
     if (!dup)
         return -1;
+    memcpy(dup, value, len);
+    dup[len] = '\0';
 
-    string = json_to_string(json);
-    jsonp_free(string->value);
+    if (string->value != string->inline_value)
+        jsonp_allocator_free(allocator, string->value, string->length + 1);
     string->value = dup;
     string->length = len;
+    hash_changed(json);
 
     return 0;
 }
@@ -770,8 +1948,11 @@ int json_string_setn(json_t *json, const char *value, size_t len) {
 }
 
 static void json_delete_string(json_string_t *string) {
-    jsonp_free(string->value);
-    jsonp_free(string);
+    hash_release(&string->json);
+    if (string->value != string->inline_value)
+        jsonp_allocator_free(json_get_allocator(&string->json), string->value,
+                             string->length + 1);
+    node_free(&string->json);
 }
 
 static int json_string_equal(const json_t *string1, const json_t *string2) {
@@ -786,7 +1967,7 @@ static json_t *json_string_copy(const json_t *string) {
     json_string_t *s;
 
     s = json_to_string(string);
-    return json_stringn_nocheck(s->value, s->length);
+    return string_create(s->value, s->length, 0, json_get_allocator(string));
 }
 
 json_t *json_vsprintf(const char *fmt, va_list ap) {
@@ -832,13 +2013,16 @@ json_t *json_sprintf(const char *fmt, ...) {
 
 /*** integer ***/
 
-json_t *json_integer(json_int_t value) {
-    json_integer_t *integer = jsonp_malloc(sizeof(json_integer_t));
+json_t *json_integer(json_int_t value) { return json_integer_alloc(value, NULL); }
+
+json_t *json_integer_alloc(json_int_t value, const json_allocator_t *allocator) {
+    json_integer_t *integer = node_alloc(allocator, sizeof(json_integer_t));
     if (!integer)
         return NULL;
-    json_init(&integer->json, JSON_INTEGER);
+    json_init(&integer->json, JSON_INTEGER, allocator);
 
     integer->value = value;
+    integer->up = NULL;
     return &integer->json;
 }
 
@@ -849,39 +2033,78 @@ json_int_t json_integer_value(const json_t *json) {
     return json_to_integer(json)->value;
 }
 
+/* Shared integers from SHARED_INTEGER_MIN to SHARED_INTEGER_MAX, built
+   by repeating the initializer */
+#define SHARED_INTEGER_MIN -256
+#define SHARED_INTEGER_MAX 4096
+
+#define INTEGER_1(n)                                                                     \
+    { {JSON_INTEGER, 0, JSON_REFCOUNT_IMMORTAL}, (n), NULL }
+#define INTEGER_4(n) INTEGER_1(n), INTEGER_1(n + 1), INTEGER_1(n + 2), INTEGER_1(n + 3)
+#define INTEGER_16(n)                                                                    \
+    INTEGER_4(n), INTEGER_4(n + 4), INTEGER_4(n + 8), INTEGER_4(n + 12)
+#define INTEGER_64(n)                                                                    \
+    INTEGER_16(n), INTEGER_16(n + 16), INTEGER_16(n + 32), INTEGER_16(n + 48)
+#define INTEGER_256(n)                                                                   \
+    INTEGER_64(n), INTEGER_64(n + 64), INTEGER_64(n + 128), INTEGER_64(n + 192)
+#define INTEGER_1024(n)                                                                  \
+    INTEGER_256(n), INTEGER_256(n + 256), INTEGER_256(n + 512), INTEGER_256(n + 768)
+
+static json_integer_t shared_integers[SHARED_INTEGER_MAX - SHARED_INTEGER_MIN + 1] = {
+    INTEGER_256(-256), INTEGER_1024(0),    INTEGER_1024(1024),
+    INTEGER_1024(2048), INTEGER_1024(3072), INTEGER_1(4096)};
+
+json_t *json_integer_shared(json_int_t value) {
+    return jsonp_integer_shared_alloc(value, NULL);
+}
+
+json_t *jsonp_integer_shared_alloc(json_int_t value, const json_allocator_t *allocator) {
+    if (value < SHARED_INTEGER_MIN || value > SHARED_INTEGER_MAX)
+        return json_integer_alloc(value, allocator);
+
+    return &shared_integers[value - SHARED_INTEGER_MIN].json;
+}
+
 int json_integer_set(json_t *json, json_int_t value) {
-    if (!json_is_integer(json))
+    if (!json_is_integer(json) || json->refcount == JSON_REFCOUNT_IMMORTAL)
         return -1;
 
     json_to_integer(json)->value = value;
+    hash_changed(json);
 
     return 0;
 }
 
-static void json_delete_integer(json_integer_t *integer) { jsonp_free(integer); }
+static void json_delete_integer(json_integer_t *integer) {
+    hash_release(&integer->json);
+    node_free(&integer->json);
+}
 
 static int json_integer_equal(const json_t *integer1, const json_t *integer2) {
     return json_integer_value(integer1) == json_integer_value(integer2);
 }
 
 static json_t *json_integer_copy(const json_t *integer) {
-    return json_integer(json_integer_value(integer));
+    return json_integer_alloc(json_integer_value(integer), json_get_allocator(integer));
 }
 
 /*** real ***/
 
-json_t *json_real(double value) {
+json_t *json_real(double value) { return json_real_alloc(value, NULL); }
+
+json_t *json_real_alloc(double value, const json_allocator_t *allocator) {
     json_real_t *real;
 
     if (isnan(value) || isinf(value))
         return NULL;
 
-    real = jsonp_malloc(sizeof(json_real_t));
+    real = node_alloc(allocator, sizeof(json_real_t));
     if (!real)
         return NULL;
-    json_init(&real->json, JSON_REAL);
+    json_init(&real->json, JSON_REAL, allocator);
 
     real->value = value;
+    real->up = NULL;
     return &real->json;
 }
 
@@ -897,18 +2120,22 @@ int json_real_set(json_t *json, double value) {
         return -1;
 
     json_to_real(json)->value = value;
+    hash_changed(json);
 
     return 0;
 }
 
-static void json_delete_real(json_real_t *real) { jsonp_free(real); }
+static void json_delete_real(json_real_t *real) {
+    hash_release(&real->json);
+    node_free(&real->json);
+}
 
 static int json_real_equal(const json_t *real1, const json_t *real2) {
     return json_real_value(real1) == json_real_value(real2);
 }
 
 static json_t *json_real_copy(const json_t *real) {
-    return json_real(json_real_value(real));
+    return json_real_alloc(json_real_value(real), json_get_allocator(real));
 }
 
 /*** number ***/
@@ -925,17 +2152,17 @@ double json_number_value(const json_t *json) {
 /*** simple values ***/
 
 json_t *json_true(void) {
-    static json_t the_true = {JSON_TRUE, (size_t)-1};
+    static json_t the_true = {JSON_TRUE, 0, JSON_REFCOUNT_IMMORTAL};
     return &the_true;
 }
 
 json_t *json_false(void) {
-    static json_t the_false = {JSON_FALSE, (size_t)-1};
+    static json_t the_false = {JSON_FALSE, 0, JSON_REFCOUNT_IMMORTAL};
     return &the_false;
 }
 
 json_t *json_null(void) {
-    static json_t the_null = {JSON_NULL, (size_t)-1};
+    static json_t the_null = {JSON_NULL, 0, JSON_REFCOUNT_IMMORTAL};
     return &the_null;
 }
 
@@ -968,8 +2195,197 @@ void json_delete(json_t *json) {
     /* json_delete is not called for true, false or null */
 }
 
+/*** hashing ***/
+
+/* The hashes don't depend on the hashtable seed, so that they can be
+   kept across runs */
+static uint64_t hash_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
+
+static uint64_t hash_bytes(const char *data, size_t len) {
+    uint64_t hash = hash_mix(len), word;
+
+    for (; len >= sizeof(word); data += sizeof(word), len -= sizeof(word)) {
+        memcpy(&word, data, sizeof(word));
+        hash = hash_mix(hash ^ word);
+    }
+    if (len) {
+        word = 0;
+        memcpy(&word, data, len);
+        hash = hash_mix(hash ^ word);
+    }
+    return hash;
+}
+
+static int hash_value(const json_t *json, jsonp_generation_t *parent,
+                      hashtable_t *parents, int *cacheable, uint64_t *hash);
+
+/* The pairs are added up, so that their order doesn't matter */
+static int hash_object(const json_t *object, jsonp_generation_t *generation,
+                       hashtable_t *parents, int *cacheable, uint64_t *hash) {
+    uint64_t value;
+    void *iter;
+
+    *hash = json_object_size(object);
+    for (iter = jsonp_object_iter(object); iter;
+         iter = jsonp_object_iter_next(object, iter)) {
+        if (hash_value(json_object_iter_value(iter), generation, parents, cacheable,
+                       &value))
+            return -1;
+
+        *hash += hash_mix(
+            hash_bytes(json_object_iter_key(iter), json_object_iter_key_len(iter)) +
+            value);
+    }
+    return 0;
+}
+
+static int hash_array(const json_t *array, jsonp_generation_t *generation,
+                      hashtable_t *parents, int *cacheable, uint64_t *hash) {
+    uint64_t value;
+    size_t i;
+
+    *hash = json_array_size(array);
+    for (i = 0; i < json_array_size(array); i++) {
+        jsonp_array_scratch_t scratch;
+
+        if (hash_value(jsonp_array_peek(array, i, &scratch), generation, parents,
+                       cacheable, &value))
+            return -1;
+
+        *hash = hash_mix(*hash + value);
+    }
+    return 0;
+}
+
+/* Return 1 and store the hash of the object or array json in hash if
+   it's cached and still valid */
+static int hash_cached(const json_t *json, uint64_t *hash) {
+    jsonp_generation_t **generation;
+    jsonp_hash_t *cache = hash_cache(json, &generation);
+
+    if (!cache->generation || !*generation || cache->generation != (*generation)->value)
+        return 0;
+
+    *hash = cache->value;
+    return 1;
+}
+
+static uint64_t hash_scalar(const json_t *json) {
+    uint64_t hash = 0;
+    double real;
+
+    switch (json_typeof(json)) {
+        case JSON_STRING:
+            hash = hash_bytes(json_string_value(json), json_string_length(json));
+            break;
+        case JSON_INTEGER:
+            hash = hash_mix((uint64_t)json_integer_value(json));
+            break;
+        case JSON_REAL:
+            /* -0.0 == 0.0 */
+            real = json_real_value(json) == 0.0 ? 0.0 : json_real_value(json);
+            memcpy(&hash, &real, sizeof(real));
+            hash = hash_mix(hash);
+            break;
+        default:
+            break;
+    }
+
+    return hash_mix(hash ^ ((uint64_t)json_typeof(json) << 59));
+}
+
+/* parent is the generation of the object or array that holds json,
+   NULL if json_hash() was called on json. If json can't be linked to
+   parent or its hash can't be cached, *cacheable is cleared, so that
+   the container doesn't cache its hash either. Return -1 if json
+   contains a circular reference. */
+static int hash_value(const json_t *json, jsonp_generation_t *parent,
+                      hashtable_t *parents, int *cacheable, uint64_t *hash) {
+    jsonp_generation_t **generation;
+    jsonp_hash_t *cache;
+    char loop_key[LOOP_KEY_LEN];
+    size_t loop_key_len;
+    uint64_t current = 0;
+    int own = 1, result;
+
+    if (parent && !hash_link((json_t *)json, parent))
+        *cacheable = 0;
+
+    cache = hash_cache(json, &generation);
+    if (!cache) {
+        *hash = hash_scalar(json);
+        return 0;
+    }
+    if (hash_cached(json, hash))
+        return 0;
+
+    if (jsonp_loop_check(parents, json, loop_key, sizeof(loop_key), &loop_key_len))
+        return -1;
+
+    /* the values are linked to the generation, so the hash can't be
+       cached without one. Read it first, so that a change made while
+       the hash is computed makes it stale. */
+    if (hash_generation((json_t *)json))
+        current = (*generation)->value;
+    else
+        own = 0;
+
+    if (json_is_object(json))
+        result = hash_object(json, *generation, parents, &own, hash);
+    else
+        result = hash_array(json, *generation, parents, &own, hash);
+
+    hashtable_del(parents, loop_key, loop_key_len);
+    if (result)
+        return -1;
+
+    *hash = hash_mix(*hash ^ ((uint64_t)json_typeof(json) << 59));
+    cache->value = *hash;
+    cache->generation = own ? current : 0;
+    if (!own)
+        *cacheable = 0;
+    return 0;
+}
+
+json_int_t json_hash(const json_t *json) {
+    hashtable_t parents_set;
+    jsonp_generation_t **generation;
+    uint64_t hash;
+    int cacheable, result;
+
+    if (!json)
+        return 0;
+
+    if (!hash_cache(json, &generation))
+        return (json_int_t)hash_scalar(json);
+    if (hash_cached(json, &hash))
+        return (json_int_t)hash;
+
+    if (hashtable_init(&parents_set))
+        return 0;
+    result = hash_value(json, NULL, &parents_set, &cacheable, &hash);
+    hashtable_close(&parents_set);
+
+    return result ? 0 : (json_int_t)hash;
+}
+
 /*** equality ***/
 
+/* Return 1 if the cached hashes tell that the containers differ.
+   Hashes that aren't cached aren't computed, that would cost more than
+   comparing the values. */
+static int hash_differs(const json_t *json1, const json_t *json2) {
+    uint64_t hash1, hash2;
+
+    return hash_cached(json1, &hash1) && hash_cached(json2, &hash2) && hash1 != hash2;
+}
+
 int json_equal(const json_t *json1, const json_t *json2) {
     if (!json1 || !json2)
         return 0;
@@ -983,9 +2399,9 @@ int json_equal(const json_t *json1, const json_t *json2) {
 
     switch (json_typeof(json1)) {
         case JSON_OBJECT:
-            return json_object_equal(json1, json2);
+            return !hash_differs(json1, json2) && json_object_equal(json1, json2);
         case JSON_ARRAY:
-            return json_array_equal(json1, json2);
+            return !hash_differs(json1, json2) && json_array_equal(json1, json2);
         case JSON_STRING:
             return json_string_equal(json1, json2);
         case JSON_INTEGER:
@@ -999,6 +2415,91 @@ int json_equal(const json_t *json1, const json_t *json2) {
 
 /*** copying ***/
 
+/* Share a value of a container being copied by json_cow_copy(). A
+   shared container is marked, so that it's copied when it is reached
+   through either parent. Scalars can be modified in place and are
+   small, so they are copied right away. */
+static json_t *cow_share(json_t *json) {
+    if (json_is_object(json))
+        json_to_object(json)->cow = 1;
+    else if (json_is_array(json))
+        json_to_array(json)->cow = 1;
+    else if (json->refcount != JSON_REFCOUNT_IMMORTAL)
+        return json_copy(json);
+
+    return json_incref(json);
+}
+
+/* Return 1 if json is a container that may be shared with a
+   json_cow_copy(). Once nothing else refers to it, it isn't shared. */
+static int cow_shared(json_t *json) {
+    int *cow;
+
+    if (json_is_object(json))
+        cow = &json_to_object(json)->cow;
+    else if (json_is_array(json))
+        cow = &json_to_array(json)->cow;
+    else
+        return 0;
+
+    if (*cow && json->refcount == 1)
+        *cow = 0;
+
+    return *cow;
+}
+
+/* Copy one level of a container, sharing its values */
+static json_t *cow_copy(json_t *json) {
+    json_array_t *array;
+    json_t *result;
+    void *iter;
+    size_t i;
+
+    if (json_is_object(json)) {
+        result = json_object_alloc(json_get_allocator(json));
+        if (!result)
+            return NULL;
+
+        for (iter = jsonp_object_iter(json); iter;
+             iter = jsonp_object_iter_next(json, iter)) {
+            if (json_object_setn_new_nocheck(result, json_object_iter_key(iter),
+                                             json_object_iter_key_len(iter),
+                                             cow_share(json_object_iter_value(iter)))) {
+                json_decref(result);
+                return NULL;
+            }
+        }
+        return result;
+    }
+
+    array = json_to_array(json);
+    if (array->kind != JSON_ARRAY_BOXED)
+        return json_array_copy_packed(array);
+
+    result = json_array_alloc(json_get_allocator(json));
+    if (!result || json_array_reserve(result, array->entries)) {
+        json_decref(result);
+        return NULL;
+    }
+
+    for (i = 0; i < array->entries; i++) {
+        json_t *value = array_values(array)[array->head + i];
+
+        if (json_array_append_new(result, cow_share(value))) {
+            json_decref(result);
+            return NULL;
+        }
+    }
+    return result;
+}
+
+json_t *json_cow_copy(json_t *json) {
+    if (!json_is_object(json) && !json_is_array(json))
+        return json_copy(json);
+
+    return cow_copy(json);
+}
+
 json_t *json_copy(json_t *json) {
     if (!json)
         return NULL;
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* An allocator that counts its blocks and checks the sizes it is
+   given back. Each block is preceded by its size. */
+typedef struct {
+    size_t blocks;
+    size_t bytes;
+    size_t reallocs;
+    size_t limit; /* fail when more bytes would be in use, 0 for none */
+} pool_t;
+
+static void *pool_malloc(size_t size, void *data) {
+    pool_t *pool = data;
+    size_t *block;
+
+    if (pool->limit && pool->bytes + size > pool->limit)
+        return NULL;
+
+    block = malloc(sizeof(size_t) + size);
+    if (!block)
+        return NULL;
+
+    *block = size;
+    pool->blocks++;
+    pool->bytes += size;
+    return block + 1;
+}
+
+static void pool_free(void *ptr, size_t size, void *data) {
+    pool_t *pool = data;
+    size_t *block = (size_t *)ptr - 1;
+
+    if (*block != size)
+        fail("allocator freed a block with a wrong size");
+
+    pool->blocks--;
+    pool->bytes -= size;
+    free(block);
+}
+
+static void *pool_realloc(void *ptr, size_t old_size, size_t new_size, void *data) {
+    pool_t *pool = data;
+    size_t *block = (size_t *)ptr - 1;
+
+    if (*block != old_size)
+        fail("allocator reallocated a block with a wrong size");
+
+    block = realloc(block, sizeof(size_t) + new_size);
+    if (!block)
+        return NULL;
+
+    *block = new_size;
+    pool->bytes += new_size - old_size;
+    pool->reallocs++;
+    return block + 1;
+}
+
+static void pool_init(pool_t *pool, json_allocator_t *allocator, int with_realloc) {
+    memset(pool, 0, sizeof(*pool));
+    allocator->malloc_fn = pool_malloc;
+    allocator->realloc_fn = with_realloc ? pool_realloc : NULL;
+    allocator->free_fn = pool_free;
+    allocator->data = pool;
+}
+
+static void check_empty(const pool_t *pool) {
+    if (pool->blocks || pool->bytes)
+        fail("allocator has blocks left after the document was freed");
+}
+
+static void test_build(void) {
+    json_allocator_t allocator;
+    pool_t pool;
+    json_t *object, *array, *value;
+    char key[16];
+    int i;
+
+    pool_init(&pool, &allocator, 1);
+
+    object = json_object_alloc(&allocator);
+    if (json_get_allocator(object) != &allocator)
+        fail("json_object_alloc didn't keep the allocator");
+
+    /* enough keys to leave the small table layout, and integer keys
+       for the index */
+    for (i = 0; i < 40; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        json_object_set_new(object, key, json_integer_alloc(i, &allocator));
+        json_object_set_by_int_new(object, i, json_real_alloc(i / 2.0, &allocator));
+    }
+    for (i = 0; i < 40; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        json_object_del(object, key);
+        json_object_del_by_int(object, i);
+    }
+
+    array = json_array_alloc(&allocator);
+    for (i = 0; i < 100; i++)
+        json_array_append_new(array, json_stringn_alloc("a string that isn't short", 25,
+                                                        &allocator));
+    json_string_set(json_array_get(array, 0), "an even longer string than that one");
+    json_string_set(json_array_get(array, 1), "short");
+    json_array_remove(array, 2);
+    json_object_set_new(object, "array", array);
+
+    /* values from elsewhere can be stored, they keep their own memory */
+    value = json_string("global");
+    json_object_set_new(object, "global", value);
+    if (json_get_allocator(value))
+        fail("json_string got an allocator");
+
+    if (!pool.blocks || !pool.reallocs)
+        fail("allocator wasn't used");
+
+    json_decref(object);
+    check_empty(&pool);
+}
+
+static void test_load(void) {
+    const char *text = "{\"name\": \"a string that is stored on its own\","
+                       " \"numbers\": [1, 2, 3.5, 100000], \"flags\": [true, false],"
+                       " \"rows\": [{\"a\": 1, \"b\": 2}, {\"a\": 3, \"b\": 4},"
+                       " {\"a\": 5, \"b\": 6}]}";
+    json_allocator_t allocator;
+    json_error_t error;
+    json_t *json, *copy, *expected;
+    pool_t pool;
+
+    pool_init(&pool, &allocator, 1);
+    expected = json_loads(text, 0, NULL);
+
+    json = json_loadb_alloc(text, strlen(text), 0, &allocator, &error);
+    if (!json || !json_equal(json, expected))
+        fail("json_loadb_alloc failed");
+    if (json_get_allocator(json_object_get(json, "name")) != &allocator ||
+        json_get_allocator(json_array_get(json_object_get(json, "numbers"), 2)) !=
+            &allocator)
+        fail("json_loadb_alloc didn't give the values the allocator");
+    json_decref(json);
+    check_empty(&pool);
+
+    json = json_loadb_alloc(text, strlen(text),
+                            JSON_DECODE_PACKED_ARRAYS | JSON_DECODE_SHARED_INTS,
+                            &allocator, &error);
+    if (!json || !json_equal(json, expected))
+        fail("json_loadb_alloc failed with flags");
+
+    /* unpacking an array allocates its values */
+    json_array_append_new(json_object_get(json, "numbers"), json_string("x"));
+    if (json_get_allocator(json_array_get(json_object_get(json, "numbers"), 3)) !=
+        &allocator)
+        fail("unpacking didn't give the values the allocator");
+
+    json_decref(json);
+    check_empty(&pool);
+
+    /* the loaders without an allocator don't use one */
+    if (json_get_allocator(json_object_get(expected, "name")))
+        fail("json_loads used an allocator");
+
+    /* copies keep the allocator of what they copy */
+    json = json_loadb_alloc(text, strlen(text), 0, &allocator, &error);
+    copy = json_deep_copy(json);
+    if (json_get_allocator(json_object_get(copy, "rows")) != &allocator)
+        fail("json_deep_copy didn't keep the allocator");
+    json_decref(copy);
+
+    copy = json_cow_copy(json);
+    json_object_set_new(json_array_get(json_object_get(copy, "rows"), 0), "c",
+                        json_null());
+    if (json_get_allocator(json_array_get(json_object_get(copy, "rows"), 0)) !=
+        &allocator)
+        fail("json_cow_copy didn't keep the allocator");
+    json_decref(copy);
+
+    copy = json_copy(expected);
+    if (json_get_allocator(copy))
+        fail("json_copy gave a copy an allocator");
+    json_decref(copy);
+
+    json_decref(json);
+    json_decref(expected);
+    check_empty(&pool);
+}
+
+static void test_no_realloc(void) {
+    json_allocator_t allocator;
+    pool_t pool;
+    json_t *array;
+    int i;
+
+    /* without realloc_fn, arrays grow by copying */
+    pool_init(&pool, &allocator, 0);
+
+    array = json_array_alloc(&allocator);
+    for (i = 0; i < 1000; i++)
+        json_array_append_new(array, json_integer_alloc(i, &allocator));
+    if (json_integer_value(json_array_get(array, 999)) != 999)
+        fail("array grew wrong without realloc_fn");
+
+    json_decref(array);
+    check_empty(&pool);
+}
+
+static void test_oom(void) {
+    const char *text = "{\"a\": [1, 2, {\"b\": \"a string that is stored on its own\"}],"
+                       " \"c\": {\"d\": 1.5, \"e\": [true, null]}}";
+    json_allocator_t allocator;
+    pool_t pool;
+    json_t *json;
+    size_t limit;
+
+    pool_init(&pool, &allocator, 1);
+
+    /* every failure on the way releases what was allocated */
+    for (limit = 1;; limit++) {
+        pool.limit = limit;
+        json = json_loadb_alloc(text, strlen(text), 0, &allocator, NULL);
+        if (json)
+            break;
+        check_empty(&pool);
+    }
+
+    json_decref(json);
+    check_empty(&pool);
+}
+
+static void test_invalid(void) {
+    if (json_get_allocator(NULL) || json_get_allocator(json_true()) ||
+        json_get_allocator(json_integer_shared(1)))
+        fail("json_get_allocator returned an allocator for a static value");
+
+    if (json_stringn_alloc("\xff", 1, NULL))
+        fail("json_stringn_alloc accepted invalid UTF-8");
+
+    if (json_loadb_alloc(NULL, 0, 0, NULL, NULL))
+        fail("json_loadb_alloc accepted NULL");
+}
+
+static void run_tests() {
+    test_build();
+    test_load();
+    test_no_realloc();
+    test_oom();
+    test_invalid();
+}
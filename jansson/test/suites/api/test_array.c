@@ -7,6 +7,7 @@
 
 #include "util.h"
 #include <jansson.h>
+#include <string.h>
 
 static void test_misc(void) {
     json_t *array, *five, *seven, *value;
@@ -337,6 +338,200 @@ static void test_extend(void) {
     json_decref(array2);
 }
 
+static void test_reserve(void) {
+    json_t *array, *five;
+    int i;
+
+    array = json_array();
+    five = json_integer(5);
+
+    if (json_array_shrink_to_fit(array))
+        fail("unable to shrink an empty array");
+    if (json_array_reserve(array, 100))
+        fail("unable to reserve");
+    if (json_array_size(array) != 0)
+        fail("reserving changed the array size");
+
+    for (i = 0; i < 100; i++) {
+        if (json_array_append(array, five))
+            fail("unable to append");
+    }
+    if (json_array_insert(array, 50, five) || json_array_size(array) != 101)
+        fail("unable to insert past the reserved size");
+
+    json_array_remove(array, 0);
+    json_array_remove(array, 0);
+    if (json_array_shrink_to_fit(array) || json_array_size(array) != 99)
+        fail("unable to shrink");
+    for (i = 0; i < 99; i++) {
+        if (json_array_get(array, i) != five)
+            fail("invalid array contents after shrinking");
+    }
+    if (json_array_append(array, five) || json_array_get(array, 99) != five)
+        fail("unable to append after shrinking");
+
+    json_array_clear(array);
+    if (json_array_shrink_to_fit(array) || json_array_append(array, five) ||
+        json_array_size(array) != 1)
+        fail("unable to shrink a cleared array");
+
+    if (json_array_reserve(five, 10) != -1 || json_array_shrink_to_fit(five) != -1)
+        fail("reserving or shrinking a non-array succeeded");
+
+    json_decref(five);
+    json_decref(array);
+}
+
+static void check_sequence(json_t *array, json_int_t first, size_t size) {
+    size_t i;
+
+    if (json_array_size(array) != size)
+        fail("invalid array size");
+    for (i = 0; i < size; i++) {
+        if (json_integer_value(json_array_get(array, i)) != first + (json_int_t)i)
+            fail("invalid array contents");
+    }
+}
+
+static void test_queue(void) {
+    json_t *array, *other;
+    int i;
+
+    array = json_array();
+
+    /* append to the back and remove from the front */
+    for (i = 0; i < 1000; i++) {
+        if (json_array_append_new(array, json_integer(i)))
+            fail("unable to append");
+        if (i % 3 == 2 && json_array_remove(array, 0))
+            fail("unable to remove the first value");
+    }
+    check_sequence(array, 333, 667);
+
+    /* insert at the front */
+    for (i = 332; i >= 0; i--) {
+        if (json_array_insert_new(array, 0, json_integer(i)))
+            fail("unable to insert at the front");
+    }
+    check_sequence(array, 0, 1000);
+
+    /* insert and remove near both ends */
+    json_array_insert_new(array, 1, json_integer(-1));
+    json_array_insert_new(array, 999, json_integer(-1));
+    if (json_integer_value(json_array_get(array, 1)) != -1 ||
+        json_integer_value(json_array_get(array, 999)) != -1)
+        fail("invalid array contents after inserting");
+    json_array_remove(array, 999);
+    json_array_remove(array, 1);
+    check_sequence(array, 0, 1000);
+
+    /* extend an array and shrink it with values removed from the front */
+    for (i = 0; i < 500; i++)
+        json_array_remove(array, 0);
+    other = json_array();
+    for (i = 1000; i < 1100; i++)
+        json_array_append_new(other, json_integer(i));
+    if (json_array_extend(array, other))
+        fail("unable to extend");
+    check_sequence(array, 500, 600);
+    if (json_array_shrink_to_fit(array) || json_array_reserve(array, 2000))
+        fail("unable to shrink or reserve");
+    check_sequence(array, 500, 600);
+
+    /* empty the array from the front */
+    while (json_array_size(array))
+        json_array_remove(array, 0);
+    if (json_array_insert_new(array, 0, json_integer(0)))
+        fail("unable to insert into an emptied array");
+    check_sequence(array, 0, 1);
+
+    json_decref(other);
+    json_decref(array);
+}
+
+static void test_packed(void) {
+    json_t *array, *other, *copy, *value;
+    const json_int_t *integers;
+    int i;
+
+    if (json_packed_array(JSON_STRING) || json_packed_array(JSON_ARRAY))
+        fail("created a packed array of strings or arrays");
+
+    array = json_packed_array(JSON_INTEGER);
+    if (!array || json_array_integers(array) || json_array_size(array) != 0)
+        fail("unable to create a packed array of integers");
+
+    for (i = 0; i < 100; i++) {
+        if (json_array_append_new(array, json_integer(i)))
+            fail("unable to append to a packed array");
+    }
+    json_array_insert_new(array, 0, json_integer(-1));
+    json_array_remove(array, 0);
+    json_array_set_new(array, 99, json_integer(1000));
+    json_array_remove(array, 99);
+
+    integers = json_array_integers(array);
+    if (!integers || json_array_reals(array))
+        fail("an array of integers is not packed");
+    for (i = 0; i < 99; i++) {
+        if (integers[i] != i)
+            fail("invalid packed array contents");
+    }
+
+    /* copies and arrays of the same type stay packed */
+    copy = json_deep_copy(array);
+    other = json_packed_array(JSON_INTEGER);
+    json_array_append_new(other, json_integer(99));
+    if (json_array_extend(copy, other) || !json_array_integers(copy) ||
+        json_array_size(copy) != 100 || json_array_integers(copy)[99] != 99)
+        fail("unable to extend a packed array");
+    json_decref(other);
+
+    /* a boxed array with the same values is equal */
+    other = json_array();
+    for (i = 0; i < 100; i++)
+        json_array_append_new(other, json_integer(i));
+    if (!json_equal(copy, other) || !json_array_integers(copy))
+        fail("a packed array is not equal to a boxed one");
+    json_decref(other);
+    json_decref(copy);
+
+    /* a value of another type converts the array */
+    if (json_array_append_new(array, json_string("foo")) || json_array_integers(array))
+        fail("unable to append a string to a packed array");
+    if (json_integer_value(json_array_get(array, 98)) != 98 ||
+        strcmp(json_string_value(json_array_get(array, 99)), "foo"))
+        fail("invalid array contents after converting a packed array");
+    json_decref(array);
+
+    /* json_array_get() converts an array of numbers */
+    array = json_packed_array(JSON_REAL);
+    json_array_append_new(array, json_real(0.5));
+    json_array_append_new(array, json_real(1.5));
+    if (!json_array_reals(array) || json_array_reals(array)[1] != 1.5)
+        fail("an array of reals is not packed");
+    value = json_array_get(array, 1);
+    if (json_real_value(value) != 1.5 || json_array_get(array, 1) != value ||
+        json_array_reals(array))
+        fail("json_array_get returned a wrong value from a packed array");
+    json_decref(array);
+
+    /* but not an array of booleans */
+    array = json_packed_array(JSON_TRUE);
+    json_array_append_new(array, json_true());
+    json_array_append_new(array, json_false());
+    if (json_array_get(array, 0) != json_true() ||
+        json_array_get(array, 1) != json_false())
+        fail("json_array_get returned a wrong value from a packed array");
+    other = json_array();
+    json_array_append_new(other, json_integer(1));
+    if (json_array_extend(other, array) || json_array_size(other) != 3 ||
+        json_array_get(other, 2) != json_false())
+        fail("unable to extend an array with a packed array");
+    json_decref(other);
+    json_decref(array);
+}
+
 static void test_circular() {
     json_t *array1, *array2;
 
@@ -478,6 +673,9 @@ static void run_tests() {
     test_remove();
     test_clear();
     test_extend();
+    test_reserve();
+    test_queue();
+    test_packed();
     test_circular();
     test_array_foreach();
     test_bad_args();
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+
+static void check_encoding(json_t *json, const char *expected, size_t expected_len) {
+    char buffer[64];
+    size_t size;
+
+    size = json_dumpb_cbor(json, buffer, sizeof(buffer), JSON_ENCODE_ANY);
+    if (size != expected_len || memcmp(buffer, expected, size))
+        fail("json_dumpb_cbor returned an unexpected encoding");
+
+    json_decref(json);
+}
+
+static json_t *check_decoding(const char *input, size_t len) {
+    json_error_t error;
+    json_t *json;
+
+    json = json_loadb_cbor(input, len, JSON_DECODE_ANY, &error);
+    if (!json)
+        fail("json_loadb_cbor failed on valid input");
+    if (error.position != (int)len)
+        fail("json_loadb_cbor returned a wrong position");
+
+    return json;
+}
+
+static void check_load_error(const char *input, size_t len, size_t flags,
+                             enum json_error_code code) {
+    json_error_t error;
+    json_t *json;
+
+    json = json_loadb_cbor(input, len, flags, &error);
+    if (json)
+        fail("json_loadb_cbor succeeded on invalid input");
+    if (json_error_code(&error) != code)
+        fail("json_loadb_cbor returned a wrong error code");
+    if (strcmp(error.source, "<buffer>"))
+        fail("json_loadb_cbor returned a wrong error source");
+}
+
+static void encode_scalars() {
+    /* examples from RFC 8949, appendix A */
+    check_encoding(json_integer(0), "\x00", 1);
+    check_encoding(json_integer(23), "\x17", 1);
+    check_encoding(json_integer(24), "\x18\x18", 2);
+    check_encoding(json_integer(1000), "\x19\x03\xe8", 3);
+    check_encoding(json_integer(1000000), "\x1a\x00\x0f\x42\x40", 5);
+    check_encoding(json_integer(1000000000000LL),
+                   "\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00", 9);
+    check_encoding(json_integer(-1), "\x20", 1);
+    check_encoding(json_integer(-1000), "\x39\x03\xe7", 3);
+    check_encoding(json_real(1.1), "\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", 9);
+    check_encoding(json_real(100000.0), "\xfa\x47\xc3\x50\x00", 5);
+    check_encoding(json_true(), "\xf5", 1);
+    check_encoding(json_false(), "\xf4", 1);
+    check_encoding(json_null(), "\xf6", 1);
+    check_encoding(json_string("IETF"), "\x64IETF", 5);
+    check_encoding(json_string("\xc3\xbc"), "\x62\xc3\xbc", 3);
+    check_encoding(json_stringn("a\0b", 3), "\x63" "a\0b", 4);
+}
+
+static void encode_containers() {
+    json_t *json;
+    char buffer[2];
+
+    check_encoding(json_array(), "\x80", 1);
+    check_encoding(json_object(), "\xa0", 1);
+    check_encoding(json_pack("[i[ii][ii]]", 1, 2, 3, 4, 5),
+                   "\x83\x01\x82\x02\x03\x82\x04\x05", 8);
+    check_encoding(json_pack("{s:i,s:[ii]}", "a", 1, "b", 2, 3),
+                   "\xa2\x61\x61\x01\x61\x62\x82\x02\x03", 9);
+
+    json = json_integer(1);
+    if (json_dumpb_cbor(json, buffer, sizeof(buffer), 0) != 0)
+        fail("json_dumpb_cbor encoded a scalar without JSON_ENCODE_ANY");
+    json_decref(json);
+
+    /* the required size is returned when the buffer is too small */
+    json = json_pack("[sss]", "foo", "bar", "baz");
+    if (json_dumpb_cbor(json, buffer, sizeof(buffer), 0) != 13)
+        fail("json_dumpb_cbor returned a wrong size for a small buffer");
+
+    /* circular references are rejected */
+    json_array_append_new(json, json_object());
+    json_object_set(json_array_get(json, 3), "loop", json);
+    if (json_dumpb_cbor(json, NULL, 0, 0) != 0)
+        fail("json_dumpb_cbor didn't fail for a circular reference");
+    json_object_clear(json_array_get(json, 3));
+    json_decref(json);
+}
+
+static void decode_scalars() {
+    json_t *json;
+
+    json = check_decoding("\x1b\x7f\xff\xff\xff\xff\xff\xff\xff", 9);
+    if (json_integer_value(json) != 9223372036854775807LL)
+        fail("json_loadb_cbor decoded a wrong maximum integer");
+    json_decref(json);
+
+    json = check_decoding("\x3b\x7f\xff\xff\xff\xff\xff\xff\xff", 9);
+    if (json_integer_value(json) != -9223372036854775807LL - 1)
+        fail("json_loadb_cbor decoded a wrong minimum integer");
+    json_decref(json);
+
+    /* half precision: 1.0, 65504.0 and the smallest subnormal */
+    json = check_decoding("\xf9\x3c\x00", 3);
+    if (json_real_value(json) != 1.0)
+        fail("json_loadb_cbor decoded a wrong half precision real");
+    json_decref(json);
+
+    json = check_decoding("\xf9\x7b\xff", 3);
+    if (json_real_value(json) != 65504.0)
+        fail("json_loadb_cbor decoded a wrong half precision real");
+    json_decref(json);
+
+    json = check_decoding("\xf9\x00\x01", 3);
+    if (json_real_value(json) != 5.960464477539063e-8)
+        fail("json_loadb_cbor decoded a wrong half precision subnormal");
+    json_decref(json);
+
+    json = check_decoding("\xfa\x47\xc3\x50\x00", 5);
+    if (json_real_value(json) != 100000.0)
+        fail("json_loadb_cbor decoded a wrong single precision real");
+    json_decref(json);
+
+    /* tags are skipped */
+    json = check_decoding("\xc1\x1a\x51\x4b\x67\xb0", 6);
+    if (json_integer_value(json) != 1363896240)
+        fail("json_loadb_cbor didn't skip a tag");
+    json_decref(json);
+
+    json = json_loadb_cbor("\x18\x2a", 2, JSON_DECODE_ANY | JSON_DECODE_INT_AS_REAL,
+                           NULL);
+    if (!json_is_real(json) || json_real_value(json) != 42.0)
+        fail("json_loadb_cbor ignored JSON_DECODE_INT_AS_REAL");
+    json_decref(json);
+
+    json = json_loadb_cbor("\x63" "a\0b", 4, JSON_DECODE_ANY | JSON_ALLOW_NUL, NULL);
+    if (json_string_length(json) != 3 || memcmp(json_string_value(json), "a\0b", 3))
+        fail("json_loadb_cbor decoded a wrong string with JSON_ALLOW_NUL");
+    json_decref(json);
+}
+
+static void decode_containers() {
+    json_t *json, *expected;
+
+    expected = json_pack("[i[ii][ii]]", 1, 2, 3, 4, 5);
+
+    json = check_decoding("\x83\x01\x82\x02\x03\x82\x04\x05", 8);
+    if (!json_equal(json, expected))
+        fail("json_loadb_cbor decoded a wrong array");
+    json_decref(json);
+
+    /* indefinite lengths */
+    json = check_decoding("\x9f\x01\x82\x02\x03\x9f\x04\x05\xff\xff", 10);
+    if (!json_equal(json, expected))
+        fail("json_loadb_cbor decoded a wrong indefinite length array");
+    json_decref(json);
+    json_decref(expected);
+
+    expected = json_pack("{s:s,s:{s:i}}", "a", "A", "b", "c", 1);
+    json = check_decoding("\xbf\x61\x61\x61\x41\x61\x62\xa1\x61\x63\x01\xff", 12);
+    if (!json_equal(json, expected))
+        fail("json_loadb_cbor decoded a wrong indefinite length map");
+    json_decref(json);
+    json_decref(expected);
+}
+
+static void decode_errors() {
+    char deep[4096];
+    json_t *json;
+
+    memset(deep, '\x81', sizeof(deep));
+
+    check_load_error("", 0, 0, json_error_invalid_syntax);
+    check_load_error("\x01", 1, 0, json_error_invalid_syntax);
+    check_load_error("\x82\x01", 2, 0, json_error_premature_end_of_input);
+    check_load_error("\x9f\x01", 2, 0, json_error_premature_end_of_input);
+    check_load_error("\x19\x01", 2, JSON_DECODE_ANY, json_error_premature_end_of_input);
+    check_load_error("\x63\x61\x62", 3, JSON_DECODE_ANY,
+                     json_error_premature_end_of_input);
+    check_load_error("\x9b\x00\x00\x00\x01\x00\x00\x00\x00", 9, 0,
+                     json_error_premature_end_of_input);
+    check_load_error("\x80\x80", 2, 0, json_error_end_of_input_expected);
+    check_load_error("\x1b\x80\x00\x00\x00\x00\x00\x00\x00", 9, JSON_DECODE_ANY,
+                     json_error_numeric_overflow);
+    check_load_error("\x41\x00", 2, JSON_DECODE_ANY, json_error_invalid_syntax);
+    check_load_error("\x7f\x61\x61\xff", 4, JSON_DECODE_ANY, json_error_invalid_syntax);
+    check_load_error("\xf7", 1, JSON_DECODE_ANY, json_error_invalid_syntax);
+    check_load_error("\xff", 1, JSON_DECODE_ANY, json_error_invalid_syntax);
+    check_load_error("\xf9\x7e\x00", 3, JSON_DECODE_ANY, json_error_invalid_syntax);
+    check_load_error("\xf9\x7c\x00", 3, JSON_DECODE_ANY, json_error_invalid_syntax);
+    check_load_error("\x62\xc3\x28", 3, JSON_DECODE_ANY, json_error_invalid_utf8);
+    check_load_error("\x63" "a\0b", 4, JSON_DECODE_ANY, json_error_null_character);
+    check_load_error("\xa1\x01\x02", 3, 0, json_error_invalid_syntax);
+    check_load_error("\xa1\x63" "a\0b" "\x01", 6, 0, json_error_null_byte_in_key);
+    check_load_error("\xa2\x61\x61\x01\x61\x61\x02", 7, JSON_REJECT_DUPLICATES,
+                     json_error_duplicate_key);
+    check_load_error(deep, sizeof(deep), 0, json_error_stack_overflow);
+
+    json = json_loadb_cbor("\x80\x80", 2, JSON_DISABLE_EOF_CHECK, NULL);
+    if (!json)
+        fail("json_loadb_cbor ignored JSON_DISABLE_EOF_CHECK");
+    json_decref(json);
+}
+
+static void round_trip() {
+    const char *path = "json_dump_file_cbor.cbor";
+    json_t *json, *loaded, *record;
+    json_error_t error;
+    char *text, *buffer;
+    size_t size;
+    int i;
+
+    json = json_array();
+    for (i = 0; i < 1000; i++) {
+        record = json_pack("{s:i,s:f,s:s,s:b,s:n,s:[]}", "id", i * 7919 - 3000, "ratio",
+                           i / 3.0, "name", "\xe2\x82\xac player", "alive", i % 2,
+                           "team", "items");
+        json_array_append_new(json, record);
+    }
+
+    size = json_dumpb_cbor(json, NULL, 0, 0);
+    buffer = malloc(size);
+    if (json_dumpb_cbor(json, buffer, size, 0) != size)
+        fail("json_dumpb_cbor returned a different size the second time");
+
+    text = json_dumps(json, JSON_COMPACT);
+    if (size >= strlen(text))
+        fail("CBOR encoding is not smaller than compact JSON");
+    free(text);
+
+    loaded = json_loadb_cbor(buffer, size, 0, &error);
+    if (!json_equal(json, loaded))
+        fail("CBOR round trip changed the value");
+    json_decref(loaded);
+    free(buffer);
+
+    if (json_dump_file_cbor(json, path, JSON_ATOMIC_FILE))
+        fail("json_dump_file_cbor failed");
+
+    loaded = json_load_file_cbor(path, 0, &error);
+    if (!json_equal(json, loaded))
+        fail("CBOR file round trip changed the value");
+    if (strcmp(error.source, path))
+        fail("json_load_file_cbor returned a wrong source");
+    json_decref(loaded);
+    remove(path);
+
+    if (json_load_file_cbor(path, 0, &error) ||
+        json_error_code(&error) != json_error_cannot_open_file)
+        fail("json_load_file_cbor didn't fail for a missing file");
+
+    json_decref(json);
+}
+
+static void run_tests() {
+    encode_scalars();
+    encode_containers();
+    decode_scalars();
+    decode_containers();
+    decode_errors();
+    round_trip();
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <string.h>
+
+static void test_columns(void) {
+    json_columnar_t *columnar;
+    json_t *rows, *column;
+    const json_int_t *kills;
+    json_stats_t stats;
+
+    rows = json_loads("[{\"name\": \"a\", \"kills\": 10, \"ratio\": 0.5},"
+                      " {\"name\": \"b\", \"kills\": -3},"
+                      " 42,"
+                      " {\"kills\": 25, \"name\": \"c\", \"ratio\": 2.5}]",
+                      0, NULL);
+    if (!rows)
+        fail("unable to decode rows");
+
+    columnar = json_columnar(rows);
+    if (!columnar)
+        fail("unable to create a columnar view");
+    if (json_columnar_rows(columnar) != 4)
+        fail("columnar view has a wrong number of rows");
+    if (json_object_size(json_columnar_columns(columnar)) != 3)
+        fail("columnar view has a wrong number of columns");
+    if (json_columnar_column(columnar, "missing"))
+        fail("columnar view returned a column for a missing key");
+
+    /* the row that is not an object is null in every column */
+    column = json_columnar_column(columnar, "kills");
+    if (json_array_size(column) != 4 || !json_is_null(json_array_get(column, 2)) ||
+        json_integer_value(json_array_get(column, 3)) != 25)
+        fail("columnar view has a wrong integer column");
+
+    if (json_array_stats(column, &stats) || stats.count != 3 || stats.sum != 32.0 ||
+        stats.min != -3.0 || stats.max != 25.0)
+        fail("json_array_stats returned wrong stats for a column with nulls");
+
+    column = json_columnar_column(columnar, "ratio");
+    if (json_array_stats(column, &stats) || stats.count != 2 || stats.sum != 3.0 ||
+        stats.min != 0.5 || stats.max != 2.5)
+        fail("json_array_stats returned wrong stats for a real column");
+
+    column = json_columnar_column(columnar, "name");
+    if (strcmp(json_string_value(json_array_get(column, 1)), "b") ||
+        json_array_stats(column, &stats) || stats.count != 0)
+        fail("columnar view has a wrong string column");
+
+    json_columnar_free(columnar);
+    json_decref(rows);
+
+    /* complete rows give packed columns */
+    rows = json_pack("[{s:i},{s:i},{s:i}]", "kills", 7, "kills", 1, "kills", 4);
+    columnar = json_columnar(rows);
+    kills = json_array_integers(json_columnar_column(columnar, "kills"));
+    if (!kills || kills[0] != 7 || kills[1] != 1 || kills[2] != 4)
+        fail("columnar view didn't pack a complete integer column");
+    if (json_array_stats(json_columnar_column(columnar, "kills"), &stats) ||
+        stats.count != 3 || stats.sum != 12.0 || stats.min != 1.0 || stats.max != 7.0)
+        fail("json_array_stats returned wrong stats for a packed column");
+    json_columnar_free(columnar);
+    json_decref(rows);
+}
+
+static void test_bad_args(void) {
+    json_stats_t stats;
+    json_t *json;
+
+    json = json_object();
+    if (json_columnar(json) || json_columnar(NULL))
+        fail("json_columnar accepted a non-array");
+    if (json_array_stats(json, &stats) != -1)
+        fail("json_array_stats accepted a non-array");
+    json_decref(json);
+
+    json = json_array();
+    if (json_array_stats(json, NULL) != -1)
+        fail("json_array_stats accepted NULL stats");
+    if (json_array_stats(json, &stats) || stats.count != 0 || stats.sum != 0.0)
+        fail("json_array_stats returned wrong stats for an empty array");
+    json_decref(json);
+
+    if (json_columnar_rows(NULL) != 0 || json_columnar_column(NULL, "a") ||
+        json_columnar_columns(NULL))
+        fail("columnar functions accepted NULL");
+    json_columnar_free(NULL);
+}
+
+static void run_tests() {
+    test_columns();
+    test_bad_args();
+}
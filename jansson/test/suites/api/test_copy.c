@@ -364,6 +364,74 @@ static void test_deep_copy_circular_references(void) {
     json_decref(json);
 }
 
+static void test_cow_copy(void) {
+    const char *key;
+    json_t *json, *copy, *expected, *players, *value;
+
+    json = json_loads("{\"round\": 1, \"players\": {\"1\": {\"kills\": 3},"
+                      " \"2\": {\"kills\": 5}}, \"log\": [{\"x\": 1}]}",
+                      0, NULL);
+    if (!json)
+        fail("unable to parse an object");
+
+    copy = json_cow_copy(json);
+    if (!copy || copy == json || !json_equal(copy, json))
+        fail("json_cow_copy failed");
+
+    /* changes on either side, including through iteration, aren't seen
+       by the other */
+    players = json_object_get(json, "players");
+    json_integer_set(json_object_get(json_object_get(players, "1"), "kills"), 10);
+    json_object_del(players, "2");
+    json_integer_set(json_object_get(json, "round"), 2);
+
+    json_object_set_new(json_array_get(json_object_get(copy, "log"), 0), "x",
+                        json_integer(2));
+    json_array_append_new(json_object_get(copy, "log"), json_true());
+    json_object_foreach(json_object_get(copy, "players"), key, value) {
+        json_object_set_new(value, "seen", json_true());
+    }
+
+    expected = json_loads("{\"round\": 2, \"players\": {\"1\": {\"kills\": 10}},"
+                          " \"log\": [{\"x\": 1}]}",
+                          0, NULL);
+    if (!json_equal(json, expected))
+        fail("a change to a copy-on-write copy was seen by the original");
+    json_decref(expected);
+
+    expected = json_loads("{\"round\": 1, \"players\": {\"1\": {\"kills\": 3, \"seen\": "
+                          "true}, \"2\": {\"kills\": 5, \"seen\": true}},"
+                          " \"log\": [{\"x\": 2}, true]}",
+                          0, NULL);
+    if (!json_equal(copy, expected))
+        fail("a change to the original was seen by a copy-on-write copy");
+    json_decref(expected);
+
+    /* a value got after copying stays the one in its parent */
+    value = json_object_get(copy, "log");
+    if (json_object_get(json, "players") != players ||
+        json_object_get(copy, "log") != value)
+        fail("a copied value changed when got again");
+
+    /* once the original is gone, nothing is copied */
+    json_decref(json);
+    players = json_object_get(copy, "players");
+    if (json_object_get(copy, "players") != players)
+        fail("json_object_get copied a value that is no longer shared");
+    json_decref(copy);
+
+    /* scalars are copied right away */
+    json = json_integer(7);
+    copy = json_cow_copy(json);
+    if (copy == json || json_integer_value(copy) != 7)
+        fail("json_cow_copy failed for an integer");
+    json_decref(json);
+    json_decref(copy);
+
+    if (json_cow_copy(NULL))
+        fail("json_cow_copy accepted NULL");
+}
+
 static void run_tests() {
     test_copy_simple();
     test_deep_copy_simple();
@@ -372,4 +440,5 @@ static void run_tests() {
     test_copy_object();
     test_deep_copy_object();
     test_deep_copy_circular_references();
+    test_cow_copy();
 }
@@ -222,6 +222,55 @@ static void dump_file() {
     remove("json_dump_file.json");
 }
 
+static void dump_file_atomic() {
+    const char *path = "json_dump_file_atomic.json";
+    json_t *json, *inner, *loaded;
+    FILE *file;
+    int i;
+
+    json = json_array();
+    for (i = 0; i < 20000; i++)
+        json_array_append_new(json, json_pack("{si}", "id", i));
+
+    file = fopen(path, "w");
+    if (!file)
+        fail("unable to create file");
+    fputs("previous contents", file);
+    fclose(file);
+
+    if (json_dump_file(json, path, JSON_ATOMIC_FILE | JSON_FSYNC))
+        fail("json_dump_file failed with JSON_ATOMIC_FILE");
+
+    file = fopen("json_dump_file_atomic.json.tmp", "r");
+    if (file) {
+        fclose(file);
+        fail("json_dump_file left the temporary file behind");
+    }
+
+    loaded = json_load_file(path, 0, NULL);
+    if (!json_equal(json, loaded))
+        fail("json_dump_file wrote wrong contents with JSON_ATOMIC_FILE");
+    json_decref(loaded);
+
+    /* a failing encode must not touch the previous file */
+    inner = json_array();
+    json_array_append(json, inner);
+    json_array_append(inner, json);
+    if (json_dump_file(json, path, JSON_ATOMIC_FILE) != -1)
+        fail("json_dump_file didn't fail for a circular reference");
+    json_array_clear(inner);
+    json_array_remove(json, json_array_size(json) - 1);
+    json_decref(inner);
+
+    loaded = json_load_file(path, 0, NULL);
+    if (!json_equal(json, loaded))
+        fail("json_dump_file replaced the file after an error");
+    json_decref(loaded);
+
+    json_decref(json);
+    remove(path);
+}
+
 static void dumpb() {
     char buf[2];
     json_t *obj;
@@ -297,6 +346,91 @@ static void embed() {
     }
 }
 
+static size_t allocations;
+
+static void *counting_malloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+/* custom memory functions may not be thread safe, so with them the
+   encoding is sequential and allocates exactly as often */
+static void parallel_alloc_funcs(json_t *array) {
+    json_malloc_t orig_malloc;
+    json_free_t orig_free;
+    size_t sequential;
+    char *result;
+
+    json_get_alloc_funcs(&orig_malloc, &orig_free);
+    json_set_alloc_funcs(counting_malloc, free);
+
+    allocations = 0;
+    free(json_dumps(array, 0));
+    sequential = allocations;
+
+    allocations = 0;
+    result = json_dumps(array, JSON_PARALLEL);
+    if (!result || allocations != sequential)
+        fail("JSON_PARALLEL used workers with custom memory functions");
+    free(result);
+
+    json_set_alloc_funcs(orig_malloc, orig_free);
+}
+
+static void parallel() {
+    /* JSON_PARALLEL must produce exactly the sequential output */
+    const size_t flag_sets[] = {0,
+                                JSON_COMPACT,
+                                JSON_INDENT(2),
+                                JSON_INDENT(4) | JSON_SORT_KEYS,
+                                JSON_COMPACT | JSON_SORT_KEYS | JSON_ENSURE_ASCII,
+                                JSON_INDENT(1) | JSON_EMBED,
+                                JSON_EMBED | JSON_SORT_KEYS | JSON_REAL_PRECISION(4)};
+    json_t *array, *object;
+    size_t i, j;
+    char key[32];
+
+    array = json_array();
+    object = json_object();
+    for (i = 0; i < 5000; i++) {
+        json_t *item = json_pack("{s:i, s:f, s:s, s:[b, n, {}]}", "id", (int)i, "ratio",
+                                 i / 7.0, "name", "\xc3\xa4\"x\"", "flags", i % 2);
+        json_array_append(array, item);
+        snprintf(key, sizeof(key), "k%u", (unsigned int)((i * 7919) % 5000));
+        json_object_set_new(object, key, item);
+    }
+
+    for (i = 0; i < sizeof(flag_sets) / sizeof(flag_sets[0]); i++) {
+        json_t *values[2];
+        values[0] = array;
+        values[1] = object;
+
+        for (j = 0; j < 2; j++) {
+            char *sequential = json_dumps(values[j], flag_sets[i]);
+            char *parallel = json_dumps(values[j], flag_sets[i] | JSON_PARALLEL);
+
+            if (!sequential || !parallel)
+                fail("json_dumps failed");
+            if (strcmp(sequential, parallel))
+                fail("JSON_PARALLEL output differs from the sequential output");
+
+            free(sequential);
+            free(parallel);
+        }
+    }
+
+    parallel_alloc_funcs(array);
+
+    /* circular references are detected by every worker */
+    json_array_append(json_object_get(json_array_get(array, 4321), "flags"), array);
+    if (json_dumps(array, JSON_PARALLEL))
+        fail("json_dumps(JSON_PARALLEL) encoded a circular reference!");
+    json_array_remove(json_object_get(json_array_get(array, 4321), "flags"), 3);
+
+    json_decref(array);
+    json_decref(object);
+}
+
 static void run_tests() {
     encode_null();
     encode_twice();
@@ -305,7 +439,9 @@ static void run_tests() {
     escape_slashes();
     encode_nul_byte();
     dump_file();
+    dump_file_atomic();
     dumpb();
     dumpfd();
     embed();
+    parallel();
 }
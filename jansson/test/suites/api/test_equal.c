@@ -194,9 +194,107 @@ static void test_equal_complex() {
     json_decref(value3);
 }
 
+static void test_hash() {
+    json_t *value1, *value2, *child, *number;
+
+    value1 = json_loads("{\"a\": [1, 2.5, -0.0], \"b\": {\"c\": \"d\"}, \"e\": null}",
+                        JSON_DECODE_PACKED_ARRAYS, NULL);
+    value2 = json_loads("{\"e\": null, \"b\": {\"c\": \"d\"}, \"a\": [1, 2.5, 0.0]}",
+                        0, NULL);
+    if (!value1 || !value2)
+        fail("unable to parse JSON");
+
+    /* key order, packing and the sign of zero don't matter */
+    if (json_hash(value1) != json_hash(value2) || !json_equal(value1, value2))
+        fail("json_hash differs for equal values");
+    number = json_integer(1);
+    child = json_real(1.0);
+    if (json_hash(number) == json_hash(child) || json_hash(NULL) != 0)
+        fail("json_hash is wrong for scalars");
+    json_decref(number);
+    json_decref(child);
+
+    /* changes below the top level end the cached hashes */
+    child = json_object_get(value2, "b");
+    json_object_set_new(child, "c", json_string("x"));
+    if (json_hash(value1) == json_hash(value2) || json_equal(value1, value2))
+        fail("json_hash didn't change with a nested object");
+    json_object_set_new(child, "c", json_string("d"));
+    if (!json_equal(value1, value2))
+        fail("json_equal fails after undoing a change");
+
+    /* a value changed in place */
+    number = json_integer(5);
+    json_array_append(json_object_get(value2, "a"), number);
+    json_array_append_new(json_object_get(value1, "a"), json_integer(5));
+    if (!json_equal(value1, value2))
+        fail("json_equal fails for two equal objects");
+    json_integer_set(number, 6);
+    if (json_equal(value1, value2))
+        fail("json_equal didn't see a number set in place");
+
+    /* numbers and strings that were hashed can still be set in place */
+    json_hash(value2);
+    if (json_integer_set(number, 5) || !json_equal(value1, value2) ||
+        json_hash(value1) != json_hash(value2))
+        fail("json_hash didn't change with a hashed number set in place");
+    child = json_object_get(json_object_get(value2, "b"), "c");
+    json_string_set(child, "e");
+    if (json_hash(value1) == json_hash(value2) || json_equal(value1, value2))
+        fail("json_hash didn't change with a hashed string set in place");
+    json_string_set(child, "d");
+
+    /* a number that outlives the array it was hashed in */
+    json_array_remove(json_object_get(value2, "a"), 3);
+    json_array_append_new(json_object_get(value2, "a"), json_integer(5));
+    json_hash(value2);
+    json_decref(value2);
+    if (json_integer_set(number, 7) || json_integer_value(number) != 7)
+        fail("json_integer_set failed after the document was freed");
+    json_decref(number);
+
+    /* a container that was kept before it was stored */
+    value2 = json_deep_copy(value1);
+    child = json_object();
+    json_object_set_new(value1, "f", json_incref(child));
+    json_object_set_new(value2, "f", json_object());
+    if (!json_equal(value1, value2))
+        fail("json_equal fails for two equal objects");
+    json_object_set_new(child, "g", json_true());
+    if (json_equal(value1, value2))
+        fail("json_hash didn't change with a kept object");
+
+    /* a container stored in two documents */
+    json_object_set(value2, "f", child);
+    if (json_hash(value1) != json_hash(value2))
+        fail("json_hash differs for equal values");
+    json_object_set_new(child, "h", json_false());
+    if (json_hash(value1) != json_hash(value2) || !json_equal(value1, value2))
+        fail("json_hash differs after changing a shared object");
+    json_object_set_new(value1, "f", json_object());
+    if (json_hash(value1) == json_hash(value2) || json_equal(value1, value2))
+        fail("json_hash didn't change with a shared object");
+    json_decref(child);
+
+    /* circular references are an error */
+    child = json_array();
+    json_object_set(value1, "f", child);
+    json_array_append(child, value1);
+    if (json_hash(value1) != 0 || json_hash(child) != 0)
+        fail("json_hash accepted a circular reference");
+    json_array_clear(child);
+    if (json_hash(value1) == 0)
+        fail("json_hash failed after a circular reference was removed");
+    json_decref(child);
+
+    json_decref(value1);
+    json_decref(value2);
+}
+
 static void run_tests() {
     test_equal_simple();
     test_equal_array();
     test_equal_object();
     test_equal_complex();
+    test_hash();
 }
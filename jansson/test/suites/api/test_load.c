@@ -164,6 +164,62 @@ static void allow_nul() {
     json_decref(json);
 }
 
+static void decode_shared_ints() {
+    json_t *json;
+
+    json = json_loads("[1, 1, 5000, -7]", JSON_DECODE_SHARED_INTS, NULL);
+    if (!json || json_array_get(json, 0) != json_array_get(json, 1) ||
+        json_array_get(json, 0) != json_integer_shared(1) ||
+        json_integer_value(json_array_get(json, 2)) != 5000 ||
+        json_array_get(json, 3) != json_integer_shared(-7))
+        fail("json_loads returned wrong shared integers");
+    json_decref(json);
+
+    json = json_loads("[1]", 0, NULL);
+    if (!json || json_array_get(json, 0) == json_integer_shared(1))
+        fail("json_loads returned a shared integer without the flag");
+    json_decref(json);
+}
+
+static void decode_packed_arrays() {
+    const json_int_t *integers;
+    const double *reals;
+    json_t *json, *boxed;
+    char *text;
+
+    json = json_loads("[[1, -2, 3], [0.5, 1.5], [true, false], [1, 2.5], []]",
+                      JSON_DECODE_PACKED_ARRAYS, NULL);
+    boxed = json_loads("[[1, -2, 3], [0.5, 1.5], [true, false], [1, 2.5], []]", 0, NULL);
+    if (!json || !boxed)
+        fail("json_loads failed with JSON_DECODE_PACKED_ARRAYS");
+
+    integers = json_array_integers(json_array_get(json, 0));
+    if (!integers || integers[0] != 1 || integers[1] != -2 || integers[2] != 3)
+        fail("json_loads didn't pack an array of integers");
+
+    reals = json_array_reals(json_array_get(json, 1));
+    if (!reals || reals[0] != 0.5 || reals[1] != 1.5)
+        fail("json_loads didn't pack an array of reals");
+
+    if (json_array_integers(json_array_get(json, 3)) ||
+        json_array_reals(json_array_get(json, 3)))
+        fail("json_loads packed a mixed array");
+
+    if (!json_equal(json, boxed))
+        fail("packed arrays are not equal to the same arrays decoded normally");
+
+    text = json_dumps(json, JSON_COMPACT);
+    if (!text || strcmp(text, "[[1,-2,3],[0.5,1.5],[true,false],[1,2.5],[]]"))
+        fail("packed arrays were encoded wrong");
+    free(text);
+
+    if (json_array_integers(json_array_get(boxed, 0)))
+        fail("json_loads packed an array without the flag");
+
+    json_decref(boxed);
+    json_decref(json);
+}
+
 static void load_wrong_args() {
     json_t *json;
     json_error_t error;
@@ -232,6 +288,8 @@ static void run_tests() {
     decode_any();
     decode_int_as_real();
     allow_nul();
+    decode_shared_ints();
+    decode_packed_arrays();
     load_wrong_args();
     position();
     error_code();
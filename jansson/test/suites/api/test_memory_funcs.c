@@ -102,14 +102,60 @@ static void test_secure_funcs(void) {
     create_and_free_complex_object();
 }
 
+static int realloc_called = 0;
+
+static void *my_realloc(void *ptr, size_t size) {
+    realloc_called++;
+    return realloc(ptr, size);
+}
+
+static void test_realloc_func(void) {
+    json_realloc_t rfunc = my_realloc;
+    json_t *array;
+    int i;
+
+    /* custom allocation functions disable the default realloc() */
+    json_set_alloc_funcs(my_malloc, my_free);
+    json_get_realloc_func(&rfunc);
+    if (rfunc != NULL)
+        fail("json_set_alloc_funcs didn't reset the realloc function");
+
+    array = json_array();
+    for (i = 0; i < 100; i++)
+        json_array_append_new(array, json_integer(i));
+    if (json_integer_value(json_array_get(array, 99)) != 99)
+        fail("growing an array without a realloc function failed");
+    json_decref(array);
+
+    json_set_realloc_func(my_realloc);
+    json_get_realloc_func(&rfunc);
+    if (rfunc != my_realloc)
+        fail("json_get_realloc_func returned a wrong function");
+
+    array = json_array();
+    for (i = 0; i < 100; i++)
+        json_array_append_new(array, json_integer(i));
+    json_array_shrink_to_fit(array);
+    if (realloc_called < 2 || json_integer_value(json_array_get(array, 99)) != 99)
+        fail("growing an array with a realloc function failed");
+    json_decref(array);
+
+    json_set_alloc_funcs(malloc, free);
+    json_get_realloc_func(&rfunc);
+    if (rfunc != realloc)
+        fail("json_set_alloc_funcs didn't restore realloc()");
+}
+
 static void test_bad_args(void) {
     /* The result of this test is not crashing. */
     json_get_alloc_funcs(NULL, NULL);
+    json_get_realloc_func(NULL);
 }
 
 static void run_tests() {
     test_simple();
     test_secure_funcs();
     test_oom();
+    test_realloc_func();
     test_bad_args();
 }
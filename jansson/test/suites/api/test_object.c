@@ -612,6 +612,450 @@ static void test_preserve_order() {
     json_decref(object);
 }
 
+static void test_order_after_growth_and_removal() {
+    char key[16];
+    const char *iter_key;
+    json_t *object, *value;
+    void *iter;
+    int i, expected;
+
+    object = json_object();
+
+    /* grow through several index sizes, remove two thirds of the keys
+       and add new ones into the reclaimed space */
+    for (i = 0; i < 3000; i++) {
+        snprintf(key, sizeof(key), "%d", i);
+        json_object_set_new(object, key, json_integer(i));
+    }
+    for (i = 0; i < 3000; i++) {
+        if (i % 3 == 0)
+            continue;
+        snprintf(key, sizeof(key), "%d", i);
+        if (json_object_del(object, key))
+            fail("unable to delete a key");
+    }
+    for (i = 3000; i < 6000; i += 3) {
+        snprintf(key, sizeof(key), "%d", i);
+        json_object_set_new(object, key, json_integer(i));
+    }
+
+    if (json_object_size(object) != 2000)
+        fail("wrong object size after removals");
+
+    expected = 0;
+    json_object_foreach(object, iter_key, value) {
+        if (json_integer_value(value) != expected)
+            fail("insertion order not preserved after removals");
+
+        snprintf(key, sizeof(key), "%d", expected);
+        if (strcmp(iter_key, key) || json_object_get(object, key) != value)
+            fail("wrong key or value after removals");
+
+        expected += 3;
+    }
+    if (expected != 6000)
+        fail("not all keys iterated after removals");
+
+    /* an iterator survives insertions that rehash the object */
+    iter = json_object_iter_at(object, "2997");
+    for (i = 6000; i < 9000; i++) {
+        snprintf(key, sizeof(key), "%d", i);
+        json_object_set_new(object, key, json_integer(i));
+    }
+    iter = json_object_iter_next(object, iter);
+    if (!iter || strcmp(json_object_iter_key(iter), "3000"))
+        fail("iterator invalidated by a rehash");
+
+    json_object_clear(object);
+    if (json_object_iter(object))
+        fail("cleared object has an iterator");
+
+    json_object_set_new(object, "a", json_integer(1));
+    if (json_integer_value(json_object_get(object, "a")) != 1)
+        fail("unable to reuse a cleared object");
+
+    json_decref(object);
+}
+
+static void test_keys_with_length() {
+    json_t *object, *copy, *value;
+    char *result;
+    void *iter;
+
+    object = json_object();
+
+    /* keys are compared by length as well as by content */
+    if (json_object_setn_new(object, "a\0b", 3, json_integer(1)) ||
+        json_object_setn_new(object, "a", 1, json_integer(2)) ||
+        json_object_setn_new(object, "abc", 2, json_integer(3)))
+        fail("unable to set keys with a length");
+
+    if (json_object_size(object) != 3)
+        fail("wrong object size after setting keys with a length");
+
+    if (json_integer_value(json_object_getn(object, "a\0b", 3)) != 1 ||
+        json_integer_value(json_object_get(object, "a")) != 2 ||
+        json_integer_value(json_object_get(object, "ab")) != 3)
+        fail("wrong values for keys with a length");
+
+    if (json_object_getn(object, "a\0c", 3) || json_object_getn(object, "a", 0))
+        fail("json_object_getn found a missing key");
+
+    if (json_object_setn_new(object, "\xff", 1, json_integer(4)) == 0)
+        fail("json_object_setn_new accepted invalid UTF-8");
+
+    iter = json_object_iter(object);
+    if (json_object_iter_key_len(iter) != 3 ||
+        memcmp(json_object_iter_key(iter), "a\0b", 4))
+        fail("wrong key or length from the iterator");
+    if (json_object_iter_key_len(NULL) != 0)
+        fail("json_object_iter_key_len returned a length for NULL");
+
+    result = json_dumps(object, JSON_SORT_KEYS | JSON_COMPACT);
+    if (!result || strcmp(result, "{\"a\":2,\"a\\u0000b\":1,\"ab\":3}"))
+        fail("wrong dump of keys with a length");
+    free(result);
+
+    copy = json_deep_copy(object);
+    if (!json_equal(copy, object) || json_object_size(copy) != 3)
+        fail("deep copy lost keys with a length");
+    value = json_object_getn(copy, "a\0b", 3);
+    if (json_integer_value(value) != 1)
+        fail("deep copy changed a key with a length");
+    json_decref(copy);
+
+    if (json_object_deln(object, "a\0b", 3) || json_object_size(object) != 2)
+        fail("unable to delete a key with a length");
+    if (json_object_deln(object, "a\0b", 3) == 0)
+        fail("deleted a missing key with a length");
+    if (!json_object_get(object, "a"))
+        fail("deleting a key with a length removed a prefix key");
+
+    json_decref(object);
+}
+
+static void test_small_to_hashed() {
+    char key[16];
+    const char *iter_key;
+    json_t *object, *value;
+    void *tmp;
+    int i, expected;
+
+    object = json_object();
+
+    /* removals and replacements while the object is small */
+    for (i = 0; i < 6; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        json_object_set_new(object, key, json_integer(i));
+    }
+    json_object_del(object, "key1");
+    json_object_del(object, "key5");
+    json_object_set_new(object, "key2", json_integer(20));
+    json_object_set_new(object, "key1", json_integer(1));
+
+    expected = 0;
+    json_object_foreach(object, iter_key, value) {
+        static const char *const keys[] = {"key0", "key2", "key3", "key4", "key1"};
+        if (expected >= 5 || strcmp(iter_key, keys[expected]))
+            fail("wrong order in a small object");
+        expected++;
+    }
+    if (expected != 5 || json_integer_value(json_object_get(object, "key2")) != 20)
+        fail("wrong contents of a small object");
+
+    /* the object keeps its order and contents when it grows past the
+       small size */
+    json_object_clear(object);
+    for (i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        json_object_set_new(object, key, json_integer(i));
+
+        if (json_object_size(object) != (size_t)i + 1)
+            fail("wrong size while growing");
+        snprintf(key, sizeof(key), "key%d", i / 2);
+        if (json_integer_value(json_object_get(object, key)) != i / 2)
+            fail("lost a key while growing");
+    }
+
+    expected = 0;
+    json_object_foreach(object, iter_key, value) {
+        if (json_integer_value(value) != expected++)
+            fail("wrong order after growing");
+    }
+
+    json_object_foreach_safe(object, tmp, iter_key, value) {
+        if (json_integer_value(value) % 2)
+            json_object_del(object, iter_key);
+    }
+    if (json_object_size(object) != 50 || json_object_get(object, "key1"))
+        fail("wrong contents after deleting while iterating");
+
+    json_decref(object);
+}
+
+static void test_iter_survives_growth() {
+    char key[16];
+    const char *first_key;
+    json_t *object, *first, *second;
+    void *iter;
+    int i;
+
+    /* adding keys doesn't move the pairs, neither while the object is
+       small nor when it's hashed */
+    object = json_object();
+    first = json_integer(0);
+    second = json_integer(1);
+    json_object_set_new(object, "first", first);
+    json_object_set_new(object, "second", second);
+
+    iter = json_object_iter(object);
+    first_key = json_object_iter_key(iter);
+
+    for (i = 0; i < 40; i++) {
+        snprintf(key, sizeof(key), "a longer key number %d", i);
+        json_object_set_new(object, key, json_integer(i));
+    }
+
+    if (json_object_iter_value(iter) != first || strcmp(first_key, "first") ||
+        json_object_iter_key(iter) != first_key)
+        fail("iterator was invalidated by adding keys");
+
+    iter = json_object_iter_next(object, iter);
+    if (json_object_iter_value(iter) != second)
+        fail("iterator didn't continue after adding keys");
+
+    json_object_iter_set_new(object, iter, json_integer(2));
+    if (json_integer_value(json_object_get(object, "second")) != 2)
+        fail("json_object_iter_set didn't set after adding keys");
+
+    json_decref(object);
+}
+
+static void test_prehashed_keys() {
+    char name[16];
+    json_key_t *key, *missing;
+    json_t *object;
+    int i;
+
+    key = json_key("kills");
+    missing = json_keyn("a\0b", 3);
+    if (!key || !missing)
+        fail("unable to create key handles");
+    if (strcmp(json_key_value(key), "kills") || json_key_length(missing) != 3)
+        fail("wrong key handle contents");
+    if (json_key("\xff") || json_key(NULL) || json_key_value(NULL))
+        fail("invalid keys accepted");
+
+    object = json_object();
+
+    /* small objects, then the same keys once the object is hashed */
+    for (i = 0; i < 2; i++) {
+        if (json_object_set_by_key_new(object, key, json_integer(i)))
+            fail("json_object_set_by_key_new failed");
+        if (json_integer_value(json_object_get(object, "kills")) != i ||
+            json_object_get_by_key(object, key) != json_object_get(object, "kills"))
+            fail("json_object_get_by_key returned a wrong value");
+        if (json_object_get_by_key(object, missing))
+            fail("json_object_get_by_key found a missing key");
+
+        if (json_object_del_by_key(object, key) || json_object_get(object, "kills"))
+            fail("json_object_del_by_key failed");
+        if (json_object_del_by_key(object, key) == 0)
+            fail("json_object_del_by_key deleted a missing key");
+        json_object_set_new(object, "kills", json_integer(i));
+
+        while (json_object_size(object) < 20) {
+            snprintf(name, sizeof(name), "key%d", (int)json_object_size(object));
+            json_object_set_new(object, name, json_null());
+        }
+    }
+
+    if (json_object_size(object) != 20)
+        fail("wrong object size after setting by key");
+
+    if (json_object_get_by_key(NULL, key) || json_object_get_by_key(object, NULL) ||
+        json_object_set_by_key(object, NULL, object) == 0 ||
+        json_object_del_by_key(object, NULL) == 0)
+        fail("NULL arguments accepted");
+
+    json_key_free(key);
+    json_key_free(missing);
+    json_key_free(NULL);
+    json_decref(object);
+}
+
+static void test_integer_keys() {
+    json_t *object, *value;
+    json_int_t key;
+    char *text;
+    int i;
+
+    object = json_loads("{\"7\": 1, \"-3\": 2, \"07\": 3, \"x\": 4}", 0, NULL);
+    if (!object)
+        fail("unable to decode an object");
+
+    /* without an index the key is formatted */
+    if (json_integer_value(json_object_get_by_int(object, -3)) != 2 ||
+        json_object_get_by_int(object, 8))
+        fail("json_object_get_by_int returned a wrong value without an index");
+
+    /* the first set builds the index, skipping keys that aren't canonical */
+    if (json_object_set_by_int_new(object, 0, json_integer(5)))
+        fail("json_object_set_by_int_new failed");
+    if (json_integer_value(json_object_get_by_int(object, 7)) != 1 ||
+        json_integer_value(json_object_get_by_int(object, -3)) != 2 ||
+        json_integer_value(json_object_get_by_int(object, 0)) != 5 ||
+        json_object_get_by_int(object, 70))
+        fail("json_object_get_by_int returned a wrong value with an index");
+
+    text = json_dumps(object, JSON_COMPACT);
+    if (strcmp(text, "{\"7\":1,\"-3\":2,\"07\":3,\"x\":4,\"0\":5}"))
+        fail("an object with integer keys encoded wrong");
+    free(text);
+
+    /* string keyed changes keep the index up to date */
+    json_object_set_new(object, "7", json_integer(10));
+    json_object_del(object, "-3");
+    json_object_iter_set_new(object, json_object_iter_at(object, "0"), json_integer(11));
+    if (json_integer_value(json_object_get_by_int(object, 7)) != 10 ||
+        json_object_get_by_int(object, -3) ||
+        json_integer_value(json_object_get_by_int(object, 0)) != 11)
+        fail("the integer index is out of date");
+
+    /* enough keys to grow the index and collide, removed in another order */
+    for (i = -500; i < 500; i++) {
+        if (json_object_set_by_int_new(object, i * 1024, json_integer(i)))
+            fail("json_object_set_by_int_new failed");
+    }
+    for (i = 0; i < 500; i++) {
+        if (json_object_del_by_int(object, i * 1024))
+            fail("json_object_del_by_int failed");
+    }
+    if (json_object_del_by_int(object, 1024) == 0)
+        fail("json_object_del_by_int deleted a missing key");
+    for (i = -500; i < 500; i++) {
+        value = json_object_get_by_int(object, i * 1024);
+        if (i < 0 ? json_integer_value(value) != i : value != NULL)
+            fail("wrong value after deleting integer keys");
+    }
+    if (json_integer_value(json_object_get_by_int(object, 7)) != 10 ||
+        json_integer_value(json_object_get(object, "-512000")) != -500)
+        fail("wrong values after growing the integer index");
+
+    /* keys too long for the index, and the most negative integer */
+    key = 1234567890123456789LL;
+    json_object_set_by_int_new(object, key, json_true());
+    json_object_set_by_int_new(object, -9223372036854775807LL - 1, json_false());
+    json_object_set_new(object, "-1234567890123456789", json_null());
+    if (!json_is_true(json_object_get(object, "1234567890123456789")) ||
+        !json_is_true(json_object_get_by_int(object, key)) ||
+        !json_is_false(json_object_get(object, "-9223372036854775808")) ||
+        !json_is_null(json_object_get_by_int(object, -key)))
+        fail("wrong value for a long integer key");
+
+    json_object_clear(object);
+    if (json_object_get_by_int(object, 7) ||
+        json_object_set_by_int(object, 1, object) == 0)
+        fail("wrong result after clearing an object with integer keys");
+
+    if (json_object_get_by_int(NULL, 1) ||
+        json_object_set_by_int_new(NULL, 1, json_null()) == 0 ||
+        json_object_set_by_int_new(object, 1, NULL) == 0 ||
+        json_object_del_by_int(NULL, 1) == 0)
+        fail("json_object_*_by_int accepted bad arguments");
+
+    json_decref(object);
+}
+
+static void test_shared_keys() {
+    const char *text = "[{\"id\": 1, \"name\": \"a\", \"tags\": [{\"k\": 1}]},"
+                       " {\"id\": 2, \"name\": \"b\", \"tags\": [{\"k\": 2}]},"
+                       " {\"id\": 3, \"name\": \"c\", \"tags\": []}]";
+    const char *key;
+    json_t *json, *copy, *first, *second, *value;
+    void *tmp;
+    int count;
+
+    /* without the flag, each record has keys of its own */
+    json = json_loads(text, 0, NULL);
+    if (!json)
+        fail("unable to parse records");
+    first = json_array_get(json, 0);
+    second = json_array_get(json, 1);
+    if (json_object_iter_value(json_object_key_to_iter(json_object_iter_key(
+            json_object_iter(second)))) != json_object_get(second, "id"))
+        fail("records share their keys without JSON_DECODE_SHARED_KEYS");
+    json_decref(json);
+
+    /* decoded records with the same keys share them, which must not
+       be visible through the API */
+    json = json_loads(text, JSON_DECODE_SHARED_KEYS, NULL);
+    if (!json)
+        fail("unable to parse records");
+    copy = json_deep_copy(json);
+
+    first = json_array_get(json, 0);
+    second = json_array_get(json, 1);
+    if (json_integer_value(json_object_get(second, "id")) != 2 ||
+        strcmp(json_string_value(json_object_get(second, "name")), "b"))
+        fail("wrong values in a record");
+
+    count = 0;
+    json_object_foreach(second, key, value) {
+        static const char *const keys[] = {"id", "name", "tags"};
+        if (count >= 3 || strcmp(key, keys[count]) ||
+            json_object_get(second, key) != value ||
+            json_object_iter_key_len(json_object_key_to_iter(key)) != strlen(key))
+            fail("wrong iteration over a record");
+        count++;
+    }
+    if (count != 3)
+        fail("wrong number of keys in a record");
+
+    /* replacing a value changes only its own record */
+    json_object_set_new(second, "id", json_integer(20));
+    json_object_iter_set_new(second, json_object_key_to_iter(json_object_iter_key(
+                                         json_object_iter(second))),
+                             json_integer(21));
+    if (json_integer_value(json_object_get(first, "id")) != 1 ||
+        json_integer_value(json_object_get(second, "id")) != 21)
+        fail("setting a value of a record changed another one");
+
+    /* removing a key while iterating */
+    json_object_foreach_safe(first, tmp, key, value) {
+        if (strcmp(key, "name"))
+            json_object_del(first, key);
+    }
+    if (json_object_size(first) != 1 || json_object_get(first, "id") ||
+        !json_object_get(first, "name") || json_object_size(second) != 3 ||
+        json_object_del(first, "id") == 0)
+        fail("wrong contents after deleting from a record");
+
+    /* adding a key, including a removed one, goes to the end */
+    json_object_set_new(first, "id", json_integer(1));
+    json_object_set_new(second, "extra", json_true());
+    if (strcmp(json_object_iter_key(json_object_iter(first)), "name") ||
+        json_object_size(second) != 4 || !json_object_get(second, "extra") ||
+        json_object_get(json_array_get(json, 2), "extra"))
+        fail("wrong contents after adding to a record");
+
+    json_object_set_new(first, "name", json_string("a"));
+    json_object_del(first, "id");
+    json_object_set_new(first, "id", json_integer(1));
+    json_object_set(first, "tags", json_object_get(json_array_get(copy, 0), "tags"));
+    json_object_set_new(second, "id", json_integer(2));
+    json_object_del(second, "extra");
+    if (!json_equal(json, copy))
+        fail("records differ after restoring them");
+
+    json_object_clear(json_array_get(json, 2));
+    if (json_object_size(json_array_get(json, 2)) != 0)
+        fail("clearing a record failed");
+
+    json_decref(copy);
+    json_decref(json);
+}
+
 static void test_object_foreach() {
     const char *key;
     json_t *object1, *object2, *value;
@@ -791,6 +1235,13 @@ static void run_tests() {
     test_set_nocheck();
     test_iterators();
     test_preserve_order();
+    test_order_after_growth_and_removal();
+    test_keys_with_length();
+    test_small_to_hashed();
+    test_iter_survives_growth();
+    test_prehashed_keys();
+    test_integer_keys();
+    test_shared_keys();
     test_object_foreach();
     test_object_foreach_safe();
     test_bad_args();
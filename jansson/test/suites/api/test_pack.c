@@ -63,7 +63,7 @@ static void run_tests() {
     value = json_pack("b", 1);
     if (!json_is_true(value))
         fail("json_pack boolean failed");
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("json_pack boolean refcount failed");
     json_decref(value);
 
@@ -71,7 +71,7 @@ static void run_tests() {
     value = json_pack("b", 0);
     if (!json_is_false(value))
         fail("json_pack boolean failed");
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("json_pack boolean refcount failed");
     json_decref(value);
 
@@ -79,7 +79,7 @@ static void run_tests() {
     value = json_pack("n");
     if (!json_is_null(value))
         fail("json_pack null failed");
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("json_pack null refcount failed");
     json_decref(value);
 
@@ -127,7 +127,7 @@ static void run_tests() {
     value = json_pack("s?", NULL);
     if (!json_is_null(value))
         fail("json_pack nullable string (NULL case) failed");
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("json_pack nullable string (NULL case) refcount failed");
     json_decref(value);
 
@@ -239,7 +239,7 @@ static void run_tests() {
     value = json_pack("o?", NULL);
     if (!json_is_null(value))
         fail("json_pack nullable object (NULL case) failed");
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("json_pack nullable object (NULL case) refcount failed");
     json_decref(value);
 
@@ -266,7 +266,7 @@ static void run_tests() {
     value = json_pack("O?", NULL);
     if (!json_is_null(value))
         fail("json_pack incref'd nullable object (NULL case) failed");
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("json_pack incref'd nullable object (NULL case) refcount failed");
 
     /* simple object */
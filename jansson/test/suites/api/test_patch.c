@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <string.h>
+
+static json_t *load(const char *text) {
+    json_t *json = json_loads(text, JSON_DECODE_PACKED_ARRAYS, NULL);
+    if (!json)
+        fail("unable to load a test document");
+    return json;
+}
+
+/* Diff two documents, compare the patch to the expected one and check
+   that it turns the first into the second */
+static void check_diff(const char *text1, const char *text2, const char *expected_text) {
+    json_t *json1, *json2, *patch, *expected;
+
+    json1 = load(text1);
+    json2 = load(text2);
+    expected = load(expected_text);
+
+    patch = json_diff(json1, json2);
+    if (!patch || !json_equal(patch, expected)) {
+        fprintf(stderr, "diff: %s -> %s\n", text1, text2);
+        fail("json_diff returned a wrong patch");
+    }
+    if (json_patch_apply(json1, patch) || !json_equal(json1, json2)) {
+        fprintf(stderr, "diff: %s -> %s\n", text1, text2);
+        fail("json_patch_apply didn't apply a diff");
+    }
+
+    json_decref(json1);
+    json_decref(json2);
+    json_decref(patch);
+    json_decref(expected);
+}
+
+static void test_diff(void) {
+    json_t *json1, *json2, *patch, *expected;
+
+    check_diff("{\"a\": 1, \"b\": [1, 2]}", "{\"a\": 1, \"b\": [1, 2]}", "[]");
+    check_diff("{\"a\": 1, \"b\": 2}", "{\"a\": 3, \"c\": 4}",
+               "[{\"op\": \"replace\", \"path\": \"/a\", \"value\": 3},"
+               " {\"op\": \"remove\", \"path\": \"/b\"},"
+               " {\"op\": \"add\", \"path\": \"/c\", \"value\": 4}]");
+    check_diff("{\"a\": {\"b\": {\"c\": 1, \"d\": 2}}}",
+               "{\"a\": {\"b\": {\"c\": 1, \"d\": 3}}}",
+               "[{\"op\": \"replace\", \"path\": \"/a/b/d\", \"value\": 3}]");
+    check_diff("{\"a/b\": 1, \"m~n\": 2}", "{\"a/b\": 2}",
+               "[{\"op\": \"replace\", \"path\": \"/a~1b\", \"value\": 2},"
+               " {\"op\": \"remove\", \"path\": \"/m~0n\"}]");
+    check_diff("{\"a\": [1]}", "{\"a\": {\"0\": 1}}",
+               "[{\"op\": \"replace\", \"path\": \"/a\", \"value\": {\"0\": 1}}]");
+
+    /* elements added or removed anywhere are one operation each */
+    check_diff("[1, 2, 3]", "[1, 2, 3, 4, 5]",
+               "[{\"op\": \"add\", \"path\": \"/3\", \"value\": 4},"
+               " {\"op\": \"add\", \"path\": \"/4\", \"value\": 5}]");
+    check_diff("[1, 2, 3, 4]", "[1, 4]",
+               "[{\"op\": \"remove\", \"path\": \"/2\"},"
+               " {\"op\": \"remove\", \"path\": \"/1\"}]");
+    check_diff("[{\"a\": 1}, {\"b\": 2}]", "[{\"x\": 0}, {\"a\": 1}, {\"b\": 2}]",
+               "[{\"op\": \"add\", \"path\": \"/0\", \"value\": {\"x\": 0}}]");
+    check_diff("[1, {\"a\": 1, \"b\": 2}, 3]", "[1, {\"a\": 1, \"b\": 3}, 3]",
+               "[{\"op\": \"replace\", \"path\": \"/1/b\", \"value\": 3}]");
+    check_diff("[1.5, 2.5]", "[1.5, 3.5, 2.5]",
+               "[{\"op\": \"add\", \"path\": \"/1\", \"value\": 3.5}]");
+
+    /* the document can only be replaced by a value of the same type */
+    json1 = load("[1, 2]");
+    json2 = load("{}");
+    patch = json_diff(json1, json2);
+    expected = load("[{\"op\": \"replace\", \"path\": \"\", \"value\": {}}]");
+    if (!json_equal(patch, expected))
+        fail("json_diff didn't replace the document");
+    if (!json_patch_apply(json1, patch))
+        fail("json_patch_apply changed the type of the document");
+
+    json_decref(json1);
+    json_decref(json2);
+    json_decref(patch);
+    json_decref(expected);
+}
+
+static void test_diff_cow(void) {
+    json_t *json1, *json2, *value, *patch, *expected;
+
+    json1 = load("{\"players\": [{\"name\": \"p1\", \"kills\": 1},"
+                 " {\"name\": \"p2\", \"kills\": 2}], \"map\": \"de_dust2\"}");
+    json2 = json_cow_copy(json1);
+
+    value = json_pointer_get(json2, "/players/1");
+    json_object_set_new(value, "kills", json_integer(3));
+
+    patch = json_diff(json1, json2);
+    expected = load("[{\"op\": \"replace\", \"path\": \"/players/1/kills\","
+                    " \"value\": 3}]");
+    if (!json_equal(patch, expected))
+        fail("json_diff returned a wrong patch for a copy on write");
+
+    /* the patch doesn't refer to the document it's applied to */
+    if (json_patch_apply(json1, patch) || !json_equal(json1, json2))
+        fail("json_patch_apply didn't apply a diff to a copy on write");
+    json_integer_set(json_pointer_get(json1, "/players/1/kills"), 4);
+    if (json_integer_value(json_pointer_get(patch, "/0/value")) != 3)
+        fail("json_patch_apply shared a value with the patch");
+
+    json_decref(json1);
+    json_decref(json2);
+    json_decref(patch);
+    json_decref(expected);
+}
+
+/* Apply a patch and compare the result to the expected document, or
+   check that it fails if expected_text is NULL */
+static void check_apply(const char *text, const char *patch_text,
+                        const char *expected_text) {
+    json_t *json, *patch, *expected;
+
+    json = load(text);
+    patch = load(patch_text);
+
+    if (!expected_text) {
+        if (!json_patch_apply(json, patch)) {
+            fprintf(stderr, "patch: %s\n", patch_text);
+            fail("json_patch_apply applied a bad patch");
+        }
+    } else {
+        expected = load(expected_text);
+        if (json_patch_apply(json, patch) || !json_equal(json, expected)) {
+            fprintf(stderr, "patch: %s\n", patch_text);
+            fail("json_patch_apply returned a wrong document");
+        }
+        json_decref(expected);
+    }
+
+    json_decref(json);
+    json_decref(patch);
+}
+
+static void test_apply(void) {
+    json_t *json, *patch;
+
+    check_apply("{\"a\": [1, 2]}",
+                "[{\"op\": \"add\", \"path\": \"/a/1\", \"value\": 3},"
+                " {\"op\": \"add\", \"path\": \"/a/-\", \"value\": 4},"
+                " {\"op\": \"add\", \"path\": \"/b\", \"value\": {}}]",
+                "{\"a\": [1, 3, 2, 4], \"b\": {}}");
+    check_apply("{\"a\": [1, 2], \"b\": 1}",
+                "[{\"op\": \"remove\", \"path\": \"/a/0\"},"
+                " {\"op\": \"remove\", \"path\": \"/b\"}]",
+                "{\"a\": [2]}");
+    check_apply("{\"a\": [1, 2], \"b\": 1}",
+                "[{\"op\": \"replace\", \"path\": \"/a/0\", \"value\": \"x\"},"
+                " {\"op\": \"replace\", \"path\": \"/b\", \"value\": null}]",
+                "{\"a\": [\"x\", 2], \"b\": null}");
+    check_apply("{\"a\": {\"b\": 1}, \"c\": [1, 2]}",
+                "[{\"op\": \"move\", \"from\": \"/a/b\", \"path\": \"/c/0\"},"
+                " {\"op\": \"move\", \"from\": \"/c\", \"path\": \"/a/c\"},"
+                " {\"op\": \"move\", \"from\": \"/a\", \"path\": \"/a\"}]",
+                "{\"a\": {\"c\": [1, 1, 2]}}");
+    check_apply("{\"a\": {\"b\": [1]}}",
+                "[{\"op\": \"copy\", \"from\": \"/a\", \"path\": \"/c\"},"
+                " {\"op\": \"add\", \"path\": \"/c/b/-\", \"value\": 2},"
+                " {\"op\": \"test\", \"path\": \"/a/b\", \"value\": [1]}]",
+                "{\"a\": {\"b\": [1]}, \"c\": {\"b\": [1, 2]}}");
+    check_apply("{\"a\": 1}",
+                "[{\"op\": \"replace\", \"path\": \"\", \"value\": {\"b\": 2}}]",
+                "{\"b\": 2}");
+    check_apply("[1, 2]", "[{\"op\": \"add\", \"path\": \"\", \"value\": [3]}]", "[3]");
+    check_apply("{\"a\": {\"b\": 1}}",
+                "[{\"op\": \"copy\", \"from\": \"/a\", \"path\": \"\"}]", "{\"b\": 1}");
+
+    check_apply("{}", "{}", NULL);
+    check_apply("{}", "[1]", NULL);
+    check_apply("{}", "[{\"path\": \"/a\", \"value\": 1}]", NULL);
+    check_apply("{}", "[{\"op\": \"add\", \"value\": 1}]", NULL);
+    check_apply("{}", "[{\"op\": \"add\", \"path\": \"/a\"}]", NULL);
+    check_apply("{}", "[{\"op\": \"append\", \"path\": \"/a\", \"value\": 1}]", NULL);
+    check_apply("{}", "[{\"op\": \"add\", \"path\": \"/a/b\", \"value\": 1}]", NULL);
+    check_apply("[1]", "[{\"op\": \"add\", \"path\": \"/2\", \"value\": 1}]", NULL);
+    check_apply("[1]", "[{\"op\": \"remove\", \"path\": \"/1\"}]", NULL);
+    check_apply("[1]", "[{\"op\": \"remove\", \"path\": \"/-\"}]", NULL);
+    check_apply("[1]", "[{\"op\": \"remove\", \"path\": \"\"}]", NULL);
+    check_apply("[1]", "[{\"op\": \"replace\", \"path\": \"/1\", \"value\": 1}]", NULL);
+    check_apply("{}", "[{\"op\": \"replace\", \"path\": \"/a\", \"value\": 1}]", NULL);
+    check_apply("{}", "[{\"op\": \"replace\", \"path\": \"\", \"value\": []}]", NULL);
+    check_apply("{\"a\": {}}",
+                "[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"/a/b\"}]", NULL);
+    check_apply("{}", "[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"/b\"}]", NULL);
+    check_apply("{\"a\": 1}", "[{\"op\": \"copy\", \"path\": \"/b\"}]", NULL);
+    check_apply("{\"a\": 1}", "[{\"op\": \"test\", \"path\": \"/a\", \"value\": 1.0}]",
+                NULL);
+    check_apply("{\"a\": 1}", "[{\"op\": \"test\", \"path\": \"/a\"}]", NULL);
+
+    /* a null byte would end the pointer early */
+    json = json_object();
+    patch = load("[{\"op\": \"add\", \"value\": 1}]");
+    json_object_set_new(json_array_get(patch, 0), "path", json_stringn("/a\0b", 4));
+    if (!json_patch_apply(json, patch))
+        fail("json_patch_apply accepted a null byte in a pointer");
+    json_decref(json);
+    json_decref(patch);
+
+    patch = json_array();
+    if (!json_patch_apply(NULL, patch) || !json_patch_apply(patch, NULL))
+        fail("json_patch_apply accepted NULL");
+    if (json_diff(NULL, patch) || json_diff(patch, NULL))
+        fail("json_diff accepted NULL");
+    json_decref(patch);
+}
+
+static void test_circular(void) {
+    json_t *json1, *json2, *patch;
+
+    json1 = json_object();
+    json2 = json_object();
+    json_object_set_new(json1, "a", json_object());
+    json_object_set_new(json2, "a", json_object());
+    json_object_set(json_object_get(json1, "a"), "b", json1);
+    json_object_set(json_object_get(json2, "a"), "b", json2);
+
+    patch = json_diff(json1, json2);
+    if (patch)
+        fail("json_diff compared circular references");
+
+    json_object_clear(json_object_get(json1, "a"));
+    json_object_clear(json_object_get(json2, "a"));
+    json_decref(json1);
+    json_decref(json2);
+}
+
+static void check_merge(const char *text, const char *patch_text,
+                        const char *expected_text) {
+    json_t *json, *patch, *expected;
+
+    json = load(text);
+    patch = load(patch_text);
+    expected = load(expected_text);
+
+    if (json_object_merge_patch(json, patch) || !json_equal(json, expected)) {
+        fprintf(stderr, "merge patch: %s\n", patch_text);
+        fail("json_object_merge_patch returned a wrong object");
+    }
+
+    json_decref(json);
+    json_decref(patch);
+    json_decref(expected);
+}
+
+static void test_merge_patch(void) {
+    json_t *json, *patch, *value, *shared;
+
+    check_merge("{\"a\": \"b\"}", "{\"a\": \"c\"}", "{\"a\": \"c\"}");
+    check_merge("{\"a\": \"b\"}", "{\"b\": \"c\"}", "{\"a\": \"b\", \"b\": \"c\"}");
+    check_merge("{\"a\": \"b\", \"b\": \"c\"}", "{\"a\": null}", "{\"b\": \"c\"}");
+    check_merge("{\"a\": [\"b\"]}", "{\"a\": \"c\"}", "{\"a\": \"c\"}");
+    check_merge("{\"a\": \"c\"}", "{\"a\": [\"b\"]}", "{\"a\": [\"b\"]}");
+    check_merge("{\"a\": {\"b\": \"c\"}}", "{\"a\": {\"b\": \"d\", \"c\": null}}",
+                "{\"a\": {\"b\": \"d\"}}");
+    check_merge("{\"a\": [{\"b\": \"c\"}]}", "{\"a\": [1]}", "{\"a\": [1]}");
+    check_merge("{\"e\": null}", "{\"a\": 1}", "{\"e\": null, \"a\": 1}");
+    check_merge("{\"a\": 1}", "{\"a\": {\"bb\": {\"ccc\": null}}}",
+                "{\"a\": {\"bb\": {}}}");
+    check_merge("{\"a\": 1, \"b\": 2.5, \"c\": \"x\", \"d\": true}",
+                "{\"a\": 2, \"b\": 3, \"c\": \"yy\", \"d\": false, \"x\": null}",
+                "{\"a\": 2, \"b\": 3, \"c\": \"yy\", \"d\": false}");
+
+    /* numbers and strings nothing else refers to are set in place */
+    json = load("{\"a\": {\"kills\": 1000, \"name\": \"p1\"}, \"b\": 1000}");
+    value = json_pointer_get(json, "/a/kills");
+    shared = json_incref(json_object_get(json, "b"));
+    patch = load("{\"a\": {\"kills\": 2000, \"name\": \"player\"}, \"b\": 2000}");
+    if (json_object_merge_patch(json, patch) ||
+        json_pointer_get(json, "/a/kills") != value || json_integer_value(value) != 2000)
+        fail("json_object_merge_patch didn't set a number in place");
+    if (json_integer_value(shared) != 1000 ||
+        json_object_get(json, "b") != json_object_get(patch, "b"))
+        fail("json_object_merge_patch changed a shared number");
+    json_decref(shared);
+    json_decref(patch);
+
+    /* a patch can't contain itself or be merged into itself */
+    patch = json_object();
+    json_object_set_new(patch, "a", json_object());
+    json_object_set(json_object_get(patch, "a"), "b", patch);
+    if (!json_object_merge_patch(json, patch))
+        fail("json_object_merge_patch merged a circular reference");
+    json_object_clear(json_object_get(patch, "a"));
+    json_decref(patch);
+    if (!json_object_merge_patch(json, json))
+        fail("json_object_merge_patch merged an object into itself");
+
+    if (!json_object_merge_patch(json, NULL) || !json_object_merge_patch(NULL, json))
+        fail("json_object_merge_patch accepted NULL");
+    json_decref(json);
+}
+
+static void run_tests() {
+    test_diff();
+    test_diff_cow();
+    test_apply();
+    test_circular();
+    test_merge_patch();
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+
+/* json_persistent() of a new reference */
+static json_persistent_t *persistent_new(json_t *json) {
+    json_persistent_t *persistent = json_persistent(json);
+    json_decref(json);
+    return persistent;
+}
+
+static void check_dump(const json_persistent_t *persistent, const char *expected) {
+    json_t *json = json_persistent_value(persistent);
+    char *result = json_dumps(json, JSON_COMPACT);
+
+    if (!result || strcmp(result, expected))
+        fail("persistent value converted to a wrong document");
+
+    free(result);
+    json_decref(json);
+}
+
+static void test_object(void) {
+    json_persistent_t *v1, *v2, *v3, *v4, *one, *two;
+
+    v1 = persistent_new(json_object());
+    one = persistent_new(json_integer(1));
+    two = persistent_new(json_integer(2));
+    if (!v1 || !one || !two)
+        fail("unable to create persistent values");
+
+    v2 = json_persistent_set(v1, "a", one);
+    v3 = json_persistent_set(v2, "b", two);
+    if (!v2 || !v3)
+        fail("json_persistent_set failed");
+
+    /* setting an existing key keeps its place */
+    v4 = json_persistent_set(v3, "a", two);
+    if (json_persistent_size(v1) != 0 || json_persistent_size(v2) != 1 ||
+        json_persistent_size(v3) != 2 || json_persistent_size(v4) != 2)
+        fail("persistent objects have wrong sizes");
+    if (json_persistent_get(v2, "a") != one || json_persistent_get(v2, "b") ||
+        json_persistent_get(v4, "a") != two || json_persistent_get(v3, "a") != one)
+        fail("an old version of a persistent object changed");
+
+    check_dump(v3, "{\"a\":1,\"b\":2}");
+    check_dump(v4, "{\"a\":2,\"b\":2}");
+
+    json_persistent_decref(v1);
+    v1 = json_persistent_del(v4, "a");
+    if (!v1 || json_persistent_size(v1) != 1 || json_persistent_get(v1, "a") ||
+        json_persistent_get(v4, "a") != two)
+        fail("json_persistent_del failed");
+    if (json_persistent_del(v1, "a"))
+        fail("json_persistent_del removed a missing key");
+    check_dump(v1, "{\"b\":2}");
+
+    json_persistent_decref(v1);
+    json_persistent_decref(v2);
+    json_persistent_decref(v3);
+    json_persistent_decref(v4);
+    json_persistent_decref(one);
+    json_persistent_decref(two);
+}
+
+static void test_many_keys(void) {
+    json_persistent_t *object, *next, *value;
+    char key[16];
+    int i;
+
+    /* enough keys to fill several levels of the trie */
+    object = persistent_new(json_object());
+    for (i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        value = persistent_new(json_integer(i));
+        next = json_persistent_set(object, key, value);
+        if (!next)
+            fail("json_persistent_set failed");
+        json_persistent_decref(value);
+        json_persistent_decref(object);
+        object = next;
+    }
+    if (json_persistent_size(object) != 5000)
+        fail("persistent object has a wrong size");
+
+    for (i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        value = json_persistent_get(object, key);
+        if (json_persistent_type(value) != JSON_INTEGER)
+            fail("persistent object lost a key");
+    }
+
+    for (i = 0; i < 5000; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        next = json_persistent_del(object, key);
+        if (!next)
+            fail("json_persistent_del failed");
+        json_persistent_decref(object);
+        object = next;
+    }
+    for (i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        if (!json_persistent_get(object, key) != (i % 2 == 0))
+            fail("json_persistent_del removed a wrong key");
+    }
+    json_persistent_decref(object);
+}
+
+static void test_array(void) {
+    json_persistent_t *array, *next, *value, *saved;
+    json_t *json;
+    int i;
+
+    array = persistent_new(json_array());
+    for (i = 0; i < 2000; i++) {
+        value = persistent_new(json_integer(i));
+        next = json_persistent_array_append(array, value);
+        if (!next)
+            fail("json_persistent_array_append failed");
+        json_persistent_decref(value);
+        json_persistent_decref(array);
+        array = next;
+    }
+
+    value = persistent_new(json_string("x"));
+    saved = json_persistent_array_set(array, 1500, value);
+    json_persistent_decref(value);
+    if (!saved || json_persistent_type(json_persistent_array_get(saved, 1500)) !=
+                      JSON_STRING ||
+        json_persistent_type(json_persistent_array_get(array, 1500)) != JSON_INTEGER)
+        fail("json_persistent_array_set failed");
+    if (json_persistent_array_set(array, 2000, value))
+        fail("json_persistent_array_set accepted an index past the end");
+
+    /* pop everything, dropping the levels of the tree on the way */
+    for (i = 1999; i >= 0; i--) {
+        json = json_persistent_value(json_persistent_array_get(array, i));
+        if (json_integer_value(json) != i)
+            fail("persistent array has a wrong value");
+        json_decref(json);
+
+        next = json_persistent_array_pop(array);
+        if (!next || json_persistent_size(next) != (size_t)i)
+            fail("json_persistent_array_pop failed");
+        json_persistent_decref(array);
+        array = next;
+    }
+    if (json_persistent_array_pop(array))
+        fail("json_persistent_array_pop popped an empty array");
+    json_persistent_decref(array);
+
+    if (json_persistent_size(saved) != 2000)
+        fail("an old version of a persistent array changed");
+    json_persistent_decref(saved);
+}
+
+static void test_conversion(void) {
+    json_persistent_t *persistent;
+    json_t *json, *result;
+
+    json = json_loads("{\"z\": [1, 2.5, true, null, \"s\"], \"a\": {\"b\": {}},"
+                      " \"m\": [[], [3, 4]]}",
+                      JSON_DECODE_PACKED_ARRAYS, NULL);
+    persistent = json_persistent(json);
+    if (!persistent || json_persistent_type(persistent) != JSON_OBJECT ||
+        json_persistent_size(persistent) != 3)
+        fail("json_persistent failed");
+
+    result = json_persistent_value(persistent);
+    if (!json_equal(json, result))
+        fail("json_persistent_value returned a different document");
+    check_dump(persistent,
+               "{\"z\":[1,2.5,true,null,\"s\"],\"a\":{\"b\":{}},\"m\":[[],[3,4]]}");
+
+    json_decref(result);
+    json_persistent_decref(persistent);
+
+    /* circular references can't be converted */
+    json_array_append(json_object_get(json, "m"), json);
+    if (json_persistent(json))
+        fail("json_persistent converted a circular reference");
+    json_array_clear(json_object_get(json, "m"));
+    json_decref(json);
+}
+
+static void test_bad_args(void) {
+    json_persistent_t *object, *array, *value;
+
+    object = persistent_new(json_object());
+    array = persistent_new(json_array());
+    value = persistent_new(json_true());
+
+    if (json_persistent(NULL) || json_persistent_value(NULL))
+        fail("persistent conversions accepted NULL");
+    if (json_persistent_type(NULL) != JSON_NULL || json_persistent_size(NULL) != 0 ||
+        json_persistent_size(value) != 0)
+        fail("persistent type or size is wrong for NULL or a scalar");
+
+    if (json_persistent_set(array, "a", value) ||
+        json_persistent_set(object, NULL, value) ||
+        json_persistent_set(object, "a", NULL) ||
+        json_persistent_set(object, "\xff", value))
+        fail("json_persistent_set accepted bad arguments");
+    if (json_persistent_get(array, "a") || json_persistent_get(object, NULL) ||
+        json_persistent_del(object, "a"))
+        fail("persistent object functions accepted bad arguments");
+    if (json_persistent_array_append(object, value) ||
+        json_persistent_array_append(array, NULL) ||
+        json_persistent_array_get(array, 0) || json_persistent_array_pop(object))
+        fail("persistent array functions accepted bad arguments");
+
+    json_persistent_decref(NULL);
+    json_persistent_decref(object);
+    json_persistent_decref(array);
+    json_persistent_decref(value);
+}
+
+static void run_tests() {
+    test_object();
+    test_many_keys();
+    test_array();
+    test_conversion();
+    test_bad_args();
+}
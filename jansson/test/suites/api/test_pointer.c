@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <string.h>
+
+static json_t *load(const char *text) {
+    json_t *json = json_loads(text, JSON_DECODE_PACKED_ARRAYS, NULL);
+    if (!json)
+        fail("unable to load a test document");
+    return json;
+}
+
+static void test_get(void) {
+    json_t *json, *value;
+
+    json = load("{\"a\": {\"b\": [10, {\"c\": \"x\"}]}, \"\": 1, \"m~n\": 2, \"k/l\": 3,"
+                " \"n\": [1, 2, 3]}");
+
+    if (json_pointer_get(json, "") != json)
+        fail("the empty pointer doesn't refer to the document");
+    value = json_object_get(json_object_get(json, "a"), "b");
+    if (json_pointer_get(json, "/a/b") != value)
+        fail("json_pointer_get returned a wrong value");
+    if (strcmp(json_string_value(json_pointer_get(json, "/a/b/1/c")), "x"))
+        fail("json_pointer_get failed for a nested key");
+    if (json_integer_value(json_pointer_get(json, "/a/b/0")) != 10)
+        fail("json_pointer_get failed for an array index");
+    if (json_integer_value(json_pointer_get(json, "/n/2")) != 3)
+        fail("json_pointer_get failed for a packed array");
+
+    if (json_integer_value(json_pointer_get(json, "/")) != 1 ||
+        json_integer_value(json_pointer_get(json, "/m~0n")) != 2 ||
+        json_integer_value(json_pointer_get(json, "/k~1l")) != 3)
+        fail("json_pointer_get failed for an empty or escaped key");
+
+    value = json_pointer_getn(json, "/a/b/1/c", 4);
+    if (!json_is_array(value))
+        fail("json_pointer_getn didn't stop at the length");
+
+    if (json_pointer_get(json, "a") || json_pointer_get(json, "/x") ||
+        json_pointer_get(json, "/a/b/2") || json_pointer_get(json, "/a/b/01") ||
+        json_pointer_get(json, "/a/b/-") || json_pointer_get(json, "/a/b/+1") ||
+        json_pointer_get(json, "/a/b/0/c") || json_pointer_get(json, "/m~2n") ||
+        json_pointer_get(json, "/m~") ||
+        json_pointer_get(json, "/n/99999999999999999999999999"))
+        fail("json_pointer_get returned a value for a bad pointer");
+    if (json_pointer_get(NULL, "") || json_pointer_get(json, NULL))
+        fail("json_pointer_get accepted NULL");
+
+    json_decref(json);
+}
+
+static void test_set(void) {
+    json_t *json, *expected;
+
+    json = load("{\"a\": {\"b\": [1, 2]}}");
+
+    if (json_pointer_set_new(json, "/a/c", json_true()) ||
+        json_pointer_set_new(json, "/a/b/0", json_string("x")) ||
+        json_pointer_set_new(json, "/a/b/2", json_integer(3)) ||
+        json_pointer_set_new(json, "/a/b/-", json_integer(4)) ||
+        json_pointer_set_new(json, "/a~1b", json_null()))
+        fail("json_pointer_set_new failed");
+
+    expected = load("{\"a\": {\"b\": [\"x\", 2, 3, 4], \"c\": true}, \"a/b\": null}");
+    if (!json_equal(json, expected))
+        fail("json_pointer_set_new set a wrong value");
+    json_decref(expected);
+
+    if (!json_pointer_set_new(json, "", json_object()) ||
+        !json_pointer_set_new(json, "/x/y", json_true()) ||
+        !json_pointer_set_new(json, "/a/b/5", json_true()) ||
+        !json_pointer_set_new(json, "/a/b/x", json_true()) ||
+        !json_pointer_set_new(json, "/a/c/d", json_true()) ||
+        !json_pointer_set_new(json, "/a/\xff", json_true()) ||
+        !json_pointer_set_new(json, "/a/b/0", NULL) ||
+        !json_pointer_set_new(NULL, "/a", json_true()))
+        fail("json_pointer_set_new accepted a bad pointer");
+
+    /* like json_array_set(), an array can't be stored in itself */
+    if (!json_pointer_set(json, "/a/b/0", json_pointer_get(json, "/a/b")))
+        fail("json_pointer_set created a circular reference");
+
+    json_decref(json);
+}
+
+static void run_tests() {
+    test_get();
+    test_set();
+}
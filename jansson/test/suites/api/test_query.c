@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <string.h>
+
+static const char *document =
+    "{\"match\": {\"map\": \"de_dust2\", \"teams\": ["
+    "  {\"name\": \"a\", \"players\": ["
+    "    {\"name\": \"p1\", \"kills\": 12, \"stats\": {\"hs\": 0.5}},"
+    "    {\"name\": \"p2\", \"kills\": 3}]},"
+    "  {\"name\": \"b\", \"players\": ["
+    "    {\"name\": \"p3\", \"kills\": 25, \"bot\": true},"
+    "    {\"name\": \"p4\", \"kills\": 10.5, \"stats\": {\"hs\": 0.25}}]}]},"
+    " \"scores\": [1, 2, 3, 4, 5, 6]}";
+
+/* Run a query and compare the matches to the expected array */
+static void check_query(json_t *json, const char *path, const char *expected_text) {
+    json_query_t *query;
+    json_t *result, *expected;
+    json_error_t error;
+
+    query = json_query(path, &error);
+    if (!query)
+        fail("json_query failed to compile a query");
+
+    result = json_query_select(query, json);
+    expected = json_loads(expected_text, 0, NULL);
+    if (!result || !expected || !json_equal(result, expected)) {
+        fprintf(stderr, "query: %s\n", path);
+        fail("json_query_select returned wrong matches");
+    }
+
+    json_decref(result);
+    json_decref(expected);
+    json_query_free(query);
+}
+
+static void test_steps(void) {
+    json_t *json = json_loads(document, JSON_DECODE_PACKED_ARRAYS, NULL);
+
+    check_query(json, "$.match.teams[0].players[1]",
+                "[{\"name\": \"p2\", \"kills\": 3}]");
+    check_query(json, "$.match.map", "[\"de_dust2\"]");
+    check_query(json, "$['match'][\"teams\"][1].name", "[\"b\"]");
+    check_query(json, "$.match.teams[-1].name", "[\"b\"]");
+    check_query(json, "$.match.teams[*].name", "[\"a\", \"b\"]");
+    check_query(json, "$.match.teams[0].players[0].*",
+                "[\"p1\", 12, {\"hs\": 0.5}]");
+    check_query(json, "$.match.teams[2].name", "[]");
+    check_query(json, "$.match.missing", "[]");
+    check_query(json, "$.match.map[0]", "[]");
+
+    check_query(json, "$.scores[1:3]", "[2, 3]");
+    check_query(json, "$.scores[:2]", "[1, 2]");
+    check_query(json, "$.scores[-2:]", "[5, 6]");
+    check_query(json, "$.scores[::2]", "[1, 3, 5]");
+    check_query(json, "$.scores[::-2]", "[6, 4, 2]");
+    check_query(json, "$.scores[4:1:-1]", "[5, 4, 3]");
+    check_query(json, "$.scores[-100:100:0]", "[]");
+    check_query(json, "$.scores[-100:100]", "[1, 2, 3, 4, 5, 6]");
+    check_query(json, "$.scores[1::9223372036854775807]", "[2]");
+    check_query(json, "$.scores[-2::-9223372036854775807]", "[5]");
+
+    json_decref(json);
+}
+
+static void test_descendants(void) {
+    json_t *json = json_loads(document, JSON_DECODE_PACKED_ARRAYS, NULL);
+
+    check_query(json, "$..kills", "[12, 3, 25, 10.5]");
+    check_query(json, "$..hs", "[0.5, 0.25]");
+    check_query(json, "$..players[0].name", "[\"p1\", \"p3\"]");
+    check_query(json, "$..['name']", "[\"a\", \"p1\", \"p2\", \"b\", \"p3\", \"p4\"]");
+    check_query(json, "$.match.teams[0]..*",
+                "[\"a\", [{\"name\": \"p1\", \"kills\": 12, \"stats\": {\"hs\": 0.5}},"
+                " {\"name\": \"p2\", \"kills\": 3}],"
+                " {\"name\": \"p1\", \"kills\": 12, \"stats\": {\"hs\": 0.5}},"
+                " {\"name\": \"p2\", \"kills\": 3}, \"p1\", 12, {\"hs\": 0.5}, 0.5,"
+                " \"p2\", 3]");
+
+    json_decref(json);
+}
+
+static void test_filters(void) {
+    json_t *json = json_loads(document, JSON_DECODE_PACKED_ARRAYS, NULL);
+
+    check_query(json, "$..players[?(@.kills > 10)].name", "[\"p1\", \"p3\", \"p4\"]");
+    check_query(json, "$..players[?(@.kills >= 12)].name", "[\"p1\", \"p3\"]");
+    check_query(json, "$..players[?(@.kills == 10.5)].name", "[\"p4\"]");
+    check_query(json, "$..players[?(@.name != 'p1')].name", "[\"p2\", \"p3\", \"p4\"]");
+    check_query(json, "$..players[?(@.name < \"p3\")].name", "[\"p1\", \"p2\"]");
+    check_query(json, "$..players[?(@.bot)].name", "[\"p3\"]");
+    check_query(json, "$..players[?(@.bot == true)].name", "[\"p3\"]");
+    check_query(json, "$..players[?(@.stats.hs < 0.3)].name", "[\"p4\"]");
+    check_query(json, "$..players[?(@['stats']['hs'])].name", "[\"p1\", \"p4\"]");
+    check_query(json, "$..players[?(@.kills > 5 && @.stats)].name", "[\"p1\", \"p4\"]");
+    check_query(json, "$..players[?(@.kills < 5 || @.bot && @.kills > 20)].name",
+                "[\"p2\", \"p3\"]");
+    check_query(json, "$..players[?@.kills > 24].name", "[\"p3\"]");
+    check_query(json, "$.match.teams[?(@.players[-1].kills > 10)].name", "[\"b\"]");
+
+    /* a packed array gives new values for its numbers */
+    check_query(json, "$.scores[?(@ > 4)]", "[5, 6]");
+    check_query(json, "$.scores[?(@ > 'x')]", "[]");
+    check_query(json, "$.scores[?(@ != 'x')]", "[1, 2, 3, 4, 5, 6]");
+
+    json_decref(json);
+}
+
+static int stop_at_first(json_t *value, void *data) {
+    *(json_t **)data = json_incref(value);
+    return -1;
+}
+
+static void test_callback(void) {
+    json_t *json, *result, *first = NULL;
+    json_query_t *query;
+
+    json = json_loads(document, 0, NULL);
+    query = json_query("$..players[*]", NULL);
+
+    /* matches are the values in the document, not copies */
+    result = json_query_select(query, json);
+    if (json_array_get(result, 0) !=
+        json_pointer_get(json, "/match/teams/0/players/0"))
+        fail("json_query_select copied a match");
+    json_decref(result);
+
+    if (json_query_callback(query, json, stop_at_first, &first) != -1 ||
+        strcmp(json_string_value(json_object_get(first, "name")), "p1"))
+        fail("json_query_callback didn't stop");
+    json_decref(first);
+
+    json_query_free(query);
+    json_decref(json);
+}
+
+static void check_compile_error(const char *path, int column) {
+    json_error_t error;
+
+    if (json_query(path, &error))
+        fail("json_query compiled an invalid query");
+    if (error.column != column || strcmp(error.source, "<query>")) {
+        fprintf(stderr, "query: %s, column %d\n", path, error.column);
+        fail("json_query reported a wrong error");
+    }
+}
+
+static void test_errors(void) {
+    json_t *json, *array;
+    json_query_t *query;
+
+    check_compile_error("", 1);
+    check_compile_error("match", 1);
+    check_compile_error("$.", 3);
+    check_compile_error("$match", 2);
+    check_compile_error("$[", 3);
+    check_compile_error("$['a'", 6);
+    check_compile_error("$['a", 5);
+    check_compile_error("$[1.5]", 3);
+    check_compile_error("$[01]", 3);
+    check_compile_error("$[99999999999999999999999]", 3);
+    check_compile_error("$[?(@.a >)]", 10);
+    check_compile_error("$[?(@.a > 1]", 12);
+    check_compile_error("$[?(a > 1)]", 5);
+    check_compile_error("$['\\x']", 5);
+
+    if (json_query(NULL, NULL))
+        fail("json_query accepted NULL");
+
+    json = json_object();
+    query = json_query("$..*", NULL);
+    if (json_query_select(NULL, json) || json_query_select(query, NULL))
+        fail("json_query_select accepted NULL");
+
+    /* circular references can't be searched */
+    array = json_array();
+    json_object_set_new(json, "a", array);
+    json_array_append(array, json);
+    if (json_query_select(query, json))
+        fail("json_query_select searched a circular reference");
+    json_array_clear(array);
+
+    json_query_free(query);
+    json_query_free(NULL);
+    json_decref(json);
+}
+
+static void run_tests() {
+    test_steps();
+    test_descendants();
+    test_filters();
+    test_callback();
+    test_errors();
+}
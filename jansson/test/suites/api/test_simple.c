@@ -241,35 +241,61 @@ static void run_tests() {
 
     /* Test reference counting on singletons (true, false, null) */
     value = json_true();
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting true works incorrectly");
     json_decref(value);
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting true works incorrectly");
     json_incref(value);
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting true works incorrectly");
 
     value = json_false();
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting false works incorrectly");
     json_decref(value);
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting false works incorrectly");
     json_incref(value);
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting false works incorrectly");
 
     value = json_null();
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting null works incorrectly");
     json_decref(value);
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting null works incorrectly");
     json_incref(value);
-    if (value->refcount != (size_t)-1)
+    if (value->refcount != JSON_REFCOUNT_IMMORTAL)
         fail("refcounting null works incorrectly");
 
+    /* small shared integers are preallocated and can't be changed */
+    value = json_integer_shared(-256);
+    if (value != json_integer_shared(-256) || json_integer_value(value) != -256 ||
+        value->refcount != JSON_REFCOUNT_IMMORTAL)
+        fail("json_integer_shared failed");
+    if (json_integer_value(json_integer_shared(4096)) != 4096)
+        fail("json_integer_shared failed");
+    if (json_integer_set(value, 1) != -1 || json_integer_value(value) != -256)
+        fail("json_integer_set changed a shared integer");
+    json_decref(value);
+
+    value = json_integer_shared(4097);
+    if (value->refcount != 1 || json_integer_set(value, 1))
+        fail("json_integer_shared failed for a big integer");
+    json_decref(value);
+
+    /* setting a string to a shorter, then longer value */
+    value = json_string("a longer string value");
+    if (json_string_set(value, "short") || strcmp(json_string_value(value), "short") ||
+        json_string_length(value) != 5)
+        fail("json_string_set failed for a shorter value");
+    if (json_string_set(value, "a value longer than the first one") ||
+        strcmp(json_string_value(value), "a value longer than the first one"))
+        fail("json_string_set failed for a longer value");
+    json_decref(value);
+
 #ifdef json_auto_t
     value = json_string("foo");
     {
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "util.h"
+#include <jansson.h>
+#include <string.h>
+
+static const char document[] =
+    "{\"name\": \"de_dust2\", \"rounds\": 30, \"ratio\": 0.5, \"empty\": [], "
+    "\"nothing\": {}, \"players\": [{\"steamid\": \"STEAM_1:0:1\", \"kills\": 20, "
+    "\"alive\": true}, {\"steamid\": \"\\u00e4\\\"\", \"kills\": -3, \"alive\": "
+    "false, \"team\": null}], \"nested\": [[1, [2]], {\"a\": {\"b\": []}}]}";
+
+static void write_player(json_writer_t *writer, const char *steamid, int kills,
+                         int alive, int with_team) {
+    json_writer_object_begin(writer);
+    json_writer_key(writer, "steamid");
+    json_writer_string(writer, steamid);
+    json_writer_key(writer, "kills");
+    json_writer_integer(writer, kills);
+    json_writer_key(writer, "alive");
+    json_writer_boolean(writer, alive);
+    if (with_team) {
+        json_writer_key(writer, "team");
+        json_writer_null(writer);
+    }
+    json_writer_object_end(writer);
+}
+
+static void write_document(json_writer_t *writer, const json_t *nested) {
+    json_writer_object_begin(writer);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, "de_dust2");
+    json_writer_key(writer, "rounds");
+    json_writer_integer(writer, 30);
+    json_writer_key(writer, "ratio");
+    json_writer_real(writer, 0.5);
+    json_writer_key(writer, "empty");
+    json_writer_array_begin(writer);
+    json_writer_array_end(writer);
+    json_writer_key(writer, "nothing");
+    json_writer_object_begin(writer);
+    json_writer_object_end(writer);
+    json_writer_key(writer, "players");
+    json_writer_array_begin(writer);
+    write_player(writer, "STEAM_1:0:1", 20, 1, 0);
+    write_player(writer, "\xc3\xa4\"", -3, 0, 1);
+    json_writer_array_end(writer);
+    json_writer_key(writer, "nested");
+    json_writer_value(writer, nested);
+    json_writer_object_end(writer);
+}
+
+static void same_as_dumps() {
+    const size_t flag_sets[] = {0,
+                                JSON_COMPACT,
+                                JSON_INDENT(2),
+                                JSON_INDENT(3) | JSON_COMPACT | JSON_ENSURE_ASCII,
+                                JSON_EMBED,
+                                JSON_INDENT(4) | JSON_EMBED,
+                                JSON_REAL_PRECISION(2) | JSON_ESCAPE_SLASH};
+    json_t *json;
+    size_t i;
+
+    json = json_loads(document, 0, NULL);
+    if (!json)
+        fail("json_loads failed");
+
+    for (i = 0; i < sizeof(flag_sets) / sizeof(flag_sets[0]); i++) {
+        json_writer_t *writer;
+        const char *result;
+        char *expected;
+        size_t length;
+
+        writer = json_writer(flag_sets[i]);
+        if (!writer)
+            fail("json_writer failed");
+
+        write_document(writer, json_object_get(json, "nested"));
+        if (!json_writer_done(writer))
+            fail("json_writer_done returned false for a complete document");
+
+        result = json_writer_result(writer, &length);
+        expected = json_dumps(json, flag_sets[i]);
+        if (!result || !expected)
+            fail("no output");
+        if (strcmp(result, expected) || length != strlen(expected))
+            fail("json_writer output differs from json_dumps");
+
+        free(expected);
+        json_writer_free(writer);
+    }
+
+    json_decref(json);
+}
+
+static int count_bytes(const char *buffer, size_t size, void *data) {
+    (void)buffer;
+    *(size_t *)data += size;
+    return 0;
+}
+
+static void callback() {
+    json_writer_t *writer;
+    size_t bytes = 0;
+
+    writer = json_writer_callback(count_bytes, &bytes, JSON_COMPACT);
+    if (!writer)
+        fail("json_writer_callback failed");
+
+    json_writer_array_begin(writer);
+    json_writer_integer(writer, 1);
+    json_writer_string(writer, "ab");
+    json_writer_array_end(writer);
+
+    if (!json_writer_done(writer) || bytes != strlen("[1,\"ab\"]"))
+        fail("json_writer_callback wrote the wrong number of bytes");
+    if (json_writer_result(writer, NULL))
+        fail("json_writer_result returned output of a callback writer");
+
+    json_writer_free(writer);
+}
+
+static void encode_any() {
+    json_writer_t *writer;
+    const char *result;
+
+    writer = json_writer(0);
+    if (json_writer_integer(writer, 42) != -1)
+        fail("json_writer wrote a top-level scalar without JSON_ENCODE_ANY");
+    json_writer_free(writer);
+
+    writer = json_writer(JSON_ENCODE_ANY);
+    if (json_writer_string(writer, "foo"))
+        fail("json_writer_string failed with JSON_ENCODE_ANY");
+    result = json_writer_result(writer, NULL);
+    if (!result || strcmp(result, "\"foo\""))
+        fail("json_writer wrote an invalid top-level scalar");
+    if (json_writer_null(writer) != -1)
+        fail("json_writer wrote a second top-level value");
+    if (json_writer_result(writer, NULL))
+        fail("json_writer_result returned output after an error");
+    json_writer_free(writer);
+}
+
+static void misuse() {
+    json_writer_t *writer;
+
+    writer = json_writer(0);
+    json_writer_object_begin(writer);
+    if (json_writer_integer(writer, 1) != -1)
+        fail("json_writer wrote an object value without a key");
+    if (json_writer_key(writer, "a") != -1)
+        fail("json_writer continued after an error");
+    json_writer_free(writer);
+
+    writer = json_writer(0);
+    json_writer_array_begin(writer);
+    if (json_writer_key(writer, "a") != -1)
+        fail("json_writer wrote a key into an array");
+    json_writer_free(writer);
+
+    writer = json_writer(0);
+    json_writer_object_begin(writer);
+    json_writer_key(writer, "a");
+    if (json_writer_object_end(writer) != -1)
+        fail("json_writer closed an object with a dangling key");
+    json_writer_free(writer);
+
+    writer = json_writer(0);
+    json_writer_array_begin(writer);
+    if (json_writer_object_end(writer) != -1)
+        fail("json_writer closed an array as an object");
+    json_writer_free(writer);
+
+    writer = json_writer(0);
+    json_writer_array_begin(writer);
+    if (json_writer_done(writer) || json_writer_result(writer, NULL))
+        fail("json_writer reported an incomplete document as done");
+    if (json_writer_real(writer, 1.0 / 0.0 - 1.0 / 0.0) != -1)
+        fail("json_writer wrote a NaN");
+    if (json_writer_stringn(writer, "\xff", 1) != -1)
+        fail("json_writer wrote invalid UTF-8");
+    json_writer_free(writer);
+}
+
+static void deep_nesting() {
+    json_writer_t *writer;
+    const char *result;
+    int i;
+
+    writer = json_writer(JSON_COMPACT);
+    for (i = 0; i < 100; i++)
+        json_writer_array_begin(writer);
+    for (i = 0; i < 100; i++)
+        json_writer_array_end(writer);
+
+    result = json_writer_result(writer, NULL);
+    if (!result || strlen(result) != 200 || result[99] != '[' || result[100] != ']')
+        fail("json_writer failed to write deeply nested arrays");
+    json_writer_free(writer);
+}
+
+static void run_tests() {
+    same_as_dumps();
+    callback();
+    encode_any();
+    misuse();
+    deep_nesting();
+}
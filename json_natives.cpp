@@ -91,13 +91,84 @@ static inline json_t *ArrayGetValue(IPluginContext *pContext, json_t *o, const i
     return v;
 }
 
+// Packed arrays keep their numbers unboxed, json_array_get() would box them all
+static inline bool ArrayGetPackedInteger(json_t *o, const int i, json_int_t *value)
+{
+    const json_int_t *integers;
+    if ((integers = json_array_integers(o)) == NULL || i < 0 || (size_t) i >= json_array_size(o))
+        return false;
+
+    *value = integers[i];
+    return true;
+}
+
+static inline bool ArrayGetPackedReal(json_t *o, const int i, double *value)
+{
+    const double *reals;
+    if ((reals = json_array_reals(o)) == NULL || i < 0 || (size_t) i >= json_array_size(o))
+        return false;
+
+    *value = reals[i];
+    return true;
+}
+
+static inline json_t *PathGetValue(IPluginContext *pContext, json_t *o, const char *p)
+{
+    json_t *v;
+    if ((v = json_pointer_get(o, p)) == NULL)
+        pContext->ThrowNativeError("JSON(GetValue): Path '%s' is not exists", p);
+
+    return v;
+}
+
+// The array a path ending in an index points into, so that numbers in a
+// packed array are read like JsonArray.GetInt() and GetFloat() do
+static inline json_t *PathGetArray(json_t *o, const char *p, int *index)
+{
+    const char *last = strrchr(p, '/');
+    if (last == NULL || last[1] < '0' || last[1] > '9' || (last[1] == '0' && last[2] != '\0'))
+        return NULL;
+
+    char *end;
+    long i = strtol(last + 1, &end, 10);
+    if (*end != '\0' || static_cast<int>(i) != i)
+        return NULL;
+
+    *index = static_cast<int>(i);
+    return json_pointer_getn(o, p, last - p);
+}
+
+static inline bool PathGetPackedInteger(json_t *o, const char *p, json_int_t *value)
+{
+    int i;
+    json_t *array = PathGetArray(o, p, &i);
+    return array != NULL && ArrayGetPackedInteger(array, i, value);
+}
+
+static inline bool PathGetPackedReal(json_t *o, const char *p, double *value)
+{
+    int i;
+    json_t *array = PathGetArray(o, p, &i);
+    return array != NULL && ArrayGetPackedReal(array, i, value);
+}
+
+// Plugins can't change integers, so small ones can be shared. Arrays are only
+// packed when a plugin asks for it, as JsonArray.Get() unpacks them again.
+// Keys are never shared between objects: a JsonKeys handle keeps an iterator
+// across native calls, which adding a key to an object with shared keys would
+// leave pointing to freed keys.
+static size_t DecodeFlags(cell_t flags)
+{
+    return ((size_t)flags & ~(size_t)JSON_DECODE_SHARED_KEYS) | JSON_DECODE_SHARED_INTS;
+}
+
 // JSON.JSON(const char[], int = 0)
 static cell_t JSONCreate(IPluginContext *pContext, const cell_t *params)
 {
     char *buffer;
     pContext->LocalToString(params[1], &buffer);
 
-    size_t flags = (size_t) params[2];
+    size_t flags = DecodeFlags(params[2]);
 
     json_t *object;
     json_error_t error;
@@ -119,7 +190,7 @@ static cell_t JSONCreateF(IPluginContext *pContext, const cell_t *params)
     char realpath[PLATFORM_MAX_PATH];
     smutils->BuildPath(Path_Game, realpath, sizeof(realpath), "%s", path);
 
-    size_t flags = (size_t)params[2];
+    size_t flags = DecodeFlags(params[2]);
 
     json_t *object;
     json_error_t error;
@@ -132,6 +203,28 @@ static cell_t JSONCreateF(IPluginContext *pContext, const cell_t *params)
     return CreateJSONHandle(pContext, object);
 }
 
+// JSON.JsonFBinary(const char[], int = 0)
+static cell_t JSONCreateFBinary(IPluginContext *pContext, const cell_t *params)
+{
+    char *path;
+    pContext->LocalToString(params[1], &path);
+
+    char realpath[PLATFORM_MAX_PATH];
+    smutils->BuildPath(Path_Game, realpath, sizeof(realpath), "%s", path);
+
+    size_t flags = DecodeFlags(params[2]);
+
+    json_t *object;
+    json_error_t error;
+    if((object = json_load_file_cbor(realpath, flags, &error)) == NULL) {
+        pContext->ThrowNativeError("JSONFBinary(constructor: %d): %s [p: %d]", 
+                                        json_error_code(&error), error.text, error.position);
+        return BAD_HANDLE;
+    }
+
+    return CreateJSONHandle(pContext, object);
+}
+
 // JSON.ToString(char[], int, int = 0)
 static cell_t JSONToString(IPluginContext *pContext, const cell_t *params)
 {
@@ -167,6 +260,24 @@ static cell_t JSONToFile(IPluginContext *pContext, const cell_t *params)
     return (json_dump_file(object, realpath, flags) == 0);
 }
 
+// JSON.ToFileBinary(const char[], int = 0)
+static cell_t JSONToFileBinary(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *path;
+    pContext->LocalToString(params[2], &path);
+
+    char realpath[PLATFORM_MAX_PATH];
+    smutils->BuildPath(Path_Game, realpath, sizeof(realpath), "%s", path);
+
+    size_t flags = (size_t)params[3];
+
+    return (json_dump_file_cbor(object, realpath, flags) == 0);
+}
+
 // JSON.Equal(Json o);
 static cell_t JSONEqual(IPluginContext *pContext, const cell_t *params)
 {
@@ -181,6 +292,59 @@ static cell_t JSONEqual(IPluginContext *pContext, const cell_t *params)
     return (json_equal(object, o));
 }
 
+// Json.Hash(char[], int)
+static cell_t JSONHash(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    unsigned long long hash = static_cast<unsigned long long>(json_hash(object));
+    if (hash == 0) {
+        pContext->ThrowNativeError("JSON(Hash): Could not hash the value, it may contain circular references");
+        return 0;
+    }
+
+    char result[17];
+    snprintf(result, sizeof(result), "%08lx%08lx", static_cast<unsigned long>(hash >> 32),
+             static_cast<unsigned long>(hash & 0xffffffff));
+    pContext->StringToLocalUTF8(params[2], params[3], result, NULL);
+
+    return 1;
+}
+
+// JSON.Copy(bool deep = true);
+static cell_t JSONCopy(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    json_t *copy;
+    if((copy = params[2] ? json_deep_copy(object) : json_copy(object)) == NULL) {
+        pContext->ThrowNativeError("JSON(Copy): Could not copy the value");
+        return BAD_HANDLE;
+    }
+
+    return CreateJSONHandle(pContext, copy);
+}
+
+// JSON.Snapshot();
+static cell_t JSONSnapshot(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    json_t *copy;
+    if((copy = json_cow_copy(object)) == NULL) {
+        pContext->ThrowNativeError("JSON(Snapshot): Could not copy the value");
+        return BAD_HANDLE;
+    }
+
+    return CreateJSONHandle(pContext, copy);
+}
+
 // JSON.Type.get()
 static cell_t JSONGetType(IPluginContext *pContext, const cell_t *params)
 {
@@ -191,104 +355,120 @@ static cell_t JSONGetType(IPluginContext *pContext, const cell_t *params)
     return json_typeof(object);
 }
 
-// JSONObject.Get(const char[])
-static cell_t ObjectGet(IPluginContext *pContext, const cell_t *params)
+// Json.GetPath(const char[])
+static cell_t JSONGetPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return BAD_HANDLE;
-    
-    char *key;	
-    pContext->LocalToString(params[2], &key);
+
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
     json_t *value;
-    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+    if((value = PathGetValue(pContext, object, path)) == NULL)
         return BAD_HANDLE;
 
     return CreateJSONHandleEx(pContext, value);
 }
 
-// JSONObject.GetBool(const char[])
-static cell_t ObjectGetBool(IPluginContext *pContext, const cell_t *params)
+// Json.GetBoolPath(const char[])
+static cell_t JSONGetBoolPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
-    
-    char *key;
-    pContext->LocalToString(params[2], &key);
 
-    json_t *value = ObjectGetValue(pContext, object, key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
+
+    json_t *value = PathGetValue(pContext, object, path);
     return (value != NULL) 
                 ? json_boolean_value(value) 
                 : 0;
 }
 
-// JSONObject.GetFloat(const char[])
-static cell_t ObjectGetFloat(IPluginContext *pContext, const cell_t *params)
+// Json.GetFloatPath(const char[])
+static cell_t JSONGetFloatPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
-    
-    char *key;
-    pContext->LocalToString(params[2], &key);
 
-    json_t *value = ObjectGetValue(pContext, object, key);
-    return (value != NULL) 
-                ? sp_ftoc(static_cast<float>(json_real_value(value))) 
-                : 0;
+    char *path;
+    pContext->LocalToString(params[2], &path);
+
+    double real;
+    if(PathGetPackedReal(object, path, &real))
+        return sp_ftoc(static_cast<float>(real));
+
+    json_t *value;
+    if((value = PathGetValue(pContext, object, path)) == NULL)
+        return 0;
+
+    return sp_ftoc(static_cast<float>(json_real_value(value)));
 }
 
-// JSONObject.GetInt(const char[])
-static cell_t ObjectGetInt(IPluginContext *pContext, const cell_t *params)
+// Json.GetIntPath(const char[])
+static cell_t JSONGetIntPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
-    
-    char *key;
-    pContext->LocalToString(params[2], &key);
 
-    json_t *value = ObjectGetValue(pContext, object, key);
-    return (value != NULL) 
-                ? static_cast<cell_t>(json_integer_value(value)) 
-                : 0;
+    char *path;
+    pContext->LocalToString(params[2], &path);
+
+    json_int_t integer;
+    if(PathGetPackedInteger(object, path, &integer))
+        return static_cast<cell_t>(integer);
+
+    json_t *value;
+    if((value = PathGetValue(pContext, object, path)) == NULL)
+        return 0;
+
+    return static_cast<cell_t>(json_integer_value(value));
 }
 
-// JSONObject.GetInt64(const char[], char[], int)
-static cell_t ObjectGetInt64(IPluginContext *pContext, const cell_t *params)
+// Json.GetInt64Path(const char[], char[], int)
+static cell_t JSONGetInt64Path(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
-    
-    char *key;
-    pContext->LocalToString(params[2], &key);
 
-    json_t *value;
-    if((value = ObjectGetValue(pContext, object, key)) == NULL)
-        return 0;
+    char *path;
+    pContext->LocalToString(params[2], &path);
+
+    json_int_t integer;
+    if(!PathGetPackedInteger(object, path, &integer))
+    {
+        json_t *value;
+        if((value = PathGetValue(pContext, object, path)) == NULL)
+            return 0;
+
+        integer = json_integer_value(value);
+    }
 
     char result[20];
-    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, json_integer_value(value));
+    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, integer);
     pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
 
     return 1;
 }
 
-// JSONObject.GetString(const char[], char[], int)
-static cell_t ObjectGetString(IPluginContext *pContext, const cell_t *params)
+// Json.GetStringPath(const char[], char[], int)
+static cell_t JSONGetStringPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
-    
-    char *key;
-    pContext->LocalToString(params[2], &key);
+
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
     json_t *value;
-    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+    if((value = PathGetValue(pContext, object, path)) == NULL)
         return 0;
 
     const char *result;
@@ -298,45 +478,45 @@ static cell_t ObjectGetString(IPluginContext *pContext, const cell_t *params)
     return (result != NULL);
 }
 
-// JSONObject.GetType(const char[])
-static cell_t ObjectGetType(IPluginContext *pContext, const cell_t *params)
+// Json.GetTypePath(const char[])
+static cell_t JSONGetTypePath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;	
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
     json_t *value;
-    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+    if((value = PathGetValue(pContext, object, path)) == NULL)
         return 0;
 
     return json_typeof(value);
 }
 
-// JSONObject.IsKeyValid(const char[])
-static cell_t IsObjectKeyValid(IPluginContext *pContext, const cell_t *params)
+// Json.HasPath(const char[])
+static cell_t JSONHasPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
-    
-    char *key;
-    pContext->LocalToString(params[2], &key);
 
-    return json_object_get(object, key) != NULL;
+    char *path;
+    pContext->LocalToString(params[2], &path);
+
+    return json_pointer_get(object, path) != NULL;
 }
 
-// JSONObject.Set(const char[], JSON)
-static cell_t ObjectSet(IPluginContext *pContext, const cell_t *params)
+// Json.SetPath(const char[], Json)
+static cell_t JSONSetPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
     json_t *value;
     value = (((Handle_t) params[3]) == BAD_HANDLE)
@@ -345,469 +525,2173 @@ static cell_t ObjectSet(IPluginContext *pContext, const cell_t *params)
 
     return (value != NULL) 
                 ?  (json_typeof(value) != JSON_NULL)
-                        ? (json_object_set(object, key, value) == 0)
-                        : (json_object_set_new(object, key, value) == 0)
+                        ? (json_pointer_set(object, path, value) == 0)
+                        : (json_pointer_set_new(object, path, value) == 0)
                 : 0;
 }
 
-// JSONObject.SetBool(const char[], bool)
-static cell_t ObjectSetBool(IPluginContext *pContext, const cell_t *params)
+// Json.SetBoolPath(const char[], bool)
+static cell_t JSONSetBoolPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
-    return (json_object_set_new(object, key, (json_boolean(params[3]))) == 0);
+    return (json_pointer_set_new(object, path, (json_boolean(params[3]))) == 0);
 }
 
-// JSONObject.SetFloat(const char[], float)
-static cell_t ObjectSetFloat(IPluginContext *pContext, const cell_t *params)
+// Json.SetFloatPath(const char[], float)
+static cell_t JSONSetFloatPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
-    return (json_object_set_new(object, key, (json_real(sp_ctof(params[3])))) == 0);
+    return (json_pointer_set_new(object, path, (json_real(sp_ctof(params[3])))) == 0);
 }
 
-// JSONObject.SetInt(const char[], int)
-static cell_t ObjectSetInt(IPluginContext *pContext, const cell_t *params)
+// Json.SetIntPath(const char[], int)
+static cell_t JSONSetIntPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
-    return (json_object_set_new(object, key, (json_integer(params[3]))) == 0);
+    return (json_pointer_set_new(object, path, (json_integer_shared(params[3]))) == 0);
 }
 
-// JSONObject.SetInt64(cosnt char[], const char[])
-static cell_t ObjectSetInt64(IPluginContext *pContext, const cell_t *params)
+// Json.SetInt64Path(const char[], const char[])
+static cell_t JSONSetInt64Path(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
     char *val;
     pContext->LocalToString(params[3], &val);
 
-    return (json_object_set_new(object, key, (json_integer(strtoll(val, NULL, 10)))) == 0);
+    return (json_pointer_set_new(object, path, (json_integer_shared(strtoll(val, NULL, 10)))) == 0);
 }
 
-// JSONObject.SetString(const char[], const char[])
-static cell_t ObjectSetString(IPluginContext *pContext, const cell_t *params)
+// Json.SetStringPath(const char[], const char[])
+static cell_t JSONSetStringPath(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    char *path;
+    pContext->LocalToString(params[2], &path);
 
     char *val;
     pContext->LocalToString(params[3], &val);
 
-    return (json_object_set_new(object, key, (json_string(val))) == 0);
+    return (json_pointer_set_new(object, path, (json_string(val))) == 0);
 }
 
-// JSONObject.Remove(const char[])
-static cell_t ObjectRemoveKey(IPluginContext *pContext, const cell_t *params)
+// Json.Diff(Json)
+static cell_t JSONDiff(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+        return BAD_HANDLE;
 
-    char *key;
-    pContext->LocalToString(params[2], &key);
+    json_t *other;
+    if((other = GetJSONFromHandle(pContext, params[2])) == NULL)
+        return BAD_HANDLE;
 
-    return (json_object_del(object, key) == 0);
+    json_t *patch;
+    if((patch = json_diff(object, other)) == NULL) {
+        pContext->ThrowNativeError("JSON(Diff): Values contain a circular reference");
+        return BAD_HANDLE;
+    }
+
+    return CreateJSONHandle(pContext, patch);
 }
 
-// JsonObject.Update(Json, JsonUpdateType)
-static cell_t ObjectUpdate(IPluginContext *pContext, const cell_t *params)
+// Json.ApplyPatch(Json)
+static cell_t JSONApplyPatch(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    json_t *other;
-    if((other = GetJSONFromHandle(pContext, params[2])) == NULL)
+    json_t *patch;
+    if((patch = GetJSONFromHandle(pContext, params[2])) == NULL)
         return 0;
-    
-    JsonUpdateType type = (JsonUpdateType) params[3];
-
-    int ret = (!type)
-            ? json_object_update(object, other)
-            : (type == JSON_UPDATE_EXISTING)
-                ? json_object_update_existing(object, other)
-                : (type == JSON_UPDATE_MISSING)
-                    ? json_object_update_missing(object, other)
-                    : json_object_update_recursive(object, other);
 
-    return ret;
+    return (json_patch_apply(object, patch) == 0);
 }
 
-// JSONObject.Clear()
-static cell_t ObjectClear(IPluginContext *pContext, const cell_t *params)
+// JSONObject.Get(const char[])
+static cell_t ObjectGet(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+    
+    char *key;	
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value;
+    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+        return BAD_HANDLE;
+
+    return CreateJSONHandleEx(pContext, value);
+}
+
+// JSONObject.GetBool(const char[])
+static cell_t ObjectGetBool(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+    
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value = ObjectGetValue(pContext, object, key);
+    return (value != NULL) 
+                ? json_boolean_value(value) 
+                : 0;
+}
+
+// JSONObject.GetFloat(const char[])
+static cell_t ObjectGetFloat(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+    
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value = ObjectGetValue(pContext, object, key);
+    return (value != NULL) 
+                ? sp_ftoc(static_cast<float>(json_real_value(value))) 
+                : 0;
+}
+
+// JSONObject.GetInt(const char[])
+static cell_t ObjectGetInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+    
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value = ObjectGetValue(pContext, object, key);
+    return (value != NULL) 
+                ? static_cast<cell_t>(json_integer_value(value)) 
+                : 0;
+}
+
+// JSONObject.GetInt64(const char[], char[], int)
+static cell_t ObjectGetInt64(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+    
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value;
+    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+        return 0;
+
+    char result[20];
+    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, json_integer_value(value));
+    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return 1;
+}
+
+// JSONObject.GetString(const char[], char[], int)
+static cell_t ObjectGetString(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+    
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value;
+    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+        return 0;
+
+    const char *result;
+    if((result = json_string_value(value)) != NULL)
+        pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return (result != NULL);
+}
+
+// JSONObject.GetType(const char[])
+static cell_t ObjectGetType(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;	
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value;
+    if((value = ObjectGetValue(pContext, object, key)) == NULL)
+        return 0;
+
+    return json_typeof(value);
+}
+
+// JSONObject.IsKeyValid(const char[])
+static cell_t IsObjectKeyValid(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+    
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    return json_object_get(object, key) != NULL;
+}
+
+// JSONObject.Set(const char[], JSON)
+static cell_t ObjectSet(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_t *value;
+    value = (((Handle_t) params[3]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[3]);
+
+    return (value != NULL) 
+                ?  (json_typeof(value) != JSON_NULL)
+                        ? (json_object_set(object, key, value) == 0)
+                        : (json_object_set_new(object, key, value) == 0)
+                : 0;
+}
+
+// JSONObject.SetBool(const char[], bool)
+static cell_t ObjectSetBool(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    return (json_object_set_new(object, key, (json_boolean(params[3]))) == 0);
+}
+
+// JSONObject.SetFloat(const char[], float)
+static cell_t ObjectSetFloat(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    return (json_object_set_new(object, key, (json_real(sp_ctof(params[3])))) == 0);
+}
+
+// JSONObject.SetInt(const char[], int)
+static cell_t ObjectSetInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    return (json_object_set_new(object, key, (json_integer_shared(params[3]))) == 0);
+}
+
+// JSONObject.SetInt64(cosnt char[], const char[])
+static cell_t ObjectSetInt64(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_object_set_new(object, key, (json_integer_shared(strtoll(val, NULL, 10)))) == 0);
+}
+
+// JSONObject.SetString(const char[], const char[])
+static cell_t ObjectSetString(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_object_set_new(object, key, (json_string(val))) == 0);
+}
+
+// JSONObject.Remove(const char[])
+static cell_t ObjectRemoveKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    return (json_object_del(object, key) == 0);
+}
+
+// JsonObject.Update(Json, JsonUpdateType)
+static cell_t ObjectUpdate(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *other;
+    if((other = GetJSONFromHandle(pContext, params[2])) == NULL)
+        return 0;
+    
+    JsonUpdateType type = (JsonUpdateType) params[3];
+
+    int ret = (!type)
+            ? json_object_update(object, other)
+            : (type == JSON_UPDATE_EXISTING)
+                ? json_object_update_existing(object, other)
+                : (type == JSON_UPDATE_MISSING)
+                    ? json_object_update_missing(object, other)
+                    : (type == JSON_UPDATE_MERGE_PATCH)
+                        ? json_object_merge_patch(object, other)
+                        : json_object_update_recursive(object, other);
+
+    return ret;
+}
+
+// JSONObject.Clear()
+static cell_t ObjectClear(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_object_clear(object) == 0);
+}
+
+// JSONObject.Size.get()
+static cell_t ObjectSize(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *o;
+    return ((o = GetJSONFromHandle(pContext, params[1])) != NULL) 
+                ? json_object_size(o) : 0;
+}
+
+// JSONObject.Keys()
+static cell_t ObjectKeys(IPluginContext *pContext, const cell_t *params)
+{
+    HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    struct JSONObjectKeys *keys = new struct JSONObjectKeys(object);
+
+    Handle_t hndlKeys;
+    HandleError *err = NULL;
+    if ((hndlKeys = handlesys->CreateHandleEx(htJSONObjectKeys, keys, &sec, NULL, err)) == BAD_HANDLE
+            || err != NULL)
+    {
+        pContext->ThrowNativeError("JSON(Keys: %d): Could not create iterator handle.", *err);
+        delete keys;
+        return BAD_HANDLE;
+    }
+
+    return hndlKeys;
+}
+
+// JSONKeys.Next(char[], int)
+static cell_t ReadObjectKey(IPluginContext *pContext, const cell_t *params)
+{
+    HandleError err;
+    HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+
+    struct JSONObjectKeys *keys;
+    Handle_t hndlKeys = static_cast<Handle_t>(params[1]);
+    if ((err=handlesys->ReadHandle(hndlKeys, htJSONObjectKeys, &sec, (void **)&keys)) != HandleError_None)
+        return pContext->ThrowNativeError("JSON(Keys): Invalid object keys handle %x (error %d)", hndlKeys, err);
+
+    const char *key;
+    if ((key = keys->GetKey()) == NULL)
+        return 0;
+
+    pContext->StringToLocalUTF8(params[2], params[3], key, NULL);
+    keys->Next();
+
+    return 1;
+}
+
+static json_key_t *GetKeyFromHandle(IPluginContext *pContext, Handle_t hndl)
+{
+    HandleError err;
+    json_key_t *key = NULL;
+    HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+    if((err = handlesys->ReadHandle(hndl, htJSONKey, &sec, (void **)&key)) != HandleError_None)
+        pContext->ThrowNativeError(
+            "JSON(Key): Invalid key handle %x (error %d)", hndl, err);
+
+    return err != HandleError_None ? NULL : key;
+}
+
+static inline json_t *ObjectGetValueByKey(IPluginContext *pContext, json_t *o, const json_key_t *k)
+{
+    json_t *v;
+    if ((v = json_object_get_by_key(o, k)) == NULL)
+        pContext->ThrowNativeError("JSON(GetValue): Key '%s' is not exists", json_key_value(k));
+
+    return v;
+}
+
+// JsonKey.JsonKey(const char[])
+static cell_t KeyCreate(IPluginContext *pContext, const cell_t *params)
+{
+    char *buffer;
+    pContext->LocalToString(params[1], &buffer);
+
+    json_key_t *key;
+    if((key = json_key(buffer)) == NULL) {
+        pContext->ThrowNativeError("JSON(Key): Invalid key '%s'", buffer);
+        return BAD_HANDLE;
+    }
+
+    Handle_t hndl;
+    HandleError err;
+    if((hndl = handlesys->CreateHandle(htJSONKey, key, pContext->GetIdentity(), myself->GetIdentity(), &err)) == BAD_HANDLE)
+    {
+        json_key_free(key);
+        pContext->ThrowNativeError(
+            "JSON(Key: %d): Could not create key handle.", err);
+    }
+
+    return hndl;
+}
+
+// JsonObject.GetByKey(JsonKey)
+static cell_t ObjectGetByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return BAD_HANDLE;
+
+    json_t *value;
+    if((value = ObjectGetValueByKey(pContext, object, key)) == NULL)
+        return BAD_HANDLE;
+
+    return CreateJSONHandleEx(pContext, value);
+}
+
+// JsonObject.GetBoolByKey(JsonKey)
+static cell_t ObjectGetBoolByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value = ObjectGetValueByKey(pContext, object, key);
+    return (value != NULL) 
+                ? json_boolean_value(value) 
+                : 0;
+}
+
+// JsonObject.GetFloatByKey(JsonKey)
+static cell_t ObjectGetFloatByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value = ObjectGetValueByKey(pContext, object, key);
+    return (value != NULL) 
+                ? sp_ftoc(static_cast<float>(json_real_value(value))) 
+                : 0;
+}
+
+// JsonObject.GetIntByKey(JsonKey)
+static cell_t ObjectGetIntByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value = ObjectGetValueByKey(pContext, object, key);
+    return (value != NULL) 
+                ? static_cast<cell_t>(json_integer_value(value)) 
+                : 0;
+}
+
+// JsonObject.GetInt64ByKey(JsonKey, char[], int)
+static cell_t ObjectGetInt64ByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ObjectGetValueByKey(pContext, object, key)) == NULL)
+        return 0;
+
+    char result[20];
+    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, json_integer_value(value));
+    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return 1;
+}
+
+// JsonObject.GetStringByKey(JsonKey, char[], int)
+static cell_t ObjectGetStringByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ObjectGetValueByKey(pContext, object, key)) == NULL)
+        return 0;
+
+    const char *result;
+    if((result = json_string_value(value)) != NULL)
+        pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return (result != NULL);
+}
+
+// JsonObject.GetTypeByKey(JsonKey)
+static cell_t ObjectGetTypeByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ObjectGetValueByKey(pContext, object, key)) == NULL)
+        return 0;
+
+    return json_typeof(value);
+}
+
+// JsonObject.HasJsonKey(JsonKey)
+static cell_t IsObjectJsonKeyValid(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    return json_object_get_by_key(object, key) != NULL;
+}
+
+// JsonObject.SetByKey(JsonKey, Json)
+static cell_t ObjectSetByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    json_t *value;
+    value = (((Handle_t) params[3]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[3]);
+
+    return (value != NULL) 
+                ?  (json_typeof(value) != JSON_NULL)
+                        ? (json_object_set_by_key(object, key, value) == 0)
+                        : (json_object_set_by_key_new(object, key, value) == 0)
+                : 0;
+}
+
+// JsonObject.SetBoolByKey(JsonKey, bool)
+static cell_t ObjectSetBoolByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    return (json_object_set_by_key_new(object, key, (json_boolean(params[3]))) == 0);
+}
+
+// JsonObject.SetFloatByKey(JsonKey, float)
+static cell_t ObjectSetFloatByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    return (json_object_set_by_key_new(object, key, (json_real(sp_ctof(params[3])))) == 0);
+}
+
+// JsonObject.SetIntByKey(JsonKey, int)
+static cell_t ObjectSetIntByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    return (json_object_set_by_key_new(object, key, (json_integer_shared(params[3]))) == 0);
+}
+
+// JsonObject.SetInt64ByKey(JsonKey, const char[])
+static cell_t ObjectSetInt64ByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_object_set_by_key_new(object, key, (json_integer_shared(strtoll(val, NULL, 10)))) == 0);
+}
+
+// JsonObject.SetStringByKey(JsonKey, const char[])
+static cell_t ObjectSetStringByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_object_set_by_key_new(object, key, (json_string(val))) == 0);
+}
+
+// JsonObject.RemoveByKey(JsonKey)
+static cell_t ObjectRemoveByKey(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_key_t *key;
+    if((key = GetKeyFromHandle(pContext, params[2])) == NULL)
+        return 0;
+
+    return (json_object_del_by_key(object, key) == 0);
+}
+
+static inline json_t *ObjectGetValueByInt(IPluginContext *pContext, json_t *o, cell_t k)
+{
+    json_t *v;
+    if ((v = json_object_get_by_int(o, k)) == NULL)
+        pContext->ThrowNativeError("JSON(GetValue): Key '%d' is not exists", k);
+
+    return v;
+}
+
+// JsonObject.GetByInt(int)
+static cell_t ObjectGetByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    json_t *value;
+    if((value = ObjectGetValueByInt(pContext, object, params[2])) == NULL)
+        return BAD_HANDLE;
+
+    return CreateJSONHandleEx(pContext, value);
+}
+
+// JsonObject.GetBoolByInt(int)
+static cell_t ObjectGetBoolByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value = ObjectGetValueByInt(pContext, object, params[2]);
+    return (value != NULL) 
+                ? json_boolean_value(value) 
+                : 0;
+}
+
+// JsonObject.GetFloatByInt(int)
+static cell_t ObjectGetFloatByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value = ObjectGetValueByInt(pContext, object, params[2]);
+    return (value != NULL) 
+                ? sp_ftoc(static_cast<float>(json_real_value(value))) 
+                : 0;
+}
+
+// JsonObject.GetIntByInt(int)
+static cell_t ObjectGetIntByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value = ObjectGetValueByInt(pContext, object, params[2]);
+    return (value != NULL) 
+                ? static_cast<cell_t>(json_integer_value(value)) 
+                : 0;
+}
+
+// JsonObject.GetInt64ByInt(int, char[], int)
+static cell_t ObjectGetInt64ByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ObjectGetValueByInt(pContext, object, params[2])) == NULL)
+        return 0;
+
+    char result[20];
+    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, json_integer_value(value));
+    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return 1;
+}
+
+// JsonObject.GetStringByInt(int, char[], int)
+static cell_t ObjectGetStringByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ObjectGetValueByInt(pContext, object, params[2])) == NULL)
+        return 0;
+
+    const char *result;
+    if((result = json_string_value(value)) != NULL)
+        pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return (result != NULL);
+}
+
+// JsonObject.GetTypeByInt(int)
+static cell_t ObjectGetTypeByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ObjectGetValueByInt(pContext, object, params[2])) == NULL)
+        return 0;
+
+    return json_typeof(value);
+}
+
+// JsonObject.HasInt(int)
+static cell_t IsObjectIntKeyValid(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return json_object_get_by_int(object, params[2]) != NULL;
+}
+
+// JsonObject.SetByInt(int, Json)
+static cell_t ObjectSetByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    value = (((Handle_t) params[3]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[3]);
+
+    return (value != NULL) 
+                ?  (json_typeof(value) != JSON_NULL)
+                        ? (json_object_set_by_int(object, params[2], value) == 0)
+                        : (json_object_set_by_int_new(object, params[2], value) == 0)
+                : 0;
+}
+
+// JsonObject.SetBoolByInt(int, bool)
+static cell_t ObjectSetBoolByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_object_set_by_int_new(object, params[2], (json_boolean(params[3]))) == 0);
+}
+
+// JsonObject.SetFloatByInt(int, float)
+static cell_t ObjectSetFloatByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_object_set_by_int_new(object, params[2], (json_real(sp_ctof(params[3])))) == 0);
+}
+
+// JsonObject.SetIntByInt(int, int)
+static cell_t ObjectSetIntByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_object_set_by_int_new(object, params[2], (json_integer_shared(params[3]))) == 0);
+}
+
+// JsonObject.SetInt64ByInt(int, const char[])
+static cell_t ObjectSetInt64ByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_object_set_by_int_new(object, params[2], (json_integer_shared(strtoll(val, NULL, 10)))) == 0);
+}
+
+// JsonObject.SetStringByInt(int, const char[])
+static cell_t ObjectSetStringByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_object_set_by_int_new(object, params[2], (json_string(val))) == 0);
+}
+
+// JsonObject.RemoveByInt(int)
+static cell_t ObjectRemoveByInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_object_del_by_int(object, params[2]) == 0);
+}
+
+// JSONArray.Get(const int)
+static cell_t ArrayGet(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    json_t *value;
+    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+        return BAD_HANDLE;
+
+    return CreateJSONHandleEx(pContext, value);
+}
+
+// JSONArray.GetBool(const int)
+static cell_t ArrayGetBool(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+        return 0;
+
+    return json_boolean_value(value);
+}
+
+// JSONArray.GetFloat(const int)
+static cell_t ArrayGetFloat(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    double real;
+    if(ArrayGetPackedReal(object, params[2], &real))
+        return sp_ftoc(static_cast<float>(real));
+
+    json_t *value;
+    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+        return 0;
+
+    return sp_ftoc(static_cast<float>(json_real_value(value)));
+}
+
+// JSONArray.GetInt(const int)
+static cell_t ArrayGetInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_int_t integer;
+    if(ArrayGetPackedInteger(object, params[2], &integer))
+        return static_cast<cell_t>(integer);
+
+    json_t *value;
+    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+        return 0;
+
+    return static_cast<cell_t>(json_integer_value(value));
+}
+
+// JSONArray.GetInt64(const int)
+static cell_t ArrayGetInt64(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_int_t integer;
+    if(!ArrayGetPackedInteger(object, params[2], &integer))
+    {
+        json_t *value;
+        if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+            return 0;
+
+        integer = json_integer_value(value);
+    }
+
+    char result[20];
+    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, integer);
+    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return 1;
+}
+
+// JSONArray.GetString(const int)
+static cell_t ArrayGetString(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+        return 0;
+
+    const char *result;
+    if ((result = json_string_value(value)) == NULL)
+        return 0;
+
+    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+
+    return 1;
+}
+
+// JSONArray.GetType(const int)
+static cell_t ArrayGetType(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_int_t integer;
+    if(ArrayGetPackedInteger(object, params[2], &integer))
+        return JSON_INTEGER;
+
+    double real;
+    if(ArrayGetPackedReal(object, params[2], &real))
+        return JSON_REAL;
+
+    json_t *value;
+    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+        return BAD_HANDLE;
+
+    return json_typeof(value);
+}
+
+// JSONArray.Set(const int, JSON)
+static cell_t ArraySet(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    value = (((Handle_t) params[3]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[3]);
+
+    return (value != NULL) 
+                ?  (json_typeof(value) != JSON_NULL)
+                        ? (json_array_set(object, params[2], value) == 0)
+                        : (json_array_set_new(object, params[2], value) == 0)
+                : 0;
+}
+
+// JSONArray.SetBool(const int, bool)
+static cell_t ArraySetBool(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_set_new(object, params[2], (json_boolean(params[3]))) == 0);
+}
+
+// JSONArray.SetFloat(const int, float)
+static cell_t ArraySetFloat(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_set_new(object, params[2], (json_real(sp_ctof(params[3])))) == 0);
+}
+
+// JSONArray.SetInt(const int, int)
+static cell_t ArraySetInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_set_new(object, params[2], (json_integer_shared(params[3]))) == 0);
+}
+
+// JSONArray.SetInt64(const int, const char[])
+static cell_t ArraySetInt64(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_array_set_new(
+                object, params[2], (json_integer_shared(json_strtoint(val, NULL, 10)))) == 0);
+}
+
+// JSONArray.SetString(const int, const char[])
+static cell_t ArraySetString(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[3], &val);
+
+    return (json_array_set_new(object, params[2], (json_string(val))) == 0);
+}
+
+// JSONArray.Push(JSON)
+static cell_t ArrayPush(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    value = (((Handle_t) params[2]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[2]);
+
+    return (value != NULL) 
+                ?  (json_typeof(value) != JSON_NULL)
+                        ? (json_array_append(object, value) == 0)
+                        : (json_array_append_new(object, value) == 0)
+                : 0;
+}
+
+// JSONArray.PushBool(bool)
+static cell_t ArrayPushBool(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_append_new(object, (json_boolean(params[2]))) == 0);
+}
+
+// JSONArray.PushFloat(float)
+static cell_t ArrayPushFloat(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_append_new(object, (json_real(sp_ctof(params[2])))) == 0);
+}
+
+// JSONArray.PushInt(int)
+static cell_t ArrayPushInt(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_append_new(object, (json_integer_shared(params[2]))) == 0);
+}
+
+// JSONArray.PushInt64(const char[])
+static cell_t ArrayPushInt64(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[2], &val);
+
+    return (json_array_append_new(object, (json_integer_shared(json_strtoint(val, NULL, 10)))) == 0);
+}
+
+// JSONArray.PushString(const char[])
+static cell_t ArrayPushString(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[2], &val);
+
+    return (json_array_append_new(object, (json_string(val))) == 0);
+}
+
+// JSONArray.Remove(const int)
+static cell_t ArrayRemove(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+        
+    return (json_array_remove(object, params[2]) == 0);
+}
+
+// JSONArray.Unshift(JSON)
+static cell_t ArrayUnshift(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    value = (((Handle_t) params[2]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[2]);
+
+    return (value != NULL) 
+                ?  (json_typeof(value) != JSON_NULL)
+                        ? (json_array_insert(object, 0, value) == 0)
+                        : (json_array_insert_new(object, 0, value) == 0)
+                : 0;
+}
+
+static cell_t ArrayTakeValue(IPluginContext *pContext, json_t *object, const size_t index)
+{
+    json_t *value;
+    if((value = json_array_get(object, index)) == NULL)
+        return BAD_HANDLE;
+
+    // The handle takes over the reference held by the array
+    json_incref(value);
+    json_array_remove(object, index);
+
+    return CreateJSONHandle(pContext, value);
+}
+
+// JSONArray.Shift()
+static cell_t ArrayShift(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    return ArrayTakeValue(pContext, object, 0);
+}
+
+// JSONArray.PopBack()
+static cell_t ArrayPopBack(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
+    size_t size;
+    if((size = json_array_size(object)) == 0)
+        return BAD_HANDLE;
+
+    return ArrayTakeValue(pContext, object, size - 1);
+}
+
+// JSONArray.Clear()
+static cell_t ArrayClear(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_clear(object) == 0);
+}
+
+// JSONArray.Reserve(const int)
+static cell_t ArrayReserve(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    if(params[2] < 0) {
+        pContext->ThrowNativeError("JSON(Reserve): Invalid size %d", params[2]);
+        return 0;
+    }
+
+    return (json_array_reserve(object, (size_t) params[2]) == 0);
+}
+
+// JSONArray.Compact()
+static cell_t ArrayCompact(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *object;
+    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_array_shrink_to_fit(object) == 0);
+}
+
+// JSONArray.Size.get()
+static cell_t ArraySize(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    return (json_object_clear(object) == 0);
+    return json_array_size(object);
 }
 
-// JSONObject.Size.get()
-static cell_t ObjectSize(IPluginContext *pContext, const cell_t *params)
+static struct JSONWriter *GetWriterFromHandle(IPluginContext *pContext, Handle_t hndl)
 {
-    json_t *o;
-    return ((o = GetJSONFromHandle(pContext, params[1])) != NULL) 
-                ? json_object_size(o) : 0;
+    HandleError err;
+    struct JSONWriter *writer = NULL;
+    HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+    if((err = handlesys->ReadHandle(hndl, htJSONWriter, &sec, (void **)&writer)) != HandleError_None)
+        pContext->ThrowNativeError(
+            "JSON(Writer): Invalid writer handle %x (error %d)", hndl, err);
+
+    return err != HandleError_None ? NULL : writer;
 }
 
-// JSONObject.Keys()
-static cell_t ObjectKeys(IPluginContext *pContext, const cell_t *params)
+static Handle_t CreateWriterHandle(IPluginContext *pContext, struct JSONWriter *writer)
+{
+    Handle_t hndl;
+    HandleError err;
+    if((hndl = handlesys->CreateHandle(htJSONWriter, writer, pContext->GetIdentity(), myself->GetIdentity(), &err)) == BAD_HANDLE)
+    {
+        delete writer;
+        pContext->ThrowNativeError(
+            "JSON(Writer: %d): Could not create writer handle.", err);
+    }
+
+    return hndl;
+}
+
+// JsonWriter.JsonWriter(int = 0)
+static cell_t WriterCreate(IPluginContext *pContext, const cell_t *params)
+{
+    json_writer_t *writer;
+    if((writer = json_writer((size_t) params[1])) == NULL)
+        return BAD_HANDLE;
+
+    return CreateWriterHandle(pContext, new struct JSONWriter(writer));
+}
+
+// JsonWriter.Open(const char[], int = 0)
+static cell_t WriterOpen(IPluginContext *pContext, const cell_t *params)
+{
+    char *path;
+    pContext->LocalToString(params[1], &path);
+
+    char realpath[PLATFORM_MAX_PATH];
+    smutils->BuildPath(Path_Game, realpath, sizeof(realpath), "%s", path);
+
+    FILE *file;
+    if((file = fopen(realpath, "w")) == NULL)
+        return BAD_HANDLE;
+
+    json_writer_t *writer;
+    if((writer = json_writer_file(file, (size_t) params[2])) == NULL) {
+        fclose(file);
+        return BAD_HANDLE;
+    }
+
+    return CreateWriterHandle(pContext, new struct JSONWriter(writer, file));
+}
+
+// JsonWriter.BeginObject()
+static cell_t WriterBeginObject(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_object_begin(writer->writer) == 0);
+}
+
+// JsonWriter.EndObject()
+static cell_t WriterEndObject(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_object_end(writer->writer) == 0);
+}
+
+// JsonWriter.BeginArray()
+static cell_t WriterBeginArray(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_array_begin(writer->writer) == 0);
+}
+
+// JsonWriter.EndArray()
+static cell_t WriterEndArray(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_array_end(writer->writer) == 0);
+}
+
+// JsonWriter.Key(const char[])
+static cell_t WriterKey(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    return (json_writer_key(writer->writer, key) == 0);
+}
+
+// JsonWriter.WriteBool(bool)
+static cell_t WriterWriteBool(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_boolean(writer->writer, params[2]) == 0);
+}
+
+// JsonWriter.WriteFloat(float)
+static cell_t WriterWriteFloat(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_real(writer->writer, sp_ctof(params[2])) == 0);
+}
+
+// JsonWriter.WriteInt(int)
+static cell_t WriterWriteInt(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_integer(writer->writer, params[2]) == 0);
+}
+
+// JsonWriter.WriteInt64(const char[])
+static cell_t WriterWriteInt64(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[2], &val);
+
+    return (json_writer_integer(writer->writer, json_strtoint(val, NULL, 10)) == 0);
+}
+
+// JsonWriter.WriteString(const char[])
+static cell_t WriterWriteString(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    char *val;
+    pContext->LocalToString(params[2], &val);
+
+    return (json_writer_string(writer->writer, val) == 0);
+}
+
+// JsonWriter.WriteNull()
+static cell_t WriterWriteNull(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return (json_writer_null(writer->writer) == 0);
+}
+
+// JsonWriter.Write(Json)
+static cell_t WriterWrite(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *value;
+    value = (((Handle_t) params[2]) == BAD_HANDLE)
+                    ? json_null()
+                    : GetJSONFromHandle(pContext, params[2]);
+
+    return (value != NULL) 
+                ? (json_writer_value(writer->writer, value) == 0)
+                : 0;
+}
+
+// JsonWriter.ToString(char[], int)
+static cell_t WriterToString(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    const char *result;
+    if((result = json_writer_result(writer->writer, NULL)) == NULL)
+        return 0;
+
+    pContext->StringToLocalUTF8(params[2], params[3], result, NULL);
+
+    return 1;
+}
+
+// JsonWriter.Done.get()
+static cell_t WriterDone(IPluginContext *pContext, const cell_t *params)
+{
+    struct JSONWriter *writer;
+    if((writer = GetWriterFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return json_writer_done(writer->writer);
+}
+
+static json_columnar_t *GetColumnsFromHandle(IPluginContext *pContext, Handle_t hndl)
 {
+    HandleError err;
+    json_columnar_t *columnar = NULL;
     HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+    if((err = handlesys->ReadHandle(hndl, htJSONColumns, &sec, (void **)&columnar)) != HandleError_None)
+        pContext->ThrowNativeError(
+            "JSON(Columns): Invalid columns handle %x (error %d)", hndl, err);
+
+    return err != HandleError_None ? NULL : columnar;
+}
+
+// A key that no row has gives an empty column
+static inline json_t *ColumnsGetColumn(IPluginContext *pContext, json_columnar_t *columnar, cell_t param, json_stats_t *stats)
+{
+    char *key;
+    pContext->LocalToString(param, &key);
 
+    json_t *column = json_columnar_column(columnar, key);
+    if(stats != NULL && json_array_stats(column, stats) != 0)
+        *stats = json_stats_t();
+
+    return column;
+}
+
+// Number of values to copy into a plugin array of the given size
+static inline size_t ColumnsCopyCount(json_t *column, const cell_t size)
+{
+    size_t count = json_array_size(column);
+    if(size <= 0)
+        return 0;
+
+    return count < (size_t) size ? count : (size_t) size;
+}
+
+// JsonColumns.JsonColumns(JsonArray)
+static cell_t ColumnsCreate(IPluginContext *pContext, const cell_t *params)
+{
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return BAD_HANDLE;
 
-    struct JSONObjectKeys *keys = new struct JSONObjectKeys(object);
+    json_columnar_t *columnar;
+    if((columnar = json_columnar(object)) == NULL) {
+        pContext->ThrowNativeError("JSON(Columns): Value is not an array");
+        return BAD_HANDLE;
+    }
 
-    Handle_t hndlKeys;
-    HandleError *err = NULL;
-    if ((hndlKeys = handlesys->CreateHandleEx(htJSONObjectKeys, keys, &sec, NULL, err)) == BAD_HANDLE
-            || err != NULL)
+    Handle_t hndl;
+    HandleError err;
+    if((hndl = handlesys->CreateHandle(htJSONColumns, columnar, pContext->GetIdentity(), myself->GetIdentity(), &err)) == BAD_HANDLE)
     {
-        pContext->ThrowNativeError("JSON(Keys: %d): Could not create iterator handle.", *err);
-        delete keys;
-        return BAD_HANDLE;
+        json_columnar_free(columnar);
+        pContext->ThrowNativeError(
+            "JSON(Columns: %d): Could not create columns handle.", err);
     }
 
-    return hndlKeys;
+    return hndl;
 }
 
-// JSONKeys.Next(char[], int)
-static cell_t ReadObjectKey(IPluginContext *pContext, const cell_t *params)
+// JsonColumns.Rows.get()
+static cell_t ColumnsRows(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    return json_columnar_rows(columnar);
+}
+
+// JsonColumns.GetInts(const char[], int[], int)
+static cell_t ColumnsGetInts(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *column = ColumnsGetColumn(pContext, columnar, params[2], NULL);
+    size_t count = ColumnsCopyCount(column, params[4]);
+
+    cell_t *values;
+    pContext->LocalToPhysAddr(params[3], &values);
+
+    const json_int_t *integers;
+    if((integers = json_array_integers(column)) != NULL) {
+        for(size_t i = 0; i < count; i++)
+            values[i] = static_cast<cell_t>(integers[i]);
+    } else {
+        for(size_t i = 0; i < count; i++)
+            values[i] = static_cast<cell_t>(json_integer_value(json_array_get(column, i)));
+    }
+
+    return count;
+}
+
+// JsonColumns.GetFloats(const char[], float[], int)
+static cell_t ColumnsGetFloats(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_t *column = ColumnsGetColumn(pContext, columnar, params[2], NULL);
+    size_t count = ColumnsCopyCount(column, params[4]);
+
+    cell_t *values;
+    pContext->LocalToPhysAddr(params[3], &values);
+
+    const double *reals;
+    if((reals = json_array_reals(column)) != NULL) {
+        for(size_t i = 0; i < count; i++)
+            values[i] = sp_ftoc(static_cast<float>(reals[i]));
+    } else {
+        for(size_t i = 0; i < count; i++)
+            values[i] = sp_ftoc(static_cast<float>(json_number_value(json_array_get(column, i))));
+    }
+
+    return count;
+}
+
+// JsonColumns.Count(const char[])
+static cell_t ColumnsCount(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_stats_t stats;
+    ColumnsGetColumn(pContext, columnar, params[2], &stats);
+
+    return stats.count;
+}
+
+// JsonColumns.Sum(const char[])
+static cell_t ColumnsSum(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_stats_t stats;
+    ColumnsGetColumn(pContext, columnar, params[2], &stats);
+
+    return sp_ftoc(static_cast<float>(stats.sum));
+}
+
+// JsonColumns.Min(const char[])
+static cell_t ColumnsMin(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_stats_t stats;
+    ColumnsGetColumn(pContext, columnar, params[2], &stats);
+
+    return sp_ftoc(static_cast<float>(stats.min));
+}
+
+// JsonColumns.Max(const char[])
+static cell_t ColumnsMax(IPluginContext *pContext, const cell_t *params)
+{
+    json_columnar_t *columnar;
+    if((columnar = GetColumnsFromHandle(pContext, params[1])) == NULL)
+        return 0;
+
+    json_stats_t stats;
+    ColumnsGetColumn(pContext, columnar, params[2], &stats);
+
+    return sp_ftoc(static_cast<float>(stats.max));
+}
+
+static json_persistent_t *GetPersistentFromHandle(IPluginContext *pContext, Handle_t hndl)
 {
     HandleError err;
+    json_persistent_t *persistent = NULL;
     HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+    if((err = handlesys->ReadHandle(hndl, htJSONPersistent, &sec, (void **)&persistent)) != HandleError_None)
+        pContext->ThrowNativeError(
+            "JSON(Persistent): Invalid persistent handle %x (error %d)", hndl, err);
 
-    struct JSONObjectKeys *keys;
-    Handle_t hndlKeys = static_cast<Handle_t>(params[1]);
-    if ((err=handlesys->ReadHandle(hndlKeys, htJSONObjectKeys, &sec, (void **)&keys)) != HandleError_None)
-        return pContext->ThrowNativeError("JSON(Keys): Invalid object keys handle %x (error %d)", hndlKeys, err);
+    return err != HandleError_None ? NULL : persistent;
+}
 
-    const char *key;
-    if ((key = keys->GetKey()) == NULL)
-        return 0;
+// Takes the reference to persistent, which is released on error
+static Handle_t CreatePersistentHandle(IPluginContext *pContext, json_persistent_t *persistent)
+{
+    Handle_t hndl;
+    HandleError err;
+    if((hndl = handlesys->CreateHandle(htJSONPersistent, persistent, pContext->GetIdentity(), myself->GetIdentity(), &err)) == BAD_HANDLE)
+    {
+        json_persistent_decref(persistent);
+        pContext->ThrowNativeError(
+            "JSON(Persistent: %d): Could not create persistent handle.", err);
+    }
 
-    pContext->StringToLocalUTF8(params[2], params[3], key, NULL);
-    keys->Next();
+    return hndl;
+}
+
+// Scalars are read as ordinary values, arrays and objects give NULL
+static inline json_t *PersistentGetScalar(IPluginContext *pContext, const cell_t *params)
+{
+    json_persistent_t *object;
+    if((object = GetPersistentFromHandle(pContext, params[1])) == NULL)
+        return NULL;
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_persistent_t *value;
+    if((value = json_persistent_get(object, key)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Key '%s' is not exists", key);
+        return NULL;
+    }
+
+    json_type type = json_persistent_type(value);
+    return (type != JSON_OBJECT && type != JSON_ARRAY)
+                ? json_persistent_value(value)
+                : NULL;
+}
+
+// Takes the reference to value
+static inline cell_t PersistentSetScalar(IPluginContext *pContext, const cell_t *params, json_t *value)
+{
+    json_persistent_t *object;
+    if((object = GetPersistentFromHandle(pContext, params[1])) == NULL) {
+        json_decref(value);
+        return BAD_HANDLE;
+    }
+
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_persistent_t *scalar = json_persistent(value);
+    json_decref(value);
+
+    json_persistent_t *result = json_persistent_set(object, key, scalar);
+    json_persistent_decref(scalar);
+    if(result == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not set key '%s'", key);
+        return BAD_HANDLE;
+    }
 
-    return 1;
+    return CreatePersistentHandle(pContext, result);
 }
 
-// JSONArray.Get(const int)
-static cell_t ArrayGet(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.JsonPersistent(Json)
+static cell_t PersistentCreate(IPluginContext *pContext, const cell_t *params)
 {
     json_t *object;
     if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
         return BAD_HANDLE;
 
-    json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+    json_persistent_t *persistent;
+    if((persistent = json_persistent(object)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Value contains a circular reference");
         return BAD_HANDLE;
+    }
 
-    return CreateJSONHandleEx(pContext, value);
+    return CreatePersistentHandle(pContext, persistent);
 }
 
-// JSONArray.GetBool(const int)
-static cell_t ArrayGetBool(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.ToJson()
+static cell_t PersistentToJson(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *persistent;
+    if((persistent = GetPersistentFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
 
     json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
-        return 0;
+    if((value = json_persistent_value(persistent)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not convert the value");
+        return BAD_HANDLE;
+    }
 
-    return json_boolean_value(value);
+    return CreateJSONHandle(pContext, value);
 }
 
-// JSONArray.GetFloat(const int)
-static cell_t ArrayGetFloat(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.Type.get()
+static cell_t PersistentGetType(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+    json_persistent_t *persistent;
+    if((persistent = GetPersistentFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+    return json_persistent_type(persistent);
+}
+
+// JsonPersistent.Size.get()
+static cell_t PersistentSize(IPluginContext *pContext, const cell_t *params)
+{
+    json_persistent_t *persistent;
+    if((persistent = GetPersistentFromHandle(pContext, params[1])) == NULL)
         return 0;
 
-    return sp_ftoc(static_cast<float>(json_real_value(value)));
+    return json_persistent_size(persistent);
 }
 
-// JSONArray.GetInt(const int)
-static cell_t ArrayGetInt(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.Get(const char[])
+static cell_t PersistentGet(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *object;
+    if((object = GetPersistentFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
 
-    json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
-        return 0;
+    char *key;
+    pContext->LocalToString(params[2], &key);
 
-    return static_cast<cell_t>(json_integer_value(value));
+    json_persistent_t *value;
+    if((value = json_persistent_get(object, key)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Key '%s' is not exists", key);
+        return BAD_HANDLE;
+    }
+
+    return CreatePersistentHandle(pContext, json_persistent_incref(value));
 }
 
-// JSONArray.GetInt64(const int)
-static cell_t ArrayGetInt64(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.GetBool(const char[])
+static cell_t PersistentGetBool(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_t *value = PersistentGetScalar(pContext, params);
+    cell_t result = json_boolean_value(value);
 
-    json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
-        return 0;
+    json_decref(value);
+    return result;
+}
 
-    char result[20];
-    snprintf(result, sizeof(result), "%" JSON_INTEGER_FORMAT, json_integer_value(value));
-    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+// JsonPersistent.GetFloat(const char[])
+static cell_t PersistentGetFloat(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *value = PersistentGetScalar(pContext, params);
+    cell_t result = sp_ftoc(static_cast<float>(json_number_value(value)));
 
-    return 1;
+    json_decref(value);
+    return result;
 }
 
-// JSONArray.GetString(const int)
-static cell_t ArrayGetString(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.GetInt(const char[])
+static cell_t PersistentGetInt(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_t *value = PersistentGetScalar(pContext, params);
+    cell_t result = static_cast<cell_t>(json_integer_value(value));
 
-    json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
-        return 0;
+    json_decref(value);
+    return result;
+}
 
-    const char *result;
-    if ((result = json_string_value(value)) == NULL)
-        return 0;
+// JsonPersistent.GetString(const char[], char[], int)
+static cell_t PersistentGetString(IPluginContext *pContext, const cell_t *params)
+{
+    json_t *value = PersistentGetScalar(pContext, params);
 
-    pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
+    const char *result;
+    if((result = json_string_value(value)) != NULL)
+        pContext->StringToLocalUTF8(params[3], params[4], result, NULL);
 
-    return 1;
+    json_decref(value);
+    return (result != NULL);
 }
 
-// JSONArray.GetType(const int)
-static cell_t ArrayGetType(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.Set(const char[], JsonPersistent)
+static cell_t PersistentSet(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *object, *value;
+    if((object = GetPersistentFromHandle(pContext, params[1])) == NULL
+        || (value = GetPersistentFromHandle(pContext, params[3])) == NULL)
+        return BAD_HANDLE;
 
-    json_t *value;
-    if((value = ArrayGetValue(pContext,object, params[2])) == NULL)
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_persistent_t *result;
+    if((result = json_persistent_set(object, key, value)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not set key '%s'", key);
         return BAD_HANDLE;
+    }
 
-    return json_typeof(value);
+    return CreatePersistentHandle(pContext, result);
 }
 
-// JSONArray.Set(const int, JSON)
-static cell_t ArraySet(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.SetBool(const char[], bool)
+static cell_t PersistentSetBool(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    return PersistentSetScalar(pContext, params, json_boolean(params[3]));
+}
 
-    json_t *value;
-    value = (((Handle_t) params[3]) == BAD_HANDLE)
-                    ? json_null()
-                    : GetJSONFromHandle(pContext, params[3]);
+// JsonPersistent.SetFloat(const char[], float)
+static cell_t PersistentSetFloat(IPluginContext *pContext, const cell_t *params)
+{
+    return PersistentSetScalar(pContext, params, json_real(sp_ctof(params[3])));
+}
 
-    return (value != NULL) 
-                ?  (json_typeof(value) != JSON_NULL)
-                        ? (json_array_set(object, params[2], value) == 0)
-                        : (json_array_set_new(object, params[2], value) == 0)
-                : 0;
+// JsonPersistent.SetInt(const char[], int)
+static cell_t PersistentSetInt(IPluginContext *pContext, const cell_t *params)
+{
+    return PersistentSetScalar(pContext, params, json_integer_shared(params[3]));
 }
 
-// JSONArray.SetBool(const int, bool)
-static cell_t ArraySetBool(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.SetString(const char[], const char[])
+static cell_t PersistentSetString(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    char *value;
+    pContext->LocalToString(params[3], &value);
 
-    return (json_array_set_new(object, params[2], (json_boolean(params[3]))) == 0);
+    return PersistentSetScalar(pContext, params, json_string(value));
 }
 
-// JSONArray.SetFloat(const int, float)
-static cell_t ArraySetFloat(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.Remove(const char[])
+static cell_t PersistentRemove(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *object;
+    if((object = GetPersistentFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
 
-    return (json_array_set_new(object, params[2], (json_real(sp_ctof(params[3])))) == 0);
+    char *key;
+    pContext->LocalToString(params[2], &key);
+
+    json_persistent_t *result;
+    if((result = json_persistent_del(object, key)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not remove key '%s'", key);
+        return BAD_HANDLE;
+    }
+
+    return CreatePersistentHandle(pContext, result);
 }
 
-// JSONArray.SetInt(const int, int)
-static cell_t ArraySetInt(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.GetAt(int)
+static cell_t PersistentGetAt(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *array;
+    if((array = GetPersistentFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
 
-    return (json_array_set_new(object, params[2], (json_integer(params[3]))) == 0);
+    json_persistent_t *value;
+    if((value = json_persistent_array_get(array, params[2])) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Index %d is out of range", params[2]);
+        return BAD_HANDLE;
+    }
+
+    return CreatePersistentHandle(pContext, json_persistent_incref(value));
 }
 
-// JSONArray.SetInt64(const int, const char[])
-static cell_t ArraySetInt64(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.SetAt(int, JsonPersistent)
+static cell_t PersistentSetAt(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *array, *value;
+    if((array = GetPersistentFromHandle(pContext, params[1])) == NULL
+        || (value = GetPersistentFromHandle(pContext, params[3])) == NULL)
+        return BAD_HANDLE;
 
-    char *val;
-    pContext->LocalToString(params[3], &val);
+    json_persistent_t *result;
+    if((result = json_persistent_array_set(array, params[2], value)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not set index %d", params[2]);
+        return BAD_HANDLE;
+    }
 
-    return (json_array_set_new(
-                object, params[2], (json_integer(json_strtoint(val, NULL, 10)))) == 0);
+    return CreatePersistentHandle(pContext, result);
 }
 
-// JSONArray.SetString(const int, const char[])
-static cell_t ArraySetString(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.Push(JsonPersistent)
+static cell_t PersistentPush(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *array, *value;
+    if((array = GetPersistentFromHandle(pContext, params[1])) == NULL
+        || (value = GetPersistentFromHandle(pContext, params[2])) == NULL)
+        return BAD_HANDLE;
 
-    char *val;
-    pContext->LocalToString(params[3], &val);
+    json_persistent_t *result;
+    if((result = json_persistent_array_append(array, value)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not push the value");
+        return BAD_HANDLE;
+    }
 
-    return (json_array_set_new(object, params[2], (json_string(val))) == 0);
+    return CreatePersistentHandle(pContext, result);
 }
 
-// JSONArray.Push(JSON)
-static cell_t ArrayPush(IPluginContext *pContext, const cell_t *params)
+// JsonPersistent.Pop()
+static cell_t PersistentPop(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    json_persistent_t *array;
+    if((array = GetPersistentFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
 
-    json_t *value;
-    value = (((Handle_t) params[2]) == BAD_HANDLE)
-                    ? json_null()
-                    : GetJSONFromHandle(pContext, params[2]);
+    json_persistent_t *result;
+    if((result = json_persistent_array_pop(array)) == NULL) {
+        pContext->ThrowNativeError("JSON(Persistent): Could not pop from the value");
+        return BAD_HANDLE;
+    }
 
-    return (value != NULL) 
-                ?  (json_typeof(value) != JSON_NULL)
-                        ? (json_array_append(object, value) == 0)
-                        : (json_array_append_new(object, value) == 0)
-                : 0;
+    return CreatePersistentHandle(pContext, result);
 }
 
-// JSONArray.PushBool(bool)
-static cell_t ArrayPushBool(IPluginContext *pContext, const cell_t *params)
+static json_query_t *GetQueryFromHandle(IPluginContext *pContext, Handle_t hndl)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    HandleError err;
+    json_query_t *query = NULL;
+    HandleSecurity sec(pContext->GetIdentity(), myself->GetIdentity());
+    if((err = handlesys->ReadHandle(hndl, htJSONQuery, &sec, (void **)&query)) != HandleError_None)
+        pContext->ThrowNativeError(
+            "JSON(Query): Invalid query handle %x (error %d)", hndl, err);
 
-    return (json_array_append_new(object, (json_boolean(params[2]))) == 0);
+    return err != HandleError_None ? NULL : query;
 }
 
-// JSONArray.PushFloat(float)
-static cell_t ArrayPushFloat(IPluginContext *pContext, const cell_t *params)
+static int QueryFirstMatch(json_t *value, void *data)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    *(json_t **)data = json_incref(value);
+    return 1;
+}
 
-    return (json_array_append_new(object, (json_real(sp_ctof(params[2])))) == 0);
+static int QueryCountMatch(json_t *value, void *data)
+{
+    (*(cell_t *)data)++;
+    return 0;
 }
 
-// JSONArray.PushInt(int)
-static cell_t ArrayPushInt(IPluginContext *pContext, const cell_t *params)
+// JsonQuery.JsonQuery(const char[])
+static cell_t QueryCreate(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    char *path;
+    pContext->LocalToString(params[1], &path);
+
+    json_query_t *query;
+    json_error_t error;
+    if((query = json_query(path, &error)) == NULL) {
+        pContext->ThrowNativeError("JSON(Query: %d): %s [c: %d]",
+                                        json_error_code(&error), error.text, error.column);
+        return BAD_HANDLE;
+    }
+
+    Handle_t hndl;
+    HandleError err;
+    if((hndl = handlesys->CreateHandle(htJSONQuery, query, pContext->GetIdentity(), myself->GetIdentity(), &err)) == BAD_HANDLE)
+    {
+        json_query_free(query);
+        pContext->ThrowNativeError(
+            "JSON(Query: %d): Could not create query handle.", err);
+    }
 
-    return (json_array_append_new(object, (json_integer(params[2]))) == 0);
+    return hndl;
 }
 
-// JSONArray.PushInt64(const char[])
-static cell_t ArrayPushInt64(IPluginContext *pContext, const cell_t *params)
+// JsonQuery.Select(Json)
+static cell_t QuerySelect(IPluginContext *pContext, const cell_t *params)
 {
+    json_query_t *query;
+    if((query = GetQueryFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
     json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    if((object = GetJSONFromHandle(pContext, params[2])) == NULL)
+        return BAD_HANDLE;
 
-    char *val;
-    pContext->LocalToString(params[2], &val);
+    json_t *result;
+    if((result = json_query_select(query, object)) == NULL) {
+        pContext->ThrowNativeError("JSON(Query): Could not search the value");
+        return BAD_HANDLE;
+    }
 
-    return (json_array_append_new(object, (json_integer(json_strtoint(val, NULL, 10)))) == 0);
+    return CreateJSONHandle(pContext, result);
 }
 
-// JSONArray.PushString(const char[])
-static cell_t ArrayPushString(IPluginContext *pContext, const cell_t *params)
+// JsonQuery.First(Json)
+static cell_t QueryFirst(IPluginContext *pContext, const cell_t *params)
 {
+    json_query_t *query;
+    if((query = GetQueryFromHandle(pContext, params[1])) == NULL)
+        return BAD_HANDLE;
+
     json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
-        return 0;
+    if((object = GetJSONFromHandle(pContext, params[2])) == NULL)
+        return BAD_HANDLE;
 
-    char *val;
-    pContext->LocalToString(params[2], &val);
+    // The search stops at the first match, so the rest isn't visited
+    json_t *first = NULL;
+    if(json_query_callback(query, object, QueryFirstMatch, &first) != 0 && first == NULL) {
+        pContext->ThrowNativeError("JSON(Query): Could not search the value");
+        return BAD_HANDLE;
+    }
 
-    return (json_array_append_new(object, (json_string(val))) == 0);
+    return (first != NULL)
+                ? CreateJSONHandle(pContext, first)
+                : BAD_HANDLE;
 }
 
-// JSONArray.Remove(const int)
-static cell_t ArrayRemove(IPluginContext *pContext, const cell_t *params)
+// JsonQuery.Count(Json)
+static cell_t QueryCount(IPluginContext *pContext, const cell_t *params)
 {
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+    json_query_t *query;
+    if((query = GetQueryFromHandle(pContext, params[1])) == NULL)
         return 0;
-        
-    return (json_array_remove(object, params[2]) == 0);
-}
 
-// JSONArray.Clear()
-static cell_t ArrayClear(IPluginContext *pContext, const cell_t *params)
-{
     json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+    if((object = GetJSONFromHandle(pContext, params[2])) == NULL)
         return 0;
 
-    return (json_array_clear(object) == 0);
-}
-
-// JSONArray.Size.get()
-static cell_t ArraySize(IPluginContext *pContext, const cell_t *params)
-{
-    json_t *object;
-    if((object = GetJSONFromHandle(pContext, params[1])) == NULL)
+    cell_t count = 0;
+    if(json_query_callback(query, object, QueryCountMatch, &count) != 0) {
+        pContext->ThrowNativeError("JSON(Query): Could not search the value");
         return 0;
+    }
 
-    return json_array_size(object);
+    return count;
 }
 
 
@@ -817,8 +2701,29 @@ const sp_nativeinfo_t json_natives[] =
     {"Json.JsonF", 						JSONCreateF},
     {"Json.ToString",					JSONToString},
     {"Json.ToFile",						JSONToFile},
+    {"Json.JsonFBinary",				JSONCreateFBinary},
+    {"Json.ToFileBinary",				JSONToFileBinary},
     {"Json.Equal",						JSONEqual},
+    {"Json.Hash",						JSONHash},
+    {"Json.Copy",						JSONCopy},
+    {"Json.Snapshot",					JSONSnapshot},
     {"Json.Type.get",					JSONGetType},
+    {"Json.GetPath",					JSONGetPath},
+    {"Json.GetBoolPath",				JSONGetBoolPath},
+    {"Json.GetFloatPath",				JSONGetFloatPath},
+    {"Json.GetIntPath",					JSONGetIntPath},
+    {"Json.GetInt64Path",				JSONGetInt64Path},
+    {"Json.GetStringPath",				JSONGetStringPath},
+    {"Json.GetTypePath",				JSONGetTypePath},
+    {"Json.HasPath",					JSONHasPath},
+    {"Json.SetPath",					JSONSetPath},
+    {"Json.SetBoolPath",				JSONSetBoolPath},
+    {"Json.SetFloatPath",				JSONSetFloatPath},
+    {"Json.SetIntPath",					JSONSetIntPath},
+    {"Json.SetInt64Path",				JSONSetInt64Path},
+    {"Json.SetStringPath",				JSONSetStringPath},
+    {"Json.Diff",						JSONDiff},
+    {"Json.ApplyPatch",					JSONApplyPatch},
 
     {"JsonObject.Get",					ObjectGet},
     {"JsonObject.GetBool",				ObjectGetBool},
@@ -842,6 +2747,38 @@ const sp_nativeinfo_t json_natives[] =
     {"JsonObject.Keys",					ObjectKeys},
     {"JsonKeys.Next",			        ReadObjectKey},
 
+    {"JsonKey.JsonKey",					KeyCreate},
+    {"JsonObject.GetByKey",				ObjectGetByKey},
+    {"JsonObject.GetBoolByKey",			ObjectGetBoolByKey},
+    {"JsonObject.GetFloatByKey",		ObjectGetFloatByKey},
+    {"JsonObject.GetIntByKey",			ObjectGetIntByKey},
+    {"JsonObject.GetInt64ByKey",		ObjectGetInt64ByKey},
+    {"JsonObject.GetStringByKey",		ObjectGetStringByKey},
+    {"JsonObject.GetTypeByKey",			ObjectGetTypeByKey},
+    {"JsonObject.HasJsonKey",			IsObjectJsonKeyValid},
+    {"JsonObject.SetByKey",				ObjectSetByKey},
+    {"JsonObject.SetBoolByKey",			ObjectSetBoolByKey},
+    {"JsonObject.SetFloatByKey",		ObjectSetFloatByKey},
+    {"JsonObject.SetIntByKey",			ObjectSetIntByKey},
+    {"JsonObject.SetInt64ByKey",		ObjectSetInt64ByKey},
+    {"JsonObject.SetStringByKey",		ObjectSetStringByKey},
+    {"JsonObject.RemoveByKey",			ObjectRemoveByKey},
+    {"JsonObject.GetByInt",				ObjectGetByInt},
+    {"JsonObject.GetBoolByInt",			ObjectGetBoolByInt},
+    {"JsonObject.GetFloatByInt",		ObjectGetFloatByInt},
+    {"JsonObject.GetIntByInt",			ObjectGetIntByInt},
+    {"JsonObject.GetInt64ByInt",		ObjectGetInt64ByInt},
+    {"JsonObject.GetStringByInt",		ObjectGetStringByInt},
+    {"JsonObject.GetTypeByInt",			ObjectGetTypeByInt},
+    {"JsonObject.HasInt",				IsObjectIntKeyValid},
+    {"JsonObject.SetByInt",				ObjectSetByInt},
+    {"JsonObject.SetBoolByInt",			ObjectSetBoolByInt},
+    {"JsonObject.SetFloatByInt",		ObjectSetFloatByInt},
+    {"JsonObject.SetIntByInt",			ObjectSetIntByInt},
+    {"JsonObject.SetInt64ByInt",		ObjectSetInt64ByInt},
+    {"JsonObject.SetStringByInt",		ObjectSetStringByInt},
+    {"JsonObject.RemoveByInt",			ObjectRemoveByInt},
+
     {"JsonArray.Get",					ArrayGet},
     {"JsonArray.GetBool",				ArrayGetBool},
     {"JsonArray.GetFloat",				ArrayGetFloat},
@@ -862,8 +2799,64 @@ const sp_nativeinfo_t json_natives[] =
     {"JsonArray.PushInt64",				ArrayPushInt64},
     {"JsonArray.PushString",			ArrayPushString},
     {"JsonArray.Remove",				ArrayRemove},
+    {"JsonArray.Unshift",				ArrayUnshift},
+    {"JsonArray.Shift",					ArrayShift},
+    {"JsonArray.PopBack",				ArrayPopBack},
     {"JsonArray.Clear",					ArrayClear},
+    {"JsonArray.Reserve",				ArrayReserve},
+    {"JsonArray.Compact",				ArrayCompact},
     {"JsonArray.Length.get",			ArraySize},
 
+    {"JsonWriter.JsonWriter",			WriterCreate},
+    {"JsonWriter.Open",					WriterOpen},
+    {"JsonWriter.BeginObject",			WriterBeginObject},
+    {"JsonWriter.EndObject",			WriterEndObject},
+    {"JsonWriter.BeginArray",			WriterBeginArray},
+    {"JsonWriter.EndArray",				WriterEndArray},
+    {"JsonWriter.Key",					WriterKey},
+    {"JsonWriter.WriteBool",			WriterWriteBool},
+    {"JsonWriter.WriteFloat",			WriterWriteFloat},
+    {"JsonWriter.WriteInt",				WriterWriteInt},
+    {"JsonWriter.WriteInt64",			WriterWriteInt64},
+    {"JsonWriter.WriteString",			WriterWriteString},
+    {"JsonWriter.WriteNull",			WriterWriteNull},
+    {"JsonWriter.Write",				WriterWrite},
+    {"JsonWriter.ToString",				WriterToString},
+    {"JsonWriter.Done.get",				WriterDone},
+
+    {"JsonColumns.JsonColumns",			ColumnsCreate},
+    {"JsonColumns.Rows.get",			ColumnsRows},
+    {"JsonColumns.GetInts",				ColumnsGetInts},
+    {"JsonColumns.GetFloats",			ColumnsGetFloats},
+    {"JsonColumns.Count",				ColumnsCount},
+    {"JsonColumns.Sum",					ColumnsSum},
+    {"JsonColumns.Min",					ColumnsMin},
+    {"JsonColumns.Max",					ColumnsMax},
+
+    {"JsonPersistent.JsonPersistent",	PersistentCreate},
+    {"JsonPersistent.ToJson",			PersistentToJson},
+    {"JsonPersistent.Type.get",			PersistentGetType},
+    {"JsonPersistent.Size.get",			PersistentSize},
+    {"JsonPersistent.Get",				PersistentGet},
+    {"JsonPersistent.GetBool",			PersistentGetBool},
+    {"JsonPersistent.GetFloat",			PersistentGetFloat},
+    {"JsonPersistent.GetInt",			PersistentGetInt},
+    {"JsonPersistent.GetString",		PersistentGetString},
+    {"JsonPersistent.Set",				PersistentSet},
+    {"JsonPersistent.SetBool",			PersistentSetBool},
+    {"JsonPersistent.SetFloat",			PersistentSetFloat},
+    {"JsonPersistent.SetInt",			PersistentSetInt},
+    {"JsonPersistent.SetString",		PersistentSetString},
+    {"JsonPersistent.Remove",			PersistentRemove},
+    {"JsonPersistent.GetAt",			PersistentGetAt},
+    {"JsonPersistent.SetAt",			PersistentSetAt},
+    {"JsonPersistent.Push",				PersistentPush},
+    {"JsonPersistent.Pop",				PersistentPop},
+
+    {"JsonQuery.JsonQuery",				QueryCreate},
+    {"JsonQuery.Select",				QuerySelect},
+    {"JsonQuery.First",					QueryFirst},
+    {"JsonQuery.Count",					QueryCount},
+
     {NULL,								NULL}
 };